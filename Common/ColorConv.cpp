@@ -18,6 +18,7 @@
 #include "ColorConv.h"
 // NEON is in a separate file so that it can be compiled with a runtime check.
 #include "ColorConvNEON.h"
+#include "ColorConvAVX2.h"
 #include "Common.h"
 #include "CPUDetect.h"
 
@@ -280,6 +281,14 @@ void ConvertRGBA8888ToRGBA4444(u16 *dst, const u32 *src, const u32 numPixels) {
 
 void ConvertRGBA565ToRGBA8888(u32 *dst32, const u16 *src, const u32 numPixels) {
 #ifdef _M_SSE
+	if (cpu_info.bAVX2 && numPixels >= 16) {
+		// Doesn't care about alignment, and leaves only the last few pixels.
+		const u32 simdPixels = numPixels & ~15;
+		ConvertRGBA565ToRGBA8888AVX2(dst32, src, simdPixels);
+		ConvertRGBA565ToRGBA8888(dst32 + simdPixels, src + simdPixels, numPixels - simdPixels);
+		return;
+	}
+
 	const __m128i mask5 = _mm_set1_epi16(0x001f);
 	const __m128i mask6 = _mm_set1_epi16(0x003f);
 	const __m128i mask8 = _mm_set1_epi16(0x00ff);
@@ -334,6 +343,14 @@ void ConvertRGBA565ToRGBA8888(u32 *dst32, const u16 *src, const u32 numPixels) {
 
 void ConvertRGBA5551ToRGBA8888(u32 *dst32, const u16 *src, const u32 numPixels) {
 #ifdef _M_SSE
+	if (cpu_info.bAVX2 && numPixels >= 16) {
+		// Doesn't care about alignment, and leaves only the last few pixels.
+		const u32 simdPixels = numPixels & ~15;
+		ConvertRGBA5551ToRGBA8888AVX2(dst32, src, simdPixels);
+		ConvertRGBA5551ToRGBA8888(dst32 + simdPixels, src + simdPixels, numPixels - simdPixels);
+		return;
+	}
+
 	const __m128i mask5 = _mm_set1_epi16(0x001f);
 	const __m128i mask8 = _mm_set1_epi16(0x00ff);
 
@@ -388,6 +405,14 @@ void ConvertRGBA5551ToRGBA8888(u32 *dst32, const u16 *src, const u32 numPixels)
 
 void ConvertRGBA4444ToRGBA8888(u32 *dst32, const u16 *src, const u32 numPixels) {
 #ifdef _M_SSE
+	if (cpu_info.bAVX2 && numPixels >= 16) {
+		// Doesn't care about alignment, and leaves only the last few pixels.
+		const u32 simdPixels = numPixels & ~15;
+		ConvertRGBA4444ToRGBA8888AVX2(dst32, src, simdPixels);
+		ConvertRGBA4444ToRGBA8888(dst32 + simdPixels, src + simdPixels, numPixels - simdPixels);
+		return;
+	}
+
 	const __m128i mask4 = _mm_set1_epi16(0x000f);
 	const __m128i mask8 = _mm_set1_epi16(0x00ff);
 	const __m128i one = _mm_set1_epi16(0x0001);
@@ -410,7 +435,7 @@ void ConvertRGBA4444ToRGBA8888(u32 *dst32, const u16 *src, const u32 numPixels)
 		__m128i b = _mm_and_si128(_mm_srli_epi16(c, 8), mask4);
 		// And lastly 00A0 00A0.  No mask needed, we have a wall.
 		__m128i a = _mm_srli_epi16(c, 12);
-		a = _mm_slli_epi16(g, 8);
+		a = _mm_slli_epi16(a, 8);
 
 		// We swizzle after combining - R0G0 R0G0 and B0A0 B0A0 -> RRGG RRGG and BBAA BBAA.
 		__m128i rg = _mm_or_si128(r, g);
@@ -0,0 +1,114 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include "ColorConvAVX2.h"
+#include "Common.h"
+
+#ifdef _M_SSE
+#include <immintrin.h>
+
+// Built with the same flags as everything else, so each function asks for AVX2 itself.
+#if defined(__GNUC__) || defined(__clang__)
+#define AVX2_FUNC __attribute__((target("avx2")))
+#else
+#define AVX2_FUNC
+#endif
+
+// Turns 16 pixels of RRGG RRGG / BBAA BBAA halves into RGBA8888 in order.
+// The unpacks work within each 128-bit lane, so the halves need to be put back together.
+AVX2_FUNC static inline void StoreInterleaved(u32 *dst, __m256i rg, __m256i ba) {
+	const __m256i lo = _mm256_unpacklo_epi16(rg, ba);
+	const __m256i hi = _mm256_unpackhi_epi16(rg, ba);
+	_mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+	_mm256_storeu_si256((__m256i *)(dst + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+AVX2_FUNC void ConvertRGBA565ToRGBA8888AVX2(u32 *dst, const u16 *src, const u32 numPixels) {
+	const __m256i mask5 = _mm256_set1_epi16(0x001f);
+	const __m256i mask6 = _mm256_set1_epi16(0x003f);
+	const __m256i mask8 = _mm256_set1_epi16(0x00ff);
+	// Always set to 00FF 00FF.
+	const __m256i a = _mm256_slli_epi16(mask8, 8);
+
+	for (u32 i = 0; i < numPixels; i += 16) {
+		const __m256i c = _mm256_loadu_si256((const __m256i *)(src + i));
+
+		__m256i r = _mm256_and_si256(c, mask5);
+		r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+		r = _mm256_and_si256(r, mask8);
+
+		__m256i g = _mm256_and_si256(_mm256_srli_epi16(c, 5), mask6);
+		g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+		g = _mm256_slli_epi16(g, 8);
+
+		__m256i b = _mm256_and_si256(_mm256_srli_epi16(c, 11), mask5);
+		b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+		b = _mm256_and_si256(b, mask8);
+
+		StoreInterleaved(dst + i, _mm256_or_si256(r, g), _mm256_or_si256(b, a));
+	}
+}
+
+AVX2_FUNC void ConvertRGBA5551ToRGBA8888AVX2(u32 *dst, const u16 *src, const u32 numPixels) {
+	const __m256i mask5 = _mm256_set1_epi16(0x001f);
+	const __m256i mask8 = _mm256_set1_epi16(0x00ff);
+
+	for (u32 i = 0; i < numPixels; i += 16) {
+		const __m256i c = _mm256_loadu_si256((const __m256i *)(src + i));
+
+		__m256i r = _mm256_and_si256(c, mask5);
+		r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+		r = _mm256_and_si256(r, mask8);
+
+		__m256i g = _mm256_and_si256(_mm256_srli_epi16(c, 5), mask5);
+		g = _mm256_or_si256(_mm256_slli_epi16(g, 3), _mm256_srli_epi16(g, 2));
+		g = _mm256_slli_epi16(g, 8);
+
+		__m256i b = _mm256_and_si256(_mm256_srli_epi16(c, 10), mask5);
+		b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+		b = _mm256_and_si256(b, mask8);
+
+		// 1 bit A to 00AA 00AA.
+		const __m256i a = _mm256_slli_epi16(_mm256_srai_epi16(c, 15), 8);
+
+		StoreInterleaved(dst + i, _mm256_or_si256(r, g), _mm256_or_si256(b, a));
+	}
+}
+
+AVX2_FUNC void ConvertRGBA4444ToRGBA8888AVX2(u32 *dst, const u16 *src, const u32 numPixels) {
+	const __m256i mask4 = _mm256_set1_epi16(0x000f);
+
+	for (u32 i = 0; i < numPixels; i += 16) {
+		const __m256i c = _mm256_loadu_si256((const __m256i *)(src + i));
+
+		// R000 R000 and 00G0 00G0, then B000 B000 and 00A0 00A0.
+		__m256i r = _mm256_and_si256(c, mask4);
+		__m256i g = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(c, 4), mask4), 8);
+		__m256i b = _mm256_and_si256(_mm256_srli_epi16(c, 8), mask4);
+		__m256i a = _mm256_slli_epi16(_mm256_srli_epi16(c, 12), 8);
+
+		// Each nibble gets duplicated into a full byte.
+		__m256i rg = _mm256_or_si256(r, g);
+		__m256i ba = _mm256_or_si256(b, a);
+		rg = _mm256_or_si256(rg, _mm256_slli_epi16(rg, 4));
+		ba = _mm256_or_si256(ba, _mm256_slli_epi16(ba, 4));
+
+		StoreInterleaved(dst + i, rg, ba);
+	}
+}
+
+#endif
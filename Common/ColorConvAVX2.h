@@ -0,0 +1,26 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include "ColorConv.h"
+
+// Only called when cpu_info.bAVX2 is set.  numPixels must be a multiple of 16, but unlike
+// the SSE2 paths, these don't need aligned buffers.
+void ConvertRGBA565ToRGBA8888AVX2(u32 *dst, const u16 *src, const u32 numPixels);
+void ConvertRGBA5551ToRGBA8888AVX2(u32 *dst, const u16 *src, const u32 numPixels);
+void ConvertRGBA4444ToRGBA8888AVX2(u32 *dst, const u16 *src, const u32 numPixels);
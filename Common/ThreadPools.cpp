@@ -10,6 +10,11 @@ void GlobalThreadPool::Loop(const std::function<void(int,int)>& loop, int lower,
 	pool->ParallelLoop(loop, lower, upper);
 }
 
+std::shared_ptr<ThreadPoolTask> GlobalThreadPool::Submit(const std::function<void()>& work) {
+	Inititialize();
+	return pool->Submit(work);
+}
+
 void GlobalThreadPool::Inititialize() {
 	if(!initialized) {
 		pool = std::make_shared<ThreadPool>(g_Config.iNumWorkerThreads);
@@ -7,6 +7,8 @@ class GlobalThreadPool {
 	// will execute slices of "loop" from "lower" to "upper"
 	// in parallel on the global thread pool
 	static void Loop(const std::function<void(int,int)>& loop, int lower, int upper);
+	// queues "work" to run on the global thread pool, wait on the task to get it done
+	static std::shared_ptr<ThreadPoolTask> Submit(const std::function<void()>& work);
 
 private:
 	static std::shared_ptr<ThreadPool> pool;
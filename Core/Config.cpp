@@ -307,6 +307,9 @@ static ConfigSetting generalSettings[] = {
 	ConfigSetting("ReportingHost", &g_Config.sReportHost, "default"),
 	ConfigSetting("AutoSaveSymbolMap", &g_Config.bAutoSaveSymbolMap, false, true, true),
 	ConfigSetting("CacheFullIsoInRam", &g_Config.bCacheFullIsoInRam, false, true, true),
+	ConfigSetting("MemoryMapIso", &g_Config.bMemoryMapIso, false, true, true),
+	ConfigSetting("DiskCacheSizeMB", &g_Config.iDiskCacheSizeMB, 256, true, true),
+	ConfigSetting("DiskCacheEviction", &g_Config.iDiskCacheEviction, 0, true, true),
 
 #ifdef ANDROID
 	ConfigSetting("ScreenRotation", &g_Config.iScreenRotation, 1),
@@ -329,6 +332,7 @@ static ConfigSetting generalSettings[] = {
 
 static ConfigSetting cpuSettings[] = {
 	ReportedConfigSetting("Jit", &g_Config.bJit, &DefaultJit, true, true),
+	ConfigSetting("JitBlockDiskCache", &g_Config.bJitBlockDiskCache, true, true, true),
 	ReportedConfigSetting("SeparateCPUThread", &g_Config.bSeparateCPUThread, false, true, true),
 	ReportedConfigSetting("SeparateIOThread", &g_Config.bSeparateIOThread, true, true, true),
 	ReportedConfigSetting("IOTimingMethod", &g_Config.iIOTimingMethod, IOTIMING_FAST, true, true),
@@ -406,8 +410,11 @@ static ConfigSetting graphicsSettings[] = {
 	ReportedConfigSetting("GPUBackend", &g_Config.iGPUBackend, 0),
 	ReportedConfigSetting("RenderingMode", &g_Config.iRenderingMode, &DefaultRenderingMode, true, true),
 	ConfigSetting("SoftwareRendering", &g_Config.bSoftwareRendering, false, true, true),
+	ConfigSetting("SoftwareRenderingJit", &g_Config.bSoftwareRenderingJit, true, true, true),
+	ConfigSetting("SoftwareRenderingSIMD", &g_Config.bSoftwareRenderingSIMD, true, true, true),
 	ReportedConfigSetting("HardwareTransform", &g_Config.bHardwareTransform, true, true, true),
 	ReportedConfigSetting("SoftwareSkinning", &g_Config.bSoftwareSkinning, true, true, true),
+	ConfigSetting("SoftwareTransformSIMD", &g_Config.bSoftwareTransformSIMD, true, true, true),
 	ReportedConfigSetting("TextureFiltering", &g_Config.iTexFiltering, 1, true, true),
 	ReportedConfigSetting("BufferFiltering", &g_Config.iBufFilter, 1, true, true),
 	ReportedConfigSetting("InternalResolution", &g_Config.iInternalResolution, &DefaultInternalResolution, true, true),
@@ -452,6 +459,10 @@ static ConfigSetting graphicsSettings[] = {
 	ReportedConfigSetting("TexScalingLevel", &g_Config.iTexScalingLevel, 1, true, true),
 	ReportedConfigSetting("TexScalingType", &g_Config.iTexScalingType, 0, true, true),
 	ReportedConfigSetting("TexDeposterize", &g_Config.bTexDeposterize, false, true, true),
+	ConfigSetting("TexScalingAsync", &g_Config.bTexScalingAsync, true, true, true),
+	ConfigSetting("TexScalingDiskCache", &g_Config.bTexScalingDiskCache, true, true, true),
+	ConfigSetting("TexScalingDiskCacheSizeMB", &g_Config.iTexScalingDiskCacheSizeMB, 256, true, false),
+	ConfigSetting("TexDecodeMode", &g_Config.iTexDecodeMode, 0, true, true),
 	ConfigSetting("VSyncInterval", &g_Config.bVSync, false, true, true),
 	ReportedConfigSetting("DisableStencilTest", &g_Config.bDisableStencilTest, false, true, true),
 	ReportedConfigSetting("AlwaysDepthWrite", &g_Config.bAlwaysDepthWrite, false, true, true),
@@ -673,6 +684,7 @@ static ConfigSetting speedHackSettings[] = {
 
 static ConfigSetting jitSettings[] = {
 	ReportedConfigSetting("DiscardRegsOnJRRA", &g_Config.bDiscardRegsOnJRRA, false, false),
+	ReportedConfigSetting("HotBlockThreshold", &g_Config.iJitHotBlockThreshold, 0, false),
 
 	ConfigSetting(false),
 };
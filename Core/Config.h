@@ -113,6 +113,7 @@ struct Config {
 	bool bIgnoreBadMemAccess;
 	bool bFastMemory;
 	bool bJit;
+	bool bJitBlockDiskCache;
 	bool bCheckForNewVersion;
 	bool bForceLagSync;
 	bool bFuncReplacements;
@@ -124,6 +125,10 @@ struct Config {
 	int iLockedCPUSpeed;
 	bool bAutoSaveSymbolMap;
 	bool bCacheFullIsoInRam;
+	// Off by default: a mapped image that gets truncated or sits on media that goes away raises SIGBUS on read.
+	bool bMemoryMapIso;
+	int iDiskCacheSizeMB;
+	int iDiskCacheEviction;  // 0 = least recently used, 1 = fewest hits
 
 	int iScreenRotation;  // The rotation angle of the PPSSPP UI. Only supported on Android and possibly other mobile platforms.
 	int iInternalScreenRotation;  // The internal screen rotation angle. Useful for vertical SHMUPs and similar.
@@ -136,8 +141,11 @@ struct Config {
 	// GFX
 	int iGPUBackend;
 	bool bSoftwareRendering;
+	bool bSoftwareRenderingJit;
+	bool bSoftwareRenderingSIMD;  // shade four pixels at once in the software renderer
 	bool bHardwareTransform; // only used in the GLES backend
 	bool bSoftwareSkinning;  // may speed up some games
+	bool bSoftwareTransformSIMD;  // transform and light four vertices at once when software transforming
 
 	int iRenderingMode; // 0 = non-buffered rendering 1 = buffered rendering 2 = Read Framebuffer to memory (CPU) 3 = Read Framebuffer to memory (GPU)
 	int iTexFiltering; // 1 = off , 2 = nearest , 3 = linear , 4 = linear(CG)
@@ -172,6 +180,10 @@ struct Config {
 	bool bMipMap;
 	int iTexScalingLevel; // 1 = off, 2 = 2x, ..., 5 = 5x
 	int iTexScalingType; // 0 = xBRZ, 1 = Hybrid
+	bool bTexScalingAsync;
+	bool bTexScalingDiskCache;
+	int iTexScalingDiskCacheSizeMB;
+	int iTexDecodeMode; // 0 = on the GPU thread, 1 = on worker threads, waiting at draw time, 2 = on worker threads, drawing a placeholder meanwhile
 	bool bTexDeposterize;
 	int iFpsLimit;
 	int iForceMaxEmulatedFPS;
@@ -325,6 +337,8 @@ struct Config {
 
 	// Risky JIT optimizations
 	bool bDiscardRegsOnJRRA;
+	// Entries before an x86 jit block is recompiled with branch continuation.  0 = never.
+	int iJitHotBlockThreshold;
 
 	// SystemParam
 	std::string sNickName;
@@ -16,15 +16,17 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 
-#include <vector>
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <functional>
+#include <unordered_map>
+#include <vector>
 
 #include "base/logging.h"
 #include "profiler/profiler.h"
 
 #include "Common/MsgHandler.h"
-#include "Common/StdMutex.h"
-#include "Common/Atomics.h"
 #include "Core/CoreTiming.h"
 #include "Core/Core.h"
 #include "Core/Config.h"
@@ -61,21 +63,54 @@ struct BaseEvent
 	s64 time;
 	u64 userdata;
 	int type;
-//	Event *next;
 };
 
-typedef LinkedListItem<BaseEvent> Event;
+// Scheduled events live in a binary min-heap ordered by time, so scheduling and removing
+// are O(log n.)  Each event is also linked into a list of events with the same type, and one
+// with the same type and userdata, so that they can be found without searching the heap.
+struct Event : public BaseEvent
+{
+	// Order of scheduling, so that events with the same time run first come first served.
+	u64 order;
+	int heapIndex;
+	int prevSame, nextSame;
+	int prevType, nextType;
+};
+
+struct EventKey
+{
+	int type;
+	u64 userdata;
+
+	bool operator ==(const EventKey &other) const {
+		return type == other.type && userdata == other.userdata;
+	}
+};
+
+struct EventKeyHash
+{
+	size_t operator ()(const EventKey &key) const {
+		return std::hash<u64>()(key.userdata * 0x9E3779B97F4A7C15ULL + key.type);
+	}
+};
+
+// Threadsafe events are pushed onto a lock-free stack by any thread, and moved into the
+// heap by the CPU thread.  seq keeps them in the order they were scheduled.
+struct TsEvent : public BaseEvent
+{
+	u64 seq;
+	TsEvent *next;
+};
 
-Event *first;
-Event *tsFirst;
-Event *tsLast;
+static std::vector<Event> events;
+static std::vector<int> freeEvents;
+static std::vector<int> eventHeap;
+static std::vector<int> firstOfType;
+static std::unordered_map<EventKey, int, EventKeyHash> firstOfKey;
+static u64 nextEventOrder;
 
-// event pools
-Event *eventPool = 0;
-Event *eventTsPool = 0;
-int allocatedTsEvents = 0;
-// Optimization to skip MoveEvents when possible.
-volatile u32 hasTsEvents = 0;
+static std::atomic<TsEvent *> tsInbox(nullptr);
+static std::atomic<u64> nextTsSeq(0);
 
 // Downcount has been moved to currentMIPS, to save a couple of clocks in every ARM JIT block
 // as we can already reach that structure through a register.
@@ -86,8 +121,6 @@ s64 idledCycles;
 s64 lastGlobalTimeTicks;
 s64 lastGlobalTimeUs;
 
-static std::recursive_mutex externalEventSection;
-
 // Warning: not included in save state.
 void (*advanceCallback)(int cyclesExecuted) = NULL;
 std::vector<MHzChangeCallback> mhzChangeCallbacks;
@@ -140,39 +173,194 @@ u64 GetGlobalTimeUs()
 	return lastGlobalTimeUs + usSinceLast;
 }
 
-Event* GetNewEvent()
+static inline bool EventBefore(int a, int b)
+{
+	const Event &ea = events[a];
+	const Event &eb = events[b];
+	return ea.time < eb.time || (ea.time == eb.time && ea.order < eb.order);
+}
+
+static void HeapSet(int pos, int slot)
+{
+	eventHeap[pos] = slot;
+	events[slot].heapIndex = pos;
+}
+
+static void HeapSiftUp(int pos)
+{
+	int slot = eventHeap[pos];
+	while (pos > 0)
+	{
+		int parent = (pos - 1) / 2;
+		if (!EventBefore(slot, eventHeap[parent]))
+			break;
+		HeapSet(pos, eventHeap[parent]);
+		pos = parent;
+	}
+	HeapSet(pos, slot);
+}
+
+static void HeapSiftDown(int pos)
+{
+	const int size = (int)eventHeap.size();
+	int slot = eventHeap[pos];
+	while (true)
+	{
+		int child = pos * 2 + 1;
+		if (child >= size)
+			break;
+		if (child + 1 < size && EventBefore(eventHeap[child + 1], eventHeap[child]))
+			++child;
+		if (!EventBefore(eventHeap[child], slot))
+			break;
+		HeapSet(pos, eventHeap[child]);
+		pos = child;
+	}
+	HeapSet(pos, slot);
+}
+
+// Returns the next event to run, or null if there are none.
+static inline Event *FirstEvent()
+{
+	return eventHeap.empty() ? nullptr : &events[eventHeap[0]];
+}
+
+static void AddEvent(s64 time, int event_type, u64 userdata)
+{
+	int slot;
+	if (freeEvents.empty())
+	{
+		slot = (int)events.size();
+		events.push_back(Event());
+	}
+	else
+	{
+		slot = freeEvents.back();
+		freeEvents.pop_back();
+	}
+
+	Event &ev = events[slot];
+	ev.time = time;
+	ev.userdata = userdata;
+	ev.type = event_type;
+	ev.order = nextEventOrder++;
+
+	if (event_type >= (int)firstOfType.size())
+		firstOfType.resize(event_type + 1, -1);
+	ev.prevType = -1;
+	ev.nextType = firstOfType[event_type];
+	if (ev.nextType != -1)
+		events[ev.nextType].prevType = slot;
+	firstOfType[event_type] = slot;
+
+	EventKey key = { event_type, userdata };
+	auto it = firstOfKey.find(key);
+	ev.prevSame = -1;
+	if (it == firstOfKey.end())
+	{
+		ev.nextSame = -1;
+		firstOfKey[key] = slot;
+	}
+	else
+	{
+		ev.nextSame = it->second;
+		events[it->second].prevSame = slot;
+		it->second = slot;
+	}
+
+	eventHeap.push_back(slot);
+	HeapSiftUp((int)eventHeap.size() - 1);
+}
+
+static void RemoveEventSlot(int slot)
 {
-	if(!eventPool)
-		return new Event;
+	Event &ev = events[slot];
+
+	if (ev.prevType != -1)
+		events[ev.prevType].nextType = ev.nextType;
+	else
+		firstOfType[ev.type] = ev.nextType;
+	if (ev.nextType != -1)
+		events[ev.nextType].prevType = ev.prevType;
+
+	if (ev.prevSame != -1)
+	{
+		events[ev.prevSame].nextSame = ev.nextSame;
+	}
+	else
+	{
+		EventKey key = { ev.type, ev.userdata };
+		if (ev.nextSame != -1)
+			firstOfKey[key] = ev.nextSame;
+		else
+			firstOfKey.erase(key);
+	}
+	if (ev.nextSame != -1)
+		events[ev.nextSame].prevSame = ev.prevSame;
 
-	Event* ev = eventPool;
-	eventPool = ev->next;
-	return ev;
+	int pos = ev.heapIndex;
+	int last = eventHeap.back();
+	eventHeap.pop_back();
+	if (last != slot)
+	{
+		HeapSet(pos, last);
+		if (pos > 0 && EventBefore(last, eventHeap[(pos - 1) / 2]))
+			HeapSiftUp(pos);
+		else
+			HeapSiftDown(pos);
+	}
+
+	freeEvents.push_back(slot);
 }
 
-Event* GetNewTsEvent()
+// All scheduled events in the order they'll run.
+static std::vector<int> SortedEvents()
 {
-	allocatedTsEvents++;
+	std::vector<int> sorted = eventHeap;
+	std::sort(sorted.begin(), sorted.end(), EventBefore);
+	return sorted;
+}
 
-	if(!eventTsPool)
-		return new Event;
+// Takes everything out of the threadsafe inbox, oldest first.
+static std::vector<TsEvent *> TakeTsEvents()
+{
+	std::vector<TsEvent *> taken;
+	for (TsEvent *ev = tsInbox.exchange(nullptr, std::memory_order_acquire); ev; ev = ev->next)
+		taken.push_back(ev);
+	std::sort(taken.begin(), taken.end(), [](const TsEvent *a, const TsEvent *b) {
+		return a->seq < b->seq;
+	});
+	return taken;
+}
 
-	Event* ev = eventTsPool;
-	eventTsPool = ev->next;
-	return ev;
+static void PushTsEvents(TsEvent *head, TsEvent *tail)
+{
+	TsEvent *old = tsInbox.load(std::memory_order_relaxed);
+	do
+	{
+		tail->next = old;
+	}
+	while (!tsInbox.compare_exchange_weak(old, head, std::memory_order_release, std::memory_order_relaxed));
 }
 
-void FreeEvent(Event* ev)
+// Puts events back into the inbox that TakeTsEvents() took out, but shouldn't be moved yet.
+static void ReturnTsEvents(const std::vector<TsEvent *> &evs)
 {
-	ev->next = eventPool;
-	eventPool = ev;
+	if (evs.empty())
+		return;
+	for (size_t i = 0; i + 1 < evs.size(); ++i)
+		evs[i]->next = evs[i + 1];
+	PushTsEvents(evs.front(), evs.back());
 }
 
-void FreeTsEvent(Event* ev)
+static void QueueTsEvent(s64 time, int event_type, u64 userdata)
 {
-	ev->next = eventTsPool;
-	eventTsPool = ev;
-	allocatedTsEvents--;
+	TsEvent *ne = new TsEvent();
+	ne->time = time;
+	ne->type = event_type;
+	ne->userdata = userdata;
+	ne->seq = nextTsSeq.fetch_add(1, std::memory_order_relaxed);
+	PushTsEvents(ne, ne);
 }
 
 int RegisterEvent(const char *name, TimedCallback callback)
@@ -197,7 +385,7 @@ void RestoreRegisterEvent(int event_type, const char *name, TimedCallback callba
 
 void UnregisterAllEvents()
 {
-	if (first)
+	if (!eventHeap.empty())
 		PanicAlert("Cannot unregister events with events pending");
 	event_types.clear();
 }
@@ -210,7 +398,6 @@ void Init()
 	idledCycles = 0;
 	lastGlobalTimeTicks = 0;
 	lastGlobalTimeUs = 0;
-	hasTsEvents = 0;
 	mhzChangeCallbacks.clear();
 }
 
@@ -220,20 +407,9 @@ void Shutdown()
 	ClearPendingEvents();
 	UnregisterAllEvents();
 
-	while(eventPool)
-	{
-		Event *ev = eventPool;
-		eventPool = ev->next;
-		delete ev;
-	}
-
-	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-	while(eventTsPool)
-	{
-		Event *ev = eventTsPool;
-		eventTsPool = ev->next;
-		delete ev;
-	}
+	std::vector<Event>().swap(events);
+	std::vector<int>().swap(freeEvents);
+	std::vector<int>().swap(eventHeap);
 }
 
 u64 GetTicks()
@@ -251,19 +427,7 @@ u64 GetIdleTicks()
 // schedule things to be executed on the main thread.
 void ScheduleEvent_Threadsafe(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
-	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-	Event *ne = GetNewTsEvent();
-	ne->time = GetTicks() + cyclesIntoFuture;
-	ne->type = event_type;
-	ne->next = 0;
-	ne->userdata = userdata;
-	if(!tsFirst)
-		tsFirst = ne;
-	if(tsLast)
-		tsLast->next = ne;
-	tsLast = ne;
-
-	Common::AtomicStoreRelease(hasTsEvents, 1);
+	QueueTsEvent(GetTicks() + cyclesIntoFuture, event_type, userdata);
 }
 
 // Same as ScheduleEvent_Threadsafe(0, ...) EXCEPT if we are already on the CPU thread
@@ -272,7 +436,6 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata)
 {
 	if(false) //Core::IsCPUThread())
 	{
-		std::lock_guard<std::recursive_mutex> lk(externalEventSection);
 		event_types[event_type].callback(userdata, 0);
 	}
 	else
@@ -281,30 +444,12 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata)
 
 void ClearPendingEvents()
 {
-	while (first)
-	{
-		Event *e = first->next;
-		FreeEvent(first);
-		first = e;
-	}
-}
-
-void AddEventToQueue(Event* ne)
-{
-	Event* prev = NULL;
-	Event** pNext = &first;
-	for(;;)
-	{
-		Event*& next = *pNext;
-		if(!next || ne->time < next->time)
-		{
-			ne->next = next;
-			next = ne;
-			break;
-		}
-		prev = next;
-		pNext = &prev->next;
-	}
+	events.clear();
+	freeEvents.clear();
+	eventHeap.clear();
+	firstOfType.clear();
+	firstOfKey.clear();
+	nextEventOrder = 0;
 }
 
 // This must be run ONLY from within the cpu thread
@@ -312,105 +457,54 @@ void AddEventToQueue(Event* ne)
 // than Advance 
 void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
-	Event *ne = GetNewEvent();
-	ne->userdata = userdata;
-	ne->type = event_type;
-	ne->time = GetTicks() + cyclesIntoFuture;
-	AddEventToQueue(ne);
+	AddEvent(GetTicks() + cyclesIntoFuture, event_type, userdata);
 }
 
 // Returns cycles left in timer.
 s64 UnscheduleEvent(int event_type, u64 userdata)
 {
-	s64 result = 0;
-	if (!first)
-		return result;
-	while(first)
-	{
-		if (first->type == event_type && first->userdata == userdata)
-		{
-			result = first->time - GetTicks();
+	EventKey key = { event_type, userdata };
+	auto it = firstOfKey.find(key);
+	if (it == firstOfKey.end())
+		return 0;
 
-			Event *next = first->next;
-			FreeEvent(first);
-			first = next;
-		}
-		else
-		{
-			break;
-		}
-	}
-	if (!first)
-		return result;
-	Event *prev = first;
-	Event *ptr = prev->next;
-	while (ptr)
+	// If there are several, the result is from the one that would've run last.
+	int lastSlot = -1;
+	for (int slot = it->second; slot != -1; slot = events[slot].nextSame)
 	{
-		if (ptr->type == event_type && ptr->userdata == userdata)
-		{
-			result = ptr->time - GetTicks();
-
-			prev->next = ptr->next;
-			FreeEvent(ptr);
-			ptr = prev->next;
-		}
-		else
-		{
-			prev = ptr;
-			ptr = ptr->next;
-		}
+		if (lastSlot == -1 || EventBefore(lastSlot, slot))
+			lastSlot = slot;
 	}
+	s64 result = events[lastSlot].time - GetTicks();
 
+	while (true)
+	{
+		it = firstOfKey.find(key);
+		if (it == firstOfKey.end())
+			break;
+		RemoveEventSlot(it->second);
+	}
 	return result;
 }
 
 s64 UnscheduleThreadsafeEvent(int event_type, u64 userdata)
 {
 	s64 result = 0;
-	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-	if (!tsFirst)
-		return result;
-	while(tsFirst)
+	std::vector<TsEvent *> pending = TakeTsEvents();
+	std::vector<TsEvent *> keep;
+	keep.reserve(pending.size());
+	for (size_t i = 0; i < pending.size(); ++i)
 	{
-		if (tsFirst->type == event_type && tsFirst->userdata == userdata)
+		TsEvent *ev = pending[i];
+		if (ev->type == event_type && ev->userdata == userdata)
 		{
-			result = tsFirst->time - GetTicks();
-
-			Event *next = tsFirst->next;
-			FreeTsEvent(tsFirst);
-			tsFirst = next;
+			result = ev->time - GetTicks();
+			delete ev;
 		}
 		else
-		{
-			break;
-		}
-	}
-	if (!tsFirst)
-	{
-		tsLast = NULL;
-		return result;
-	}
-
-	Event *prev = tsFirst;
-	Event *ptr = prev->next;
-	while (ptr)
-	{
-		if (ptr->type == event_type && ptr->userdata == userdata)
-		{
-			result = ptr->time - GetTicks();
-
-			prev->next = ptr->next;
-			if (ptr == tsLast)
-				tsLast = prev;
-			FreeTsEvent(ptr);
-			ptr = prev->next;
-		}
-		else
-		{
-			prev = ptr;
-			ptr = ptr->next;
-		}
+			keep.push_back(ev);
 	}
+	ReturnTsEvents(keep);
 
 	return result;
 }
@@ -427,97 +521,28 @@ void RegisterMHzChangeCallback(MHzChangeCallback callback) {
 
 bool IsScheduled(int event_type) 
 {
-	if (!first)
-		return false;
-	Event *e = first;
-	while (e) {
-		if (e->type == event_type)
-			return true;
-		e = e->next;
-	}
-	return false;
+	return event_type < (int)firstOfType.size() && firstOfType[event_type] != -1;
 }
 
 void RemoveEvent(int event_type)
 {
-	if (!first)
-		return;
-	while(first)
-	{
-		if (first->type == event_type)
-		{
-			Event *next = first->next;
-			FreeEvent(first);
-			first = next;
-		}
-		else
-		{
-			break;
-		}
-	}
-	if (!first)
-		return;
-	Event *prev = first;
-	Event *ptr = prev->next;
-	while (ptr)
-	{
-		if (ptr->type == event_type)
-		{
-			prev->next = ptr->next;
-			FreeEvent(ptr);
-			ptr = prev->next;
-		}
-		else
-		{
-			prev = ptr;
-			ptr = ptr->next;
-		}
-	}
+	while (IsScheduled(event_type))
+		RemoveEventSlot(firstOfType[event_type]);
 }
 
 void RemoveThreadsafeEvent(int event_type)
 {
-	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-	if (!tsFirst)
-	{
-		return;
-	}
-	while(tsFirst)
-	{
-		if (tsFirst->type == event_type)
-		{
-			Event *next = tsFirst->next;
-			FreeTsEvent(tsFirst);
-			tsFirst = next;
-		}
-		else
-		{
-			break;
-		}
-	}
-	if (!tsFirst)
-	{
-		tsLast = NULL;
-		return;
-	}
-	Event *prev = tsFirst;
-	Event *ptr = prev->next;
-	while (ptr)
+	std::vector<TsEvent *> pending = TakeTsEvents();
+	std::vector<TsEvent *> keep;
+	keep.reserve(pending.size());
+	for (size_t i = 0; i < pending.size(); ++i)
 	{
-		if (ptr->type == event_type)
-		{	
-			prev->next = ptr->next;
-			if (ptr == tsLast)
-				tsLast = prev;
-			FreeTsEvent(ptr);
-			ptr = prev->next;
-		}
+		if (pending[i]->type == event_type)
+			delete pending[i];
 		else
-		{
-			prev = ptr;
-			ptr = ptr->next;
-		}
+			keep.push_back(pending[i]);
 	}
+	ReturnTsEvents(keep);
 }
 
 void RemoveAllEvents(int event_type)
@@ -529,16 +554,17 @@ void RemoveAllEvents(int event_type)
 //This raise only the events required while the fifo is processing data
 void ProcessFifoWaitEvents()
 {
-	while (first)
+	while (!eventHeap.empty())
 	{
+		Event *first = FirstEvent();
 		if (first->time <= (s64)GetTicks())
 		{
 //			LOG(TIMER, "[Scheduler] %s		 (%lld, %lld) ", 
 //				first->name ? first->name : "?", (u64)GetTicks(), (u64)first->time);
-			Event* evt = first;
-			first = first->next;
-			event_types[evt->type].callback(evt->userdata, (int)(GetTicks() - evt->time));
-			FreeEvent(evt);
+			// The callback may schedule more, so take it out first.
+			BaseEvent evt = *first;
+			RemoveEventSlot(eventHeap[0]);
+			event_types[evt.type].callback(evt.userdata, (int)(GetTicks() - evt.time));
 		}
 		else
 		{
@@ -549,26 +575,12 @@ void ProcessFifoWaitEvents()
 
 void MoveEvents()
 {
-	Common::AtomicStoreRelease(hasTsEvents, 0);
-
-	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
 	// Move events from async queue into main queue
-	while (tsFirst)
-	{
-		Event *next = tsFirst->next;
-		AddEventToQueue(tsFirst);
-		tsFirst = next;
-	}
-	tsLast = NULL;
-
-	// Move free events to threadsafe pool
-	while(allocatedTsEvents > 0 && eventPool)
+	std::vector<TsEvent *> pending = TakeTsEvents();
+	for (size_t i = 0; i < pending.size(); ++i)
 	{
-		Event *ev = eventPool;
-		eventPool = ev->next;
-		ev->next = eventTsPool;
-		eventTsPool = ev;
-		allocatedTsEvents--;
+		AddEvent(pending[i]->time, pending[i]->type, pending[i]->userdata);
+		delete pending[i];
 	}
 }
 
@@ -589,10 +601,12 @@ void Advance()
 	globalTimer += cyclesExecuted;
 	currentMIPS->downcount = slicelength;
 
-	if (Common::AtomicLoadAcquire(hasTsEvents))
+	// Optimization to skip MoveEvents when possible.
+	if (tsInbox.load(std::memory_order_relaxed))
 		MoveEvents();
 	ProcessFifoWaitEvents();
 
+	Event *first = FirstEvent();
 	if (!first)
 	{
 		// This should never happen in PPSSPP.
@@ -619,11 +633,10 @@ void Advance()
 
 void LogPendingEvents()
 {
-	Event *ptr = first;
-	while (ptr)
+	std::vector<int> sorted = SortedEvents();
+	for (size_t i = 0; i < sorted.size(); ++i)
 	{
-		//INFO_LOG(TIMER, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, ptr->time, ptr->type);
-		ptr = ptr->next;
+		//INFO_LOG(TIMER, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, events[sorted[i]].time, events[sorted[i]].type);
 	}
 }
 
@@ -633,6 +646,7 @@ void Idle(int maxIdle)
 	if (maxIdle != 0 && cyclesDown > maxIdle)
 		cyclesDown = maxIdle;
 
+	Event *first = FirstEvent();
 	if (first && cyclesDown > 0)
 	{
 		int cyclesExecuted = slicelength - currentMIPS->downcount;
@@ -657,11 +671,12 @@ void Idle(int maxIdle)
 
 std::string GetScheduledEventsSummary()
 {
-	Event *ptr = first;
+	std::vector<int> sorted = SortedEvents();
 	std::string text = "Scheduled events\n";
 	text.reserve(1000);
-	while (ptr)
+	for (size_t i = 0; i < sorted.size(); ++i)
 	{
+		const Event *ptr = &events[sorted[i]];
 		unsigned int t = ptr->type;
 		if (t >= event_types.size())
 			PanicAlert("Invalid event type"); // %i", t);
@@ -671,7 +686,6 @@ std::string GetScheduledEventsSummary()
 		char temp[512];
 		sprintf(temp, "%s : %i %08x%08x\n", name, (int)ptr->time, (u32)(ptr->userdata >> 32), (u32)(ptr->userdata));
 		text += temp;
-		ptr = ptr->next;
 	}
 	return text;
 }
@@ -689,10 +703,38 @@ void Event_DoStateOld(PointerWrap &p, BaseEvent *ev)
 	p.Do(*ev);
 }
 
+// Same format as PointerWrap::DoLinkedList(), which this used to be.
+static void DoEventList(PointerWrap &p, std::vector<BaseEvent> &list, void (*doEvent)(PointerWrap &p, BaseEvent *ev))
+{
+	if (p.mode == p.MODE_READ) {
+		list.clear();
+		while (true) {
+			u8 shouldExist = 0;
+			p.Do(shouldExist);
+			if (shouldExist != 1) {
+				if (shouldExist != 0) {
+					WARN_LOG(COMMON, "Savestate failure: incorrect item marker %d", shouldExist);
+					p.SetError(p.ERROR_FAILURE);
+				}
+				break;
+			}
+			BaseEvent ev;
+			doEvent(p, &ev);
+			list.push_back(ev);
+		}
+	} else {
+		for (size_t i = 0; i < list.size(); ++i) {
+			u8 shouldExist = 1;
+			p.Do(shouldExist);
+			doEvent(p, &list[i]);
+		}
+		u8 shouldExist = 0;
+		p.Do(shouldExist);
+	}
+}
+
 void DoState(PointerWrap &p)
 {
-	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-
 	auto s = p.Section("CoreTiming", 1, 3);
 	if (!s)
 		return;
@@ -702,12 +744,36 @@ void DoState(PointerWrap &p)
 	// These (should) be filled in later by the modules.
 	event_types.resize(n, EventType(AntiCrashCallback, "INVALID EVENT"));
 
-	if (s >= 3) {
-		p.DoLinkedList<BaseEvent, GetNewEvent, FreeEvent, Event_DoState>(first, (Event **) NULL);
-		p.DoLinkedList<BaseEvent, GetNewTsEvent, FreeTsEvent, Event_DoState>(tsFirst, &tsLast);
+	void (*doEvent)(PointerWrap &p, BaseEvent *ev) = s >= 3 ? &Event_DoState : &Event_DoStateOld;
+
+	std::vector<BaseEvent> list;
+	if (p.mode != p.MODE_READ) {
+		std::vector<int> sorted = SortedEvents();
+		for (size_t i = 0; i < sorted.size(); ++i)
+			list.push_back(events[sorted[i]]);
+	}
+	DoEventList(p, list, doEvent);
+	if (p.mode == p.MODE_READ) {
+		ClearPendingEvents();
+		for (size_t i = 0; i < list.size(); ++i)
+			AddEvent(list[i].time, list[i].type, list[i].userdata);
+	}
+
+	// The threadsafe events get put back where they were.
+	std::vector<TsEvent *> pending = TakeTsEvents();
+	list.clear();
+	if (p.mode != p.MODE_READ) {
+		for (size_t i = 0; i < pending.size(); ++i)
+			list.push_back(*pending[i]);
+	}
+	DoEventList(p, list, doEvent);
+	if (p.mode == p.MODE_READ) {
+		for (size_t i = 0; i < pending.size(); ++i)
+			delete pending[i];
+		for (size_t i = 0; i < list.size(); ++i)
+			QueueTsEvent(list[i].time, list[i].type, list[i].userdata);
 	} else {
-		p.DoLinkedList<BaseEvent, GetNewEvent, FreeEvent, Event_DoStateOld>(first, (Event **) NULL);
-		p.DoLinkedList<BaseEvent, GetNewTsEvent, FreeTsEvent, Event_DoStateOld>(tsFirst, &tsLast);
+		ReturnTsEvents(pending);
 	}
 
 	p.Do(CPU_HZ);
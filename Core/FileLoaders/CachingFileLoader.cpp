@@ -15,15 +15,26 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <string.h>
 #include "thread/thread.h"
 #include "thread/threadutil.h"
 #include "base/timeutil.h"
+#include "Common/Log.h"
 #include "Core/FileLoaders/CachingFileLoader.h"
 
+// Shared by all loaders, for the debug stats.
+static std::atomic<u32> statBlockReads(0);
+static std::atomic<u32> statMisses(0);
+static std::atomic<u32> statReadAhead(0);
+static std::atomic<u32> statReadAheadUsed(0);
+static std::atomic<u64> statStallMicros(0);
+
 // Takes ownership of backend.
 CachingFileLoader::CachingFileLoader(FileLoader *backend)
-	: filesize_(0), filepos_(0), backend_(backend), exists_(-1), isDirectory_(-1), aheadThread_(false) {
+	: filesize_(0), filepos_(0), backend_(backend), exists_(-1), isDirectory_(-1), streamUseCounter_(0), aheadThread_(nullptr), aheadActive_(false) {
 	filesize_ = backend->FileSize();
 	if (filesize_ > 0) {
 		InitCache();
@@ -75,24 +86,34 @@ size_t CachingFileLoader::ReadAt(s64 absolutePos, size_t bytes, void *data) {
 		readSize += ReadFromCache(absolutePos + readSize, bytes - readSize, (u8 *)data + readSize);
 	}
 
-	StartReadAhead(absolutePos + readSize);
+	NoteStreamRead(absolutePos, readSize);
 
 	filepos_ = absolutePos + readSize;
 	return readSize;
 }
 
+void CachingFileLoader::GetStats(u32 &blockReads, u32 &misses, u32 &readAhead, u32 &readAheadUsed, double &stallTime) {
+	blockReads = statBlockReads;
+	misses = statMisses;
+	readAhead = statReadAhead;
+	readAheadUsed = statReadAheadUsed;
+	stallTime = statStallMicros / 1000000.0;
+}
+
 void CachingFileLoader::InitCache() {
 	cacheSize_ = 0;
-	oldestGeneration_ = 0;
-	generation_ = 0;
+	memset(streams_, 0, sizeof(streams_));
 }
 
 void CachingFileLoader::ShutdownCache() {
-	// TODO: Maybe add some hint that deletion is coming soon?
-	// We can't delete while the thread is running, so have to wait.
-	// This should only happen from the menu.
-	while (aheadThread_) {
-		sleep_ms(1);
+	if (aheadThread_) {
+		blocksMutex_.lock();
+		aheadActive_ = false;
+		aheadCond_.notify_one();
+		blocksMutex_.unlock();
+		aheadThread_->join();
+		delete aheadThread_;
+		aheadThread_ = nullptr;
 	}
 
 	lock_guard guard(blocksMutex_);
@@ -100,6 +121,7 @@ void CachingFileLoader::ShutdownCache() {
 		delete [] block.second.ptr;
 	}
 	blocks_.clear();
+	lru_.clear();
 	cacheSize_ = 0;
 }
 
@@ -117,10 +139,16 @@ size_t CachingFileLoader::ReadFromCache(s64 pos, size_t bytes, void *data) {
 		if (block == blocks_.end()) {
 			return readSize;
 		}
-		block->second.generation = generation_;
+		BlockInfo &info = block->second;
+		lru_.splice(lru_.begin(), lru_, info.lruPos);
+		++statBlockReads;
+		if (info.readAhead) {
+			info.readAhead = false;
+			++statReadAheadUsed;
+		}
 
 		size_t toRead = std::min(bytes - readSize, (size_t)BLOCK_SIZE - offset);
-		memcpy(p + readSize, block->second.ptr + offset, toRead);
+		memcpy(p + readSize, info.ptr + offset, toRead);
 		readSize += toRead;
 
 		// Don't need an offset after the first read.
@@ -132,139 +160,168 @@ size_t CachingFileLoader::ReadFromCache(s64 pos, size_t bytes, void *data) {
 void CachingFileLoader::SaveIntoCache(s64 pos, size_t bytes, bool readingAhead) {
 	s64 cacheStartPos = pos >> BLOCK_SHIFT;
 	s64 cacheEndPos = (pos + bytes - 1) >> BLOCK_SHIFT;
+	double startTime = real_time_now();
+
+	// One fetch at a time.  If read-ahead was already fetching these blocks, we'll find them below.
+	lock_guard backendGuard(backendMutex_);
 
-	lock_guard guard(blocksMutex_);
 	size_t blocksToRead = 0;
-	for (s64 i = cacheStartPos; i <= cacheEndPos; ++i) {
-		auto block = blocks_.find(i);
-		if (block != blocks_.end()) {
-			break;
-		}
-		++blocksToRead;
-		if (blocksToRead >= MAX_BLOCKS_PER_READ) {
-			break;
+	{
+		lock_guard guard(blocksMutex_);
+		for (s64 i = cacheStartPos; i <= cacheEndPos; ++i) {
+			auto block = blocks_.find(i);
+			if (block != blocks_.end()) {
+				break;
+			}
+			++blocksToRead;
+			if (blocksToRead >= MAX_BLOCKS_PER_READ) {
+				break;
+			}
 		}
-	}
-
-	if (!MakeCacheSpaceFor(blocksToRead, readingAhead) || blocksToRead == 0) {
-		return;
-	}
-
-	if (blocksToRead == 1) {
-		blocksMutex_.unlock();
-
-		u8 *buf = new u8[BLOCK_SIZE];
-		backendMutex_.lock();
-		backend_->ReadAt(cacheStartPos << BLOCK_SHIFT, BLOCK_SIZE, buf);
-		backendMutex_.unlock();
 
-		blocksMutex_.lock();
-		// While blocksMutex_ was unlocked, another thread may have read.
-		// If so, free the one we just read.
-		if (blocks_.find(cacheStartPos) == blocks_.end()) {
-			blocks_[cacheStartPos] = BlockInfo(buf);
-		} else {
-			delete [] buf;
+		if (blocksToRead == 0 || !MakeCacheSpaceFor(blocksToRead)) {
+			if (!readingAhead) {
+				// Read-ahead got there first, but we still had to wait for it.
+				statStallMicros += (u64)((real_time_now() - startTime) * 1000000.0);
+			}
+			return;
 		}
-	} else {
-		blocksMutex_.unlock();
+	}
 
-		u8 *wholeRead = new u8[blocksToRead << BLOCK_SHIFT];
-		backendMutex_.lock();
-		backend_->ReadAt(cacheStartPos << BLOCK_SHIFT, blocksToRead << BLOCK_SHIFT, wholeRead);
-		backendMutex_.unlock();
+	u8 *wholeRead = new u8[blocksToRead << BLOCK_SHIFT];
+	backend_->ReadAt(cacheStartPos << BLOCK_SHIFT, blocksToRead << BLOCK_SHIFT, wholeRead);
 
-		blocksMutex_.lock();
-		for (size_t i = 0; i < blocksToRead; ++i) {
-			if (blocks_.find(cacheStartPos + i) != blocks_.end()) {
-				// Written while we were busy, just skip it.  Keep the existing block.
-				continue;
-			}
-			u8 *buf = new u8[BLOCK_SIZE];
-			memcpy(buf, wholeRead + (i << BLOCK_SHIFT), BLOCK_SIZE);
-			blocks_[cacheStartPos + i] = BlockInfo(buf);
+	lock_guard guard(blocksMutex_);
+	u32 blocksAdded = 0;
+	for (size_t i = 0; i < blocksToRead; ++i) {
+		if (blocks_.find(cacheStartPos + i) != blocks_.end()) {
+			// Written while we were busy, just skip it.  Keep the existing block.
+			continue;
 		}
-		delete[] wholeRead;
+		BlockInfo &info = blocks_[cacheStartPos + i];
+		info.ptr = new u8[BLOCK_SIZE];
+		memcpy(info.ptr, wholeRead + (i << BLOCK_SHIFT), BLOCK_SIZE);
+		lru_.push_front(cacheStartPos + i);
+		info.lruPos = lru_.begin();
+		info.readAhead = readingAhead;
+		++cacheSize_;
+		++blocksAdded;
 	}
+	delete[] wholeRead;
 
-	cacheSize_ += blocksToRead;
-	++generation_;
+	if (readingAhead) {
+		statReadAhead += blocksAdded;
+	} else {
+		statMisses += blocksAdded;
+		statStallMicros += (u64)((real_time_now() - startTime) * 1000000.0);
+	}
 }
 
-bool CachingFileLoader::MakeCacheSpaceFor(size_t blocks, bool readingAhead) {
-	size_t goal = MAX_BLOCKS_CACHED - blocks;
-
-	if (readingAhead && cacheSize_ > goal) {
+bool CachingFileLoader::MakeCacheSpaceFor(size_t blocks) {
+	if (blocks > MAX_BLOCKS_CACHED) {
 		return false;
 	}
 
 	lock_guard guard(blocksMutex_);
-	while (cacheSize_ > goal) {
-		u64 minGeneration = generation_;
-
-		// We increment the iterator inside because we delete things inside.
-		for (auto it = blocks_.begin(); it != blocks_.end(); ) {
-			// Check for the minimum seen generation.
-			// TODO: Do this smarter?
-			if (it->second.generation != 0 && it->second.generation < minGeneration) {
-				minGeneration = it->second.generation;
-			}
-
-			// 0 means it was never used yet or was the first read (e.g. block descriptor.)
-			if (it->second.generation == oldestGeneration_ || it->second.generation == 0) {
-				s64 pos = it->first;
-				delete it->second.ptr;
-				blocks_.erase(it);
-				--cacheSize_;
-
-				// Our iterator is invalid now.  Keep going?
-				if (cacheSize_ > goal) {
-					// This finds the one at that position.
-					it = blocks_.lower_bound(pos);
-				} else {
-					break;
-				}
-			} else {
-				++it;
-			}
-		}
-
-		// If we didn't find any, update to the lowest we did find.
-		oldestGeneration_ = minGeneration;
+	// Least recently used first.  Read-ahead counts as a use, so it doesn't get thrown out right away.
+	while (cacheSize_ + blocks > MAX_BLOCKS_CACHED) {
+		auto block = blocks_.find(lru_.back());
+		delete [] block->second.ptr;
+		blocks_.erase(block);
+		lru_.pop_back();
+		--cacheSize_;
 	}
 
 	return true;
 }
 
-void CachingFileLoader::StartReadAhead(s64 pos) {
+void CachingFileLoader::NoteStreamRead(s64 pos, size_t bytes) {
 	lock_guard guard(blocksMutex_);
-	if (aheadThread_) {
-		// Already going.
+
+	// Allow small skips and overlaps, like reading a sector header twice.
+	Stream *stream = nullptr;
+	for (int i = 0; i < MAX_STREAMS; ++i) {
+		Stream &s = streams_[i];
+		if (s.lastUse != 0 && pos >= s.nextPos - BLOCK_SIZE && pos <= s.nextPos + BLOCK_SIZE) {
+			stream = &s;
+			break;
+		}
+	}
+
+	const s64 nextBlock = (pos + bytes) >> BLOCK_SHIFT;
+	if (stream) {
+		if (stream->window == 0) {
+			stream->window = MIN_BLOCKS_READAHEAD;
+		} else if (nextBlock > (stream->nextPos >> BLOCK_SHIFT)) {
+			// Still going, so it's probably a long one.
+			stream->window = std::min(stream->window * 2, (u32)MAX_BLOCKS_READAHEAD);
+		}
+	} else {
+		// A new stream, or just a random read.  Replace the stream that's been quiet the longest.
+		stream = &streams_[0];
+		for (int i = 1; i < MAX_STREAMS; ++i) {
+			if (streams_[i].lastUse < stream->lastUse) {
+				stream = &streams_[i];
+			}
+		}
+		stream->readAheadPos = 0;
+		stream->readAheadEnd = 0;
+		stream->window = 0;
+	}
+	stream->nextPos = pos + bytes;
+	stream->lastUse = ++streamUseCounter_;
+
+	// Only once the second read confirms it's a stream.
+	if (stream->window == 0) {
 		return;
 	}
-	if (cacheSize_ + BLOCK_READAHEAD > MAX_BLOCKS_CACHED) {
-		// Not enough space to readahead.
+
+	const s64 numBlocks = (filesize_ + BLOCK_SIZE - 1) >> BLOCK_SHIFT;
+	const s64 end = std::min(nextBlock + stream->window, numBlocks);
+	if (end <= stream->readAheadEnd) {
 		return;
 	}
+	stream->readAheadPos = std::max(nextBlock, std::max(stream->readAheadPos, stream->readAheadEnd));
+	stream->readAheadEnd = end;
 
-	aheadThread_ = true;
-	std::thread th([this, pos] {
-		setCurrentThreadName("FileLoaderReadAhead");
+	if (!aheadThread_) {
+		aheadActive_ = true;
+		aheadThread_ = new std::thread(std::bind(&CachingFileLoader::ReadAheadFunc, this));
+	}
+	aheadCond_.notify_one();
+}
 
-		lock_guard guard(blocksMutex_);
-		s64 cacheStartPos = pos >> BLOCK_SHIFT;
-		s64 cacheEndPos = cacheStartPos + BLOCK_READAHEAD - 1;
+void CachingFileLoader::ReadAheadFunc() {
+	setCurrentThreadName("FileLoaderReadAhead");
 
-		for (s64 i = cacheStartPos; i <= cacheEndPos; ++i) {
-			auto block = blocks_.find(i);
-			if (block == blocks_.end()) {
-				blocksMutex_.unlock();
-				SaveIntoCache(i << BLOCK_SHIFT, BLOCK_SIZE * BLOCK_READAHEAD, true);
-				break;
+	lock_guard guard(blocksMutex_);
+	while (aheadActive_) {
+		// Whichever stream is closest to running out goes first.
+		Stream *stream = nullptr;
+		for (int i = 0; i < MAX_STREAMS; ++i) {
+			Stream &s = streams_[i];
+			while (s.readAheadPos < s.readAheadEnd && blocks_.find(s.readAheadPos) != blocks_.end()) {
+				++s.readAheadPos;
 			}
+			if (s.readAheadPos >= s.readAheadEnd) {
+				continue;
+			}
+			if (!stream || s.readAheadPos - (s.nextPos >> BLOCK_SHIFT) < stream->readAheadPos - (stream->nextPos >> BLOCK_SHIFT)) {
+				stream = &s;
+			}
+		}
+
+		if (!stream) {
+			aheadCond_.wait(blocksMutex_);
+			continue;
 		}
 
-		aheadThread_ = false;
-	});
-	th.detach();
+		const s64 start = stream->readAheadPos;
+		const s64 count = std::min(stream->readAheadEnd - start, (s64)BLOCKS_PER_READAHEAD);
+		stream->readAheadPos += count;
+
+		blocksMutex_.unlock();
+		SaveIntoCache(start << BLOCK_SHIFT, (size_t)count << BLOCK_SHIFT, true);
+		blocksMutex_.lock();
+	}
 }
@@ -17,8 +17,10 @@
 
 #pragma once
 
+#include <list>
 #include <map>
 #include "base/mutex.h"
+#include "thread/thread.h"
 #include "Common/CommonTypes.h"
 #include "Core/Loaders.h"
 
@@ -44,21 +46,42 @@ class CachingFileLoader : public FileLoader {
 	}
 	virtual size_t ReadAt(s64 absolutePos, size_t bytes, void *data) override;
 
+	// Totals for all caching loaders, in blocks: blocks read, blocks that had to be fetched first,
+	// blocks read ahead and how many of those were then read.  Plus seconds spent waiting on fetches.
+	static void GetStats(u32 &blockReads, u32 &misses, u32 &readAhead, u32 &readAheadUsed, double &stallTime);
+
 private:
 	void InitCache();
 	void ShutdownCache();
 	size_t ReadFromCache(s64 pos, size_t bytes, void *data);
-	// Guaranteed to read at least one block into the cache.
+	// Guaranteed to read at least one block into the cache, unless another thread just did.
 	void SaveIntoCache(s64 pos, size_t bytes, bool readingAhead = false);
-	bool MakeCacheSpaceFor(size_t blocks, bool readingAhead);
-	void StartReadAhead(s64 pos);
+	bool MakeCacheSpaceFor(size_t blocks);
+	void NoteStreamRead(s64 pos, size_t bytes);
+	void ReadAheadFunc();
 
 	enum {
 		BLOCK_SIZE = 65536,
 		BLOCK_SHIFT = 16,
 		MAX_BLOCKS_PER_READ = 16,
 		MAX_BLOCKS_CACHED = 4096, // 256 MB
-		BLOCK_READAHEAD = 4,
+		// Read-ahead starts at this many blocks and doubles with each new block a stream reaches.
+		MIN_BLOCKS_READAHEAD = 2,
+		MAX_BLOCKS_READAHEAD = 32, // 2 MB
+		// Small pieces, so that reads the game is actually waiting for can get in between.
+		BLOCKS_PER_READAHEAD = 4,
+		MAX_STREAMS = 4,
+	};
+
+	// A run of sequential reads, e.g. a movie or an audio track being streamed.
+	struct Stream {
+		// Where the next read is expected to start.
+		s64 nextPos;
+		// Blocks still to read ahead, [readAheadPos, readAheadEnd).
+		s64 readAheadPos;
+		s64 readAheadEnd;
+		u32 window;
+		u32 lastUse;
 	};
 
 	s64 filesize_;
@@ -66,22 +89,25 @@ class CachingFileLoader : public FileLoader {
 	FileLoader *backend_;
 	int exists_;
 	int isDirectory_;
-	u64 generation_;
-	u64 oldestGeneration_;
 	size_t cacheSize_;
 
 	struct BlockInfo {
 		u8 *ptr;
-		u64 generation;
-
-		BlockInfo() : ptr(nullptr), generation(0) {
-		}
-		BlockInfo(u8 *p) : ptr(p), generation(0) {
-		}
+		std::list<s64>::iterator lruPos;
+		// Read ahead, and not yet read by anyone.
+		bool readAhead;
 	};
 
 	std::map<s64, BlockInfo> blocks_;
+	// Block positions, most recently used first.
+	std::list<s64> lru_;
+	// Also protects the streams and the read-ahead queue.
 	recursive_mutex blocksMutex_;
 	mutable recursive_mutex backendMutex_;
-	bool aheadThread_;
+
+	Stream streams_[MAX_STREAMS];
+	u32 streamUseCounter_;
+	std::thread *aheadThread_;
+	condition_variable aheadCond_;
+	bool aheadActive_;
 };
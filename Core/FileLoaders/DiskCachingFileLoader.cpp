@@ -16,17 +16,27 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include <algorithm>
+#include <limits>
 #include <string.h>
 #include "file/file_util.h"
 #include "Common/FileUtil.h"
+#include "Core/Config.h"
 #include "Core/FileLoaders/DiskCachingFileLoader.h"
 #include "Core/System.h"
 
+#ifdef _WIN32
+#include "Common/CommonWindows.h"
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 static const char *CACHEFILE_MAGIC = "ppssppDC";
 
 std::string DiskCachingFileLoaderCache::cacheDir_;
 
 std::map<std::string, DiskCachingFileLoaderCache *> DiskCachingFileLoader::caches_;
+recursive_mutex DiskCachingFileLoader::cachesLock_;
 
 // Takes ownership of backend.
 DiskCachingFileLoader::DiskCachingFileLoader(FileLoader *backend)
@@ -72,11 +82,21 @@ size_t DiskCachingFileLoader::ReadAt(s64 absolutePos, size_t bytes, void *data)
 		readSize = cache_->ReadFromCache(absolutePos, bytes, data);
 		// While in case the cache size is too small for the entire read.
 		while (readSize < bytes) {
-			readSize += cache_->SaveIntoCache(backend_, absolutePos + readSize, bytes - readSize, (u8 *)data + readSize);
+			size_t saved = cache_->SaveIntoCache(backend_, backendLock_, absolutePos + readSize, bytes - readSize, (u8 *)data + readSize);
+			readSize += saved;
 			// If there are already-cached blocks afterward, we have to read them.
-			readSize += cache_->ReadFromCache(absolutePos + readSize, bytes - readSize, (u8 *)data + readSize);
+			size_t cached = cache_->ReadFromCache(absolutePos + readSize, bytes - readSize, (u8 *)data + readSize);
+			readSize += cached;
+
+			if (saved == 0 && cached == 0) {
+				// End of file, or every block is busy.  Either way, the cache can't help.
+				lock_guard guard(backendLock_);
+				readSize += backend_->ReadAt(absolutePos + readSize, bytes - readSize, (u8 *)data + readSize);
+				break;
+			}
 		}
 	} else {
+		lock_guard guard(backendLock_);
 		readSize = backend_->ReadAt(absolutePos, bytes, data);
 	}
 
@@ -85,6 +105,7 @@ size_t DiskCachingFileLoader::ReadAt(s64 absolutePos, size_t bytes, void *data)
 }
 
 void DiskCachingFileLoader::InitCache() {
+	lock_guard guard(cachesLock_);
 	std::string path = backend_->Path();
 	auto &entry = caches_[path];
 	if (!entry) {
@@ -96,6 +117,7 @@ void DiskCachingFileLoader::InitCache() {
 }
 
 void DiskCachingFileLoader::ShutdownCache() {
+	lock_guard guard(cachesLock_);
 	if (cache_->Release()) {
 		// If it ran out of counts, delete it.
 		delete cache_;
@@ -105,7 +127,7 @@ void DiskCachingFileLoader::ShutdownCache() {
 }
 
 DiskCachingFileLoaderCache::DiskCachingFileLoaderCache(const std::string &path, u64 filesize)
-	: refCount_(0), filesize_(filesize), f_(nullptr), fd_(0) {
+	: refCount_(0), filesize_(filesize), nextFreeBlock_(0), f_(nullptr), fd_(0) {
 	InitCache(path);
 }
 
@@ -116,9 +138,12 @@ DiskCachingFileLoaderCache::~DiskCachingFileLoaderCache() {
 void DiskCachingFileLoaderCache::InitCache(const std::string &path) {
 	cacheSize_ = 0;
 	indexCount_ = 0;
-	oldestGeneration_ = 0;
 	generation_ = 0;
 
+	// The size is in MB, so at least one block.
+	maxBlocks_ = (u32)std::max(1, g_Config.iDiskCacheSizeMB) * (1024 * 1024 / DEFAULT_BLOCK_SIZE);
+	evictionPolicy_ = g_Config.iDiskCacheEviction == EVICT_FEWEST_HITS ? EVICT_FEWEST_HITS : EVICT_LEAST_RECENT;
+
 	const std::string cacheFilePath = MakeCacheFilePath(path);
 	if (!LoadCacheFile(cacheFilePath)) {
 		CreateCacheFile(cacheFilePath);
@@ -127,12 +152,8 @@ void DiskCachingFileLoaderCache::InitCache(const std::string &path) {
 
 void DiskCachingFileLoaderCache::ShutdownCache() {
 	if (f_) {
-		if (fseek(f_, sizeof(FileHeader), SEEK_SET) != 0) {
-			ERROR_LOG(LOADER, "Unable to flush disk cache.");
-		}
-		if (fwrite(&index_[0], sizeof(BlockInfo), indexCount_, f_) != indexCount_) {
-			ERROR_LOG(LOADER, "Unable to flush disk cache.");
-		}
+		// Only what changed since the last flush, usually just hit counts.
+		FlushIndex();
 
 		fclose(f_);
 		f_ = nullptr;
@@ -141,159 +162,182 @@ void DiskCachingFileLoaderCache::ShutdownCache() {
 
 	index_.clear();
 	blockIndexLookup_.clear();
+	blockPins_.clear();
+	dirtyIndexes_.clear();
+	indexDirty_.clear();
 	cacheSize_ = 0;
 }
 
 size_t DiskCachingFileLoaderCache::ReadFromCache(s64 pos, size_t bytes, void *data) {
-	lock_guard guard(lock_);
-
 	s64 cacheStartPos = pos / blockSize_;
 	s64 cacheEndPos = (pos + bytes - 1) / blockSize_;
-	size_t readSize = 0;
 	size_t offset = (size_t)(pos - (cacheStartPos * (u64)blockSize_));
-	u8 *p = (u8 *)data;
 
-	for (s64 i = cacheStartPos; i <= cacheEndPos; ++i) {
-		auto &info = index_[i];
-		if (info.block == INVALID_BLOCK) {
-			return readSize;
-		}
-		info.generation = generation_;
-		if (info.hits < std::numeric_limits<u16>::max()) {
-			++info.hits;
+	// Pin the cached blocks, so they stay put while we read them without the lock.
+	std::vector<u32> blocks;
+	{
+		lock_guard guard(lock_);
+		for (s64 i = cacheStartPos; i <= cacheEndPos && i < (s64)indexCount_; ++i) {
+			auto &info = index_[i];
+			if (info.block == INVALID_BLOCK) {
+				break;
+			}
+			info.generation = generation_;
+			if (info.hits < std::numeric_limits<u16>::max()) {
+				++info.hits;
+			}
+			MarkIndexDirty((u32)i);
+
+			++blockPins_[info.block];
+			blocks.push_back(info.block);
 		}
+	}
+
+	if (blocks.empty()) {
+		return 0;
+	}
 
-		size_t toRead = std::min(bytes - readSize, (size_t)blockSize_ - offset);
-		ReadBlockData(p + readSize, info, offset, toRead);
-		readSize += toRead;
+	size_t readSize = std::min(bytes, blocks.size() * blockSize_ - offset);
+	ReadBlockData((u8 *)data, blocks, offset, readSize);
 
-		// Don't need an offset after the first read.
-		offset = 0;
+	lock_guard guard(lock_);
+	for (u32 block : blocks) {
+		--blockPins_[block];
 	}
 	return readSize;
 }
 
-size_t DiskCachingFileLoaderCache::SaveIntoCache(FileLoader *backend, s64 pos, size_t bytes, void *data) {
-	lock_guard guard(lock_);
-
+size_t DiskCachingFileLoaderCache::SaveIntoCache(FileLoader *backend, recursive_mutex &backendLock, s64 pos, size_t bytes, void *data) {
 	s64 cacheStartPos = pos / blockSize_;
 	s64 cacheEndPos = (pos + bytes - 1) / blockSize_;
-	size_t readSize = 0;
 	size_t offset = (size_t)(pos - (cacheStartPos * (u64)blockSize_));
-	u8 *p = (u8 *)data;
 
-	size_t blocksToRead = 0;
-	for (s64 i = cacheStartPos; i <= cacheEndPos; ++i) {
-		auto &info = index_[i];
-		if (info.block != INVALID_BLOCK) {
-			break;
-		}
-		++blocksToRead;
-		if (blocksToRead >= MAX_BLOCKS_PER_READ) {
-			break;
+	std::vector<u32> blocks;
+	{
+		lock_guard guard(lock_);
+		size_t blocksToRead = 0;
+		for (s64 i = cacheStartPos; i <= cacheEndPos && i < (s64)indexCount_; ++i) {
+			auto &info = index_[i];
+			if (info.block != INVALID_BLOCK) {
+				break;
+			}
+			++blocksToRead;
+			if (blocksToRead >= MAX_BLOCKS_PER_READ) {
+				break;
+			}
 		}
-	}
-
-	if (!MakeCacheSpaceFor(blocksToRead) || blocksToRead == 0) {
-		return 0;
-	}
-
-	if (blocksToRead == 1) {
-		auto &info = index_[cacheStartPos];
 
-		u8 *buf = new u8[blockSize_];
-		size_t readBytes = backend->ReadAt(cacheStartPos * (u64)blockSize_, blockSize_, buf);
+		if (blocksToRead == 0 || !MakeCacheSpaceFor(blocksToRead)) {
+			return 0;
+		}
 
-		// Check if it was written while we were busy.  Might happen if we thread.
-		if (info.block == INVALID_BLOCK && readBytes != 0) {
-			info.block = AllocateBlock((u32)cacheStartPos);
-			WriteBlockData(info, buf);
-			WriteIndexData((u32)cacheStartPos, info);
+		// Reserved, but not in the index until the data is written.
+		for (size_t i = 0; i < blocksToRead; ++i) {
+			u32 block = AllocateBlock((u32)cacheStartPos + (u32)i);
+			++blockPins_[block];
+			blocks.push_back(block);
 		}
+	}
 
-		size_t toRead = std::min(bytes - readSize, (size_t)blockSize_ - offset);
-		memcpy(p + readSize, buf + offset, toRead);
-		readSize += toRead;
+	// Whatever was evicted has to be gone on disk before its block gets new data.
+	FlushIndex();
 
-		delete [] buf;
-	} else {
-		u8 *wholeRead = new u8[blocksToRead * blockSize_];
-		size_t readBytes = backend->ReadAt(cacheStartPos * (u64)blockSize_, blocksToRead * blockSize_, wholeRead);
+	const size_t blocksToRead = blocks.size();
+	u8 *wholeRead = new u8[blocksToRead * blockSize_];
+	size_t readBytes;
+	{
+		lock_guard guard(backendLock);
+		readBytes = backend->ReadAt(cacheStartPos * (u64)blockSize_, blocksToRead * blockSize_, wholeRead);
+	}
+	if (readBytes != 0) {
+		WriteBlockData(blocks, wholeRead);
+	}
 
+	{
+		lock_guard guard(lock_);
 		for (size_t i = 0; i < blocksToRead; ++i) {
-			auto &info = index_[cacheStartPos + i];
-			// Check if it was written while we were busy.  Might happen if we thread.
+			const u32 indexPos = (u32)cacheStartPos + (u32)i;
+			auto &info = index_[indexPos];
+			--blockPins_[blocks[i]];
+			// Check if it was written while we were busy.  Happens when two threads miss at once.
 			if (info.block == INVALID_BLOCK && readBytes != 0) {
-				info.block = AllocateBlock((u32)cacheStartPos + (u32)i);
-				WriteBlockData(info, wholeRead + (i * blockSize_));
-				// TODO: Doing each index together would probably be better.
-				WriteIndexData((u32)cacheStartPos + (u32)i, info);
+				info.block = blocks[i];
+				MarkIndexDirty(indexPos);
+			} else {
+				FreeBlock(blocks[i]);
 			}
+		}
 
-			size_t toRead = std::min(bytes - readSize, (size_t)blockSize_ - offset);
-			memcpy(p + readSize, wholeRead + (i * blockSize_) + offset, toRead);
-			readSize += toRead;
+		++generation_;
+		if (generation_ == std::numeric_limits<u16>::max()) {
+			RebalanceGenerations();
 		}
-		delete[] wholeRead;
 	}
+	FlushIndex();
 
-	cacheSize_ += blocksToRead;
-	++generation_;
-
-	if (generation_ == std::numeric_limits<u16>::max()) {
-		RebalanceGenerations();
-	}
+	size_t readSize = std::min(bytes, blocksToRead * blockSize_ - offset);
+	memcpy(data, wholeRead + offset, readSize);
+	delete[] wholeRead;
 
 	return readSize;
 }
 
 bool DiskCachingFileLoaderCache::MakeCacheSpaceFor(size_t blocks) {
-	size_t goal = MAX_BLOCKS_CACHED - blocks;
-
-	while (cacheSize_ > goal) {
-		u16 minGeneration = generation_;
-
-		// We increment the iterator inside because we delete things inside.
-		for (size_t i = 0; i < blockIndexLookup_.size(); ++i) {
-			if (blockIndexLookup_[i] == INVALID_INDEX) {
-				continue;
-			}
-			auto &info = index_[blockIndexLookup_[i]];
+	if (cacheSize_ + blocks <= maxBlocks_) {
+		return true;
+	}
+	if (blocks > maxBlocks_) {
+		return false;
+	}
+	const size_t needed = cacheSize_ + blocks - maxBlocks_;
 
-			// Check for the minimum seen generation.
-			// TODO: Do this smarter?
-			if (info.generation != 0 && info.generation < minGeneration) {
-				minGeneration = info.generation;
-			}
+	// Blocks still being read or written, or not in the index yet, have to stay.
+	std::vector<u32> candidates;
+	for (u32 block = 0; block < maxBlocks_; ++block) {
+		const u32 indexPos = blockIndexLookup_[block];
+		if (indexPos != INVALID_INDEX && blockPins_[block] == 0 && index_[indexPos].block == block) {
+			candidates.push_back(block);
+		}
+	}
+	if (candidates.size() < needed) {
+		return false;
+	}
 
-			// 0 means it was never used yet or was the first read (e.g. block descriptor.)
-			if (info.generation == oldestGeneration_ || info.generation == 0) {
-				info.block = INVALID_BLOCK;
-				info.generation = 0;
-				info.hits = 0;
-				--cacheSize_;
-
-				// TODO: Doing this in chunks might be a lot better.
-				WriteIndexData(blockIndexLookup_[i], info);
-				blockIndexLookup_[i] = INVALID_INDEX;
-
-				// Keep going?
-				if (cacheSize_ <= goal) {
-					break;
-				}
-			}
+	// 0 means it was never used yet or was the first read (e.g. block descriptor), so those go first.
+	auto evictFirst = [&](u32 a, u32 b) {
+		const BlockInfo &infoA = index_[blockIndexLookup_[a]];
+		const BlockInfo &infoB = index_[blockIndexLookup_[b]];
+		if (evictionPolicy_ == EVICT_FEWEST_HITS && infoA.hits != infoB.hits) {
+			return infoA.hits < infoB.hits;
 		}
+		return infoA.generation < infoB.generation;
+	};
+	if (needed < candidates.size()) {
+		std::nth_element(candidates.begin(), candidates.begin() + needed, candidates.end(), evictFirst);
+	}
 
-		// If we didn't find any, update to the lowest we did find.
-		oldestGeneration_ = minGeneration;
+	for (size_t i = 0; i < needed; ++i) {
+		const u32 indexPos = blockIndexLookup_[candidates[i]];
+		auto &info = index_[indexPos];
+		info.block = INVALID_BLOCK;
+		info.generation = 0;
+		info.hits = 0;
+		MarkIndexDirty(indexPos);
+		FreeBlock(candidates[i]);
 	}
 
 	return true;
 }
 
 void DiskCachingFileLoaderCache::RebalanceGenerations() {
-	// To make things easy, we will subtract oldestGeneration_ and cut in half.
+	// To make things easy, we will subtract the oldest generation and cut in half.
 	// That should give us more space but not break anything.
+	u16 oldestGeneration = generation_;
+	for (size_t i = 0; i < index_.size(); ++i) {
+		if (index_[i].block != INVALID_BLOCK && index_[i].generation != 0) {
+			oldestGeneration = std::min(oldestGeneration, index_[i].generation);
+		}
+	}
 
 	for (size_t i = 0; i < index_.size(); ++i) {
 		auto &info = index_[i];
@@ -301,21 +345,24 @@ void DiskCachingFileLoaderCache::RebalanceGenerations() {
 			continue;
 		}
 
-		if (info.generation > oldestGeneration_) {
-			info.generation = (info.generation - oldestGeneration_) / 2;
-			// TODO: Doing this all at once would be much better.
-			WriteIndexData((u32)i, info);
+		if (info.generation > oldestGeneration) {
+			info.generation = (info.generation - oldestGeneration) / 2;
+			MarkIndexDirty((u32)i);
 		}
 	}
 
-	oldestGeneration_ = 0;
+	generation_ = (generation_ - oldestGeneration) / 2 + 1;
 }
 
 u32 DiskCachingFileLoaderCache::AllocateBlock(u32 indexPos) {
-	for (size_t i = 0; i < blockIndexLookup_.size(); ++i) {
-		if (blockIndexLookup_[i] == INVALID_INDEX) {
-			blockIndexLookup_[i] = indexPos;
-			return (u32)i;
+	// Search on from the last one, so that blocks read together tend to sit together.
+	for (u32 i = 0; i < maxBlocks_; ++i) {
+		u32 block = (nextFreeBlock_ + i) % maxBlocks_;
+		if (blockIndexLookup_[block] == INVALID_INDEX) {
+			blockIndexLookup_[block] = indexPos;
+			nextFreeBlock_ = (block + 1) % maxBlocks_;
+			++cacheSize_;
+			return block;
 		}
 	}
 
@@ -323,6 +370,11 @@ u32 DiskCachingFileLoaderCache::AllocateBlock(u32 indexPos) {
 	return INVALID_BLOCK;
 }
 
+void DiskCachingFileLoaderCache::FreeBlock(u32 block) {
+	blockIndexLookup_[block] = INVALID_INDEX;
+	--cacheSize_;
+}
+
 std::string DiskCachingFileLoaderCache::MakeCacheFilePath(const std::string &path) {
 	std::string dir = cacheDir_;
 	if (dir.empty()) {
@@ -352,49 +404,114 @@ s64 DiskCachingFileLoaderCache::GetBlockOffset(u32 block) {
 	return blockOffset + (s64)block * (s64)blockSize_;
 }
 
-void DiskCachingFileLoaderCache::ReadBlockData(u8 *dest, BlockInfo &info, size_t offset, size_t size) {
-	s64 blockOffset = GetBlockOffset(info.block);
+// Positioned reads and writes don't share a file position, so any number of threads can use them at once.
+bool DiskCachingFileLoaderCache::ReadFileData(void *dest, size_t size, s64 offset) {
+#ifdef _WIN32
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD bytesRead = 0;
+	HANDLE handle = (HANDLE)_get_osfhandle(fd_);
+	return ReadFile(handle, dest, (DWORD)size, &bytesRead, &overlapped) && bytesRead == size;
+#elif defined(ANDROID)
+	// Android NDK does not support 64-bit file I/O using C streams
+	return pread64(fd_, dest, size, offset) == (ssize_t)size;
+#else
+	return pread(fd_, dest, size, offset) == (ssize_t)size;
+#endif
+}
 
-#ifdef ANDROID
-	if (lseek64(fd_, blockOffset, SEEK_SET) != blockOffset) {
-		ERROR_LOG(LOADER, "Unable to read disk cache data entry.");
-	} else if (read(fd_, dest + offset, size) != (ssize_t)size) {
-		ERROR_LOG(LOADER, "Unable to read disk cache data entry.");
-	}
+bool DiskCachingFileLoaderCache::WriteFileData(const void *src, size_t size, s64 offset) {
+#ifdef _WIN32
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD bytesWritten = 0;
+	HANDLE handle = (HANDLE)_get_osfhandle(fd_);
+	return WriteFile(handle, src, (DWORD)size, &bytesWritten, &overlapped) && bytesWritten == size;
+#elif defined(ANDROID)
+	return pwrite64(fd_, src, size, offset) == (ssize_t)size;
 #else
-	if (fseeko(f_, blockOffset, SEEK_SET) != 0) {
-		ERROR_LOG(LOADER, "Unable to read disk cache data entry.");
-	} else if (fread(dest + offset, size, 1, f_) != 1) {
-		ERROR_LOG(LOADER, "Unable to read disk cache data entry.");
-	}
+	return pwrite(fd_, src, size, offset) == (ssize_t)size;
 #endif
 }
 
-void DiskCachingFileLoaderCache::WriteBlockData(BlockInfo &info, u8 *src) {
-	s64 blockOffset = GetBlockOffset(info.block);
+void DiskCachingFileLoaderCache::ReadBlockData(u8 *dest, const std::vector<u32> &blocks, size_t offset, size_t size) {
+	// Blocks next to each other in the file are read together.
+	size_t i = 0;
+	while (size > 0) {
+		size_t run = 1;
+		while (i + run < blocks.size() && blocks[i + run] == blocks[i] + run) {
+			++run;
+		}
 
-#ifdef ANDROID
-	if (lseek64(fd_, blockOffset, SEEK_SET) != blockOffset) {
-		ERROR_LOG(LOADER, "Unable to write disk cache data entry.");
-	} else if (write(fd_, src, blockSize_) != (ssize_t)blockSize_) {
-		ERROR_LOG(LOADER, "Unable to write disk cache data entry.");
+		size_t toRead = std::min(size, run * blockSize_ - offset);
+		if (!ReadFileData(dest, toRead, GetBlockOffset(blocks[i]) + offset)) {
+			ERROR_LOG(LOADER, "Unable to read disk cache data entry.");
+		}
+		dest += toRead;
+		size -= toRead;
+		i += run;
+		offset = 0;
 	}
-#else
-	if (fseeko(f_, blockOffset, SEEK_SET) != 0) {
-		ERROR_LOG(LOADER, "Unable to write disk cache data entry.");
-	} else if (fwrite(src, blockSize_, 1, f_) != 1) {
-		ERROR_LOG(LOADER, "Unable to write disk cache data entry.");
+}
+
+void DiskCachingFileLoaderCache::WriteBlockData(const std::vector<u32> &blocks, const u8 *src) {
+	size_t i = 0;
+	while (i < blocks.size()) {
+		size_t run = 1;
+		while (i + run < blocks.size() && blocks[i + run] == blocks[i] + run) {
+			++run;
+		}
+
+		if (!WriteFileData(src + i * blockSize_, run * blockSize_, GetBlockOffset(blocks[i]))) {
+			ERROR_LOG(LOADER, "Unable to write disk cache data entry.");
+		}
+		i += run;
+	}
+}
+
+void DiskCachingFileLoaderCache::MarkIndexDirty(u32 indexPos) {
+	if (!indexDirty_[indexPos]) {
+		indexDirty_[indexPos] = true;
+		dirtyIndexes_.push_back(indexPos);
 	}
-#endif
 }
 
-void DiskCachingFileLoaderCache::WriteIndexData(u32 indexPos, BlockInfo &info) {
-	u32 offset = (u32)sizeof(FileHeader) + indexPos * (u32)sizeof(BlockInfo);
+void DiskCachingFileLoaderCache::FlushIndex() {
+	// Must not be called with lock_ held, indexLock_ comes first.
+	lock_guard writeGuard(indexLock_);
+
+	// Copy what changed, so the writes can happen without holding up readers.
+	std::vector<u32> positions;
+	std::vector<BlockInfo> entries;
+	{
+		lock_guard guard(lock_);
+		if (dirtyIndexes_.empty()) {
+			return;
+		}
+		std::sort(dirtyIndexes_.begin(), dirtyIndexes_.end());
+		positions.swap(dirtyIndexes_);
+		entries.reserve(positions.size());
+		for (u32 indexPos : positions) {
+			entries.push_back(index_[indexPos]);
+			indexDirty_[indexPos] = false;
+		}
+	}
 
-	if (fseek(f_, offset, SEEK_SET) != 0) {
-		ERROR_LOG(LOADER, "Unable to write disk cache index entry.");
-	} else if (fwrite(&info, sizeof(BlockInfo), 1, f_) != 1) {
-		ERROR_LOG(LOADER, "Unable to write disk cache index entry.");
+	size_t i = 0;
+	while (i < positions.size()) {
+		const u32 start = positions[i];
+		size_t run = 1;
+		while (i + run < positions.size() && positions[i + run] == start + run) {
+			++run;
+		}
+
+		s64 offset = (s64)sizeof(FileHeader) + (s64)start * (s64)sizeof(BlockInfo);
+		if (!WriteFileData(&entries[i], run * sizeof(BlockInfo), offset)) {
+			ERROR_LOG(LOADER, "Unable to write disk cache index entry.");
+		}
+		i += run;
 	}
 }
 
@@ -419,11 +536,8 @@ bool DiskCachingFileLoaderCache::LoadCacheFile(const std::string &path) {
 	// If it's valid, retain the file pointer.
 	if (valid) {
 		f_ = fp;
-
-#ifdef ANDROID
-		// Android NDK does not support 64-bit file I/O using C streams
+		// All access after this is positioned, through the descriptor.
 		fd_ = fileno(f_);
-#endif
 
 		// Now let's load the index.
 		blockSize_ = header.blockSize;
@@ -437,19 +551,14 @@ bool DiskCachingFileLoaderCache::LoadCacheFile(const std::string &path) {
 }
 
 void DiskCachingFileLoaderCache::LoadCacheIndex() {
-	if (fseek(f_, sizeof(FileHeader), SEEK_SET) != 0) {
-		fclose(f_);
-		f_ = nullptr;
-		fd_ = 0;
-		return;
-	}
-
 	indexCount_ = (filesize_ + blockSize_ - 1) / blockSize_;
 	index_.resize(indexCount_);
-	blockIndexLookup_.resize(MAX_BLOCKS_CACHED);
-	memset(&blockIndexLookup_[0], INVALID_INDEX, MAX_BLOCKS_CACHED * sizeof(blockIndexLookup_[0]));
+	indexDirty_.resize(indexCount_);
+	blockIndexLookup_.resize(maxBlocks_);
+	memset(&blockIndexLookup_[0], INVALID_INDEX, maxBlocks_ * sizeof(blockIndexLookup_[0]));
+	blockPins_.resize(maxBlocks_);
 
-	if (fread(&index_[0], sizeof(BlockInfo), indexCount_, f_) != indexCount_) {
+	if (!ReadFileData(&index_[0], indexCount_ * sizeof(BlockInfo), sizeof(FileHeader))) {
 		fclose(f_);
 		f_ = nullptr;
 		fd_ = 0;
@@ -457,21 +566,21 @@ void DiskCachingFileLoaderCache::LoadCacheIndex() {
 	}
 
 	// Now let's set some values we need.
-	oldestGeneration_ = std::numeric_limits<u16>::max();
 	generation_ = 0;
 	cacheSize_ = 0;
 
 	for (size_t i = 0; i < index_.size(); ++i) {
-		if (index_[i].block > MAX_BLOCKS_CACHED) {
+		// Also drops blocks past the end if the cache size was lowered.
+		if (index_[i].block != INVALID_BLOCK && (index_[i].block >= maxBlocks_ || blockIndexLookup_[index_[i].block] != INVALID_INDEX)) {
 			index_[i].block = INVALID_BLOCK;
+			index_[i].generation = 0;
+			index_[i].hits = 0;
+			MarkIndexDirty((u32)i);
 		}
 		if (index_[i].block == INVALID_BLOCK) {
 			continue;
 		}
 
-		if (index_[i].generation < oldestGeneration_) {
-			oldestGeneration_ = index_[i].generation;
-		}
 		if (index_[i].generation > generation_) {
 			generation_ = index_[i].generation;
 		}
@@ -479,6 +588,7 @@ void DiskCachingFileLoaderCache::LoadCacheIndex() {
 
 		blockIndexLookup_[index_[i].block] = (u32)i;
 	}
+	FlushIndex();
 }
 
 void DiskCachingFileLoaderCache::CreateCacheFile(const std::string &path) {
@@ -487,10 +597,8 @@ void DiskCachingFileLoaderCache::CreateCacheFile(const std::string &path) {
 		ERROR_LOG(LOADER, "Could not create disk cache file");
 		return;
 	}
-#ifdef ANDROID
-	// Android NDK does not support 64-bit file I/O using C streams
+	// All access is positioned, through the descriptor.
 	fd_ = fileno(f_);
-#endif
 
 	blockSize_ = DEFAULT_BLOCK_SIZE;
 
@@ -500,7 +608,7 @@ void DiskCachingFileLoaderCache::CreateCacheFile(const std::string &path) {
 	header.blockSize = blockSize_;
 	header.filesize = filesize_;
 
-	if (fwrite(&header, sizeof(header), 1, f_) != 1) {
+	if (!WriteFileData(&header, sizeof(header), 0)) {
 		fclose(f_);
 		f_ = nullptr;
 		fd_ = 0;
@@ -509,10 +617,12 @@ void DiskCachingFileLoaderCache::CreateCacheFile(const std::string &path) {
 
 	indexCount_ = (filesize_ + blockSize_ - 1) / blockSize_;
 	index_.resize(indexCount_);
-	blockIndexLookup_.resize(MAX_BLOCKS_CACHED);
-	memset(&blockIndexLookup_[0], INVALID_INDEX, MAX_BLOCKS_CACHED * sizeof(blockIndexLookup_[0]));
+	indexDirty_.resize(indexCount_);
+	blockIndexLookup_.resize(maxBlocks_);
+	memset(&blockIndexLookup_[0], INVALID_INDEX, maxBlocks_ * sizeof(blockIndexLookup_[0]));
+	blockPins_.resize(maxBlocks_);
 
-	if (fwrite(&index_[0], sizeof(BlockInfo), indexCount_, f_) != indexCount_) {
+	if (!WriteFileData(&index_[0], indexCount_ * sizeof(BlockInfo), sizeof(FileHeader))) {
 		fclose(f_);
 		f_ = nullptr;
 		fd_ = 0;
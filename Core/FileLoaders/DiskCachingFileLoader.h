@@ -54,11 +54,15 @@ class DiskCachingFileLoader : public FileLoader {
 	s64 filesize_;
 	s64 filepos_;
 	FileLoader *backend_;
+	// Backends aren't necessarily safe to read from on several threads.  Each loader has its own
+	// backend, so loaders sharing a cache still read theirs in parallel.
+	recursive_mutex backendLock_;
 	DiskCachingFileLoaderCache *cache_;
 
 	// We don't support concurrent disk cache access (we use memory cached indexes.)
 	// So we have to ensure there's only one of these per.
 	static std::map<std::string, DiskCachingFileLoaderCache *> caches_;
+	static recursive_mutex cachesLock_;
 };
 
 class DiskCachingFileLoaderCache {
@@ -70,6 +74,7 @@ class DiskCachingFileLoaderCache {
 		return f_ != nullptr;
 	}
 
+	// Only called with DiskCachingFileLoader::cachesLock_ held.
 	void AddRef() {
 		++refCount_;
 	}
@@ -82,9 +87,12 @@ class DiskCachingFileLoaderCache {
 		cacheDir_ = path;
 	}
 
+	// Both can be called from several threads at once.  Disk access happens outside the index lock,
+	// so readers of cached blocks don't wait on each other or on blocks being fetched.
 	size_t ReadFromCache(s64 pos, size_t bytes, void *data);
-	// Guaranteed to read at least one block into the cache.
-	size_t SaveIntoCache(FileLoader *backend, s64 pos, size_t bytes, void *data);
+	// Reads at least one block into the cache, unless it's full of blocks still being read.
+	// backendLock is held while reading from backend.
+	size_t SaveIntoCache(FileLoader *backend, recursive_mutex &backendLock, s64 pos, size_t bytes, void *data);
 
 private:
 	void InitCache(const std::string &path);
@@ -92,12 +100,15 @@ class DiskCachingFileLoaderCache {
 	bool MakeCacheSpaceFor(size_t blocks);
 	void RebalanceGenerations();
 	u32 AllocateBlock(u32 indexPos);
+	void FreeBlock(u32 block);
 
-	struct BlockInfo;
-	void ReadBlockData(u8 *dest, BlockInfo &info, size_t offset, size_t size);
-	void WriteBlockData(BlockInfo &info, u8 *src);
-	void WriteIndexData(u32 indexPos, BlockInfo &info);
+	void ReadBlockData(u8 *dest, const std::vector<u32> &blocks, size_t offset, size_t size);
+	void WriteBlockData(const std::vector<u32> &blocks, const u8 *src);
+	void MarkIndexDirty(u32 indexPos);
+	void FlushIndex();
 	s64 GetBlockOffset(u32 block);
+	bool ReadFileData(void *dest, size_t size, s64 offset);
+	bool WriteFileData(const void *src, size_t size, s64 offset);
 
 	std::string MakeCacheFilePath(const std::string &path);
 	bool LoadCacheFile(const std::string &path);
@@ -120,20 +131,34 @@ class DiskCachingFileLoaderCache {
 		CACHE_VERSION = 1,
 		DEFAULT_BLOCK_SIZE = 65536,
 		MAX_BLOCKS_PER_READ = 16,
-		// TODO: Dynamic.
-		MAX_BLOCKS_CACHED = 4096, // 256 MB
 		INVALID_BLOCK = 0xFFFFFFFF,
 		INVALID_INDEX = 0xFFFFFFFF,
 	};
 
+	enum EvictionPolicy {
+		// Oldest generation first, blocks that were never read back before anything else.
+		EVICT_LEAST_RECENT = 0,
+		// Fewest hits first, then oldest generation.
+		EVICT_FEWEST_HITS = 1,
+	};
+
 	int refCount_;
 	s64 filesize_;
 	u32 blockSize_;
 	u16 generation_;
-	u16 oldestGeneration_;
+	// Blocks in use, including those still being read from the backend.
 	size_t cacheSize_;
 	size_t indexCount_;
+	// From the config, in blocks.  The cache file grows up to this size.
+	u32 maxBlocks_;
+	EvictionPolicy evictionPolicy_;
+	u32 nextFreeBlock_;
+
+	// Protects everything below.  Never held during any file access.
 	recursive_mutex lock_;
+	// Held while writing the index, and taken before lock_.  Snapshots of dirty entries are
+	// taken and written in the same order, so an older entry can't overwrite a newer one.
+	recursive_mutex indexLock_;
 
 	struct FileHeader {
 		char magic[8];
@@ -153,6 +178,11 @@ class DiskCachingFileLoaderCache {
 
 	std::vector<BlockInfo> index_;
 	std::vector<u32> blockIndexLookup_;
+	// Blocks being read or written outside the lock can't be evicted.
+	std::vector<u16> blockPins_;
+	// Index entries changed since they were last written, flushed in contiguous runs.
+	std::vector<u32> dirtyIndexes_;
+	std::vector<bool> indexDirty_;
 
 	FILE *f_;
 	int fd_;
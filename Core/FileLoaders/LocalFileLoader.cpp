@@ -15,13 +15,34 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include "file/file_util.h"
 #include "Common/FileUtil.h"
 #include "Core/FileLoaders/LocalFileLoader.h"
 
-LocalFileLoader::LocalFileLoader(const std::string &filename)
-	: fd_(0), f_(nullptr), filesize_(0), filename_(filename) {
+#ifdef _WIN32
+#include "Common/CommonWindows.h"
+#include <io.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Mapping a whole disc image takes more address space than 32-bit builds can spare.
+#if defined(_ARCH_64)
+#define LOCAL_FILE_LOADER_MMAP
+#endif
+
+// How many reads in a row it takes to change our mind about the access pattern.
+static const int ACCESS_PATTERN_THRESHOLD = 4;
+
+LocalFileLoader::LocalFileLoader(const std::string &filename, bool allowMap)
+	: fd_(0), f_(nullptr), filesize_(0), filename_(filename), mapped_(nullptr),
+#ifdef _WIN32
+	mapping_(nullptr),
+#endif
+	filepos_(0), pattern_(ACCESS_NORMAL), lastReadEnd_(-1), sequentialReads_(0), randomReads_(0) {
 	f_ = File::OpenCFile(filename, "rb");
 	if (!f_) {
 		return;
@@ -40,14 +61,63 @@ LocalFileLoader::LocalFileLoader(const std::string &filename)
 	filesize_ = ftello(f_);
 	fseek(f_, 0, SEEK_SET);
 #endif
+
+	if (allowMap) {
+		MapFile();
+	}
 }
 
 LocalFileLoader::~LocalFileLoader() {
+	UnmapFile();
 	if (f_) {
 		fclose(f_);
 	}
 }
 
+void LocalFileLoader::MapFile() {
+#ifdef LOCAL_FILE_LOADER_MMAP
+	if (filesize_ == 0) {
+		return;
+	}
+
+#ifdef _WIN32
+	HANDLE file = (HANDLE)_get_osfhandle(_fileno(f_));
+	if (file == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	mapping_ = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping_) {
+		return;
+	}
+	mapped_ = (const u8 *)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+	if (!mapped_) {
+		CloseHandle(mapping_);
+		mapping_ = nullptr;
+	}
+#else
+	void *ptr = mmap(nullptr, (size_t)filesize_, PROT_READ, MAP_SHARED, fileno(f_), 0);
+	if (ptr == MAP_FAILED) {
+		return;
+	}
+	mapped_ = (const u8 *)ptr;
+#endif
+#endif
+}
+
+void LocalFileLoader::UnmapFile() {
+	if (!mapped_) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(mapped_);
+	CloseHandle(mapping_);
+	mapping_ = nullptr;
+#else
+	munmap((void *)mapped_, (size_t)filesize_);
+#endif
+	mapped_ = nullptr;
+}
+
 bool LocalFileLoader::Exists() {
 	// If we couldn't open it for reading, we say it does not exist.
 	if (f_ || IsDirectory()) {
@@ -74,6 +144,10 @@ std::string LocalFileLoader::Path() const {
 }
 
 void LocalFileLoader::Seek(s64 absolutePos) {
+	if (mapped_) {
+		filepos_ = absolutePos;
+		return;
+	}
 #ifdef ANDROID
 	lseek64(fd_, absolutePos, SEEK_SET);
 #else
@@ -82,6 +156,9 @@ void LocalFileLoader::Seek(s64 absolutePos) {
 }
 
 size_t LocalFileLoader::Read(size_t bytes, size_t count, void *data) {
+	if (mapped_) {
+		return ReadAt(filepos_, bytes, count, data);
+	}
 #ifdef ANDROID
 	return read(fd_, data, bytes * count) / bytes;
 #else
@@ -90,6 +167,53 @@ size_t LocalFileLoader::Read(size_t bytes, size_t count, void *data) {
 }
 
 size_t LocalFileLoader::ReadAt(s64 absolutePos, size_t bytes, size_t count, void *data) {
+	if (mapped_) {
+		if (absolutePos < 0 || (u64)absolutePos >= filesize_ || bytes == 0) {
+			return 0;
+		}
+		// Like fread, only whole items count.
+		count = std::min(count, (size_t)((filesize_ - absolutePos) / bytes));
+		NoteAccess(absolutePos, bytes * count);
+		memcpy(data, mapped_ + absolutePos, bytes * count);
+		filepos_ = absolutePos + bytes * count;
+		return count;
+	}
+
 	Seek(absolutePos);
 	return Read(bytes, count, data);
 }
+
+const u8 *LocalFileLoader::GetPointer(s64 absolutePos, size_t bytes) {
+	if (!mapped_ || absolutePos < 0 || (u64)absolutePos + bytes > filesize_) {
+		return nullptr;
+	}
+	NoteAccess(absolutePos, bytes);
+	return mapped_ + absolutePos;
+}
+
+void LocalFileLoader::NoteAccess(s64 absolutePos, size_t bytes) {
+	if (absolutePos == lastReadEnd_) {
+		sequentialReads_++;
+		randomReads_ = 0;
+	} else {
+		randomReads_++;
+		sequentialReads_ = 0;
+	}
+	lastReadEnd_ = absolutePos + bytes;
+
+	AccessPattern pattern = pattern_;
+	if (sequentialReads_ >= ACCESS_PATTERN_THRESHOLD) {
+		pattern = ACCESS_SEQUENTIAL;
+	} else if (randomReads_ >= ACCESS_PATTERN_THRESHOLD) {
+		pattern = ACCESS_RANDOM;
+	}
+	if (pattern == pattern_) {
+		return;
+	}
+	pattern_ = pattern;
+
+#if !defined(_WIN32) && defined(MADV_SEQUENTIAL)
+	// Streaming gets aggressive read-ahead, and seeking around doesn't drag in pages nobody wants.
+	madvise((void *)mapped_, (size_t)filesize_, pattern == ACCESS_SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM);
+#endif
+}
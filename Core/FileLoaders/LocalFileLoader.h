@@ -22,7 +22,8 @@
 
 class LocalFileLoader : public FileLoader {
 public:
-	LocalFileLoader(const std::string &filename);
+	// Memory maps the file when allowed and possible, otherwise reads through stdio.
+	LocalFileLoader(const std::string &filename, bool allowMap = false);
 	virtual ~LocalFileLoader();
 
 	virtual bool Exists() override;
@@ -33,11 +34,39 @@ class LocalFileLoader : public FileLoader {
 	virtual void Seek(s64 absolutePos) override;
 	virtual size_t Read(size_t bytes, size_t count, void *data) override;
 	virtual size_t ReadAt(s64 absolutePos, size_t bytes, size_t count, void *data) override;
+	virtual const u8 *GetPointer(s64 absolutePos, size_t bytes) override;
+
+	bool IsMapped() const {
+		return mapped_ != nullptr;
+	}
 
 private:
+	void MapFile();
+	void UnmapFile();
+	void NoteAccess(s64 absolutePos, size_t bytes);
+
+	enum AccessPattern {
+		ACCESS_NORMAL,
+		ACCESS_SEQUENTIAL,
+		ACCESS_RANDOM,
+	};
+
 	// First only used by Android, but we can keep it here for everyone.
 	int fd_;
 	FILE *f_;
 	u64 filesize_;
 	std::string filename_;
+
+	// The whole file, when mapped.  Reads are then just copies, and filepos_ replaces the stdio position.
+	const u8 *mapped_;
+#ifdef _WIN32
+	void *mapping_;
+#endif
+	s64 filepos_;
+
+	// Used to tell the OS how far to read ahead in the mapping.
+	AccessPattern pattern_;
+	s64 lastReadEnd_;
+	int sequentialReads_;
+	int randomReads_;
 };
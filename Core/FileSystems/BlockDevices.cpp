@@ -16,7 +16,10 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 
+#include "base/timeutil.h"
+#include "thread/threadutil.h"
 #include "Common/FileUtil.h"
+#include "Common/ThreadPools.h"
 #include "Core/Loaders.h"
 #include "Core/FileSystems/BlockDevices.h"
 #include <cstdio>
@@ -68,6 +71,13 @@ bool RAMBlockDevice::ReadBlock(int blockNumber, u8 *outPtr) {
 	return false;
 }
 
+const u8 *RAMBlockDevice::GetBlocksPointer(u32 minBlock, int count) {
+	if (count >= 0 && (u64)minBlock + count <= (u64)totalBlocks_) {
+		return image_ + (u64)minBlock * GetBlockSize();
+	}
+	return nullptr;
+}
+
 u32 RAMBlockDevice::GetNumBlocks() {
 	return totalBlocks_;
 }
@@ -99,6 +109,10 @@ bool FileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr) {
 	return true;
 }
 
+const u8 *FileBlockDevice::GetBlocksPointer(u32 minBlock, int count) {
+	return fileLoader_->GetPointer((u64)minBlock * (u64)GetBlockSize(), (size_t)count * GetBlockSize());
+}
+
 // .CSO format
 
 // compressed ISO(9660) header format
@@ -127,10 +141,17 @@ typedef struct ciso_header
 
 // TODO: Need much better error handling.
 
+// Decompressed frames kept around, in bytes.  Reads often revisit the frame they last touched,
+// and read-ahead needs somewhere to put its frames.
+static const u32 CSO_CACHE_SIZE = 1024 * 1024;
+static const int CSO_MIN_CACHE_SLOTS = 16;
+static const u32 CSO_MIN_READ_AHEAD_FRAMES = 4;
+static const u32 CSO_INVALID_FRAME = 0xFFFFFFFF;
 static const u32 CSO_READ_BUFFER_SIZE = 256 * 1024;
 
 CISOFileBlockDevice::CISOFileBlockDevice(FileLoader *fileLoader)
-	: fileLoader_(fileLoader)
+	: fileLoader_(fileLoader), readAheadThread_(nullptr), readAheadActive_(false), nextSequentialFrame_(0),
+	  readAheadStart_(0), readAheadCount_(0), cacheHits_(0), cacheMisses_(0), inflateTime_(0.0)
 {
 	// CISO format is fairly simple, but most tools do not write the header_size.
 
@@ -167,13 +188,14 @@ CISOFileBlockDevice::CISOFileBlockDevice(FileLoader *fileLoader)
 	numBlocks = (u32)(totalSize / GetBlockSize());
 	VERBOSE_LOG(LOADER, "CSO numBlocks=%i numFrames=%i align=%i", numBlocks, numFrames, indexShift);
 
-	// We might read a bit of alignment too, so be prepared.
-	if (frameSize + (1 << indexShift) < CSO_READ_BUFFER_SIZE)
-		readBuffer = new u8[CSO_READ_BUFFER_SIZE];
-	else
-		readBuffer = new u8[frameSize + (1 << indexShift)];
-	zlibBuffer = new u8[frameSize + (1 << indexShift)];
-	zlibBufferFrame = numFrames;
+	numSlots_ = std::max(CSO_MIN_CACHE_SLOTS, (int)(CSO_CACHE_SIZE / frameSize));
+	frameCache_ = new u8[(size_t)numSlots_ * frameSize];
+	slotFrame_.resize(numSlots_, CSO_INVALID_FRAME);
+	slotLoading_.resize(numSlots_, false);
+	slotLruPos_.resize(numSlots_, lruSlots_.end());
+	for (int i = numSlots_ - 1; i >= 0; --i) {
+		freeSlots_.push_back(i);
+	}
 
 	const u32 indexSize = numFrames + 1;
 
@@ -201,9 +223,28 @@ CISOFileBlockDevice::CISOFileBlockDevice(FileLoader *fileLoader)
 
 CISOFileBlockDevice::~CISOFileBlockDevice()
 {
+	if (readAheadThread_) {
+		lock_.lock();
+		readAheadActive_ = false;
+		readAheadCond_.notify_one();
+		lock_.unlock();
+		readAheadThread_->join();
+		delete readAheadThread_;
+	}
+
+	if (cacheHits_ + cacheMisses_ != 0) {
+		INFO_LOG(LOADER, "CSO frame cache: %d hits, %d misses, %0.2f ms inflating", cacheHits_, cacheMisses_, inflateTime_ * 1000.0);
+	}
+
 	delete [] index;
-	delete [] readBuffer;
-	delete [] zlibBuffer;
+	delete [] frameCache_;
+}
+
+void CISOFileBlockDevice::GetStats(u32 &hits, u32 &misses, double &inflateTime) {
+	lock_guard guard(lock_);
+	hits = cacheHits_;
+	misses = cacheMisses_;
+	inflateTime = inflateTime_;
 }
 
 bool CISOFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr) 
@@ -214,161 +255,304 @@ bool CISOFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr)
 		return false;
 	}
 
-	const u32 frameNumber = blockNumber >> blockShift;
-	const u32 idx = index[frameNumber];
-	const u32 indexPos = idx & 0x7FFFFFFF;
-	const u32 nextIndexPos = index[frameNumber + 1] & 0x7FFFFFFF;
-	z_stream z;
+	lock_guard guard(lock_);
+	return ReadFrames(blockNumber, blockNumber, outPtr);
+}
 
-	const u64 compressedReadPos = (u64)indexPos << indexShift;
-	const u64 compressedReadEnd = (u64)nextIndexPos << indexShift;
-	const size_t compressedReadSize = (size_t)(compressedReadEnd - compressedReadPos);
-	const u32 compressedOffset = (blockNumber & ((1 << blockShift) - 1)) * GetBlockSize();
+bool CISOFileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr) {
+	if (minBlock >= numBlocks) {
+		memset(outPtr, 0, GetBlockSize() * count);
+		return false;
+	}
 
-	const int plain = idx & 0x80000000;
-	if (plain)
-	{
-		int readSize = (u32)fileLoader_->ReadAt(compressedReadPos + compressedOffset, 1, GetBlockSize(), outPtr);
-		if (readSize < GetBlockSize())
-			memset(outPtr + readSize, 0, GetBlockSize() - readSize);
+	const u32 lastBlock = std::min(minBlock + count, numBlocks) - 1;
+	const u32 missingBlocks = count - (lastBlock + 1 - minBlock);
+	if (missingBlocks != 0) {
+		memset(outPtr + GetBlockSize() * (count - missingBlocks), 0, GetBlockSize() * missingBlocks);
 	}
-	else if (zlibBufferFrame == frameNumber)
-	{
-		// We already have it.  Just apply the offset and copy.
-		memcpy(outPtr, zlibBuffer + compressedOffset, GetBlockSize());
+
+	lock_guard guard(lock_);
+	return ReadFrames(minBlock, lastBlock, outPtr);
+}
+
+bool CISOFileBlockDevice::ReadFrames(u32 minBlock, u32 lastBlock, u8 *outPtr) {
+	const u32 minFrame = minBlock >> blockShift;
+	const u32 lastFrame = lastBlock >> blockShift;
+	const u32 blocksPerFrame = 1 << blockShift;
+	NoteAccess(minFrame, lastFrame);
+
+	// The read-ahead thread will have these soon, no need to read them twice.
+	while (FramesLoading(minFrame, lastFrame)) {
+		loadedCond_.wait(lock_);
 	}
-	else
-	{
-		const u32 readSize = (u32)fileLoader_->ReadAt(compressedReadPos, 1, compressedReadSize, readBuffer);
-
-		z.zalloc = Z_NULL;
-		z.zfree = Z_NULL;
-		z.opaque = Z_NULL;
-		if(inflateInit2(&z, -15) != Z_OK)
-		{
-			ERROR_LOG(LOADER, "GetBlockSize() ERROR: %s\n", (z.msg) ? z.msg : "?");
-			return false;
-		}
-		z.avail_in = readSize;
-		z.next_out = frameSize == (u32)GetBlockSize() ? outPtr : zlibBuffer;
-		z.avail_out = frameSize;
-		z.next_in = readBuffer;
 
-		int status = inflate(&z, Z_FINISH);
-		if (status != Z_STREAM_END)
-		{
-			ERROR_LOG(LOADER, "block %d: inflate : %s[%d]\n", blockNumber, (z.msg) ? z.msg : "error", status);
-			inflateEnd(&z);
-			memset(outPtr, 0, GetBlockSize());
-			return false;
-		}
-		if (z.total_out != frameSize)
-		{
-			ERROR_LOG(LOADER, "block %d: block size error %d != %d\n", blockNumber, (u32)z.total_out, frameSize);
-			inflateEnd(&z);
-			memset(outPtr, 0, GetBlockSize());
-			return false;
+	struct Placement {
+		u8 *dest;
+		u32 blockOffset;
+		u32 blocks;
+	};
+	std::vector<FrameJob> jobs;
+	std::vector<Placement> placements;
+	int slotsUsed = 0;
+
+	u32 block = minBlock;
+	for (u32 frame = minFrame; frame <= lastFrame; ++frame) {
+		const u32 frameBlockOffset = block & (blocksPerFrame - 1);
+		const u32 frameBlocks = std::min(lastBlock - block + 1, blocksPerFrame - frameBlockOffset);
+
+		auto cached = frameSlot_.find(frame);
+		if (cached != frameSlot_.end()) {
+			const int slot = cached->second;
+			lruSlots_.splice(lruSlots_.end(), lruSlots_, slotLruPos_[slot]);
+			memcpy(outPtr, frameCache_ + (size_t)slot * frameSize + frameBlockOffset * GetBlockSize(), frameBlocks * GetBlockSize());
+			cacheHits_++;
+		} else {
+			FrameJob job;
+			job.frame = frame;
+			job.failed = false;
+			// Big reads go straight to the caller, so they don't flush everything else from the cache.
+			if (frameBlocks == blocksPerFrame && slotsUsed >= numSlots_ / 2) {
+				job.slot = -1;
+				job.target = outPtr;
+			} else {
+				job.slot = AllocateSlot();
+				job.target = frameCache_ + (size_t)job.slot * frameSize;
+				slotsUsed++;
+			}
+			Placement placement = { outPtr, frameBlockOffset, frameBlocks };
+			jobs.push_back(job);
+			placements.push_back(placement);
+			cacheMisses_++;
 		}
-		inflateEnd(&z);
 
-		if (frameSize != (u32)GetBlockSize())
-		{
-			zlibBufferFrame = frameNumber;
-			memcpy(outPtr, zlibBuffer + compressedOffset, GetBlockSize());
+		block += frameBlocks;
+		outPtr += frameBlocks * GetBlockSize();
+	}
+
+	if (jobs.empty()) {
+		return true;
+	}
+
+	inflateTime_ += LoadFrames(jobs);
+	PublishFrames(jobs);
+
+	bool success = true;
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		const FrameJob &job = jobs[i];
+		const Placement &placement = placements[i];
+		if (job.failed) {
+			memset(placement.dest, 0, placement.blocks * GetBlockSize());
+			success = false;
+		} else if (job.slot >= 0) {
+			memcpy(placement.dest, job.target + placement.blockOffset * GetBlockSize(), placement.blocks * GetBlockSize());
 		}
 	}
-	return true;
+	return success;
 }
 
-bool CISOFileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr) {
-	if (count == 1) {
-		return ReadBlock(minBlock, outPtr);
+// Reads take at most half the slots plus one, and read-ahead leaves that many, so there's always one.
+int CISOFileBlockDevice::AllocateSlot() {
+	int slot;
+	if (!freeSlots_.empty()) {
+		slot = freeSlots_.back();
+		freeSlots_.pop_back();
+	} else {
+		_dbg_assert_msg_(LOADER, !lruSlots_.empty(), "CSO frame cache out of slots");
+		slot = lruSlots_.front();
+		lruSlots_.pop_front();
+		frameSlot_.erase(slotFrame_[slot]);
+		slotFrame_[slot] = CSO_INVALID_FRAME;
 	}
-	if (minBlock >= numBlocks) {
-		memset(outPtr, 0, GetBlockSize() * count);
-		return false;
+	return slot;
+}
+
+bool CISOFileBlockDevice::FramesLoading(u32 minFrame, u32 lastFrame) {
+	for (auto it = frameSlot_.lower_bound(minFrame); it != frameSlot_.end() && it->first <= lastFrame; ++it) {
+		if (slotLoading_[it->second]) {
+			return true;
+		}
 	}
+	return false;
+}
 
-	const u32 lastBlock = std::min(minBlock + count, numBlocks) - 1;
-	const u32 missingBlocks = (lastBlock + 1 - minBlock) - count;
-	if (lastBlock < minBlock + count) {
-		memset(outPtr + GetBlockSize() * (count - missingBlocks), 0, GetBlockSize() * missingBlocks);
+// Puts the jobs with a slot in the cache, or frees the slot if the frame couldn't be read.
+void CISOFileBlockDevice::PublishFrames(const std::vector<FrameJob> &jobs) {
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		const FrameJob &job = jobs[i];
+		if (job.slot < 0) {
+			continue;
+		}
+		slotLoading_[job.slot] = false;
+		if (job.failed) {
+			frameSlot_.erase(job.frame);
+			slotFrame_[job.slot] = CSO_INVALID_FRAME;
+			freeSlots_.push_back(job.slot);
+		} else {
+			slotFrame_[job.slot] = job.frame;
+			frameSlot_[job.frame] = job.slot;
+			slotLruPos_[job.slot] = lruSlots_.insert(lruSlots_.end(), job.slot);
+		}
 	}
+	loadedCond_.notify_all();
+}
 
-	const u32 minFrameNumber = minBlock >> blockShift;
-	const u32 lastFrameNumber = lastBlock >> blockShift;
-	const u32 afterLastIndexPos = index[lastFrameNumber + 1] & 0x7FFFFFFF;
-	const u64 totalReadEnd = (u64)afterLastIndexPos << indexShift;
+// Reads and inflates the frames of jobs (sorted by frame) into their targets.  Doesn't need lock_.
+// Returns the seconds spent inflating.
+double CISOFileBlockDevice::LoadFrames(std::vector<FrameJob> &jobs) {
+	lock_guard guard(readLock_);
+	double inflateTime = 0.0;
+	size_t first = 0;
+	while (first < jobs.size()) {
+		// Read as many frames at once as fit in the buffer, but at least one.
+		const u64 readStart = (u64)(index[jobs[first].frame] & 0x7FFFFFFF) << indexShift;
+		size_t last = first + 1;
+		while (last < jobs.size() && (((u64)(index[jobs[last].frame + 1] & 0x7FFFFFFF) << indexShift) - readStart) <= CSO_READ_BUFFER_SIZE) {
+			++last;
+		}
+		const u64 readEnd = (u64)(index[jobs[last - 1].frame + 1] & 0x7FFFFFFF) << indexShift;
+		const size_t readSize = (size_t)(readEnd - readStart);
+
+		// We might read a bit of alignment too, so be prepared.
+		if (readBuffer_.size() < readSize + (1 << indexShift)) {
+			readBuffer_.resize(readSize + (1 << indexShift));
+		}
+		const size_t bytesRead = fileLoader_->ReadAt(readStart, 1, readSize, &readBuffer_[0]);
+		if (bytesRead < readSize) {
+			memset(&readBuffer_[bytesRead], 0, readSize - bytesRead);
+		}
 
+		double start = real_time_now();
+		if (last - first == 1) {
+			InflateFrames(&jobs, readStart, (int)first, (int)last);
+		} else {
+			GlobalThreadPool::Loop(std::bind(&CISOFileBlockDevice::InflateFrames, this, &jobs, readStart, placeholder::_1, placeholder::_2), (int)first, (int)last);
+		}
+		inflateTime += real_time_now() - start;
+
+		first = last;
+	}
+	return inflateTime;
+}
+
+// Runs on worker threads, so it mustn't touch anything but its own jobs.
+void CISOFileBlockDevice::InflateFrames(std::vector<FrameJob> *jobs, u64 readStart, int lower, int upper) {
 	z_stream z;
 	z.zalloc = Z_NULL;
 	z.zfree = Z_NULL;
 	z.opaque = Z_NULL;
 	if (inflateInit2(&z, -15) != Z_OK) {
 		ERROR_LOG(LOADER, "Unable to initialize inflate: %s\n", (z.msg) ? z.msg : "?");
-		return false;
+		for (int i = lower; i < upper; ++i) {
+			(*jobs)[i].failed = true;
+		}
+		return;
 	}
 
-	u64 readBufferStart = 0;
-	u64 readBufferEnd = 0;
-	u32 block = minBlock;
-	const u32 blocksPerFrame = 1 << blockShift;
-	for (u32 frame = minFrameNumber; frame <= lastFrameNumber; ++frame) {
-		const u32 idx = index[frame];
-		const u32 indexPos = idx & 0x7FFFFFFF;
-		const u32 nextIndexPos = index[frame + 1] & 0x7FFFFFFF;
-
-		const u64 frameReadPos = (u64)indexPos << indexShift;
-		const u64 frameReadEnd = (u64)nextIndexPos << indexShift;
+	for (int i = lower; i < upper; ++i) {
+		FrameJob &job = (*jobs)[i];
+		const u32 idx = index[job.frame];
+		const u64 frameReadPos = (u64)(idx & 0x7FFFFFFF) << indexShift;
+		const u64 frameReadEnd = (u64)(index[job.frame + 1] & 0x7FFFFFFF) << indexShift;
 		const u32 frameReadSize = (u32)(frameReadEnd - frameReadPos);
-		const u32 frameBlockOffset = block & ((1 << blockShift) - 1);
-		const u32 frameBlocks = std::min(lastBlock - block + 1, blocksPerFrame - frameBlockOffset);
-
-		if (frameReadEnd > readBufferEnd) {
-			const s64 maxNeeded = totalReadEnd - frameReadPos;
-			const size_t chunkSize = (size_t)std::min(maxNeeded, (s64)std::max(frameReadSize, CSO_READ_BUFFER_SIZE));
+		u8 *rawBuffer = &readBuffer_[frameReadPos - readStart];
 
-			const u32 readSize = (u32)fileLoader_->ReadAt(frameReadPos, 1, chunkSize, readBuffer);
-			if (readSize < chunkSize) {
-				memset(readBuffer + readSize, 0, chunkSize - readSize);
-			}
-
-			readBufferStart = frameReadPos;
-			readBufferEnd = frameReadPos + readSize;
-		}
-
-		u8 *rawBuffer = &readBuffer[frameReadPos - readBufferStart];
 		const int plain = idx & 0x80000000;
 		if (plain) {
-			memcpy(outPtr, rawBuffer + frameBlockOffset * GetBlockSize(), frameBlocks * GetBlockSize());
-		} else {
-			z.avail_in = frameReadSize;
-			z.next_out = frameBlocks == blocksPerFrame ? outPtr : zlibBuffer;
-			z.avail_out = frameSize;
-			z.next_in = rawBuffer;
-
-			int status = inflate(&z, Z_FINISH);
-			if (status != Z_STREAM_END) {
-				ERROR_LOG(LOADER, "Inflate frame %d: failed - %s[%d]\n", frame, (z.msg) ? z.msg : "error", status);
-				memset(outPtr, 0, frameBlocks * GetBlockSize());
-			} else if (z.total_out != frameSize) {
-				ERROR_LOG(LOADER, "Inflate frame %d: block size error %d != %d\n", frame, (u32)z.total_out, frameSize);
-				memset(outPtr, 0, frameBlocks * GetBlockSize());
-			} else if (frameBlocks != blocksPerFrame) {
-				memcpy(outPtr, zlibBuffer + frameBlockOffset * GetBlockSize(), frameBlocks * GetBlockSize());
-				// In case we end up reusing it in a single read later.
-				zlibBufferFrame = frame;
+			memcpy(job.target, rawBuffer, std::min(frameReadSize, frameSize));
+			if (frameReadSize < frameSize) {
+				memset(job.target + frameReadSize, 0, frameSize - frameReadSize);
 			}
+			continue;
+		}
+
+		z.avail_in = frameReadSize;
+		z.next_out = job.target;
+		z.avail_out = frameSize;
+		z.next_in = rawBuffer;
 
-			inflateReset(&z);
+		int status = inflate(&z, Z_FINISH);
+		if (status != Z_STREAM_END) {
+			ERROR_LOG(LOADER, "Inflate frame %d: failed - %s[%d]\n", job.frame, (z.msg) ? z.msg : "error", status);
+			job.failed = true;
+		} else if (z.total_out != frameSize) {
+			ERROR_LOG(LOADER, "Inflate frame %d: block size error %d != %d\n", job.frame, (u32)z.total_out, frameSize);
+			job.failed = true;
 		}
 
-		block += frameBlocks;
-		outPtr += frameBlocks * GetBlockSize();
+		inflateReset(&z);
 	}
 
 	inflateEnd(&z);
-	return true;
+}
+
+void CISOFileBlockDevice::NoteAccess(u32 minFrame, u32 lastFrame) {
+	// Consecutive reads often share the frame at the boundary.
+	const bool sequential = minFrame == nextSequentialFrame_ || minFrame + 1 == nextSequentialFrame_;
+	nextSequentialFrame_ = lastFrame + 1;
+	if (!sequential || nextSequentialFrame_ >= numFrames) {
+		return;
+	}
+
+	// Read as far ahead as the last read went, within reason.
+	u32 count = std::max(lastFrame - minFrame + 1, CSO_MIN_READ_AHEAD_FRAMES);
+	count = std::min(count, (u32)numSlots_ / 4);
+	readAheadStart_ = nextSequentialFrame_;
+	readAheadCount_ = std::min(count, numFrames - readAheadStart_);
+
+	if (!readAheadThread_) {
+		readAheadActive_ = true;
+		readAheadThread_ = new std::thread(std::bind(&CISOFileBlockDevice::ReadAheadFunc, this));
+	}
+	readAheadCond_.notify_one();
+}
+
+void CISOFileBlockDevice::ReadAheadFunc() {
+	setCurrentThreadName("CSOReadAhead");
+
+	lock_guard guard(lock_);
+	while (readAheadActive_) {
+		if (readAheadCount_ == 0) {
+			readAheadCond_.wait(lock_);
+			continue;
+		}
+
+		const u32 start = readAheadStart_;
+		const u32 end = start + readAheadCount_;
+		readAheadCount_ = 0;
+
+		// Only the first run of frames we don't have yet, the rest is likely already there.
+		std::vector<FrameJob> jobs;
+		for (u32 frame = start; frame < end; ++frame) {
+			if (frameSlot_.find(frame) != frameSlot_.end()) {
+				if (jobs.empty()) {
+					continue;
+				}
+				break;
+			}
+			// Leave enough slots for any read to fit.
+			if (freeSlots_.size() + lruSlots_.size() <= (size_t)numSlots_ / 2 + 1) {
+				break;
+			}
+			FrameJob job;
+			job.frame = frame;
+			job.failed = false;
+			job.slot = AllocateSlot();
+			job.target = frameCache_ + (size_t)job.slot * frameSize;
+			slotFrame_[job.slot] = frame;
+			slotLoading_[job.slot] = true;
+			frameSlot_[frame] = job.slot;
+			jobs.push_back(job);
+		}
+
+		if (!jobs.empty()) {
+			// Reads of frames already in the cache can go on meanwhile.
+			lock_.unlock();
+			const double inflateTime = LoadFrames(jobs);
+			lock_.lock();
+			inflateTime_ += inflateTime;
+			PublishFrames(jobs);
+		}
+	}
 }
 
 
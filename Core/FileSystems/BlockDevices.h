@@ -23,6 +23,12 @@
 // The ISOFileSystemReader reads from a BlockDevice, so it automatically works
 // with CISO images.
 
+#include <list>
+#include <map>
+#include <vector>
+
+#include "base/mutex.h"
+#include "thread/thread.h"
 #include "Common/CommonTypes.h"
 #include "Core/ELF/PBPReader.h"
 
@@ -42,6 +48,11 @@ class BlockDevice
 		}
 		return true;
 	}
+	// Points at count whole blocks when they're already in memory, so reads can copy straight
+	// to their destination.  Returns nullptr otherwise, then use ReadBlocks.
+	virtual const u8 *GetBlocksPointer(u32 minBlock, int count) {
+		return nullptr;
+	}
 	int GetBlockSize() const { return 2048;}  // forced, it cannot be changed by subclasses
 	virtual u32 GetNumBlocks() = 0;
 };
@@ -56,17 +67,65 @@ class CISOFileBlockDevice : public BlockDevice
 	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr) override;
 	u32 GetNumBlocks() override { return numBlocks; }
 
+	// Frames found in the cache and frames that had to be read, and seconds spent inflating.
+	void GetStats(u32 &hits, u32 &misses, double &inflateTime);
+
 private:
+	struct FrameJob {
+		u32 frame;
+		// Where the frame goes: a cache slot, or straight into the caller's buffer.
+		u8 *target;
+		int slot;
+		bool failed;
+	};
+
+	bool ReadFrames(u32 minBlock, u32 lastBlock, u8 *outPtr);
+	double LoadFrames(std::vector<FrameJob> &jobs);
+	void InflateFrames(std::vector<FrameJob> *jobs, u64 readStart, int lower, int upper);
+	void PublishFrames(const std::vector<FrameJob> &jobs);
+	bool FramesLoading(u32 minFrame, u32 lastFrame);
+	int AllocateSlot();
+	void NoteAccess(u32 minFrame, u32 lastFrame);
+	void ReadAheadFunc();
+
 	FileLoader *fileLoader_;
 	u32 *index;
-	u8 *readBuffer;
-	u8 *zlibBuffer;
-	u32 zlibBufferFrame;
 	u8 indexShift;
 	u8 blockShift;
 	u32 frameSize;
 	u32 numBlocks;
 	u32 numFrames;
+
+	// Protects fileLoader_ and readBuffer_.  Never wait for lock_ while holding this.
+	recursive_mutex readLock_;
+	std::vector<u8> readBuffer_;
+
+	// Everything below is protected by lock_.
+	recursive_mutex lock_;
+
+	// Recently inflated frames, evicted least recently used first.  Slots being loaded by
+	// the read-ahead thread are in frameSlot_ already, but in neither list until they're done.
+	u8 *frameCache_;
+	int numSlots_;
+	std::vector<u32> slotFrame_;
+	std::vector<bool> slotLoading_;
+	std::list<int> lruSlots_;
+	std::vector<std::list<int>::iterator> slotLruPos_;
+	std::vector<int> freeSlots_;
+	std::map<u32, int> frameSlot_;
+	condition_variable loadedCond_;
+
+	// Sequential reads are followed up by reading the next frames in the background.
+	std::thread *readAheadThread_;
+	condition_variable readAheadCond_;
+	bool readAheadActive_;
+	u32 nextSequentialFrame_;
+	u32 readAheadStart_;
+	u32 readAheadCount_;
+
+	u32 cacheHits_;
+	u32 cacheMisses_;
+	double inflateTime_;
 };
 
 
@@ -77,6 +136,7 @@ class FileBlockDevice : public BlockDevice
 	~FileBlockDevice();
 	bool ReadBlock(int blockNumber, u8 *outPtr) override;
 	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr) override;
+	const u8 *GetBlocksPointer(u32 minBlock, int count) override;
 	u32 GetNumBlocks() override {return (u32)(filesize_ / GetBlockSize());}
 
 private:
@@ -131,6 +191,7 @@ class RAMBlockDevice : public BlockDevice
 	~RAMBlockDevice();
 
 	bool ReadBlock(int blockNumber, u8 *outPtr) override;
+	const u8 *GetBlocksPointer(u32 minBlock, int count) override;
 	u32 GetNumBlocks() override;
 
 private:
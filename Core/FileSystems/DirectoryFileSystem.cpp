@@ -47,11 +47,190 @@ QTM_USE_NAMESPACE
 #endif
 #include <ctype.h>
 #include <fcntl.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
 #endif
 
 #if HOST_IS_CASE_SENSITIVE
-static bool FixFilenameCase(const std::string &path, std::string &filename)
+// Each one needs an inotify watch, and there aren't that many of those to go around.
+static const size_t MAX_CACHED_DIRS = 1024;
+
+PathCaseCache::PathCaseCache() : inotify_(-1)
+{
+#if defined(__linux__)
+	// Not inotify_init1(), older Androids don't have it.
+	inotify_ = inotify_init();
+	if (inotify_ >= 0)
+	{
+		fcntl(inotify_, F_SETFL, fcntl(inotify_, F_GETFL) | O_NONBLOCK);
+		fcntl(inotify_, F_SETFD, FD_CLOEXEC);
+	}
+	else
+	{
+		WARN_LOG(FILESYS, "inotify unavailable, not caching directory listings");
+	}
+#endif
+}
+
+PathCaseCache::~PathCaseCache()
+{
+	if (inotify_ >= 0)
+		close(inotify_);
+}
+
+bool PathCaseCache::FixFilenameCase(const std::string &dir, std::string &filename, bool *found)
 {
+	if (inotify_ < 0)
+		return false;
+
+	PollChanges();
+
+	auto iter = dirs_.find(dir);
+	if (iter == dirs_.end())
+	{
+		if (dirs_.size() >= MAX_CACHED_DIRS)
+			Clear();
+
+		Listing listing;
+		if (!ReadListing(dir, listing))
+			return false;
+		iter = dirs_.insert(std::make_pair(dir, listing)).first;
+	}
+
+	const Listing &listing = iter->second;
+	if (listing.ambiguous)
+		return false;
+
+	std::string lower = filename;
+	for (size_t i = 0; i < lower.size(); i++)
+		lower[i] = tolower(lower[i]);
+
+	auto name = listing.names.find(lower);
+	*found = name != listing.names.end();
+	if (*found)
+		filename = name->second;
+	return true;
+}
+
+void PathCaseCache::Invalidate(const std::string &path)
+{
+	size_t len = path.size();
+	while (len > 0 && path[len - 1] == '/')
+		len--;
+
+	const std::string target = path.substr(0, len);
+	size_t slash = target.find_last_of('/');
+	if (slash != target.npos)
+		dirs_.erase(target.substr(0, slash + 1));
+	DropTree(target + "/");
+}
+
+bool PathCaseCache::ReadListing(const std::string &dir, Listing &listing)
+{
+#if defined(__linux__)
+	// Watch first, so nothing that changes while we read gets missed.
+	int wd = inotify_add_watch(inotify_, dir.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+	if (wd < 0)
+		return false;
+	watches_[wd] = dir;
+
+	DIR *dirp = opendir(dir.c_str());
+	if (!dirp)
+	{
+		// Nothing gets cached, so there's nothing for the watch to invalidate.
+		inotify_rm_watch(inotify_, wd);
+		watches_.erase(wd);
+		return false;
+	}
+
+	listing.ambiguous = false;
+	dirent *result;
+	while ((result = readdir(dirp)) != NULL)
+	{
+		std::string name = result->d_name;
+		if (name == "." || name == "..")
+			continue;
+
+		std::string lower = name;
+		for (size_t i = 0; i < lower.size(); i++)
+			lower[i] = tolower(lower[i]);
+		if (!listing.names.insert(std::make_pair(lower, name)).second)
+			listing.ambiguous = true;
+	}
+	closedir(dirp);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void PathCaseCache::PollChanges()
+{
+#if defined(__linux__)
+	alignas(inotify_event) char buffer[4096];
+	ssize_t len;
+	while ((len = read(inotify_, buffer, sizeof(buffer))) > 0)
+	{
+		for (ssize_t offset = 0; offset < len; )
+		{
+			const inotify_event *event = (const inotify_event *)&buffer[offset];
+			offset += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				// Lost track of what changed, so start over.
+				Clear();
+				continue;
+			}
+
+			auto watch = watches_.find(event->wd);
+			if (watch == watches_.end())
+				continue;
+
+			const std::string dir = watch->second;
+			if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+			{
+				DropTree(dir);
+				if (event->mask & IN_IGNORED)
+					watches_.erase(watch);
+			}
+			else
+			{
+				dirs_.erase(dir);
+				// Something else might take its name, so what we knew about below it is wrong now.
+				if ((event->mask & IN_ISDIR) && event->len != 0)
+					DropTree(dir + event->name + "/");
+			}
+		}
+	}
+#endif
+}
+
+void PathCaseCache::DropTree(const std::string &dir)
+{
+	auto iter = dirs_.lower_bound(dir);
+	while (iter != dirs_.end() && iter->first.compare(0, dir.size(), dir) == 0)
+		dirs_.erase(iter++);
+}
+
+void PathCaseCache::Clear()
+{
+#if defined(__linux__)
+	for (auto iter = watches_.begin(); iter != watches_.end(); ++iter)
+		inotify_rm_watch(inotify_, iter->first);
+#endif
+	// The IN_IGNORED events for those will just be skipped.
+	watches_.clear();
+	dirs_.clear();
+}
+
+static bool FixFilenameCase(const std::string &path, std::string &filename, PathCaseCache *cache)
+{
+	bool found;
+	if (cache && cache->FixFilenameCase(path, filename, &found))
+		return found;
+
 	// Are we lucky?
 	if (File::Exists(path + filename))
 		return true;
@@ -98,7 +277,7 @@ static bool FixFilenameCase(const std::string &path, std::string &filename)
 	return retValue;
 }
 
-bool FixPathCase(std::string& basePath, std::string &path, FixPathCaseBehavior behavior)
+bool FixPathCase(std::string& basePath, std::string &path, FixPathCaseBehavior behavior, PathCaseCache *cache)
 {
 	size_t len = path.size();
 
@@ -129,7 +308,7 @@ bool FixPathCase(std::string& basePath, std::string &path, FixPathCaseBehavior b
 			std::string component = path.substr(start, i - start);
 
 			// Fix case and stop on nonexistant path component
-			if (FixFilenameCase(fullPath, component) == false) {
+			if (FixFilenameCase(fullPath, component, cache) == false) {
 				// Still counts as success if partial matches allowed or if this
 				// is the last component and only the ones before it are required
 				return (behavior == FPC_PARTIAL_ALLOWED || (behavior == FPC_PATH_MUST_EXIST && i >= len));
@@ -171,7 +350,7 @@ std::string DirectoryFileHandle::GetLocalPath(std::string& basePath, std::string
 	return basePath + localpath;
 }
 
-bool DirectoryFileHandle::Open(std::string &basePath, std::string &fileName, FileAccess access, u32 &error)
+bool DirectoryFileHandle::Open(std::string &basePath, std::string &fileName, FileAccess access, u32 &error, PathCaseCache *caseCache)
 {
 	error = 0;
 
@@ -179,7 +358,7 @@ bool DirectoryFileHandle::Open(std::string &basePath, std::string &fileName, Fil
 	if (access & (FILEACCESS_APPEND|FILEACCESS_CREATE|FILEACCESS_WRITE))
 	{
 		DEBUG_LOG(FILESYS, "Checking case for path %s", fileName.c_str());
-		if ( ! FixPathCase(basePath, fileName, FPC_PATH_MUST_EXIST) )
+		if ( ! FixPathCase(basePath, fileName, FPC_PATH_MUST_EXIST, caseCache) )
 			return false;  // or go on and attempt (for a better error code than just 0?)
 	}
 	// else we try fopen first (in case we're lucky) before simulating case insensitivity
@@ -248,7 +427,7 @@ bool DirectoryFileHandle::Open(std::string &basePath, std::string &fileName, Fil
 
 #if HOST_IS_CASE_SENSITIVE
 	if (!success && !(access & FILEACCESS_CREATE)) {
-		if ( ! FixPathCase(basePath,fileName, FPC_PATH_MUST_EXIST) )
+		if ( ! FixPathCase(basePath,fileName, FPC_PATH_MUST_EXIST, caseCache) )
 			return 0;  // or go on and attempt (for a better error code than just 0?)
 		fullName = GetLocalPath(basePath,fileName); 
 		const char *fullNameC = fullName.c_str();
@@ -411,6 +590,20 @@ DirectoryFileSystem::~DirectoryFileSystem() {
 	CloseAll();
 }
 
+PathCaseCache *DirectoryFileSystem::CaseCache() {
+#if HOST_IS_CASE_SENSITIVE
+	return &caseCache_;
+#else
+	return nullptr;
+#endif
+}
+
+void DirectoryFileSystem::PathChanged(const std::string &fullPath) {
+#if HOST_IS_CASE_SENSITIVE
+	caseCache_.Invalidate(fullPath);
+#endif
+}
+
 std::string DirectoryFileSystem::GetLocalPath(std::string localpath) {
 	if (localpath.empty())
 		return basePath;
@@ -433,10 +626,22 @@ bool DirectoryFileSystem::MkDir(const std::string &dirname) {
 	// duplicate (different case) directories
 
 	std::string fixedCase = dirname;
-	if ( ! FixPathCase(basePath,fixedCase, FPC_PARTIAL_ALLOWED) )
+	if ( ! FixPathCase(basePath,fixedCase, FPC_PARTIAL_ALLOWED, CaseCache()) )
 		return false;
 
-	return File::CreateFullPath(GetLocalPath(fixedCase));
+	// The first new directory on the way is the only one whose parent's contents change.
+	std::string created = GetLocalPath(fixedCase);
+	for (size_t pos = fixedCase.find('/', 1); pos != fixedCase.npos; pos = fixedCase.find('/', pos + 1)) {
+		std::string dir = GetLocalPath(fixedCase.substr(0, pos));
+		if (!File::Exists(dir)) {
+			created = dir;
+			break;
+		}
+	}
+
+	bool result = File::CreateFullPath(GetLocalPath(fixedCase));
+	PathChanged(created);
+	return result;
 #else
 	return File::CreateFullPath(GetLocalPath(dirname));
 #endif
@@ -447,12 +652,14 @@ bool DirectoryFileSystem::RmDir(const std::string &dirname) {
 
 #if HOST_IS_CASE_SENSITIVE
 	// Maybe we're lucky?
-	if (File::DeleteDirRecursively(fullName))
+	if (File::DeleteDirRecursively(fullName)) {
+		PathChanged(fullName);
 		return true;
+	}
 
 	// Nope, fix case and try again
 	fullName = dirname;
-	if ( ! FixPathCase(basePath,fullName, FPC_FILE_MUST_EXIST) )
+	if ( ! FixPathCase(basePath,fullName, FPC_FILE_MUST_EXIST, CaseCache()) )
 		return false;  // or go on and attempt (for a better error code than just false?)
 
 	fullName = GetLocalPath(fullName);
@@ -463,7 +670,9 @@ bool DirectoryFileSystem::RmDir(const std::string &dirname) {
 #else
 	return 0 == rmdir(fullName.c_str());
 #endif*/
-	return File::DeleteDirRecursively(fullName);
+	bool result = File::DeleteDirRecursively(fullName);
+	PathChanged(fullName);
+	return result;
 }
 
 int DirectoryFileSystem::RenameFile(const std::string &from, const std::string &to) {
@@ -487,7 +696,7 @@ int DirectoryFileSystem::RenameFile(const std::string &from, const std::string &
 
 #if HOST_IS_CASE_SENSITIVE
 	// In case TO should overwrite a file with different case
-	if ( ! FixPathCase(basePath,fullTo, FPC_PATH_MUST_EXIST) )
+	if ( ! FixPathCase(basePath,fullTo, FPC_PATH_MUST_EXIST, CaseCache()) )
 		return -1;  // or go on and attempt (for a better error code than just false?)
 #endif
 
@@ -505,7 +714,7 @@ int DirectoryFileSystem::RenameFile(const std::string &from, const std::string &
 	{
 		// May have failed due to case sensitivity on FROM, so try again
 		fullFrom = from;
-		if ( ! FixPathCase(basePath,fullFrom, FPC_FILE_MUST_EXIST) )
+		if ( ! FixPathCase(basePath,fullFrom, FPC_FILE_MUST_EXIST, CaseCache()) )
 			return -1;  // or go on and attempt (for a better error code than just false?)
 		fullFrom = GetLocalPath(fullFrom);
 
@@ -517,6 +726,11 @@ int DirectoryFileSystem::RenameFile(const std::string &from, const std::string &
 	}
 #endif
 
+	if (retValue) {
+		PathChanged(fullFrom);
+		PathChanged(fullTo);
+	}
+
 	// TODO: Better error codes.
 	return retValue ? 0 : (int)SCE_KERNEL_ERROR_ERRNO_FILE_ALREADY_EXISTS;
 }
@@ -534,7 +748,7 @@ bool DirectoryFileSystem::RemoveFile(const std::string &filename) {
 	{
 		// May have failed due to case sensitivity, so try again
 		fullName = filename;
-		if ( ! FixPathCase(basePath,fullName, FPC_FILE_MUST_EXIST) )
+		if ( ! FixPathCase(basePath,fullName, FPC_FILE_MUST_EXIST, CaseCache()) )
 			return false;  // or go on and attempt (for a better error code than just false?)
 		fullName = GetLocalPath(fullName);
 
@@ -546,13 +760,15 @@ bool DirectoryFileSystem::RemoveFile(const std::string &filename) {
 	}
 #endif
 
+	if (retValue)
+		PathChanged(fullName);
 	return retValue;
 }
 
 u32 DirectoryFileSystem::OpenFile(std::string filename, FileAccess access, const char *devicename) {
 	OpenFileEntry entry;
 	u32 err = 0;
-	bool success = entry.hFile.Open(basePath, filename, access, err);
+	bool success = entry.hFile.Open(basePath, filename, access, err, CaseCache());
 
 	if (!success) {
 #ifdef _WIN32
@@ -568,6 +784,9 @@ u32 DirectoryFileSystem::OpenFile(std::string filename, FileAccess access, const
 			entry.hFile.Seek(0,FILEMOVE_END);
 #endif
 
+		if (access & FILEACCESS_CREATE)
+			PathChanged(GetLocalPath(filename));
+
 		u32 newHandle = hAlloc->GetNewHandle();
 
 		entry.guestFilename = filename;
@@ -662,7 +881,7 @@ PSPFileInfo DirectoryFileSystem::GetFileInfo(std::string filename) {
 	std::string fullName = GetLocalPath(filename);
 	if (!File::Exists(fullName)) {
 #if HOST_IS_CASE_SENSITIVE
-		if (! FixPathCase(basePath,filename, FPC_FILE_MUST_EXIST))
+		if (! FixPathCase(basePath,filename, FPC_FILE_MUST_EXIST, CaseCache()))
 			return x;
 		fullName = GetLocalPath(filename);
 
@@ -763,7 +982,7 @@ std::vector<PSPFileInfo> DirectoryFileSystem::GetDirListing(std::string path) {
 	DIR *dp = opendir(localPath.c_str());
 
 #if HOST_IS_CASE_SENSITIVE
-	if (dp == NULL && FixPathCase(basePath,path, FPC_FILE_MUST_EXIST)) {
+	if (dp == NULL && FixPathCase(basePath,path, FPC_FILE_MUST_EXIST, CaseCache())) {
 		// May have failed due to case sensitivity, try again
 		localPath = GetLocalPath(path);
 		dp = opendir(localPath.c_str());
@@ -813,7 +1032,7 @@ u64 DirectoryFileSystem::FreeSpace(const std::string &path) {
 
 #if HOST_IS_CASE_SENSITIVE
 	std::string fixedCase = path;
-	if (res != 0 && FixPathCase(basePath, fixedCase, FPC_FILE_MUST_EXIST)) {
+	if (res != 0 && FixPathCase(basePath, fixedCase, FPC_FILE_MUST_EXIST, CaseCache())) {
 		// May have failed due to case sensitivity, try again.
 		localPath = GetLocalPath(fixedCase);
 		res = statvfs(localPath.c_str(), &diskstat);
@@ -860,7 +1079,7 @@ void DirectoryFileSystem::DoState(PointerWrap &p) {
 			p.Do(entry.guestFilename);
 			p.Do(entry.access);
 			u32 err;
-			if (!entry.hFile.Open(basePath,entry.guestFilename,entry.access, err)) {
+			if (!entry.hFile.Open(basePath,entry.guestFilename,entry.access, err, CaseCache())) {
 				ERROR_LOG(FILESYS, "Failed to reopen file while loading state: %s", entry.guestFilename.c_str());
 				continue;
 			}
@@ -20,6 +20,7 @@
 // TODO: Remove the Windows-specific code, FILE is fine there too.
 
 #include <map>
+#include <unordered_map>
 
 #include "../Core/FileSystems/FileSystem.h"
 
@@ -54,7 +55,39 @@ enum FixPathCaseBehavior {
 	FPC_PARTIAL_ALLOWED,  // don't care how many exist (mkdir recursive)
 };
 
-bool FixPathCase(std::string& basePath, std::string &path, FixPathCaseBehavior behavior);
+// Remembers what's in each directory FixPathCase looks through, by lowercase name, so it doesn't
+// have to scan them again.  Only used where inotify can tell us about changes made outside the emulator.
+class PathCaseCache {
+public:
+	PathCaseCache();
+	~PathCaseCache();
+
+	// Returns false if dir's listing isn't cached (and couldn't be), so it has to be scanned.
+	// Otherwise, found says whether filename is in it, and its case is fixed if so.
+	bool FixFilenameCase(const std::string &dir, std::string &filename, bool *found);
+	// Call after creating, removing or renaming path (a full host path) to forget its directory and anything under it.
+	void Invalidate(const std::string &path);
+
+private:
+	struct Listing {
+		std::unordered_map<std::string, std::string> names;
+		// Names that only differ by case, which the cache can't pick between.
+		bool ambiguous;
+	};
+
+	bool ReadListing(const std::string &dir, Listing &listing);
+	void PollChanges();
+	void DropTree(const std::string &dir);
+	void Clear();
+
+	std::map<std::string, Listing> dirs_;
+	std::map<int, std::string> watches_;
+	int inotify_;
+};
+
+bool FixPathCase(std::string& basePath, std::string &path, FixPathCaseBehavior behavior, PathCaseCache *cache = nullptr);
+#else
+class PathCaseCache;
 #endif
 
 struct DirectoryFileHandle
@@ -77,7 +110,7 @@ struct DirectoryFileHandle
 	}
 
 	std::string GetLocalPath(std::string& basePath, std::string localpath);
-	bool Open(std::string& basePath, std::string& fileName, FileAccess access, u32 &err);
+	bool Open(std::string& basePath, std::string& fileName, FileAccess access, u32 &err, PathCaseCache *caseCache = nullptr);
 	size_t Read(u8* pointer, s64 size);
 	size_t Write(const u8* pointer, s64 size);
 	size_t Seek(s32 position, FileMove type);
@@ -125,8 +158,13 @@ class DirectoryFileSystem : public IFileSystem {
 	std::string basePath;
 	IHandleAllocator *hAlloc;
 	int flags;
+#if HOST_IS_CASE_SENSITIVE
+	PathCaseCache caseCache_;
+#endif
 	// In case of Windows: Translate slashes, etc.
 	std::string GetLocalPath(std::string localpath);
+	PathCaseCache *CaseCache();
+	void PathChanged(const std::string &fullPath);
 };
 
 // VFSFileSystem: Ability to map in Android APK paths as well! Does not support all features, only meant for fonts.
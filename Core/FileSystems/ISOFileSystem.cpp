@@ -205,13 +205,16 @@ ISOFileSystem::ISOFileSystem(IHandleAllocator *_hAlloc, BlockDevice *_blockDevic
 
 	if (memcmp(desc.cd001, "CD001", 5)) {
 		ERROR_LOG(FILESYS, "ISO looks bogus? Giving up...");
+		treeroot->valid = true;
 		return;
 	}
 
-	u32 rootSector = desc.root.firstDataSector();
-	u32 rootSize = desc.root.dataLength();
+	treeroot->startingPosition = desc.root.firstDataSector() * 2048;
+	treeroot->size = desc.root.dataLength();
 
-	ReadDirectory(rootSector, rootSize, treeroot, 0);
+	// Only the root for now, subdirectories are read as they're looked in.
+	ReadDirectory(treeroot);
+	lastReadBlock_ = desc.root.firstDataSector() + (u32)(treeroot->size / 2048) - 1;
 }
 
 ISOFileSystem::~ISOFileSystem()
@@ -220,17 +223,90 @@ ISOFileSystem::~ISOFileSystem()
 	delete treeroot;
 }
 
-void ISOFileSystem::ReadDirectory(u32 startsector, u32 dirsize, TreeEntry *root, size_t level)
+// Lowercases and drops empty, "." and ".." components, so that any spelling of a path gives the same key.
+// Without lowercasing, gives the path the key was made from, component for component.
+static std::string PathIndexKey(const std::string &path, bool lowercase = true)
 {
-	for (u32 secnum = startsector, endsector = dirsize/2048 + startsector; secnum < endsector; ++secnum)
+	std::string key;
+	key.reserve(path.size());
+
+	size_t pos = 0;
+	while (pos < path.size())
 	{
-		u8 theSector[2048];
-		blockDevice->ReadBlock(secnum, theSector);
-		lastReadBlock_ = secnum;
+		size_t end = path.find('/', pos);
+		if (end == path.npos)
+			end = path.size();
+
+		const size_t len = end - pos;
+		if (len == 2 && path[pos] == '.' && path[pos + 1] == '.')
+		{
+			size_t slash = key.rfind('/');
+			key.resize(slash == key.npos ? 0 : slash);
+		}
+		else if (len != 0 && !(len == 1 && path[pos] == '.'))
+		{
+			if (!key.empty())
+				key.push_back('/');
+			for (size_t i = pos; i < end; ++i)
+				key.push_back(lowercase ? (char)tolower((u8)path[i]) : path[i]);
+		}
+		pos = end + 1;
+	}
+	return key;
+}
+
+void ISOFileSystem::ReadDirectory(TreeEntry *root)
+{
+	root->valid = true;
+
+	const u32 startsector = root->startingPosition / 2048;
+	u32 numSectors = (u32)(root->size / 2048);
+	if (startsector >= blockDevice->GetNumBlocks())
+	{
+		ERROR_LOG(FILESYS, "Directory %s starts past the end of the disc, corrupt iso?", EntryFullPath(root).c_str());
+		return;
+	}
+	if (numSectors > blockDevice->GetNumBlocks() - startsector)
+	{
+		ERROR_LOG(FILESYS, "Directory %s runs past the end of the disc, corrupt iso?", EntryFullPath(root).c_str());
+		numSectors = blockDevice->GetNumBlocks() - startsector;
+	}
+	if (numSectors == 0)
+		return;
+
+	// The whole directory in one go, rather than a sector at a time.
+	const u8 *sectors = blockDevice->GetBlocksPointer(startsector, numSectors);
+	std::vector<u8> buffer;
+	if (!sectors)
+	{
+		buffer.resize(numSectors * 2048);
+		if (!blockDevice->ReadBlocks(startsector, numSectors, &buffer[0]))
+		{
+			ERROR_LOG(FILESYS, "Failed to read directory %s", EntryFullPath(root).c_str());
+			return;
+		}
+		sectors = &buffer[0];
+	}
+
+	size_t level = 0;
+	for (TreeEntry *cur = root; cur != treeroot; cur = cur->parent)
+		++level;
+	const std::string keyPrefix = root == treeroot ? "" : PathIndexKey(EntryFullPath(root)) + "/";
+	// Below a name that's ambiguous by case, lookups go by exact name only, so don't index anything.
+	bool indexChildren = root == treeroot;
+	if (!indexChildren)
+	{
+		auto self = pathIndex_.find(keyPrefix.substr(0, keyPrefix.size() - 1));
+		indexChildren = self != pathIndex_.end() && self->second == root;
+	}
+
+	for (u32 i = 0; i < numSectors; ++i)
+	{
+		const u8 *theSector = sectors + i * 2048;
 
 		for (int offset = 0; offset < 2048; )
 		{
-			DirectoryEntry &dir = *(DirectoryEntry *)&theSector[offset];
+			const DirectoryEntry &dir = *(const DirectoryEntry *)&theSector[offset];
 			u8 sz = theSector[offset];
 
 			// Nothing left in this sector.  There might be more in the next one.
@@ -275,22 +351,32 @@ void ISOFileSystem::ReadDirectory(u32 startsector, u32 dirsize, TreeEntry *root,
 			// Let's not excessively spam the log - I commented this line out.
 			//DEBUG_LOG(FILESYS, "%s: %s %08x %08x %i", e->isDirectory?"D":"F", e->name.c_str(), dir.firstDataSectorLE, e->startingPosition, e->startingPosition);
 
-			if (e->isDirectory && !relative)
+			if (relative)
 			{
-				if (dir.firstDataSector() == startsector)
+				e->valid = true;
+			}
+			else
+			{
+				if (e->isDirectory)
 				{
-					ERROR_LOG(FILESYS, "WARNING: Appear to have a recursive file system, breaking recursion");
+					if (!restrictTree.empty() && !(level < restrictTree.size() && restrictTree[level] == e->name))
+					{
+						delete e;
+						continue;
+					}
+					if (dir.firstDataSector() == startsector)
+					{
+						ERROR_LOG(FILESYS, "WARNING: Appear to have a recursive file system, breaking recursion");
+						e->valid = true;
+					}
 				}
-				else
-				{
-					bool doRecurse = true;
-					if (!restrictTree.empty())
-						doRecurse = level < restrictTree.size() && restrictTree[level] == e->name;
 
-					if (doRecurse)
-						ReadDirectory(dir.firstDataSector(), dir.dataLength(), e, level + 1);
-					else
-						continue;
+				if (indexChildren)
+				{
+					// If names only differ by case, mark the key as ambiguous so lookups fall back to exact matches.
+					auto inserted = pathIndex_.insert(std::make_pair(keyPrefix + PathIndexKey(e->name), e));
+					if (!inserted.second)
+						inserted.first->second = nullptr;
 				}
 			}
 			root->children.push_back(e);
@@ -300,70 +386,73 @@ void ISOFileSystem::ReadDirectory(u32 startsector, u32 dirsize, TreeEntry *root,
 
 ISOFileSystem::TreeEntry *ISOFileSystem::GetFromPath(const std::string &path, bool catchError)
 {
-	const size_t pathLength = path.length();
-
-	if (pathLength == 0) {
+	if (path.empty()) {
 		// Ah, the device!	"umd0:"
 		return &entireISO;
 	}
 
-	size_t pathIndex = 0;
-
-	// Skip "./"
-	if (pathLength > pathIndex + 1 && path[pathIndex] == '.' && path[pathIndex + 1] == '/')
-		pathIndex += 2;
-
-	// Skip "/"
-	if (pathLength > pathIndex && path[pathIndex] == '/')
-		++pathIndex;
-
-	if (pathLength <= pathIndex)
+	const std::string key = PathIndexKey(path);
+	if (key.empty())
 		return treeroot;
 
+	auto found = pathIndex_.find(key);
+	if (found != pathIndex_.end() && found->second)
+		return found->second;
+
+	// Might be in a directory we haven't read yet, so read the ones on the way.
+	const std::string exactPath = PathIndexKey(path, false);
+	bool exact = false;
 	TreeEntry *e = treeroot;
-	while (true)
+	size_t pos = 0;
+	while (e != nullptr && pos <= key.size())
 	{
-		TreeEntry *ne = nullptr;
-		std::string name = "";
-		if (pathLength > pathIndex)
+		if (!e->isDirectory)
 		{
-			size_t nextSlashIndex = path.find_first_of('/', pathIndex);
-			if (nextSlashIndex == std::string::npos)
-				nextSlashIndex = pathLength;
+			e = nullptr;
+			break;
+		}
+		if (!e->valid)
+			ReadDirectory(e);
 
-			const std::string firstPathComponent = path.substr(pathIndex, nextSlashIndex - pathIndex);
-			for (size_t i = 0; i < e->children.size(); i++)
+		size_t end = key.find('/', pos);
+		if (end == key.npos)
+			end = key.size();
+
+		if (!exact)
+		{
+			found = pathIndex_.find(key.substr(0, end));
+			if (found == pathIndex_.end())
 			{
-				const std::string &n = e->children[i]->name;
-				
-				if (firstPathComponent == n)
-				{
-					//yay we got it
-					ne = e->children[i];
-					name = n;
-					break;
-				}
+				e = nullptr;
+				break;
+			}
+			if (found->second)
+			{
+				e = found->second;
+				pos = end + 1;
+				continue;
 			}
+			// Names that only differ by case: like before, only the exact name will do from here on.
+			exact = true;
 		}
-		
-		if (ne)
-		{
-			e = ne;
-			pathIndex += name.length();
-			if (pathIndex < pathLength && path[pathIndex] == '/')
-				++pathIndex;
 
-			if (pathLength <= pathIndex)
-				return e;
-		}
-		else
+		const std::string name = exactPath.substr(pos, end - pos);
+		TreeEntry *match = nullptr;
+		for (size_t i = 0; i < e->children.size(); i++)
 		{
-			if (catchError)
-				ERROR_LOG(FILESYS,"File %s not found", path.c_str());
-
-			return 0;
+			if (e->children[i]->name == name)
+			{
+				match = e->children[i];
+				break;
+			}
 		}
+		e = match;
+		pos = end + 1;
 	}
+
+	if (!e && catchError)
+		ERROR_LOG(FILESYS,"File %s not found", path.c_str());
+	return e;
 }
 
 u32 ISOFileSystem::OpenFile(std::string filename, FileAccess access, const char *devicename)
@@ -583,21 +672,30 @@ size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size, int &usec)
 		_dbg_assert_msg_(FILESYS, (middleSize & 2047) == 0, "Remaining size should be aligned");
 
 		const u8 *const start = pointer;
-		if (firstBlockSize > 0) {
-			blockDevice->ReadBlock(secNum++, theSector);
-			memcpy(pointer, theSector + firstBlockOffset, firstBlockSize);
-			pointer += firstBlockSize;
-		}
-		if (middleSize > 0) {
-			const u32 sectors = (u32)(middleSize / 2048);
-			blockDevice->ReadBlocks(secNum, sectors, pointer);
-			secNum += sectors;
-			pointer += middleSize;
-		}
-		if (lastBlockSize > 0) {
-			blockDevice->ReadBlock(secNum++, theSector);
-			memcpy(pointer, theSector, lastBlockSize);
-			pointer += lastBlockSize;
+		const u32 endSecNum = (u32)((positionOnIso + size + 2047) / 2048);
+		const u8 *mapped = size > 0 ? blockDevice->GetBlocksPointer(secNum, endSecNum - secNum) : nullptr;
+		if (mapped) {
+			// The image is in memory, so copy straight into PSP RAM, partial sectors and all.
+			memcpy(pointer, mapped + firstBlockOffset, (size_t)size);
+			pointer += size;
+			secNum = endSecNum;
+		} else {
+			if (firstBlockSize > 0) {
+				blockDevice->ReadBlock(secNum++, theSector);
+				memcpy(pointer, theSector + firstBlockOffset, firstBlockSize);
+				pointer += firstBlockSize;
+			}
+			if (middleSize > 0) {
+				const u32 sectors = (u32)(middleSize / 2048);
+				blockDevice->ReadBlocks(secNum, sectors, pointer);
+				secNum += sectors;
+				pointer += middleSize;
+			}
+			if (lastBlockSize > 0) {
+				blockDevice->ReadBlock(secNum++, theSector);
+				memcpy(pointer, theSector, lastBlockSize);
+				pointer += lastBlockSize;
+			}
 		}
 
 		size_t totalBytes = pointer - start;
@@ -701,6 +799,8 @@ std::vector<PSPFileInfo> ISOFileSystem::GetDirListing(std::string path)
 	TreeEntry *entry = GetFromPath(path);
 	if (! entry)
 		return myVector;
+	if (entry->isDirectory && !entry->valid)
+		ReadDirectory(entry);
 
 	const std::string dot(".");
 	const std::string dotdot("..");
@@ -19,6 +19,7 @@
 
 #include <map>
 #include <list>
+#include <unordered_map>
 
 #include "FileSystem.h"
 
@@ -56,7 +57,7 @@ class ISOFileSystem : public IFileSystem {
 
 private:
 	struct TreeEntry {
-		TreeEntry(){}
+		TreeEntry() : valid(false) {}
 		~TreeEntry();
 
 		std::string name;
@@ -66,6 +67,8 @@ class ISOFileSystem : public IFileSystem {
 		bool isDirectory;
 
 		TreeEntry *parent;
+		// Directories are only read the first time something looks inside them.
+		bool valid;
 		std::vector<TreeEntry *> children;
 	};
 
@@ -86,11 +89,13 @@ class ISOFileSystem : public IFileSystem {
 	u32 lastReadBlock_;
 
 	TreeEntry entireISO;
+	// Every entry read so far, by lowercase path (no leading slash.)
+	std::unordered_map<std::string, TreeEntry *> pathIndex_;
 
 	// Don't use this in the emu, not savestated.
 	std::vector<std::string> restrictTree;
 
-	void ReadDirectory(u32 startsector, u32 dirsize, TreeEntry *root, size_t level);
+	void ReadDirectory(TreeEntry *root);
 	TreeEntry *GetFromPath(const std::string &path, bool catchError = true);
 	std::string EntryFullPath(TreeEntry *e);
 };
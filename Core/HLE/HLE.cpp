@@ -17,6 +17,7 @@
 
 #include <cstdarg>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <string>
 
@@ -61,7 +62,27 @@ enum
 	HLE_AFTER_SKIP_DEADBEEF     = 0x40,
 };
 
+struct HLEModuleNameHash {
+	size_t operator ()(const char *name) const {
+		// FNV-1a, module names are short.
+		u32 hash = 0x811C9DC5;
+		for (; *name; ++name)
+			hash = (hash ^ (u8)*name) * 0x01000193;
+		return hash;
+	}
+};
+
+struct HLEModuleNameEqual {
+	bool operator ()(const char *a, const char *b) const {
+		return strcmp(a, b) == 0;
+	}
+};
+
 static std::vector<HLEModule> moduleDB;
+// Indexes into moduleDB, so imports don't have to strcmp every module and scan every table.
+static std::unordered_map<const char *, int, HLEModuleNameHash, HLEModuleNameEqual> moduleIndexByName;
+// Keyed by moduleIndex << 32 | nid, gives the index into the module's funcTable.
+static std::unordered_map<u64, int> funcIndexByNID;
 static int delayedResultEvent = -1;
 static int hleAfterSyscall = HLE_AFTER_NOTHING;
 static const char *hleAfterSyscallReschedReason;
@@ -106,30 +127,42 @@ void HLEShutdown()
 	hleAfterSyscall = HLE_AFTER_NOTHING;
 	latestSyscall = nullptr;
 	moduleDB.clear();
+	moduleIndexByName.clear();
+	funcIndexByNID.clear();
 }
 
 void RegisterModule(const char *name, int numFunctions, const HLEFunction *funcTable)
 {
 	HLEModule module = {name, numFunctions, funcTable};
+	const int moduleIndex = (int)moduleDB.size();
 	moduleDB.push_back(module);
+
+	// insert() keeps the first of any duplicates, just like a search from the start would.
+	moduleIndexByName.insert(std::make_pair(name, moduleIndex));
+	for (int i = 0; i < numFunctions; i++)
+		funcIndexByNID.insert(std::make_pair(((u64)moduleIndex << 32) | funcTable[i].ID, i));
+}
+
+const HLEModule *GetModuleByIndex(int moduleIndex)
+{
+	if (moduleIndex >= 0 && moduleIndex < (int)moduleDB.size())
+		return &moduleDB[moduleIndex];
+	return nullptr;
 }
 
 int GetModuleIndex(const char *moduleName)
 {
-	for (size_t i = 0; i < moduleDB.size(); i++)
-		if (strcmp(moduleName, moduleDB[i].name) == 0)
-			return (int)i;
+	auto it = moduleIndexByName.find(moduleName);
+	if (it != moduleIndexByName.end())
+		return it->second;
 	return -1;
 }
 
 int GetFuncIndex(int moduleIndex, u32 nib)
 {
-	const HLEModule &module = moduleDB[moduleIndex];
-	for (int i = 0; i < module.numFunctions; i++)
-	{
-		if (module.funcTable[i].ID == nib)
-			return i;
-	}
+	auto it = funcIndexByNID.find(((u64)moduleIndex << 32) | nib);
+	if (it != funcIndexByNID.end())
+		return it->second;
 	return -1;
 }
 
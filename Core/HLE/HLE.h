@@ -97,6 +97,8 @@ const char *GetFuncName(int module, int func);
 const HLEFunction *GetFunc(const char *module, u32 nib);
 int GetFuncIndex(int moduleIndex, u32 nib);
 int GetModuleIndex(const char *modulename);
+// Returns nullptr past the last registered module.
+const HLEModule *GetModuleByIndex(int moduleIndex);
 
 void RegisterModule(const char *name, int numFunctions, const HLEFunction *funcTable);
 
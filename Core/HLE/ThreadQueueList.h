@@ -18,6 +18,7 @@
 #pragma once
 
 #include "Core/HLE/sceKernel.h"
+#include "Common/BitSet.h"
 #include "Common/ChunkFile.h"
 
 struct ThreadQueueList {
@@ -25,6 +26,8 @@ struct ThreadQueueList {
 	static const int NUM_QUEUES = 128;
 	// Initial number of threads a single queue can handle.
 	static const int INITIAL_CAPACITY = 32;
+	// Number of words in the bitmap of non-empty queues.
+	static const int NUM_MASK_WORDS = NUM_QUEUES / 32;
 
 	struct Queue {
 		// Next ever-been-used queue (worse priority.)
@@ -51,6 +54,7 @@ struct ThreadQueueList {
 
 	ThreadQueueList() {
 		memset(queues, 0, sizeof(queues));
+		memset(readyMask, 0, sizeof(readyMask));
 		first = invalid();
 	}
 
@@ -75,11 +79,9 @@ struct ThreadQueueList {
 	}
 
 	inline SceUID pop_first() {
-		Queue *cur = first;
-		while (cur != invalid()) {
-			if (cur->size() > 0)
-				return cur->data[cur->first++];
-			cur = cur->next;
+		for (int w = 0; w < NUM_MASK_WORDS; ++w) {
+			if (readyMask[w] != 0)
+				return pop_from(w * 32 + LeastSignificantSetBit(readyMask[w]));
 		}
 
 		_dbg_assert_msg_(SCEKERNEL, false, "ThreadQueueList should not be empty.");
@@ -87,13 +89,16 @@ struct ThreadQueueList {
 	}
 
 	inline SceUID pop_first_better(u32 priority) {
-		Queue *cur = first;
 		// Don't bother looking past (worse than) this priority.
-		Queue *stop = &queues[priority];
-		while (cur < stop) {
-			if (cur->size() > 0)
-				return cur->data[cur->first++];
-			cur = cur->next;
+		const int lastWord = (int)priority / 32;
+		for (int w = 0; w < lastWord; ++w) {
+			if (readyMask[w] != 0)
+				return pop_from(w * 32 + LeastSignificantSetBit(readyMask[w]));
+		}
+		if (lastWord < NUM_MASK_WORDS) {
+			const u32 better = readyMask[lastWord] & ((1U << (priority & 31)) - 1);
+			if (better != 0)
+				return pop_from(lastWord * 32 + LeastSignificantSetBit(better));
 		}
 
 		return 0;
@@ -102,6 +107,7 @@ struct ThreadQueueList {
 	inline void push_front(u32 priority, const SceUID threadID) {
 		Queue *cur = &queues[priority];
 		cur->data[--cur->first] = threadID;
+		mark_ready(priority);
 		// If we ran out of room toward the front, add more room for next time.
 		if (cur->first == 0)
 			rebalance(priority);
@@ -110,6 +116,7 @@ struct ThreadQueueList {
 	inline void push_back(u32 priority, const SceUID threadID) {
 		Queue *cur = &queues[priority];
 		cur->data[cur->end++] = threadID;
+		mark_ready(priority);
 		if (cur->full())
 			rebalance(priority);
 	}
@@ -128,6 +135,8 @@ struct ThreadQueueList {
 
 				// Now we're one shorter.
 				--cur->end;
+				if (cur->empty())
+					mark_empty(priority);
 				return;
 			}
 		}
@@ -153,6 +162,7 @@ struct ThreadQueueList {
 				free(queues[i].data);
 		}
 		memset(queues, 0, sizeof(queues));
+		memset(readyMask, 0, sizeof(readyMask));
 		first = invalid();
 	}
 
@@ -197,6 +207,8 @@ struct ThreadQueueList {
 				link(i, capacity);
 				cur->first = (cur->capacity - size) / 2;
 				cur->end = cur->first + size;
+				if (size != 0)
+					mark_ready(i);
 			}
 
 			if (size != 0)
@@ -209,6 +221,23 @@ struct ThreadQueueList {
 		return (Queue *)-1;
 	}
 
+	inline void mark_ready(u32 priority) {
+		readyMask[priority / 32] |= 1U << (priority & 31);
+	}
+
+	inline void mark_empty(u32 priority) {
+		readyMask[priority / 32] &= ~(1U << (priority & 31));
+	}
+
+	// Takes the first thread off a queue known to be non-empty.
+	inline SceUID pop_from(int priority) {
+		Queue *cur = &queues[priority];
+		SceUID id = cur->data[cur->first++];
+		if (cur->empty())
+			mark_empty(priority);
+		return id;
+	}
+
 	// Initialize a priority level and link to other queues.
 	void link(u32 priority, int size) {
 		_dbg_assert_msg_(SCEKERNEL, queues[priority].data == nullptr, "ThreadQueueList::Queue should only be initialized once.");
@@ -275,4 +304,6 @@ struct ThreadQueueList {
 	Queue *first;
 	// The priority level queues of thread ids.
 	Queue queues[NUM_QUEUES];
+	// One bit per priority level, set when that queue has threads in it.
+	u32 readyMask[NUM_MASK_WORDS];
 };
@@ -41,6 +41,8 @@
 #include "Core/Reporting.h"
 #include "Core/Config.h"
 #include "Core/System.h"
+#include "Core/SaveState.h"
+#include "Core/FileLoaders/CachingFileLoader.h"
 #include "Core/HLE/HLE.h"
 #include "Core/HLE/FunctionWrappers.h"
 #include "Core/HLE/sceDisplay.h"
@@ -413,6 +415,16 @@ static void CalculateFPS() {
 void __DisplayGetDebugStats(char stats[], size_t bufsize) {
 	gpu->UpdateStats();
 
+	float rewindCaptureMs;
+	int rewindBytesPerState, rewindStates, rewindTotalBytes;
+	SaveState::GetRewindStats(rewindCaptureMs, rewindBytesPerState, rewindStates, rewindTotalBytes);
+
+	u32 fileBlockReads, fileMisses, fileReadAhead, fileReadAheadUsed;
+	double fileStallTime;
+	CachingFileLoader::GetStats(fileBlockReads, fileMisses, fileReadAhead, fileReadAheadUsed, fileStallTime);
+	int fileHitPercent = fileBlockReads > 0 ? (int)(100 * (u64)(fileBlockReads - std::min(fileMisses, fileBlockReads)) / fileBlockReads) : 0;
+	int fileReadAheadPercent = fileReadAhead > 0 ? (int)(100 * (u64)fileReadAheadUsed / fileReadAhead) : 0;
+
 	float vertexAverageCycles = gpuStats.numVertsSubmitted > 0 ? (float)gpuStats.vertexGPUCycles / (float)gpuStats.numVertsSubmitted : 0.0f;
 
 	snprintf(stats, bufsize - 1,
@@ -434,9 +446,15 @@ void __DisplayGetDebugStats(char stats[], size_t bufsize) {
 		"FBOs active: %i\n"
 		"Textures active: %i, decoded: %i\n"
 		"Texture invalidations: %i\n"
+		"Texture scaling: %0.2f ms, %i pending\n"
+		"Texture decoding: %0.2f ms, %i stalls, %i pending\n"
+		"Texture dedupe: %i hits, %i KB saved\n"
+		"Tessellation: %0.2f ms, %i of %i draws cached\n"
 		"Vertex shaders loaded: %i\n"
 		"Fragment shaders loaded: %i\n"
-		"Combined shaders loaded: %i\n",
+		"Combined shaders loaded: %i\n"
+		"Rewind: %0.2f ms capture, %i KB/state, %i states (%i KB)\n"
+		"Streaming: %i%% cached, %i%% of read-ahead used, %0.2f ms stalled\n",
 		gpuStats.numVBlanks,
 		gpuStats.msProcessingDisplayLists * 1000.0f,
 		kernelStats.msInSyscalls * 1000.0f,
@@ -460,9 +478,26 @@ void __DisplayGetDebugStats(char stats[], size_t bufsize) {
 		gpuStats.numTextures,
 		gpuStats.numTexturesDecoded,
 		gpuStats.numTextureInvalidations,
+		gpuStats.msTextureScaling * 1000.0f,
+		gpuStats.numTexturesScalePending,
+		gpuStats.msTextureDecoding * 1000.0f,
+		gpuStats.numTextureDecodeStalls,
+		gpuStats.numTexturesDecodePending,
+		gpuStats.numTextureDedupeHits,
+		gpuStats.numTextureDedupeBytesSaved / 1024,
+		gpuStats.msTessellating * 1000.0f,
+		gpuStats.numTessCacheHits,
+		gpuStats.numTessCacheHits + gpuStats.numTessCacheMisses,
 		gpuStats.numVertexShaders,
 		gpuStats.numFragmentShaders,
-		gpuStats.numShaders
+		gpuStats.numShaders,
+		rewindCaptureMs,
+		rewindBytesPerState / 1024,
+		rewindStates,
+		rewindTotalBytes / 1024,
+		fileHitPercent,
+		fileReadAheadPercent,
+		fileStallTime * 1000.0
 		);
 	stats[bufsize - 1] = '\0';
 	gpuStats.ResetFrame();
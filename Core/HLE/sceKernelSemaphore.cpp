@@ -303,19 +303,20 @@ int sceKernelSignalSema(SceUID id, int signal)
 		s->ns.currentCount += signal;
 		DEBUG_LOG(SCEKERNEL, "sceKernelSignalSema(%i, %i) (count: %i -> %i)", id, signal, oldval, s->ns.currentCount);
 
-		if ((s->ns.attr & PSP_SEMA_ATTR_PRIORITY) != 0)
+		if ((s->ns.attr & PSP_SEMA_ATTR_PRIORITY) != 0 && s->waitingThreads.size() > 1)
 			std::stable_sort(s->waitingThreads.begin(), s->waitingThreads.end(), __KernelThreadSortPriority);
 
+		// The count only goes down as threads wake, so anyone who can't have it now won't
+		// get it later in this pass either.  One pass, keeping those still waiting in order.
 		bool wokeThreads = false;
-retry:
-		for (auto iter = s->waitingThreads.begin(), end = s->waitingThreads.end(); iter != end; ++iter)
+		size_t kept = 0;
+		for (size_t i = 0, n = s->waitingThreads.size(); i < n; ++i)
 		{
-			if (__KernelUnlockSemaForThread(s, *iter, error, 0, wokeThreads))
-			{
-				s->waitingThreads.erase(iter);
-				goto retry;
-			}
+			const SceUID threadID = s->waitingThreads[i];
+			if (!__KernelUnlockSemaForThread(s, threadID, error, 0, wokeThreads))
+				s->waitingThreads[kept++] = threadID;
 		}
+		s->waitingThreads.resize(kept);
 
 		if (wokeThreads)
 			hleReSchedule("semaphore signaled");
@@ -21,6 +21,7 @@
 #include "file/file_util.h"
 #include "Common/FileUtil.h"
 
+#include "Core/Config.h"
 #include "Core/FileLoaders/CachingFileLoader.h"
 #include "Core/FileLoaders/DiskCachingFileLoader.h"
 #include "Core/FileLoaders/HTTPFileLoader.h"
@@ -37,7 +38,7 @@
 FileLoader *ConstructFileLoader(const std::string &filename) {
 	if (filename.find("http://") == 0 || filename.find("https://") == 0)
 		return new CachingFileLoader(new RetryingFileLoader(new HTTPFileLoader(filename)));
-	return new LocalFileLoader(filename);
+	return new LocalFileLoader(filename, g_Config.bMemoryMapIso);
 }
 
 // TODO : improve, look in the file more
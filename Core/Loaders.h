@@ -76,6 +76,11 @@ class FileLoader {
 	virtual size_t ReadAt(s64 absolutePos, size_t bytes, void *data) {
 		return ReadAt(absolutePos, 1, bytes, data);
 	}
+	// Points straight at the data when the file is in memory (e.g. mapped), so there's no need to copy it
+	// out first.  Stays valid as long as the loader does.  Returns nullptr if not possible, then use ReadAt.
+	virtual const u8 *GetPointer(s64 absolutePos, size_t bytes) {
+		return nullptr;
+	}
 };
 
 FileLoader *ConstructFileLoader(const std::string &filename);
@@ -26,6 +26,7 @@
 #include <algorithm>
 
 #include "Common.h"
+#include "Common/FileUtil.h"
 
 #ifdef _WIN32
 #include "Common/CommonWindows.h"
@@ -43,6 +44,7 @@
 #include "Core/MIPS/JitCommon/JitBlockCache.h"
 #include "Core/MIPS/JitCommon/JitCommon.h"
 #include "Core/MIPS/JitCommon/NativeJit.h"
+#include "ext/xxhash.h"
 
 #if defined(_M_IX86) || defined(_M_X64)
 #include "Common/x64Analyzer.h"
@@ -73,8 +75,22 @@ using namespace Arm64JitConstants;
 
 const u32 INVALID_EXIT = 0xFFFFFFFF;
 
+static const char PERSISTENT_MAGIC[8] = {'p', 'p', 's', 'j', 'i', 't', 'b', 'c'};
+static const u32 PERSISTENT_VERSION = 1;
+// Don't let the file grow forever for games that generate code.
+static const u32 PERSISTENT_MAX_BLOCKS = 65536;
+
+struct PersistentCacheHeader {
+	char magic[8];
+	u32 version;
+	u32 optionsHash;
+	u32 maxExits;
+	u32 count;
+};
+
 JitBlockCache::JitBlockCache(MIPSState *mips, NativeCodeBlock *codeBlock) :
-	mips_(mips), codeBlock_(codeBlock), blocks_(0), num_blocks_(0) {
+	mips_(mips), codeBlock_(codeBlock), blocks_(0), blockEntryCounts_(0), numTierUps_(0), num_blocks_(0), persistentOptionsHash_(0),
+	persistentHits_(0), persistentMisses_(0), persistentInvalidated_(0) {
 }
 
 JitBlockCache::~JitBlockCache() {
@@ -96,12 +112,15 @@ void JitBlockCache::Init() {
 	agent = op_open_agent();
 #endif
 	blocks_ = new JitBlock[MAX_NUM_BLOCKS];
+	blockEntryCounts_ = new u32[MAX_NUM_BLOCKS];
 	Clear();
 }
 
 void JitBlockCache::Shutdown() {
 	delete [] blocks_;
 	blocks_ = 0;
+	delete [] blockEntryCounts_;
+	blockEntryCounts_ = 0;
 	num_blocks_ = 0;
 #if defined USE_OPROFILE && USE_OPROFILE
 	op_close_agent(agent);
@@ -115,6 +134,7 @@ void JitBlockCache::Shutdown() {
 // This clears the JIT cache. It's called from JitCache.cpp when the JIT cache
 // is full and when saving and loading states.
 void JitBlockCache::Clear() {
+	RecordPersistentBlocks();
 	block_map_.clear();
 	proxyBlockMap_.clear();
 	for (int i = 0; i < num_blocks_; i++)
@@ -163,6 +183,8 @@ int JitBlockCache::AllocateBlock(u32 startAddress) {
 		b.linkStatus[i] = false;
 	}
 	b.blockNum = num_blocks_;
+	b.tier = 1;
+	blockEntryCounts_[num_blocks_] = 0;
 	num_blocks_++; //commit the current block
 	return num_blocks_ - 1;
 }
@@ -190,6 +212,7 @@ void JitBlockCache::ProxyBlock(u32 rootAddress, u32 startAddress, u32 size, cons
 	}
 	b.exitAddress[0] = rootAddress;
 	b.blockNum = num_blocks_;
+	b.tier = 0;
 	b.proxyFor = new std::vector<u32>();
 	b.SetPureProxy();  // flag as pure proxy block.
 
@@ -202,12 +225,34 @@ void JitBlockCache::ProxyBlock(u32 rootAddress, u32 startAddress, u32 size, cons
 	num_blocks_++; //commit the current block
 }
 
-void JitBlockCache::AddBlockMap(int block_num) {
-	const JitBlock &b = blocks_[block_num];
+// Returns the physical [start, end) range of the block, and the pages it touches.
+static void GetBlockMapRange(const JitBlock &b, u32 &pAddr, u32 &pEnd, u32 &firstPage, u32 &lastPage) {
 	// Convert the logical address to a physical address for the block map
 	// Yeah, this'll work fine for PSP too I think.
-	u32 pAddr = b.originalAddress & 0x1FFFFFFF;
-	block_map_[std::make_pair(pAddr + 4 * b.originalSize, pAddr)] = block_num;
+	pAddr = b.originalAddress & 0x1FFFFFFF;
+	pEnd = pAddr + 4 * b.originalSize;
+	firstPage = pAddr >> JitBlockCache::BLOCK_MAP_PAGE_SHIFT;
+	lastPage = (pEnd > pAddr ? pEnd - 1 : pAddr) >> JitBlockCache::BLOCK_MAP_PAGE_SHIFT;
+}
+
+void JitBlockCache::AddBlockMap(int block_num) {
+	u32 pAddr, pEnd, firstPage, lastPage;
+	GetBlockMapRange(blocks_[block_num], pAddr, pEnd, firstPage, lastPage);
+	for (u32 page = firstPage; page <= lastPage; ++page) {
+		block_map_[page].push_back(block_num);
+	}
+}
+
+static bool EraseBlockNum(std::vector<int> &nums, int block_num) {
+	for (size_t i = 0; i < nums.size(); ++i) {
+		if (nums[i] == block_num) {
+			// Order doesn't matter, so just move the last one here.
+			nums[i] = nums.back();
+			nums.pop_back();
+			return true;
+		}
+	}
+	return false;
 }
 
 void JitBlockCache::RemoveBlockMap(int block_num) {
@@ -216,16 +261,27 @@ void JitBlockCache::RemoveBlockMap(int block_num) {
 		return;
 	}
 
-	const u32 pAddr = b.originalAddress & 0x1FFFFFFF;
-	auto it = block_map_.find(std::make_pair(pAddr + 4 * b.originalSize, pAddr));
-	if (it != block_map_.end() && it->second == (u32)block_num) {
-		block_map_.erase(it);
-	} else {
-		// It wasn't in there, or it has the wrong key.  Let's search...
-		for (auto it = block_map_.begin(); it != block_map_.end(); ++it) {
-			if (it->second == (u32)block_num) {
+	u32 pAddr, pEnd, firstPage, lastPage;
+	GetBlockMapRange(b, pAddr, pEnd, firstPage, lastPage);
+	bool found = false;
+	for (u32 page = firstPage; page <= lastPage; ++page) {
+		auto it = block_map_.find(page);
+		if (it != block_map_.end() && EraseBlockNum(it->second, block_num)) {
+			found = true;
+			if (it->second.empty()) {
 				block_map_.erase(it);
-				break;
+			}
+		}
+	}
+
+	if (!found) {
+		// It wasn't in there, or it has the wrong key.  Let's search...
+		for (auto it = block_map_.begin(); it != block_map_.end(); ) {
+			EraseBlockNum(it->second, block_num);
+			if (it->second.empty()) {
+				it = block_map_.erase(it);
+			} else {
+				++it;
 			}
 		}
 	}
@@ -365,9 +421,17 @@ int JitBlockCache::GetBlockNumberFromStartAddress(u32 addr, bool realBlocksOnly)
 }
 
 void JitBlockCache::GetBlockNumbersFromAddress(u32 em_address, std::vector<int> *block_numbers) {
-	for (int i = 0; i < num_blocks_; i++)
-		if (blocks_[i].ContainsAddress(em_address))
-			block_numbers->push_back(i);
+	auto it = block_map_.find((em_address & 0x1FFFFFFF) >> BLOCK_MAP_PAGE_SHIFT);
+	if (it == block_map_.end()) {
+		return;
+	}
+
+	size_t first = block_numbers->size();
+	for (int block_num : it->second) {
+		if (blocks_[block_num].ContainsAddress(em_address))
+			block_numbers->push_back(block_num);
+	}
+	std::sort(block_numbers->begin() + first, block_numbers->end());
 }
 
 u32 JitBlockCache::GetAddressFromBlockPtr(const u8 *ptr) const {
@@ -623,25 +687,51 @@ void JitBlockCache::InvalidateICache(u32 address, const u32 length) {
 		return;
 	}
 
-	// Blocks may start and end in overlapping ways, and destroying one invalidates iterators.
-	// So after destroying one, we start over.
-	do {
-	restart:
-		auto next = block_map_.lower_bound(std::make_pair(pAddr, 0));
-		auto last = block_map_.upper_bound(std::make_pair(pEnd + MAX_BLOCK_INSTRUCTIONS, 0));
-		// Note that if next is end(), last will be end() too (equal.)
-		for (; next != last; ++next) {
-			const u32 blockStart = next->first.second;
-			const u32 blockEnd = next->first.first;
+	const u32 firstPage = pAddr >> BLOCK_MAP_PAGE_SHIFT;
+	const u32 lastPage = (pEnd > pAddr ? pEnd - 1 : pAddr) >> BLOCK_MAP_PAGE_SHIFT;
+
+	// Destroying blocks changes the map, so gather them first.
+	std::vector<int> overlapping;
+	auto checkBlocks = [&](const std::vector<int> &nums) {
+		for (int block_num : nums) {
+			const JitBlock &b = blocks_[block_num];
+			const u32 blockStart = b.originalAddress & 0x1FFFFFFF;
+			const u32 blockEnd = blockStart + 4 * b.originalSize;
 			if (blockStart < pEnd && blockEnd > pAddr) {
-				DestroyBlock(next->second, true);
-				// Our iterator is now invalid.  Break and search again.
-				// Most of the time there shouldn't be a bunch of matching blocks.
-				goto restart;
+				overlapping.push_back(block_num);
+			}
+		}
+	};
+
+	if (lastPage - firstPage >= block_map_.size()) {
+		// Huge range (like a full memcpy), cheaper to just look at every page we have.
+		for (auto it = block_map_.begin(); it != block_map_.end(); ++it) {
+			if (it->first >= firstPage && it->first <= lastPage) {
+				checkBlocks(it->second);
 			}
 		}
-		// We got here - it wasn't in the map at all (or anymore.)
-	} while (false);
+	} else {
+		for (u32 page = firstPage; page <= lastPage; ++page) {
+			auto it = block_map_.find(page);
+			if (it != block_map_.end()) {
+				checkBlocks(it->second);
+			}
+		}
+	}
+
+	if (overlapping.empty()) {
+		return;
+	}
+
+	// Blocks spanning multiple pages will be listed multiple times.
+	std::sort(overlapping.begin(), overlapping.end());
+	overlapping.erase(std::unique(overlapping.begin(), overlapping.end()), overlapping.end());
+	for (int block_num : overlapping) {
+		// Might've been destroyed already as part of a proxy chain.
+		if (!blocks_[block_num].invalid) {
+			DestroyBlock(block_num, true);
+		}
+	}
 }
 
 void JitBlockCache::InvalidateChangedBlocks() {
@@ -678,8 +768,14 @@ void JitBlockCache::ComputeStats(BlockCacheStats &bcStats) {
 	double totalBloat = 0.0;
 	double maxBloat = 0.0;
 	double minBloat = 1000000000.0;
+	bcStats.numTier1Blocks = 0;
+	bcStats.numTier2Blocks = 0;
 	for (int i = 0; i < num_blocks_; i++) {
 		JitBlock *b = GetBlock(i);
+		if (!b->invalid && b->tier == 1)
+			bcStats.numTier1Blocks++;
+		else if (!b->invalid && b->tier == 2)
+			bcStats.numTier2Blocks++;
 		double codeSize = (double)b->codeSize;
 		if (codeSize == 0)
 			continue;
@@ -697,7 +793,198 @@ void JitBlockCache::ComputeStats(BlockCacheStats &bcStats) {
 		bcStats.bloatMap[bloat] = b->originalAddress;
 	}
 	bcStats.numBlocks = num_blocks_;
+	bcStats.numTierUps = numTierUps_;
+	bcStats.persistentHits = persistentHits_;
+	bcStats.persistentMisses = persistentMisses_;
+	bcStats.persistentInvalidated = persistentInvalidated_;
 	bcStats.minBloat = minBloat;
 	bcStats.maxBloat = maxBloat;
 	bcStats.avgBloat = totalBloat / (double)num_blocks_;
 }
+
+u32 JitBlockCache::HashBlockCode(u32 em_address, u32 size) const {
+	// Can't hash memory directly, the range may contain emuhacks from other blocks or replacements.
+	u32 code[256];
+	XXH32_state_t state;
+	XXH32_reset(&state, 0x50434A54);
+	for (u32 i = 0; i < size; i += ARRAY_SIZE(code)) {
+		const u32 count = std::min(size - i, (u32)ARRAY_SIZE(code));
+		for (u32 j = 0; j < count; ++j) {
+			code[j] = Memory::Read_Instruction(em_address + (i + j) * 4, true).encoding;
+		}
+		XXH32_update(&state, code, count * sizeof(u32));
+	}
+	return XXH32_digest(&state);
+}
+
+// Done in one go before blocks are thrown away, rather than on every FinalizeBlock(),
+// to keep hashing and allocations out of compiles.
+void JitBlockCache::RecordPersistentBlocks() {
+	if (!HasPersistentCache()) {
+		return;
+	}
+
+	for (int block_num = 0; block_num < num_blocks_; ++block_num) {
+		const JitBlock &b = blocks_[block_num];
+		// Tier 2 blocks continue across branches, so their exits aren't the next blocks.
+		if (b.invalid || b.IsPureProxy() || b.originalSize == 0 || b.tier != 1) {
+			continue;
+		}
+		if (!Memory::IsValidRange(b.originalAddress, b.originalSize * 4)) {
+			continue;
+		}
+		// If the emuhack is gone, memory was replaced (e.g. a savestate) and the code isn't ours to hash.
+		if (Memory::Read_Opcode_JIT(b.originalAddress).encoding != GetEmuHackOpForBlock(block_num).encoding) {
+			continue;
+		}
+
+		auto it = persistentBlocks_.find(b.originalAddress);
+		if (it == persistentBlocks_.end() && persistentBlocks_.size() >= PERSISTENT_MAX_BLOCKS) {
+			continue;
+		}
+
+		PersistentEntry &entry = persistentBlocks_[b.originalAddress];
+		entry.block.originalAddress = b.originalAddress;
+		entry.block.originalSize = b.originalSize;
+		entry.block.codeHash = HashBlockCode(b.originalAddress, b.originalSize);
+		for (int i = 0; i < MAX_JIT_BLOCK_EXITS; ++i) {
+			entry.block.exitAddress[i] = b.exitAddress[i];
+		}
+		entry.state = PERSISTENT_VALID;
+	}
+}
+
+bool JitBlockCache::CheckPersistentBlock(u32 em_address) {
+	if (!HasPersistentCache()) {
+		return false;
+	}
+
+	auto it = persistentBlocks_.find(em_address);
+	if (it == persistentBlocks_.end()) {
+		persistentMisses_++;
+		return false;
+	}
+
+	PersistentEntry &entry = it->second;
+	if (entry.state == PERSISTENT_UNCHECKED) {
+		const PersistentBlock &pb = entry.block;
+		bool valid = pb.originalSize != 0 && pb.originalSize <= MAX_BLOCK_INSTRUCTIONS;
+		valid = valid && Memory::IsValidRange(pb.originalAddress, pb.originalSize * 4);
+		valid = valid && HashBlockCode(pb.originalAddress, pb.originalSize) == pb.codeHash;
+		if (!valid) {
+			// Keep it for saving anyway, the code may just not be loaded yet (overlays.)
+			// If we compile the block later, it'll be rerecorded.
+			persistentInvalidated_++;
+		}
+		entry.state = valid ? PERSISTENT_VALID : PERSISTENT_INVALID;
+	} else if (entry.state == PERSISTENT_INVALID) {
+		return false;
+	}
+
+	if (entry.state == PERSISTENT_VALID) {
+		persistentHits_++;
+		return true;
+	}
+	return false;
+}
+
+int JitBlockCache::GetPersistentExits(u32 em_address, u32 exits[MAX_JIT_BLOCK_EXITS]) const {
+	auto it = persistentBlocks_.find(em_address);
+	if (it == persistentBlocks_.end() || it->second.state == PERSISTENT_INVALID) {
+		return 0;
+	}
+	int count = 0;
+	for (int i = 0; i < MAX_JIT_BLOCK_EXITS; ++i) {
+		const u32 exit = it->second.block.exitAddress[i];
+		if (exit != INVALID_EXIT && exit != em_address && persistentBlocks_.find(exit) != persistentBlocks_.end()) {
+			exits[count++] = exit;
+		}
+	}
+	return count;
+}
+
+bool JitBlockCache::LoadPersistentCache(const std::string &filename, u32 optionsHash) {
+	persistentBlocks_.clear();
+	persistentFilename_ = filename;
+	persistentOptionsHash_ = optionsHash;
+	persistentHits_ = 0;
+	persistentMisses_ = 0;
+	persistentInvalidated_ = 0;
+
+	FILE *f = File::OpenCFile(filename, "rb");
+	if (!f) {
+		return false;
+	}
+
+	PersistentCacheHeader header;
+	bool valid = true;
+	if (fread(&header, sizeof(header), 1, f) != 1) {
+		valid = false;
+	} else if (memcmp(header.magic, PERSISTENT_MAGIC, sizeof(header.magic)) != 0) {
+		valid = false;
+	} else if (header.version != PERSISTENT_VERSION || header.optionsHash != optionsHash) {
+		valid = false;
+	} else if (header.maxExits != MAX_JIT_BLOCK_EXITS || header.count > PERSISTENT_MAX_BLOCKS) {
+		valid = false;
+	}
+
+	if (valid) {
+		std::vector<PersistentBlock> loaded;
+		loaded.resize(header.count);
+		if (header.count != 0 && fread(&loaded[0], sizeof(PersistentBlock), header.count, f) != header.count) {
+			valid = false;
+		} else {
+			for (const PersistentBlock &pb : loaded) {
+				PersistentEntry &entry = persistentBlocks_[pb.originalAddress];
+				entry.block = pb;
+				entry.state = PERSISTENT_UNCHECKED;
+			}
+		}
+	}
+	fclose(f);
+
+	if (!valid) {
+		WARN_LOG(JIT, "Ignoring outdated or corrupt jit block cache %s", filename.c_str());
+		persistentBlocks_.clear();
+		return false;
+	}
+
+	INFO_LOG(JIT, "Loaded %d blocks from jit block cache", (int)persistentBlocks_.size());
+	return true;
+}
+
+bool JitBlockCache::SavePersistentCache() {
+	RecordPersistentBlocks();
+	if (!HasPersistentCache() || persistentBlocks_.empty()) {
+		return false;
+	}
+
+	FILE *f = File::OpenCFile(persistentFilename_, "wb");
+	if (!f) {
+		ERROR_LOG(JIT, "Unable to write jit block cache %s", persistentFilename_.c_str());
+		return false;
+	}
+
+	PersistentCacheHeader header;
+	memcpy(header.magic, PERSISTENT_MAGIC, sizeof(header.magic));
+	header.version = PERSISTENT_VERSION;
+	header.optionsHash = persistentOptionsHash_;
+	header.maxExits = MAX_JIT_BLOCK_EXITS;
+	header.count = (u32)persistentBlocks_.size();
+
+	std::vector<PersistentBlock> saved;
+	saved.reserve(persistentBlocks_.size());
+	for (auto it = persistentBlocks_.begin(); it != persistentBlocks_.end(); ++it) {
+		saved.push_back(it->second.block);
+	}
+
+	bool success = fwrite(&header, sizeof(header), 1, f) == 1;
+	success = success && fwrite(&saved[0], sizeof(PersistentBlock), saved.size(), f) == saved.size();
+	fclose(f);
+
+	if (!success) {
+		ERROR_LOG(JIT, "Unable to write jit block cache %s", persistentFilename_.c_str());
+		File::Delete(persistentFilename_);
+	}
+	return success;
+}
@@ -62,6 +62,16 @@ struct BlockCacheStats {
 	float maxBloat;
 	u32 maxBloatBlock;
 	std::map<float, u32> bloatMap;
+
+	// Persistent block cache, see JitBlockCache::LoadPersistentCache().
+	int persistentHits;
+	int persistentMisses;
+	int persistentInvalidated;
+
+	// Tiered compilation.
+	int numTier1Blocks;
+	int numTier2Blocks;
+	int numTierUps;
 };
 
 // Define this in order to get VTune profile support for the Jit generated code.
@@ -84,6 +94,8 @@ struct JitBlock {
 	u16 codeSize;
 	u16 originalSize;
 	u16 blockNum;
+	// 1 for blocks compiled on first use, 2 for hot blocks recompiled as superblocks.
+	u8 tier;
 
 	bool invalid;
 	bool linkStatus[MAX_JIT_BLOCK_EXITS];
@@ -107,6 +119,16 @@ struct JitBlock {
 
 typedef void (*CompiledCode)();
 
+// Describes a block seen in a previous run.  Native code isn't position independent
+// (it embeds pointers to MIPSState, the dispatcher, thunks, etc.) so we only keep enough
+// to recompile and link the block eagerly, and to check that the MIPS code is unchanged.
+struct PersistentBlock {
+	u32 originalAddress;
+	u32 originalSize;
+	u32 codeHash;
+	u32 exitAddress[MAX_JIT_BLOCK_EXITS];
+};
+
 class JitBlockCache {
 public:
 	JitBlockCache(MIPSState *mips_, NativeCodeBlock *codeBlock);
@@ -134,8 +156,7 @@ class JitBlockCache {
 
 	// slower, but can get numbers from within blocks, not just the first instruction.
 	// WARNING! WILL NOT WORK WITH JIT INLINING ENABLED (not yet a feature but will be soon)
-	// Returns a list of block numbers - only one block can start at a particular address, but they CAN overlap.
-	// This one is slow so should only be used for one-shots from the debugger UI, not for anything during runtime.
+	// Returns a list of valid block numbers - only one block can start at a particular address, but they CAN overlap.
 	void GetBlockNumbersFromAddress(u32 em_address, std::vector<int> *block_numbers);
 	int GetBlockNumberFromEmuHackOp(MIPSOpcode inst, bool ignoreBad = false) const;
 
@@ -157,10 +178,26 @@ class JitBlockCache {
 
 	int GetNumBlocks() const { return num_blocks_; }
 
+	// Incremented by the generated code on block entry, when tiered compilation is enabled.
+	u32 *GetBlockEntryCounter(int block_num) { return &blockEntryCounts_[block_num]; }
+	void RecordTierUp() { numTierUps_++; }
+
 	static int GetBlockExitSize();
 
+	// The persistent cache keeps descriptors of compiled blocks across runs, so that the jit
+	// can compile known hot paths eagerly.  optionsHash should change with anything that
+	// affects block boundaries.
+	bool LoadPersistentCache(const std::string &filename, u32 optionsHash);
+	bool SavePersistentCache();
+	bool HasPersistentCache() const { return !persistentFilename_.empty(); }
+	// Validated lazily, when a block is about to be compiled.  Updates the hit/miss counters.
+	bool CheckPersistentBlock(u32 em_address);
+	// Returns how many of the block's exits from a previous run are known blocks.
+	int GetPersistentExits(u32 em_address, u32 exits[MAX_JIT_BLOCK_EXITS]) const;
+
 	enum {
 		MAX_BLOCK_INSTRUCTIONS = 0x4000,
+		BLOCK_MAP_PAGE_SHIFT = 12,
 	};
 
 private:
@@ -172,15 +209,22 @@ class JitBlockCache {
 	void RemoveBlockMap(int block_num);
 
 	MIPSOpcode GetEmuHackOpForBlock(int block_num) const;
+	u32 HashBlockCode(u32 em_address, u32 size) const;
+	void RecordPersistentBlocks();
 
 	MIPSState *mips_;
 	NativeCodeBlock *codeBlock_;
 	JitBlock *blocks_;
+	// Kept apart from blocks_ to keep the runtime cache footprint small.
+	u32 *blockEntryCounts_;
+	int numTierUps_;
 	std::unordered_multimap<u32, int> proxyBlockMap_;
 
 	int num_blocks_;
 	std::unordered_multimap<u32, int> links_to_;
-	std::map<std::pair<u32,u32>, u32> block_map_; // (end_addr, start_addr) -> number
+	// Physical page -> numbers of the valid blocks overlapping that page.  A block is listed
+	// in every page it touches, so range lookups only visit blocks near the range.
+	std::unordered_map<u32, std::vector<int>> block_map_;
 
 	enum {
 		JITBLOCK_RANGE_SCRATCH = 0,
@@ -190,6 +234,23 @@ class JitBlockCache {
 	};
 	std::pair<u32, u32> blockMemRanges_[3];
 
+	enum PersistentState {
+		PERSISTENT_UNCHECKED,
+		PERSISTENT_VALID,
+		PERSISTENT_INVALID,
+	};
+	struct PersistentEntry {
+		PersistentBlock block;
+		PersistentState state;
+	};
+	// Survives Clear(), so that blocks dropped when the cache fills up are still saved.
+	std::unordered_map<u32, PersistentEntry> persistentBlocks_;
+	std::string persistentFilename_;
+	u32 persistentOptionsHash_;
+	int persistentHits_;
+	int persistentMisses_;
+	int persistentInvalidated_;
+
 	enum {
 		MAX_NUM_BLOCKS = 65536*2
 	};
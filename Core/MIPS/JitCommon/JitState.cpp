@@ -24,6 +24,8 @@ namespace MIPSComp {
 		enableVFPUSIMD = true;
 		// Set by Asm if needed.
 		reserveR15ForAsm = false;
+		// Set from config by the jit.
+		hotBlockThreshold = 0;
 
 		// ARM/ARM64
 		useBackJump = false;
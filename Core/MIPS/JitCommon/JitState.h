@@ -184,6 +184,8 @@ namespace MIPSComp {
 		// x86
 		bool enableVFPUSIMD;
 		bool reserveR15ForAsm;
+		// Blocks entered this many times are recompiled as superblocks.  0 disables.
+		int hotBlockThreshold;
 
 		// ARM/ARM64
 		bool useBackJump;
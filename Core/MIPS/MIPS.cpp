@@ -166,6 +166,7 @@ void MIPSState::Shutdown() {
 		delete MIPSComp::jit;
 		MIPSComp::jit = 0;
 	}
+	MIPSInterpret_ClearCache();
 }
 
 void MIPSState::Reset() {
@@ -325,12 +326,15 @@ int MIPSState::RunLoopUntil(u64 globalTicks) {
 }
 
 void MIPSState::InvalidateICache(u32 address, int length) {
-	// Only really applies to jit.
 	if (MIPSComp::jit)
 		MIPSComp::jit->InvalidateCacheAt(address, length);
+	else
+		MIPSInterpret_InvalidateCache(address, length);
 }
 
 void MIPSState::ClearJitCache() {
 	if (MIPSComp::jit)
 		MIPSComp::jit->ClearCache();
+	else
+		MIPSInterpret_ClearCache();
 }
@@ -42,8 +42,7 @@ class PspAssemblerFile: public AssemblerFile
 		Memory::Memcpy((u32)address,data,(u32)length);
 		
 		// In case this is a delay slot or combined instruction, clear cache above it too.
-		if (MIPSComp::jit)
-			MIPSComp::jit->InvalidateCacheAt((u32)(address - 4),(int)length+4);
+		currentMIPS->InvalidateICache((u32)(address - 4),(int)length+4);
 
 		address += length;
 		return true;
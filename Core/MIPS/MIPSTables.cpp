@@ -15,6 +15,9 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <map>
+#include <vector>
+
 #include "Core/Core.h"
 #include "Core/System.h"
 #include "Core/MemMap.h"
@@ -981,9 +984,162 @@ void MIPSInterpret(MIPSOpcode op) {
 #define R(i)   (curMips->r[i])
 
 
+// Decoded instructions for the interpreter, so we don't walk the tables every time we run one.
+struct DecodedInstruction {
+	MIPSOpcode op;
+	// Null for invalid instructions, which go through MIPSInterpret() for the error handling.
+	MIPSInterpretFunc func;
+};
+
+struct InterpretBlock {
+	u32 start;
+	std::vector<DecodedInstruction> instructions;
+};
+
+// Basic blocks of decoded instructions, looked up by start address.  Invalidated through
+// MIPSState::InvalidateICache() like the jit cache, but each instruction is also checked
+// against memory before running, since not all code writes come with an invalidation.
+class InterpretBlockCache {
+public:
+	InterpretBlockCache() {
+		memset(fastLookup_, 0, sizeof(fastLookup_));
+	}
+	~InterpretBlockCache() {
+		Clear();
+		FreeRetired();
+	}
+
+	// Invalidates any block previously returned, so don't hold on to them.
+	InterpretBlock *Get(u32 pc) {
+		FreeRetired();
+
+		InterpretBlock *&fast = fastLookup_[(pc >> 2) & (FAST_LOOKUP_SIZE - 1)];
+		if (fast && fast->start == pc)
+			return fast;
+
+		auto it = blocks_.find(pc);
+		if (it == blocks_.end()) {
+			if (blocks_.size() >= MAX_BLOCKS)
+				Clear();
+			it = blocks_.insert(std::make_pair(pc, Decode(pc))).first;
+		}
+		fast = it->second;
+		return fast;
+	}
+
+	void Invalidate(u32 address, int length) {
+		const u64 end = (u64)address + length;
+		// A block starting this far back could still reach address.
+		const u32 lowest = address >= MAX_BLOCK_SIZE * 4 ? address - MAX_BLOCK_SIZE * 4 : 0;
+		auto it = blocks_.lower_bound(lowest);
+		while (it != blocks_.end() && it->first < end) {
+			InterpretBlock *block = it->second;
+			if ((u64)block->start + block->instructions.size() * 4 > address) {
+				InterpretBlock *&fast = fastLookup_[(block->start >> 2) & (FAST_LOOKUP_SIZE - 1)];
+				if (fast == block)
+					fast = nullptr;
+				retired_.push_back(block);
+				blocks_.erase(it++);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	void Clear() {
+		for (auto it = blocks_.begin(); it != blocks_.end(); ++it)
+			retired_.push_back(it->second);
+		blocks_.clear();
+		memset(fastLookup_, 0, sizeof(fastLookup_));
+	}
+
+private:
+	// Syscalls can invalidate the block that's running, so blocks are only freed once
+	// the interpreter has moved on to another one.  Running a bit further on a stale
+	// block is fine, since instructions are checked against memory anyway.
+	void FreeRetired() {
+		for (size_t i = 0; i < retired_.size(); ++i)
+			delete retired_[i];
+		retired_.clear();
+	}
+
+	static void DecodeInto(InterpretBlock *block, u32 addr, const MIPSInstruction *&instr) {
+		DecodedInstruction inst;
+		inst.op = MIPSOpcode(Memory::Read_U32(addr));
+		instr = MIPSGetInstruction(inst.op);
+		inst.func = instr ? instr->interpret : nullptr;
+		block->instructions.push_back(inst);
+	}
+
+	static InterpretBlock *Decode(u32 pc) {
+		InterpretBlock *block = new InterpretBlock();
+		block->start = pc;
+		block->instructions.reserve(16);
+
+		u32 addr = pc;
+		while (block->instructions.size() < MAX_BLOCK_SIZE) {
+			// Always decode at least one, even if it's bad, so that we get the same error handling.
+			if (!block->instructions.empty() && !Memory::IsValidAddress(addr))
+				break;
+
+			const MIPSInstruction *instr;
+			DecodeInto(block, addr, instr);
+			addr += 4;
+
+			// Stop after the delay slot of a branch, we're unlikely to fall through.
+			if (instr && (instr->flags & (IS_CONDBRANCH | IS_JUMP))) {
+				if ((instr->flags & DELAYSLOT) && Memory::IsValidAddress(addr))
+					DecodeInto(block, addr, instr);
+				break;
+			}
+		}
+		return block;
+	}
+
+	enum {
+		MAX_BLOCK_SIZE = 128,
+		MAX_BLOCKS = 0x10000,
+		FAST_LOOKUP_SIZE = 0x1000,
+	};
+
+	std::map<u32, InterpretBlock *> blocks_;
+	std::vector<InterpretBlock *> retired_;
+	InterpretBlock *fastLookup_[FAST_LOOKUP_SIZE];
+};
+
+// Allocated on first use, so it doesn't depend on static destruction order.
+static InterpretBlockCache *interpretCache;
+
+void MIPSInterpret_InvalidateCache(u32 address, int length) {
+	if (interpretCache)
+		interpretCache->Invalidate(address, length);
+}
+
+void MIPSInterpret_ClearCache() {
+	if (interpretCache)
+		interpretCache->Clear();
+}
+
+static inline void RunDecodedInstruction(DecodedInstruction &inst, u32 pc) {
+	MIPSOpcode op = MIPSOpcode(Memory::Read_U32(pc));
+	if (op.encoding != inst.op.encoding) {
+		// Changed behind our back, decode it again.
+		const MIPSInstruction *instr = MIPSGetInstruction(op);
+		inst.op = op;
+		inst.func = instr ? instr->interpret : nullptr;
+	}
+	if (inst.func)
+		inst.func(op);
+	else
+		MIPSInterpret(op);
+}
+
 int MIPSInterpret_RunUntil(u64 globalTicks)
 {
 	MIPSState *curMips = currentMIPS;
+	if (!interpretCache)
+		interpretCache = new InterpretBlockCache();
+
 	while (coreState == CORE_RUNNING)
 	{
 		CoreTiming::Advance();
@@ -991,23 +1147,14 @@ int MIPSInterpret_RunUntil(u64 globalTicks)
 		// NEVER stop in a delay slot!
 		while (curMips->downcount >= 0 && coreState == CORE_RUNNING)
 		{
-			// int cycles = 0;
-			{
-				again:
-				MIPSOpcode op = MIPSOpcode(Memory::Read_U32(curMips->pc));
-				//MIPSOpcode op = Memory::Read_Opcode_JIT(mipsr4k.pc);
-				/*
-				// Choke on VFPU
-				MIPSInfo info = MIPSGetInfo(op);
-				if (info & IS_VFPU)
-				{
-					if (!Core_IsStepping() && !GetAsyncKeyState(VK_LSHIFT))
-					{
-						Core_EnableStepping(true);
-						return;
-					}
-				}*/
+			InterpretBlock *block = interpretCache->Get(curMips->pc);
+			DecodedInstruction *inst = &block->instructions[0];
+			DecodedInstruction *end = inst + block->instructions.size();
+			u32 expectedPC = block->start;
 
+			// Keep running down the block for as long as execution follows it.
+			while (true)
+			{
 		//2: check for breakpoint (VERY SLOW)
 #if defined(_DEBUG)
 				if (CBreakPoints::IsAddressBreakPoint(curMips->pc))
@@ -1018,15 +1165,18 @@ int MIPSInterpret_RunUntil(u64 globalTicks)
 						Core_EnableStepping(true);
 						if (CBreakPoints::IsTempBreakPoint(curMips->pc))
 							CBreakPoints::RemoveBreakPoint(curMips->pc);
-						break;
+						return 1;
 					}
 				}
 #endif
 
 				bool wasInDelaySlot = curMips->inDelaySlot;
 
-				MIPSInterpret(op);
+				RunDecodedInstruction(*inst, curMips->pc);
+				++inst;
+				expectedPC += 4;
 
+				bool mustContinue = false;
 				if (curMips->inDelaySlot)
 				{
 					// The reason we have to check this is the delay slot hack in Int_Syscall.
@@ -1036,15 +1186,30 @@ int MIPSInterpret_RunUntil(u64 globalTicks)
 						curMips->inDelaySlot = false;
 					}
 					curMips->downcount -= 1;
-					goto again;
+					mustContinue = true;
+				}
+				else
+				{
+					curMips->downcount -= 1;
+					if (CoreTiming::GetTicks() > globalTicks)
+					{
+						// DEBUG_LOG(CPU, "Hit the max ticks, bailing 1 : %llu, %llu", globalTicks, CoreTiming::GetTicks());
+						return 1;
+					}
+					if (curMips->downcount < 0 || coreState != CORE_RUNNING)
+						break;
 				}
-			}
 
-			curMips->downcount -= 1;
-			if (CoreTiming::GetTicks() > globalTicks)
-			{
-				// DEBUG_LOG(CPU, "Hit the max ticks, bailing 1 : %llu, %llu", globalTicks, CoreTiming::GetTicks());
-				return 1;
+				if (inst == end || curMips->pc != expectedPC)
+				{
+					if (!mustContinue)
+						break;
+					// Can't stop here, so switch blocks right away.
+					block = interpretCache->Get(curMips->pc);
+					inst = &block->instructions[0];
+					end = inst + block->instructions.size();
+					expectedPC = block->start;
+				}
 			}
 		}
 	}
@@ -28,6 +28,7 @@
 #include "Common/MemoryUtil.h"
 
 #include "Core/MIPS/JitCommon/JitCommon.h"
+#include "Core/MIPS/JitCommon/NativeJit.h"
 #include "Core/MIPS/x86/Jit.h"
 
 using namespace Gen;
@@ -58,6 +59,10 @@ static bool enableDebug = false;
 //R14 - Pointer to fpr/gpr regs
 //R15 - Pointer to array of block pointers
 
+static void JitTierUp() {
+	MIPSComp::jit->CompileHotBlock(currentMIPS->pc);
+}
+
 void ImHere() {
 	DEBUG_LOG(CPU, "JIT Here: %08x", currentMIPS->pc);
 }
@@ -212,6 +217,14 @@ void Jit::GenerateFixedCode(JitOptions &jo) {
 	ABI_PopAllCalleeSavedRegsAndAdjustStack();
 	RET();
 
+	// Hot blocks jump here with the PC set, to get recompiled as superblocks.
+	tierUp = AlignCode16();
+	RestoreRoundingMode(true);
+	ABI_CallFunction(&JitTierUp);
+	ApplyRoundingMode(true);
+	// The new block does its own downcount check.
+	JMP(dispatcherNoCheck, true);
+
 	breakpointBailout = GetCodePtr();
 	RestoreRoundingMode(true);
 	ABI_PopAllCalleeSavedRegsAndAdjustStack();
@@ -22,6 +22,7 @@
 #include "profiler/profiler.h"
 
 #include "Common/ChunkFile.h"
+#include "Common/FileUtil.h"
 #include "Core/Core.h"
 #include "Core/MemMap.h"
 #include "Core/System.h"
@@ -29,6 +30,7 @@
 #include "Core/Config.h"
 #include "Core/Reporting.h"
 #include "Core/Debugger/SymbolMap.h"
+#include "Core/ELF/ParamSFO.h"
 #include "Core/MIPS/MIPS.h"
 #include "Core/MIPS/MIPSCodeUtils.h"
 #include "Core/MIPS/MIPSInt.h"
@@ -62,6 +64,10 @@ static u64 saved_flags;
 const bool USE_JIT_MISSMAP = false;
 static std::map<std::string, u32> notJitOps;
 
+// Maximum number of blocks compiled ahead from the persistent cache per dispatcher miss.
+// The rest stay queued for later misses, so no single miss stalls for long.
+static const int MAX_PERSISTENT_COMPILES = 4;
+
 template<typename A, typename B>
 std::pair<B,A> flip_pair(const std::pair<A,B> &p) {
 	return std::pair<B, A>(p.second, p.first);
@@ -120,10 +126,14 @@ static void JitLogMiss(MIPSOpcode op)
 #pragma warning(disable:4355)
 #endif
 Jit::Jit(MIPSState *mips)
-		: blocks(mips, this), mips_(mips) {
+		: blocks(mips, this), mips_(mips), compilingHot_(false), persistentQueueCount_(0) {
 	blocks.Init();
 	gpr.SetEmitter(this);
 	fpr.SetEmitter(this);
+	// Tier up is only useful if blocks aren't already compiled with continuation.
+	if (!jo.continueBranches || !jo.continueJumps) {
+		jo.hotBlockThreshold = std::max(0, g_Config.iJitHotBlockThreshold);
+	}
 	AllocCodeSpace(1024 * 1024 * 16);
 	GenerateFixedCode(jo);
 
@@ -131,12 +141,25 @@ Jit::Jit(MIPSState *mips)
 
 	js.startDefaultPrefix = mips_->HasDefaultPrefix();
 
+	// Homebrew usually lacks a disc ID, and isn't worth caching anyway.
+	const std::string discID = g_paramSFO.GetValueString("DISC_ID");
+	if (g_Config.bJitBlockDiskCache && !discID.empty()) {
+		// Anything that changes where blocks end must be part of this.
+		const u32 optionsHash = (jo.enableBlocklink ? 1 : 0) | (jo.immBranches ? 2 : 0) | (jo.continueBranches ? 4 : 0) | (jo.continueJumps ? 8 : 0) | (jo.continueMaxInstructions << 4);
+		const std::string dir = GetSysDirectory(DIRECTORY_CACHE);
+		if (!File::Exists(dir)) {
+			File::CreateFullPath(dir);
+		}
+		blocks.LoadPersistentCache(dir + discID + ".jitblocks", optionsHash);
+	}
+
 	// The debugger sets this so that "go" on a breakpoint will actually... go.
 	// But if they reset, we can end up hitting it by mistake, since it's based on PC and ticks.
 	CBreakPoints::SetSkipFirst(0);
 }
 
 Jit::~Jit() {
+	blocks.SavePersistentCache();
 }
 
 void Jit::DoState(PointerWrap &p)
@@ -241,6 +264,7 @@ void Jit::UpdateRoundingMode() {
 
 void Jit::ClearCache()
 {
+	persistentQueueCount_ = 0;
 	blocks.Clear();
 	ClearCodeSpace();
 	GenerateFixedCode(jo);
@@ -299,11 +323,56 @@ void Jit::Compile(u32 em_address)
 		ClearCache();
 	}
 
+	if (!compilingHot_) {
+		blocks.CheckPersistentBlock(em_address);
+	}
+
 	int block_num = blocks.AllocateBlock(em_address);
 	JitBlock *b = blocks.GetBlock(block_num);
+	b->tier = compilingHot_ ? 2 : 1;
 	DoJit(em_address, b);
 	blocks.FinalizeBlock(block_num, jo.enableBlocklink);
 
+	bool cleanSlate = CheckCleanSlate();
+	if (!cleanSlate && !compilingHot_ && blocks.HasPersistentCache()) {
+		cleanSlate = CompilePersistentExits(em_address);
+	}
+
+	if (cleanSlate) {
+		// Our assumptions are all wrong so it's clean-slate time.
+		ClearCache();
+		Compile(em_address);
+	}
+}
+
+// Called from the generated code when a block has been entered hotBlockThreshold times.
+// Recompiles it with branch and jump continuation, so the register cache stays live across
+// what used to be block boundaries.
+void Jit::CompileHotBlock(u32 em_address) {
+	int block_num = blocks.GetBlockNumberFromStartAddress(em_address);
+	if (block_num == -1) {
+		// Must've been invalidated, the dispatcher will compile it normally.
+		return;
+	}
+
+	// Blocks linking to this one get relinked to the new block when it's finalized.
+	blocks.DestroyBlock(block_num, false);
+	blocks.RecordTierUp();
+
+	const bool oldContinueBranches = jo.continueBranches;
+	const bool oldContinueJumps = jo.continueJumps;
+	jo.continueBranches = true;
+	jo.continueJumps = true;
+	compilingHot_ = true;
+
+	Compile(em_address);
+
+	compilingHot_ = false;
+	jo.continueBranches = oldContinueBranches;
+	jo.continueJumps = oldContinueJumps;
+}
+
+bool Jit::CheckCleanSlate() {
 	bool cleanSlate = false;
 
 	if (js.hasSetRounding && !js.lastSetRounding) {
@@ -323,13 +392,57 @@ void Jit::Compile(u32 em_address)
 		cleanSlate = true;
 	}
 
-	if (cleanSlate) {
-		// Our assumptions are all wrong so it's clean-slate time.
-		ClearCache();
-		Compile(em_address);
+	return cleanSlate;
+}
+
+void Jit::QueuePersistentExits(u32 em_address) {
+	u32 exits[MAX_JIT_BLOCK_EXITS];
+	const int count = blocks.GetPersistentExits(em_address, exits);
+	for (int i = 0; i < count && persistentQueueCount_ < PERSISTENT_QUEUE_SIZE; ++i) {
+		persistentQueue_[persistentQueueCount_++] = exits[i];
 	}
 }
 
+// Compiles a few of the blocks that followed em_address in previous runs, so they're linked
+// right away instead of each going through the dispatcher on first use.  The rest are left
+// queued for the next miss.  Returns true if the jit needs a clean slate.
+bool Jit::CompilePersistentExits(u32 em_address) {
+	QueuePersistentExits(em_address);
+
+	// DoJit() compiles at the PC.
+	const u32 savedPC = mips_->pc;
+	bool cleanSlate = false;
+	int remaining = MAX_PERSISTENT_COMPILES;
+	while (persistentQueueCount_ > 0 && remaining > 0) {
+		const u32 addr = persistentQueue_[--persistentQueueCount_];
+
+		if (blocks.GetBlockNumberFromStartAddress(addr) != -1) {
+			continue;
+		}
+		if (GetSpaceLeft() < 0x10000 || blocks.IsFull()) {
+			break;
+		}
+		if (!blocks.CheckPersistentBlock(addr)) {
+			continue;
+		}
+
+		mips_->pc = addr;
+		int block_num = blocks.AllocateBlock(addr);
+		DoJit(addr, blocks.GetBlock(block_num));
+		blocks.FinalizeBlock(block_num, jo.enableBlocklink);
+		--remaining;
+
+		if (CheckCleanSlate()) {
+			cleanSlate = true;
+			break;
+		}
+		QueuePersistentExits(addr);
+	}
+	mips_->pc = savedPC;
+
+	return cleanSlate;
+}
+
 void Jit::RunLoopUntil(u64 globalticks)
 {
 	PROFILE_THIS_SCOPE("jit");
@@ -368,6 +481,24 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b)
 
 	b->normalEntry = GetCodePtr();
 
+	if (jo.hotBlockThreshold > 0 && !compilingHot_) {
+		// Count entries, so we can recompile the block once it's hot.  No regs are cached yet,
+		// and the flags from the downcount check are already consumed, so RAX and flags are free.
+		u32 *counter = blocks.GetBlockEntryCounter(b->blockNum);
+#ifdef _M_X64
+		MOV(64, R(RAX), ImmPtr(counter));
+		ADD(32, MatR(RAX), Imm8(1));
+		CMP(32, MatR(RAX), Imm32(jo.hotBlockThreshold));
+#else
+		ADD(32, M(counter), Imm8(1));
+		CMP(32, M(counter), Imm32(jo.hotBlockThreshold));
+#endif
+		FixupBranch notHot = J_CC(CC_NE);
+		MOV(32, M(&mips_->pc), Imm32(js.blockStart));
+		JMP(tierUp, true);
+		SetJumpTarget(notHot);
+	}
+
 	MIPSAnalyst::AnalysisResults analysis = MIPSAnalyst::Analyze(em_address);
 
 	gpr.Start(mips_, &js, &jo, analysis);
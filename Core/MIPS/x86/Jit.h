@@ -63,6 +63,7 @@ class Jit : public Gen::XCodeBlock
 	void RunLoopUntil(u64 globalticks);
 
 	void Compile(u32 em_address);	// Compiles a block at current MIPS PC
+	void CompileHotBlock(u32 em_address);
 	const u8 *DoJit(u32 em_address, JitBlock *b);
 
 	bool DescribeCodePtr(const u8 *ptr, std::string &name);
@@ -175,6 +176,9 @@ class Jit : public Gen::XCodeBlock
 
 private:
 	void GenerateFixedCode(JitOptions &jo);
+	bool CheckCleanSlate();
+	void QueuePersistentExits(u32 em_address);
+	bool CompilePersistentExits(u32 em_address);
 	void GetStateAndFlushAll(RegCacheState &state);
 	void RestoreState(const RegCacheState& state);
 	void FlushAll();
@@ -302,6 +306,11 @@ class Jit : public Gen::XCodeBlock
 	JitSafeMemFuncs safeMemFuncs;
 
 	MIPSState *mips_;
+	bool compilingHot_;
+	// Blocks predicted by the persistent cache, compiled a few at a time on dispatcher misses.
+	enum { PERSISTENT_QUEUE_SIZE = 256 };
+	u32 persistentQueue_[PERSISTENT_QUEUE_SIZE];
+	int persistentQueueCount_;
 
 
 	const u8 *enterDispatcher;
@@ -313,6 +322,7 @@ class Jit : public Gen::XCodeBlock
 	const u8 *dispatcherInEAXNoCheck;
 
 	const u8 *breakpointBailout;
+	const u8 *tierUp;
 
 	const u8 *restoreRoundingMode;
 	const u8 *applyRoundingMode;
@@ -17,15 +17,18 @@
 
 #include <vector>
 
+#include "base/mutex.h"
 #include "base/timeutil.h"
 #include "base/NativeApp.h"
 #include "i18n/i18n.h"
+#include "thread/thread.h"
 
 #include "Common/StdMutex.h"
 #include "Common/FileUtil.h"
 #include "Common/ChunkFile.h"
 
 #include "Core/SaveState.h"
+#include "Core/StateRingbuffer.h"
 #include "Core/Config.h"
 #include "Core/Core.h"
 #include "Core/CoreTiming.h"
@@ -86,124 +89,6 @@ namespace SaveState
 		return CChunkFileReader::LoadPtr(&data[0], state);
 	}
 
-	struct StateRingbuffer
-	{
-		StateRingbuffer(int size) : first_(0), next_(0), size_(size), base_(-1)
-		{
-			states_.resize(size);
-			baseMapping_.resize(size);
-		}
-
-		CChunkFileReader::Error Save()
-		{
-			int n = next_++ % size_;
-			if ((next_ % size_) == first_)
-				++first_;
-
-			static std::vector<u8> buffer;
-			std::vector<u8> *compressBuffer = &buffer;
-			CChunkFileReader::Error err;
-
-			if (base_ == -1 || ++baseUsage_ > BASE_USAGE_INTERVAL)
-			{
-				base_ = (base_ + 1) % ARRAY_SIZE(bases_);
-				baseUsage_ = 0;
-				err = SaveToRam(bases_[base_]);
-				// Let's not bother savestating twice.
-				compressBuffer = &bases_[base_];
-			}
-			else
-				err = SaveToRam(buffer);
-
-			if (err == CChunkFileReader::ERROR_NONE)
-				Compress(states_[n], *compressBuffer, bases_[base_]);
-			else
-				states_[n].clear();
-			baseMapping_[n] = base_;
-			return err;
-		}
-
-		CChunkFileReader::Error Restore()
-		{
-			// No valid states left.
-			if (Empty())
-				return CChunkFileReader::ERROR_BAD_FILE;
-
-			int n = (--next_ + size_) % size_;
-			if (states_[n].empty())
-				return CChunkFileReader::ERROR_BAD_FILE;
-
-			static std::vector<u8> buffer;
-			Decompress(buffer, states_[n], bases_[baseMapping_[n]]);
-			return LoadFromRam(buffer);
-		}
-
-		void Compress(std::vector<u8> &result, const std::vector<u8> &state, const std::vector<u8> &base)
-		{
-			result.clear();
-			for (size_t i = 0; i < state.size(); i += BLOCK_SIZE)
-			{
-				int blockSize = std::min(BLOCK_SIZE, (int)(state.size() - i));
-				if (i + blockSize > base.size() || memcmp(&state[i], &base[i], blockSize) != 0)
-				{
-					result.push_back(1);
-					result.insert(result.end(), state.begin() + i, state.begin() +i + blockSize);
-				}
-				else
-					result.push_back(0);
-			}
-		}
-
-		void Decompress(std::vector<u8> &result, const std::vector<u8> &compressed, const std::vector<u8> &base)
-		{
-			result.clear();
-			result.reserve(base.size());
-			auto basePos = base.begin();
-			for (size_t i = 0; i < compressed.size(); )
-			{
-				if (compressed[i] == 0)
-				{
-					++i;
-					int blockSize = std::min(BLOCK_SIZE, (int)(base.size() - result.size()));
-					result.insert(result.end(), basePos, basePos + blockSize);
-					basePos += blockSize;
-				}
-				else
-				{
-					++i;
-					int blockSize = std::min(BLOCK_SIZE, (int)(compressed.size() - i));
-					result.insert(result.end(), compressed.begin() + i, compressed.begin() + i + blockSize);
-					i += blockSize;
-					basePos += blockSize;
-				}
-			}
-		}
-
-		void Clear()
-		{
-			first_ = 0;
-			next_ = 0;
-		}
-
-		bool Empty() const
-		{
-			return next_ == first_;
-		}
-
-		static const int BLOCK_SIZE;
-		// TODO: Instead, based on size of compressed state?
-		static const int BASE_USAGE_INTERVAL;
-		typedef std::vector<u8> StateBuffer;
-		int first_;
-		int next_;
-		int size_;
-		std::vector<StateBuffer> states_;
-		StateBuffer bases_[2];
-		std::vector<int> baseMapping_;
-		int base_;
-		int baseUsage_;
-	};
-
 	static bool needsProcess = false;
 	static std::vector<Operation> pending;
 	static std::recursive_mutex mutex;
@@ -211,12 +96,8 @@ namespace SaveState
 
 	// TODO: Should this be configurable?
 	static const int REWIND_NUM_STATES = 20;
-	static StateRingbuffer rewindStates(REWIND_NUM_STATES);
-	// TODO: Any reason for this to be configurable?
-	const static float rewindMaxWallFrequency = 1.0f;
+	static StateRingbuffer rewindStates(REWIND_NUM_STATES, &SaveToRam, &LoadFromRam);
 	static float rewindLastTime = 0.0f;
-	const int StateRingbuffer::BLOCK_SIZE = 8192;
-	const int StateRingbuffer::BASE_USAGE_INTERVAL = 15;
 
 	void SaveStart::DoState(PointerWrap &p)
 	{
@@ -289,6 +170,11 @@ namespace SaveState
 		return !rewindStates.Empty();
 	}
 
+	void GetRewindStats(float &captureMs, int &bytesPerState, int &numStates, int &totalBytes)
+	{
+		rewindStates.GetStats(captureMs, bytesPerState, numStates, totalBytes);
+	}
+
 	static const char *STATE_EXTENSION = "ppst";
 	static const char *SCREENSHOT_EXTENSION = "jpg";
 	// Slot utilities
@@ -487,9 +373,10 @@ namespace SaveState
 			return;
 
 		// For fast-forwarding, otherwise they may be useless and too close.
+		// Allow up to twice the rate of flips at normal speed.
 		time_update();
 		float diff = time_now() - rewindLastTime;
-		if (diff < rewindMaxWallFrequency)
+		if (diff < g_Config.iRewindFlipFrequency / 120.0f)
 			return;
 
 		rewindLastTime = time_now();
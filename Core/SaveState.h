@@ -68,6 +68,8 @@ namespace SaveState
 
 	// Returns true if there are rewind snapshots available.
 	bool CanRewind();
+	// Average capture time and compressed size of rewind snapshots, and the current totals.
+	void GetRewindStats(float &captureMs, int &bytesPerState, int &numStates, int &totalBytes);
 
 	// Returns true if a savestate has been used during this session.
 	bool HasLoadedState();
@@ -0,0 +1,320 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/basictypes.h"
+#include "base/timeutil.h"
+#include "thread/threadutil.h"
+#include "ext/snappy/snappy-c.h"
+
+#include "Common/Log.h"
+#include "Core/StateRingbuffer.h"
+
+namespace SaveState
+{
+	const int StateRingbuffer::BLOCK_SIZE = 8192;
+	const int StateRingbuffer::BASE_USAGE_INTERVAL = 15;
+	// Compressed states only, the two bases come on top of this.
+	const size_t StateRingbuffer::REWIND_MAX_BYTES = 64 * 1024 * 1024;
+
+	StateRingbuffer::StateRingbuffer(int size, const StateFunc &save, const StateFunc &load)
+		: save_(save), load_(load), next_(0), count_(0), size_(size), base_(-1), baseUsage_(0),
+		storedBytes_(0), worker_(nullptr), running_(false), compressPending_(false), pendingSlot_(-1)
+	{
+		states_.resize(size);
+		baseMapping_.resize(size, -1);
+		ResetStats();
+	}
+
+	StateRingbuffer::~StateRingbuffer()
+	{
+		if (worker_) {
+			{
+				lock_guard guard(lock_);
+				running_ = false;
+				workAvailable_.notify_one();
+			}
+			worker_->join();
+			delete worker_;
+		}
+	}
+
+	CChunkFileReader::Error StateRingbuffer::Save()
+	{
+		{
+			lock_guard guard(lock_);
+			// If the worker hasn't caught up yet, skip this one rather than stall the game.
+			if (compressPending_) {
+				stats_.skipped++;
+				return CChunkFileReader::ERROR_NONE;
+			}
+		}
+
+		// Nobody else touches the capture buffer while nothing is pending.
+		double start = real_time_now();
+		CChunkFileReader::Error err = save_(captureBuffer_);
+		double captureTime = real_time_now() - start;
+		if (err != CChunkFileReader::ERROR_NONE)
+			return err;
+
+		lock_guard guard(lock_);
+		int n = next_;
+		next_ = (next_ + 1) % size_;
+		if (count_ < size_)
+			++count_;
+		stats_.captureTime += captureTime;
+		stats_.captures++;
+
+		pendingSlot_ = n;
+		compressPending_ = true;
+		if (!worker_) {
+			running_ = true;
+			worker_ = new std::thread(std::bind(&StateRingbuffer::WorkFunc, this));
+		}
+		workAvailable_.notify_one();
+		return err;
+	}
+
+	CChunkFileReader::Error StateRingbuffer::Restore()
+	{
+		Flush();
+
+		lock_guard guard(lock_);
+		// No valid states left.
+		if (count_ == 0)
+			return CChunkFileReader::ERROR_BAD_FILE;
+
+		next_ = (next_ + size_ - 1) % size_;
+		--count_;
+		int n = next_;
+		if (states_[n].empty() || baseMapping_[n] < 0)
+			return CChunkFileReader::ERROR_BAD_FILE;
+
+		if (!Decompress(restoreBuffer_, states_[n], bases_[baseMapping_[n]]))
+			return CChunkFileReader::ERROR_BROKEN_STATE;
+		return load_(restoreBuffer_);
+	}
+
+	void StateRingbuffer::Clear()
+	{
+		Flush();
+
+		lock_guard guard(lock_);
+		if (stats_.captures != 0) {
+			INFO_LOG(COMMON, "Rewind: %d snapshots (%d skipped), capture %0.2f ms avg, %d bytes/snapshot avg, state size %d bytes",
+				stats_.captures, stats_.skipped, stats_.captureTime * 1000.0 / stats_.captures,
+				(int)(stats_.compressedBytes / std::max(stats_.compressed, 1)), (int)captureBuffer_.size());
+		}
+		ResetStats();
+
+		storedBytes_ = 0;
+		next_ = 0;
+		count_ = 0;
+		base_ = -1;
+		baseUsage_ = 0;
+		for (size_t i = 0; i < states_.size(); ++i) {
+			StateBuffer().swap(states_[i]);
+			baseMapping_[i] = -1;
+		}
+	}
+
+	bool StateRingbuffer::Empty()
+	{
+		lock_guard guard(lock_);
+		return count_ == 0;
+	}
+
+	void StateRingbuffer::GetStats(float &captureMs, int &bytesPerState, int &numStates, int &totalBytes)
+	{
+		lock_guard guard(lock_);
+		captureMs = stats_.captures == 0 ? 0.0f : (float)(stats_.captureTime * 1000.0 / stats_.captures);
+		bytesPerState = stats_.compressed == 0 ? 0 : (int)(stats_.compressedBytes / stats_.compressed);
+		numStates = count_;
+		totalBytes = (int)storedBytes_;
+	}
+
+	void StateRingbuffer::Flush()
+	{
+		lock_guard guard(lock_);
+		while (compressPending_)
+			workDone_.wait(lock_);
+	}
+
+	void StateRingbuffer::WorkFunc()
+	{
+		setCurrentThreadName("RewindCompress");
+
+		lock_guard guard(lock_);
+		while (true) {
+			while (running_ && !compressPending_)
+				workAvailable_.wait(lock_);
+			if (!running_)
+				break;
+
+			// While a state is pending, Save() leaves the buffers alone and everyone
+			// else waits in Flush(), so we don't need the lock for the heavy part.
+			int n = pendingSlot_;
+			lock_.unlock();
+			size_t compressedSize = CompressPending(n);
+			lock_.lock();
+
+			stats_.compressedBytes += compressedSize;
+			stats_.compressed++;
+			TrimToBudget(n);
+			storedBytes_ = TotalSize();
+
+			compressPending_ = false;
+			workDone_.notify_one();
+		}
+	}
+
+	size_t StateRingbuffer::CompressPending(int n)
+	{
+		if (base_ == -1 || ++baseUsage_ > BASE_USAGE_INTERVAL)
+		{
+			base_ = (base_ + 1) % ARRAY_SIZE(bases_);
+			baseUsage_ = 0;
+			bases_[base_] = captureBuffer_;
+			// Anything still pointing at the previous contents of this base is useless now.
+			for (int i = 0; i < size_; ++i) {
+				if (baseMapping_[i] == base_ && i != n) {
+					StateBuffer().swap(states_[i]);
+					baseMapping_[i] = -1;
+				}
+			}
+		}
+
+		Compress(states_[n], captureBuffer_, bases_[base_]);
+		baseMapping_[n] = base_;
+		return states_[n].size();
+	}
+
+	void StateRingbuffer::TrimToBudget(int newest)
+	{
+		size_t total = TotalSize();
+		while (total > REWIND_MAX_BYTES && count_ > 1) {
+			int oldest = (next_ + size_ - count_) % size_;
+			if (oldest == newest)
+				break;
+			total -= states_[oldest].size();
+			StateBuffer().swap(states_[oldest]);
+			baseMapping_[oldest] = -1;
+			--count_;
+		}
+	}
+
+	size_t StateRingbuffer::TotalSize() const
+	{
+		size_t total = 0;
+		for (size_t i = 0; i < states_.size(); ++i)
+			total += states_[i].size();
+		return total;
+	}
+
+	void StateRingbuffer::Compress(StateBuffer &result, const StateBuffer &state, const StateBuffer &base)
+	{
+		// First, a block delta: 0 for unchanged blocks, otherwise the block XORed with the
+		// base (mostly zeros, so it compresses well) or raw if the base is too short.
+		deltaBuffer_.clear();
+		deltaBuffer_.reserve(state.size() + state.size() / BLOCK_SIZE + 1);
+		for (size_t i = 0; i < state.size(); i += BLOCK_SIZE)
+		{
+			int blockSize = std::min(BLOCK_SIZE, (int)(state.size() - i));
+			if (i + blockSize > base.size())
+			{
+				deltaBuffer_.push_back(DELTA_RAW);
+				deltaBuffer_.insert(deltaBuffer_.end(), state.begin() + i, state.begin() + i + blockSize);
+			}
+			else if (memcmp(&state[i], &base[i], blockSize) != 0)
+			{
+				deltaBuffer_.push_back(DELTA_XOR);
+				size_t pos = deltaBuffer_.size();
+				deltaBuffer_.resize(pos + blockSize);
+				for (int j = 0; j < blockSize; ++j)
+					deltaBuffer_[pos + j] = state[i + j] ^ base[i + j];
+			}
+			else
+				deltaBuffer_.push_back(DELTA_SAME);
+		}
+
+		// Then a fast compressor over the whole thing.
+		size_t compressedSize = snappy_max_compressed_length(deltaBuffer_.size());
+		compressBuffer_.resize(compressedSize);
+		if (snappy_compress((const char *)&deltaBuffer_[0], deltaBuffer_.size(), (char *)&compressBuffer_[0], &compressedSize) != SNAPPY_OK)
+		{
+			ERROR_LOG(COMMON, "Rewind: failed to compress state");
+			result.clear();
+			return;
+		}
+		// Copy so that the stored state doesn't keep the worst case capacity around.
+		StateBuffer(compressBuffer_.begin(), compressBuffer_.begin() + compressedSize).swap(result);
+	}
+
+	bool StateRingbuffer::Decompress(StateBuffer &result, const StateBuffer &compressed, const StateBuffer &base)
+	{
+		size_t deltaSize = 0;
+		if (snappy_uncompressed_length((const char *)&compressed[0], compressed.size(), &deltaSize) != SNAPPY_OK)
+			return false;
+		deltaBuffer_.resize(deltaSize);
+		if (deltaSize == 0 || snappy_uncompress((const char *)&compressed[0], compressed.size(), (char *)&deltaBuffer_[0], &deltaSize) != SNAPPY_OK)
+			return false;
+
+		result.clear();
+		result.reserve(base.size());
+		for (size_t i = 0; i < deltaSize; )
+		{
+			u8 type = deltaBuffer_[i++];
+			size_t pos = result.size();
+			if (type == DELTA_SAME)
+			{
+				int blockSize = std::min(BLOCK_SIZE, (int)(base.size() - pos));
+				if (blockSize <= 0)
+					return false;
+				result.insert(result.end(), base.begin() + pos, base.begin() + pos + blockSize);
+			}
+			else
+			{
+				int blockSize = std::min(BLOCK_SIZE, (int)(deltaSize - i));
+				if (type == DELTA_RAW)
+				{
+					result.insert(result.end(), deltaBuffer_.begin() + i, deltaBuffer_.begin() + i + blockSize);
+				}
+				else if (type == DELTA_XOR && pos + blockSize <= base.size())
+				{
+					result.resize(pos + blockSize);
+					for (int j = 0; j < blockSize; ++j)
+						result[pos + j] = deltaBuffer_[i + j] ^ base[pos + j];
+				}
+				else
+					return false;
+				i += blockSize;
+			}
+		}
+		return true;
+	}
+
+	void StateRingbuffer::ResetStats()
+	{
+		stats_.captureTime = 0.0;
+		stats_.captures = 0;
+		stats_.skipped = 0;
+		stats_.compressedBytes = 0;
+		stats_.compressed = 0;
+	}
+};
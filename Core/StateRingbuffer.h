@@ -0,0 +1,109 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <vector>
+
+#include "base/functional.h"
+#include "base/mutex.h"
+#include "thread/thread.h"
+#include "Common/ChunkFile.h"
+
+namespace SaveState
+{
+	// Snapshots are delta encoded against a recent full "base" state and then compressed.
+	// The emulation thread only serializes the state, the rest happens on a worker thread.
+	struct StateRingbuffer
+	{
+		typedef std::vector<u8> StateBuffer;
+		// Serializes the current state into the buffer, or loads it from the buffer.
+		typedef std::function<CChunkFileReader::Error(StateBuffer &)> StateFunc;
+
+		StateRingbuffer(int size, const StateFunc &save, const StateFunc &load);
+		~StateRingbuffer();
+
+		CChunkFileReader::Error Save();
+		CChunkFileReader::Error Restore();
+		void Clear();
+		bool Empty();
+		// Waits for the worker to finish the pending state, if any.
+		void Flush();
+
+		void GetStats(float &captureMs, int &bytesPerState, int &numStates, int &totalBytes);
+
+	private:
+		void WorkFunc();
+		size_t CompressPending(int n);
+		// Drops the oldest states until we're within REWIND_MAX_BYTES again, always keeping the newest.
+		void TrimToBudget(int newest);
+		size_t TotalSize() const;
+		void Compress(StateBuffer &result, const StateBuffer &state, const StateBuffer &base);
+		bool Decompress(StateBuffer &result, const StateBuffer &compressed, const StateBuffer &base);
+		void ResetStats();
+
+		enum {
+			DELTA_SAME = 0,
+			DELTA_RAW = 1,
+			DELTA_XOR = 2,
+		};
+
+		static const int BLOCK_SIZE;
+		// TODO: Instead, based on size of compressed state?
+		static const int BASE_USAGE_INTERVAL;
+		static const size_t REWIND_MAX_BYTES;
+
+		StateFunc save_;
+		StateFunc load_;
+
+		// Slot the next state goes into, and how many valid states lead up to it.
+		int next_;
+		int count_;
+		int size_;
+		std::vector<StateBuffer> states_;
+		StateBuffer bases_[2];
+		std::vector<int> baseMapping_;
+		int base_;
+		int baseUsage_;
+
+		// Compressed size of all states, for stats.
+		size_t storedBytes_;
+
+		StateBuffer captureBuffer_;
+		StateBuffer deltaBuffer_;
+		StateBuffer compressBuffer_;
+		StateBuffer restoreBuffer_;
+
+		// Protects the ring positions and the stats.  While compressPending_ is set, the worker
+		// owns the states, bases and buffers, and anyone else needing them waits in Flush().
+		::recursive_mutex lock_;
+		::condition_variable workAvailable_;
+		::condition_variable workDone_;
+		std::thread *worker_;
+		bool running_;
+		bool compressPending_;
+		int pendingSlot_;
+
+		struct {
+			double captureTime;
+			int captures;
+			int skipped;
+			u64 compressedBytes;
+			int compressed;
+		} stats_;
+	};
+};
@@ -15,6 +15,7 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "Common/ThreadPools.h"
 #include "GPU/Common/DrawEngineCommon.h"
 #include "GPU/Common/SplineCommon.h"
 #include "GPU/Common/VertexDecoderCommon.h"
@@ -27,7 +28,10 @@
 
 #define QUAD_INDICES_MAX 65536
 
-DrawEngineCommon::DrawEngineCommon() : dec_(nullptr) {
+// Below this, waking up the workers costs more than the decoding.
+#define PARALLEL_DECODE_MIN_VERTS 8192
+
+DrawEngineCommon::DrawEngineCommon() : dec_(nullptr), tessCacheBytes_(0), tessCacheLastDecimation_(0) {
 	quadIndices_ = new u16[6 * QUAD_INDICES_MAX];
 	decJitCache_ = new VertexDecoderJitCache();
 }
@@ -50,6 +54,24 @@ VertexDecoder *DrawEngineCommon::GetVertexDecoder(u32 vtype) {
 	return dec;
 }
 
+void DrawEngineCommon::DecodeVertsRange(const VertexDecoder *dec, u8 *decoded, const void *verts, int lowerBound, int upperBound) {
+	// The step functions keep their position in the decoder, so only jitted code can run in parallel.
+	// Whatever else it writes (software skinning matrices, vertexFullAlpha) is the same from every thread.
+	const JittedVertexDecoder jitted = dec->jitted_;
+	if (!jitted || upperBound - lowerBound + 1 < PARALLEL_DECODE_MIN_VERTS) {
+		dec->DecodeVerts(decoded, verts, lowerBound, upperBound);
+		return;
+	}
+
+	const u8 *src = (const u8 *)verts;
+	const int srcSize = dec->VertexSize();
+	const int dstStride = dec->decFmt.stride;
+	// Each slice goes right where a serial decode would have put it.
+	GlobalThreadPool::Loop([=](int lower, int upper) {
+		jitted(src + lower * srcSize, decoded + (lower - lowerBound) * dstStride, upper - lower);
+	}, lowerBound, upperBound + 1);
+}
+
 struct Plane {
 	float x, y, z, w;
 	void Set(float _x, float _y, float _z, float _w) { x = _x; y = _y; z = _z; w = _w; }
@@ -301,6 +323,9 @@ u32 DrawEngineCommon::NormalizeVertices(u8 *outPtr, u8 *bufPtr, const u8 *inPtr,
 			SimpleVertex &sv = sverts[i];
 			if (vertType & GE_VTYPE_TC_MASK) {
 				reader.ReadUV(sv.uv);
+			} else {
+				sv.uv[0] = 0;  // This will get filled in during tesselation
+				sv.uv[1] = 0;
 			}
 
 			if (vertType & GE_VTYPE_COL_MASK) {
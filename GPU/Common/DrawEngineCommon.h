@@ -26,6 +26,7 @@
 #include "GPU/Common/VertexDecoderCommon.h"
 
 class VertexDecoder;
+struct SimpleVertex;
 
 enum {
 	VERTEX_BUFFER_MAX = 65536,
@@ -45,6 +46,9 @@ class DrawEngineCommon {
 
 	static u32 NormalizeVertices(u8 *outPtr, u8 *bufPtr, const u8 *inPtr, VertexDecoder *dec, int lowerBound, int upperBound, u32 vertType);
 
+	// Same as dec->DecodeVerts(), but large ranges are split up over the thread pool.
+	static void DecodeVertsRange(const VertexDecoder *dec, u8 *decoded, const void *verts, int lowerBound, int upperBound);
+
 	// Flush is normally non-virtual but here's a virtual way to call it, used by the shared spline code, which is expensive anyway.
 	// Not really sure if these wrappers are worth it...
 	virtual void DispatchFlush() = 0;
@@ -60,6 +64,13 @@ class DrawEngineCommon {
 
 	VertexDecoder *GetVertexDecoder(u32 vtype);
 
+	// Tessellated splines and beziers, keyed by their control points and parameters.
+	// Looking up copies the result into splineBuffer and quadIndices_.
+	u64 ComputeTessCacheKey(const SimpleVertex *points, int lowerBound, int upperBound, const void *indices, int indexCount, u32 vertType, const int *params, int numParams);
+	bool LookupTessCache(u64 key, int &count);
+	void AddToTessCache(u64 key, int vertexSize, int count);
+	void DecimateTessCache(int maxAge);
+
 	// Vertex collector buffers
 	u8 *decoded;
 	u16 *decIndex;
@@ -73,4 +84,15 @@ class DrawEngineCommon {
 
 	// Fixed index buffer for easy quad generation from spline/bezier
 	u16 *quadIndices_;
+
+	struct TessCacheEntry {
+		// Empty until the same patch has been seen twice, so animated ones aren't copied around.
+		std::vector<u8> verts;
+		std::vector<u16> indices;
+		int count;
+		int lastFrame;
+	};
+	std::unordered_map<u64, TessCacheEntry> tessCache_;
+	size_t tessCacheBytes_;
+	int tessCacheLastDecimation_;
 };
@@ -128,6 +128,32 @@ static bool IsReallyAClear(const TransformedVertex *transformed, int numVerts) {
 	return true;
 }
 
+#if defined(_M_SSE)
+// Vec3ByMatrix43 and Norm3ByMatrix43 for four vertices, structure of arrays.  Same order of
+// operations, so the results match the scalar ones exactly.  out must not be v.
+static inline void Vec3ByMatrix43_4(__m128 out[3], const __m128 v[3], const float m[12]) {
+	for (int i = 0; i < 3; i++) {
+		__m128 sum = _mm_add_ps(_mm_mul_ps(v[0], _mm_set1_ps(m[i])), _mm_mul_ps(v[1], _mm_set1_ps(m[i + 3])));
+		sum = _mm_add_ps(sum, _mm_mul_ps(v[2], _mm_set1_ps(m[i + 6])));
+		out[i] = _mm_add_ps(sum, _mm_set1_ps(m[i + 9]));
+	}
+}
+
+static inline void Norm3ByMatrix43_4(__m128 out[3], const __m128 v[3], const float m[12]) {
+	for (int i = 0; i < 3; i++) {
+		__m128 sum = _mm_add_ps(_mm_mul_ps(v[0], _mm_set1_ps(m[i])), _mm_mul_ps(v[1], _mm_set1_ps(m[i + 3])));
+		out[i] = _mm_add_ps(sum, _mm_mul_ps(v[2], _mm_set1_ps(m[i + 6])));
+	}
+}
+
+// Like Vec3f::Normalized().
+static inline void Normalize4(__m128 v[3]) {
+	__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(v[0], v[0]), _mm_add_ps(_mm_mul_ps(v[1], v[1]), _mm_mul_ps(v[2], v[2]))));
+	for (int i = 0; i < 3; i++)
+		v[i] = _mm_div_ps(v[i], len);
+}
+#endif
+
 void SoftwareTransform(
 	int prim, u8 *decoded, int vertexCount, u32 vertType, u16 *&inds, int indexType,
 	const DecVtxFormat &decVtxFormat, int &maxIndex, FramebufferManagerCommon *fbman, TextureCacheCommon *texCache, TransformedVertex *transformed, TransformedVertex *transformedExpanded, TransformedVertex *&drawBuffer, int &numTrans, bool &drawIndexed, SoftwareTransformResult *result, float ySign) {
@@ -211,14 +237,230 @@ void SoftwareTransform(
 			// The w of uv is also never used (hardcoded to 1.0.)
 		}
 	} else {
+		// Texture coordinate generation and the final write, shared by the scalar and SIMD paths.
+		// Expects the reader to be at the vertex already.
+		auto finishVertex = [&](int index, const float pos[3], const Vec3f &normal, const Vec3f &worldnormal, const float v[3], float fogCoef, const Vec4f &c0, const Vec4f &c1) {
+			float uv[3] = {0, 0, 1};
+			float ruv[2] = {0.0f, 0.0f};
+			if (reader.hasUV())
+				reader.ReadUV(ruv);
+
+			// Perform texture coordinate generation after the transform and lighting - one style of UV depends on lights.
+			switch (gstate.getUVGenMode()) {
+			case GE_TEXMAP_TEXTURE_COORDS:	// UV mapping
+			case GE_TEXMAP_UNKNOWN: // Seen in Riviera.  Unsure of meaning, but this works.
+				// Texture scale/offset is only performed in this mode.
+				if (scaleUV) {
+					uv[0] = ruv[0]*gstate_c.uv.uScale + gstate_c.uv.uOff;
+					uv[1] = ruv[1]*gstate_c.uv.vScale + gstate_c.uv.vOff;
+				} else {
+					uv[0] = ruv[0];
+					uv[1] = ruv[1];
+				}
+				uv[2] = 1.0f;
+				break;
+
+			case GE_TEXMAP_TEXTURE_MATRIX:
+				{
+					// Projection mapping
+					Vec3f source;
+					switch (gstate.getUVProjMode())	{
+					case GE_PROJMAP_POSITION: // Use model space XYZ as source
+						source = pos;
+						break;
+
+					case GE_PROJMAP_UV: // Use unscaled UV as source
+						source = Vec3f(ruv[0], ruv[1], 0.0f);
+						break;
+
+					case GE_PROJMAP_NORMALIZED_NORMAL: // Use normalized normal as source
+						source = normal.Normalized();
+						if (!reader.hasNormal()) {
+							ERROR_LOG_REPORT(G3D, "Normal projection mapping without normal?");
+						}
+						break;
+
+					case GE_PROJMAP_NORMAL: // Use non-normalized normal as source!
+						source = normal;
+						if (!reader.hasNormal()) {
+							ERROR_LOG_REPORT(G3D, "Normal projection mapping without normal?");
+						}
+						break;
+					}
+
+					float uvw[3];
+					Vec3ByMatrix43(uvw, &source.x, gstate.tgenMatrix);
+					uv[0] = uvw[0];
+					uv[1] = uvw[1];
+					uv[2] = uvw[2];
+				}
+				break;
+
+			case GE_TEXMAP_ENVIRONMENT_MAP:
+				// Shade mapping - use two light sources to generate U and V.
+				{
+					Vec3f lightpos0 = Vec3f(&lighter.lpos[gstate.getUVLS0() * 3]).Normalized();
+					Vec3f lightpos1 = Vec3f(&lighter.lpos[gstate.getUVLS1() * 3]).Normalized();
+
+					uv[0] = (1.0f + Dot(lightpos0, worldnormal))/2.0f;
+					uv[1] = (1.0f + Dot(lightpos1, worldnormal))/2.0f;
+					uv[2] = 1.0f;
+				}
+				break;
+
+			default:
+				// Illegal
+				ERROR_LOG_REPORT(G3D, "Impossible UV gen mode? %d", gstate.getUVGenMode());
+				break;
+			}
+
+			uv[0] = uv[0] * widthFactor;
+			uv[1] = uv[1] * heightFactor;
+
+			// TODO: Write to a flexible buffer, we don't always need all four components.
+			memcpy(&transformed[index].x, v, 3 * sizeof(float));
+			transformed[index].fog = fogCoef;
+			memcpy(&transformed[index].u, uv, 3 * sizeof(float));
+			if (flipV) {
+				transformed[index].v = 1.0f - transformed[index].v;
+			}
+			transformed[index].color0_32 = c0.ToRGBA();
+			transformed[index].color1_32 = c1.ToRGBA();
+
+			// The multiplication by the projection matrix is still performed in the vertex shader.
+			// So is vertex depth rounding, to simulate the 16-bit depth buffer.
+		};
+
 		// Okay, need to actually perform the full transform.
-		for (int index = 0; index < maxIndex; index++) {
+		int index = 0;
+#if defined(_M_SSE)
+		// Four vertices at a time, transposed so each register holds one component of all four.
+		if (g_Config.bSoftwareTransformSIMD) {
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 signBits = _mm_set1_ps(-0.0f);
+			const bool hasNormal = reader.hasNormal();
+			const int numBones = vertTypeGetNumBoneWeights(vertType);
+			const u32 materialAmbient = gstate.getMaterialAmbientRGBA();
+
+			for (; index + 4 <= maxIndex; index += 4) {
+				float pos[4][4] = {};
+				float nrm[4][4] = {};
+				float weights[4][8];
+				Vec4f unlitColor[4];
+				for (int i = 0; i < 4; i++) {
+					reader.Goto(index + i);
+					reader.ReadPos(pos[i]);
+					if (skinningEnabled)
+						reader.ReadWeights(weights[i]);
+					if (hasNormal)
+						reader.ReadNrm(nrm[i]);
+					if (reader.hasColor0())
+						reader.ReadColor0(&unlitColor[i].x);
+					else
+						unlitColor[i] = Vec4f::FromRGBA(materialAmbient);
+				}
+
+				__m128 p[4] = { _mm_loadu_ps(pos[0]), _mm_loadu_ps(pos[1]), _mm_loadu_ps(pos[2]), _mm_loadu_ps(pos[3]) };
+				_MM_TRANSPOSE4_PS(p[0], p[1], p[2], p[3]);
+				__m128 n[4] = { _mm_loadu_ps(nrm[0]), _mm_loadu_ps(nrm[1]), _mm_loadu_ps(nrm[2]), _mm_loadu_ps(nrm[3]) };
+				_MM_TRANSPOSE4_PS(n[0], n[1], n[2], n[3]);
+				__m128 col[4] = { unlitColor[0].vec, unlitColor[1].vec, unlitColor[2].vec, unlitColor[3].vec };
+				_MM_TRANSPOSE4_PS(col[0], col[1], col[2], col[3]);
+
+				__m128 out[4];
+				__m128 normal[4] = { zero, zero, _mm_set1_ps(1.0f), zero };
+				__m128 worldnormal[4] = { zero, zero, _mm_set1_ps(1.0f), zero };
+				if (!skinningEnabled) {
+					Vec3ByMatrix43_4(out, p, gstate.worldMatrix);
+					if (hasNormal) {
+						for (int j = 0; j < 3; j++)
+							normal[j] = n[j];
+					}
+				} else {
+					// Skinning
+					__m128 psum[3] = { zero, zero, zero };
+					__m128 nsum[3] = { zero, zero, zero };
+					for (int b = 0; b < numBones; b++) {
+						__m128 w = _mm_setr_ps(weights[0][b], weights[1][b], weights[2][b], weights[3][b]);
+						// Lanes with zero weights skip the bone, like below.
+						__m128 used = _mm_cmpneq_ps(w, zero);
+						if (_mm_movemask_ps(used) == 0)
+							continue;
+						__m128 tpos[3];
+						Vec3ByMatrix43_4(tpos, p, gstate.boneMatrix + b * 12);
+						for (int j = 0; j < 3; j++)
+							psum[j] = _mm_add_ps(psum[j], _mm_and_ps(used, _mm_mul_ps(tpos[j], w)));
+						if (hasNormal) {
+							__m128 tnorm[3];
+							Norm3ByMatrix43_4(tnorm, n, gstate.boneMatrix + b * 12);
+							for (int j = 0; j < 3; j++)
+								nsum[j] = _mm_add_ps(nsum[j], _mm_and_ps(used, _mm_mul_ps(tnorm[j], w)));
+						}
+					}
+
+					// Yes, we really must multiply by the world matrix too.
+					Vec3ByMatrix43_4(out, psum, gstate.worldMatrix);
+					if (hasNormal) {
+						for (int j = 0; j < 3; j++)
+							normal[j] = nsum[j];
+					}
+				}
+				if (hasNormal) {
+					if (gstate.areNormalsReversed()) {
+						for (int j = 0; j < 3; j++)
+							normal[j] = _mm_xor_ps(normal[j], signBits);
+					}
+					Norm3ByMatrix43_4(worldnormal, normal, gstate.worldMatrix);
+					Normalize4(worldnormal);
+				}
+
+				__m128 c0[4];
+				__m128 c1[4] = { zero, zero, zero, zero };
+				if (gstate.isLightingEnabled()) {
+					__m128 litColor1[4];
+					lighter.Light4(c0, litColor1, col, out, worldnormal);
+					for (int j = 0; j < 4; j++) {
+						if (lmode) {
+							// Separate colors
+							c1[j] = litColor1[j];
+						} else {
+							// Summed color into c0 (will clamp in ToRGBA().)
+							c0[j] = _mm_add_ps(c0[j], litColor1[j]);
+						}
+					}
+				} else {
+					for (int j = 0; j < 4; j++)
+						c0[j] = col[j];
+				}
+
+				// Transform the coord by the view matrix, and put the fog coefficient in the fourth lane.
+				__m128 v[4];
+				Vec3ByMatrix43_4(v, out, gstate.viewMatrix);
+				v[3] = _mm_mul_ps(_mm_add_ps(v[2], _mm_set1_ps(fog_end)), _mm_set1_ps(fog_slope));
+
+				// Back to one vertex per register.
+				_MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+				_MM_TRANSPOSE4_PS(normal[0], normal[1], normal[2], normal[3]);
+				_MM_TRANSPOSE4_PS(worldnormal[0], worldnormal[1], worldnormal[2], worldnormal[3]);
+				_MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+				_MM_TRANSPOSE4_PS(c1[0], c1[1], c1[2], c1[3]);
+				for (int i = 0; i < 4; i++) {
+					float vf[4];
+					_mm_storeu_ps(vf, v[i]);
+					reader.Goto(index + i);
+					finishVertex(index + i, pos[i], Vec3f(normal[i]), Vec3f(worldnormal[i]), vf, vf[3], Vec4f(c0[i]), Vec4f(c1[i]));
+				}
+			}
+		}
+#endif
+
+		// The rest, one by one.
+		for (; index < maxIndex; index++) {
 			reader.Goto(index);
 
 			float v[3] = {0, 0, 0};
 			Vec4f c0 = Vec4f(1, 1, 1, 1);
 			Vec4f c1 = Vec4f(0, 0, 0, 0);
-			float uv[3] = {0, 0, 1};
 			float fogCoef = 1.0f;
 
 			// We do software T&L for now
@@ -313,98 +555,11 @@ void SoftwareTransform(
 				}
 			}
 
-			float ruv[2] = {0.0f, 0.0f};
-			if (reader.hasUV())
-				reader.ReadUV(ruv);
-
-			// Perform texture coordinate generation after the transform and lighting - one style of UV depends on lights.
-			switch (gstate.getUVGenMode()) {
-			case GE_TEXMAP_TEXTURE_COORDS:	// UV mapping
-			case GE_TEXMAP_UNKNOWN: // Seen in Riviera.  Unsure of meaning, but this works.
-				// Texture scale/offset is only performed in this mode.
-				if (scaleUV) {
-					uv[0] = ruv[0]*gstate_c.uv.uScale + gstate_c.uv.uOff;
-					uv[1] = ruv[1]*gstate_c.uv.vScale + gstate_c.uv.vOff;
-				} else {
-					uv[0] = ruv[0];
-					uv[1] = ruv[1];
-				}
-				uv[2] = 1.0f;
-				break;
-
-			case GE_TEXMAP_TEXTURE_MATRIX:
-				{
-					// Projection mapping
-					Vec3f source;
-					switch (gstate.getUVProjMode())	{
-					case GE_PROJMAP_POSITION: // Use model space XYZ as source
-						source = pos;
-						break;
-
-					case GE_PROJMAP_UV: // Use unscaled UV as source
-						source = Vec3f(ruv[0], ruv[1], 0.0f);
-						break;
-
-					case GE_PROJMAP_NORMALIZED_NORMAL: // Use normalized normal as source
-						source = normal.Normalized();
-						if (!reader.hasNormal()) {
-							ERROR_LOG_REPORT(G3D, "Normal projection mapping without normal?");
-						}
-						break;
-
-					case GE_PROJMAP_NORMAL: // Use non-normalized normal as source!
-						source = normal;
-						if (!reader.hasNormal()) {
-							ERROR_LOG_REPORT(G3D, "Normal projection mapping without normal?");
-						}
-						break;
-					}
-
-					float uvw[3];
-					Vec3ByMatrix43(uvw, &source.x, gstate.tgenMatrix);
-					uv[0] = uvw[0];
-					uv[1] = uvw[1];
-					uv[2] = uvw[2];
-				}
-				break;
-
-			case GE_TEXMAP_ENVIRONMENT_MAP:
-				// Shade mapping - use two light sources to generate U and V.
-				{
-					Vec3f lightpos0 = Vec3f(&lighter.lpos[gstate.getUVLS0() * 3]).Normalized();
-					Vec3f lightpos1 = Vec3f(&lighter.lpos[gstate.getUVLS1() * 3]).Normalized();
-
-					uv[0] = (1.0f + Dot(lightpos0, worldnormal))/2.0f;
-					uv[1] = (1.0f + Dot(lightpos1, worldnormal))/2.0f;
-					uv[2] = 1.0f;
-				}
-				break;
-
-			default:
-				// Illegal
-				ERROR_LOG_REPORT(G3D, "Impossible UV gen mode? %d", gstate.getUVGenMode());
-				break;
-			}
-
-			uv[0] = uv[0] * widthFactor;
-			uv[1] = uv[1] * heightFactor;
-
 			// Transform the coord by the view matrix.
 			Vec3ByMatrix43(v, out, gstate.viewMatrix);
 			fogCoef = (v[2] + fog_end) * fog_slope;
 
-			// TODO: Write to a flexible buffer, we don't always need all four components.
-			memcpy(&transformed[index].x, v, 3 * sizeof(float));
-			transformed[index].fog = fogCoef;
-			memcpy(&transformed[index].u, uv, 3 * sizeof(float));
-			if (flipV) {
-				transformed[index].v = 1.0f - transformed[index].v;
-			}
-			transformed[index].color0_32 = c0.ToRGBA();
-			transformed[index].color1_32 = c1.ToRGBA();
-
-			// The multiplication by the projection matrix is still performed in the vertex shader.
-			// So is vertex depth rounding, to simulate the 16-bit depth buffer.
+			finishVertex(index, pos, normal, worldnormal, v, fogCoef, c0, c1);
 		}
 	}
 
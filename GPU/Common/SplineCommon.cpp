@@ -18,6 +18,7 @@
 #include <string.h>
 #include <algorithm>
 
+#include "base/timeutil.h"
 #include "profiler/profiler.h"
 
 #include "Common/CPUDetect.h"
@@ -25,7 +26,9 @@
 
 #include "GPU/Common/SplineCommon.h"
 #include "GPU/Common/DrawEngineCommon.h"
+#include "GPU/Common/TextureDecoder.h"
 #include "GPU/ge_constants.h"
+#include "GPU/GPU.h"
 #include "GPU/GPUState.h"  // only needed for UVScale stuff
 
 #if defined(_M_SSE)
@@ -124,14 +127,26 @@ inline float bern2deriv(float x) { return 3 * (2 - 3 * x) * x; }
 inline float bern3deriv(float x) { return 3 * x * x; }
 
 // http://en.wikipedia.org/wiki/Bernstein_polynomial
-static Vec3Packedf Bernstein3D(const Vec3Packedf& p0, const Vec3Packedf& p1, const Vec3Packedf& p2, const Vec3Packedf& p3, float x) {
-	if (x == 0) return p0;
-	else if (x == 1) return p3;
-	return p0 * bern0(x) + p1 * bern1(x) + p2 * bern2(x) + p3 * bern3(x);
+// The weights only depend on u or v, so they're computed once per row or column, not per vertex.
+static inline Vec4f BernsteinWeights(float x) {
+	return Vec4f(bern0(x), bern1(x), bern2(x), bern3(x));
 }
 
-static Vec3Packedf Bernstein3DDerivative(const Vec3Packedf& p0, const Vec3Packedf& p1, const Vec3Packedf& p2, const Vec3Packedf& p3, float x) {
-	return p0 * bern0deriv(x) + p1 * bern1deriv(x) + p2 * bern2deriv(x) + p3 * bern3deriv(x);
+static inline Vec4f BernsteinDerivativeWeights(float x) {
+	return Vec4f(bern0deriv(x), bern1deriv(x), bern2deriv(x), bern3deriv(x));
+}
+
+// p[0] * w.x + p[1] * w.y + p[2] * w.z + p[3] * w.w, in that order.
+static inline Vec3f Bernstein3D(const Vec3f p[4], const Vec4f &w) {
+#ifdef _M_SSE
+	__m128 r = _mm_mul_ps(p[0].vec, _mm_shuffle_ps(w.vec, w.vec, _MM_SHUFFLE(0, 0, 0, 0)));
+	r = _mm_add_ps(r, _mm_mul_ps(p[1].vec, _mm_shuffle_ps(w.vec, w.vec, _MM_SHUFFLE(1, 1, 1, 1))));
+	r = _mm_add_ps(r, _mm_mul_ps(p[2].vec, _mm_shuffle_ps(w.vec, w.vec, _MM_SHUFFLE(2, 2, 2, 2))));
+	r = _mm_add_ps(r, _mm_mul_ps(p[3].vec, _mm_shuffle_ps(w.vec, w.vec, _MM_SHUFFLE(3, 3, 3, 3))));
+	return Vec3f(r);
+#else
+	return p[0] * w.x + p[1] * w.y + p[2] * w.z + p[3] * w.w;
+#endif
 }
 
 static void spline_n_4(int i, float t, float *knot, float *splineVal) {
@@ -626,60 +641,45 @@ static void _BezierPatchHighQuality(u8 *&dest, u16 *&indices, int &count, int te
 	// First compute all the vertices and put them in an array
 	SimpleVertex *&vertices = (SimpleVertex*&)dest;
 
-	Vec3Packedf *horiz = new Vec3Packedf[(tess_u + 1) * 4];
-	Vec3Packedf *horiz2 = horiz + (tess_u + 1) * 1;
-	Vec3Packedf *horiz3 = horiz + (tess_u + 1) * 2;
-	Vec3Packedf *horiz4 = horiz + (tess_u + 1) * 3;
+	Vec3f controls[16];
+	for (int i = 0; i < 16; i++)
+		controls[i] = Vec3f(patch.points[i]->pos.x, patch.points[i]->pos.y, patch.points[i]->pos.z);
 
-	Vec3Packedf *derivU1 = new Vec3Packedf[(tess_u + 1) * 4];
-	Vec3Packedf *derivU2 = derivU1 + (tess_u + 1) * 1;
-	Vec3Packedf *derivU3 = derivU1 + (tess_u + 1) * 2;
-	Vec3Packedf *derivU4 = derivU1 + (tess_u + 1) * 3;
+	// The four horizontal curves (and their derivatives) at each u, interleaved so that
+	// horiz[i * 4 + row] are the four control points of the vertical curve at u.
+	Vec3f *horiz = new Vec3f[(tess_u + 1) * 4];
+	Vec3f *derivU = new Vec3f[(tess_u + 1) * 4];
 
 	bool computeNormals = patch.computeNormals;
 
 	// Precompute the horizontal curves to we only have to evaluate the vertical ones.
 	for (int i = 0; i < tess_u + 1; i++) {
 		float u = ((float)i / (float)tess_u);
-		horiz[i] = Bernstein3D(patch.points[0]->pos, patch.points[1]->pos, patch.points[2]->pos, patch.points[3]->pos, u);
-		horiz2[i] = Bernstein3D(patch.points[4]->pos, patch.points[5]->pos, patch.points[6]->pos, patch.points[7]->pos, u);
-		horiz3[i] = Bernstein3D(patch.points[8]->pos, patch.points[9]->pos, patch.points[10]->pos, patch.points[11]->pos, u);
-		horiz4[i] = Bernstein3D(patch.points[12]->pos, patch.points[13]->pos, patch.points[14]->pos, patch.points[15]->pos, u);
-
-		if (computeNormals) {
-			derivU1[i] = Bernstein3DDerivative(patch.points[0]->pos, patch.points[1]->pos, patch.points[2]->pos, patch.points[3]->pos, u);
-			derivU2[i] = Bernstein3DDerivative(patch.points[4]->pos, patch.points[5]->pos, patch.points[6]->pos, patch.points[7]->pos, u);
-			derivU3[i] = Bernstein3DDerivative(patch.points[8]->pos, patch.points[9]->pos, patch.points[10]->pos, patch.points[11]->pos, u);
-			derivU4[i] = Bernstein3DDerivative(patch.points[12]->pos, patch.points[13]->pos, patch.points[14]->pos, patch.points[15]->pos, u);
+		const Vec4f weights = BernsteinWeights(u);
+		const Vec4f derivWeights = BernsteinDerivativeWeights(u);
+		for (int row = 0; row < 4; row++) {
+			horiz[i * 4 + row] = Bernstein3D(&controls[row * 4], weights);
+			if (computeNormals)
+				derivU[i * 4 + row] = Bernstein3D(&controls[row * 4], derivWeights);
 		}
 	}
 
-
 	for (int tile_v = 0; tile_v < tess_v + 1; ++tile_v) {
+		float v = ((float)tile_v / (float)tess_v);
+		const Vec4f weightsV = BernsteinWeights(v);
+		const Vec4f derivWeightsV = BernsteinDerivativeWeights(v);
+
 		for (int tile_u = 0; tile_u < tess_u + 1; ++tile_u) {
 			float u = ((float)tile_u / (float)tess_u);
-			float v = ((float)tile_v / (float)tess_v);
-			float bu = u;
-			float bv = v;
-
-			// TODO: Should be able to precompute the four curves per U, then just Bernstein per V. Will benefit large tesselation factors.
-			const Vec3Packedf &pos1 = horiz[tile_u];
-			const Vec3Packedf &pos2 = horiz2[tile_u];
-			const Vec3Packedf &pos3 = horiz3[tile_u];
-			const Vec3Packedf &pos4 = horiz4[tile_u];
+			const Vec3f *pos = &horiz[tile_u * 4];
 
 			SimpleVertex &vert = vertices[tile_v * (tess_u + 1) + tile_u];
 
 			if (computeNormals) {
-				const Vec3Packedf &derivU1_ = derivU1[tile_u];
-				const Vec3Packedf &derivU2_ = derivU2[tile_u];
-				const Vec3Packedf &derivU3_ = derivU3[tile_u];
-				const Vec3Packedf &derivU4_ = derivU4[tile_u];
-
-				Vec3Packedf derivU = Bernstein3D(derivU1_, derivU2_, derivU3_, derivU4_, bv);
-				Vec3Packedf derivV = Bernstein3DDerivative(pos1, pos2, pos3, pos4, bv);
+				Vec3Packedf du(Bernstein3D(&derivU[tile_u * 4], weightsV));
+				Vec3Packedf dv(Bernstein3D(pos, derivWeightsV));
 
-				vert.nrm = Cross(derivU, derivV).Normalized();
+				vert.nrm = Cross(du, dv).Normalized();
 				if (patch.patchFacing)
 					vert.nrm *= -1.0f;
 			}
@@ -687,7 +687,7 @@ static void _BezierPatchHighQuality(u8 *&dest, u16 *&indices, int &count, int te
 				vert.nrm.SetZero();
 			}
 
-			vert.pos = Bernstein3D(pos1, pos2, pos3, pos4, bv);
+			vert.pos = Bernstein3D(pos, weightsV);
 
 			if ((origVertType & GE_VTYPE_TC_MASK) == 0) {
 				// Generate texcoord
@@ -705,7 +705,7 @@ static void _BezierPatchHighQuality(u8 *&dest, u16 *&indices, int &count, int te
 			}
 		}
 	}
-	delete[] derivU1;
+	delete[] derivU;
 	delete[] horiz;
 
 	GEPatchPrimType prim_type = patch.primType;
@@ -742,6 +742,89 @@ void TesselateBezierPatch(u8 *&dest, u16 *&indices, int &count, int tess_u, int
 
 const GEPrimitiveType primType[] = { GE_PRIM_TRIANGLES, GE_PRIM_LINES, GE_PRIM_POINTS };
 
+enum {
+	TESS_CACHE_DECIMATION_INTERVAL = 17,
+	TESS_CACHE_KILL_AGE = 120,
+	TESS_CACHE_MAX_BYTES = 16 * 1024 * 1024,
+};
+
+u64 DrawEngineCommon::ComputeTessCacheKey(const SimpleVertex *points, int lowerBound, int upperBound, const void *indices, int indexCount, u32 vertType, const int *params, int numParams) {
+	// These are the control points after skinning and morphing, so the bones and weights are covered.
+	u64 hash = DoReliableHash64(points + lowerBound, (upperBound - lowerBound + 1) * sizeof(SimpleVertex), 0x5E3B1A27);
+	if (indices) {
+		int indexSize = (vertType & GE_VTYPE_IDX_MASK) == GE_VTYPE_IDX_16BIT ? 2 : 1;
+		hash = DoReliableHash64(indices, indexCount * indexSize, hash);
+	}
+	return DoReliableHash64(params, numParams * sizeof(int), hash);
+}
+
+bool DrawEngineCommon::LookupTessCache(u64 key, int &count) {
+	if (gpuStats.numFlips - tessCacheLastDecimation_ >= TESS_CACHE_DECIMATION_INTERVAL) {
+		tessCacheLastDecimation_ = gpuStats.numFlips;
+		DecimateTessCache(TESS_CACHE_KILL_AGE);
+	}
+
+	auto iter = tessCache_.find(key);
+	if (iter != tessCache_.end())
+		iter->second.lastFrame = gpuStats.numFlips;
+	if (iter == tessCache_.end() || iter->second.verts.empty()) {
+		gpuStats.numTessCacheMisses++;
+		return false;
+	}
+
+	const TessCacheEntry &entry = iter->second;
+	memcpy(splineBuffer, &entry.verts[0], entry.verts.size());
+	memcpy(quadIndices_, &entry.indices[0], entry.indices.size() * sizeof(u16));
+	count = entry.count;
+	gpuStats.numTessCacheHits++;
+	return true;
+}
+
+void DrawEngineCommon::AddToTessCache(u64 key, int vertexSize, int count) {
+	auto iter = tessCache_.find(key);
+	if (iter == tessCache_.end()) {
+		// First time we see it, only remember that.
+		TessCacheEntry &entry = tessCache_[key];
+		entry.count = 0;
+		entry.lastFrame = gpuStats.numFlips;
+		return;
+	}
+	if (count == 0)
+		return;
+
+	// Not all the tessellators advance dest, so go by the indices.
+	int numVerts = *std::max_element(quadIndices_, quadIndices_ + count) + 1;
+	const size_t vertexBytes = numVerts * vertexSize;
+	const size_t bytes = vertexBytes + count * sizeof(u16);
+	if (bytes > TESS_CACHE_MAX_BYTES / 4)
+		return;
+	if (tessCacheBytes_ + bytes > TESS_CACHE_MAX_BYTES) {
+		// Drop everything not drawn this frame (this one was just looked up), and give up if that's not enough.
+		DecimateTessCache(0);
+		if (tessCacheBytes_ + bytes > TESS_CACHE_MAX_BYTES)
+			return;
+	}
+
+	TessCacheEntry &entry = iter->second;
+	entry.verts.assign(splineBuffer, splineBuffer + vertexBytes);
+	entry.indices.assign(quadIndices_, quadIndices_ + count);
+	entry.count = count;
+	entry.lastFrame = gpuStats.numFlips;
+	tessCacheBytes_ += bytes;
+}
+
+void DrawEngineCommon::DecimateTessCache(int maxAge) {
+	const int threshold = gpuStats.numFlips - maxAge;
+	for (auto iter = tessCache_.begin(); iter != tessCache_.end(); ) {
+		if (iter->second.lastFrame < threshold) {
+			tessCacheBytes_ -= iter->second.verts.size() + iter->second.indices.size() * sizeof(u16);
+			tessCache_.erase(iter++);
+		} else {
+			++iter;
+		}
+	}
+}
+
 void DrawEngineCommon::SubmitSpline(const void *control_points, const void *indices, int tess_u, int tess_v, int count_u, int count_v, int type_u, int type_v, GEPatchPrimType prim_type, bool computeNormals, bool patchFacing, u32 vertType) {
 	PROFILE_THIS_SCOPE("spline");
 	DispatchFlush();
@@ -772,37 +855,46 @@ void DrawEngineCommon::SubmitSpline(const void *control_points, const void *indi
 		ERROR_LOG(G3D, "Something went really wrong, vertex size: %i vs %i", vertexSize, (int)sizeof(SimpleVertex));
 	}
 
-	// TODO: Do something less idiotic to manage this buffer
-	SimpleVertex **points = new SimpleVertex *[count_u * count_v];
-
-	// Make an array of pointers to the control points, to get rid of indices.
-	for (int idx = 0; idx < count_u * count_v; idx++) {
-		if (indices)
-			points[idx] = simplified_control_points + (indices_16bit ? indices16[idx] : indices8[idx]);
-		else
-			points[idx] = simplified_control_points + idx;
-	}
+	const int tessParams[] = { 0, tess_u, tess_v, count_u, count_v, type_u, type_v, prim_type, computeNormals, patchFacing, (int)origVertType, g_Config.iSplineBezierQuality };
+	u64 tessKey = ComputeTessCacheKey(simplified_control_points, index_lower_bound, index_upper_bound, indices, count_u * count_v, origVertType, tessParams, ARRAY_SIZE(tessParams));
 
 	int count = 0;
+	if (!LookupTessCache(tessKey, count)) {
+		double st = real_time_now();
+
+		// TODO: Do something less idiotic to manage this buffer
+		SimpleVertex **points = new SimpleVertex *[count_u * count_v];
+
+		// Make an array of pointers to the control points, to get rid of indices.
+		for (int idx = 0; idx < count_u * count_v; idx++) {
+			if (indices)
+				points[idx] = simplified_control_points + (indices_16bit ? indices16[idx] : indices8[idx]);
+			else
+				points[idx] = simplified_control_points + idx;
+		}
+
+		u8 *dest = splineBuffer;
 
-	u8 *dest = splineBuffer;
+		SplinePatchLocal patch;
+		patch.tess_u = tess_u;
+		patch.tess_v = tess_v;
+		patch.type_u = type_u;
+		patch.type_v = type_v;
+		patch.count_u = count_u;
+		patch.count_v = count_v;
+		patch.points = points;
+		patch.computeNormals = computeNormals;
+		patch.primType = prim_type;
+		patch.patchFacing = patchFacing;
 
-	SplinePatchLocal patch;
-	patch.tess_u = tess_u;
-	patch.tess_v = tess_v;
-	patch.type_u = type_u;
-	patch.type_v = type_v;
-	patch.count_u = count_u;
-	patch.count_v = count_v;
-	patch.points = points;
-	patch.computeNormals = computeNormals;
-	patch.primType = prim_type;
-	patch.patchFacing = patchFacing;
+		int maxVertexCount = SPLINE_BUFFER_SIZE / vertexSize;
+		TesselateSplinePatch(dest, quadIndices_, count, patch, origVertType, maxVertexCount);
 
-	int maxVertexCount = SPLINE_BUFFER_SIZE / vertexSize;
-	TesselateSplinePatch(dest, quadIndices_, count, patch, origVertType, maxVertexCount);
+		delete[] points;
 
-	delete[] points;
+		AddToTessCache(tessKey, vertexSize, count);
+		gpuStats.msTessellating += real_time_now() - st;
+	}
 
 	u32 vertTypeWithIndex16 = (vertType & ~GE_VTYPE_IDX_MASK) | GE_VTYPE_IDX_16BIT;
 
@@ -858,47 +950,57 @@ void DrawEngineCommon::SubmitBezier(const void *control_points, const void *indi
 		ERROR_LOG(G3D, "Something went really wrong, vertex size: %i vs %i", vertexSize, (int)sizeof(SimpleVertex));
 	}
 
-	// Bezier patches share less control points than spline patches. Otherwise they are pretty much the same (except bezier don't support the open/close thing)
-	int num_patches_u = (count_u - 1) / 3;
-	int num_patches_v = (count_v - 1) / 3;
-	BezierPatch* patches = new BezierPatch[num_patches_u * num_patches_v];
-	for (int patch_u = 0; patch_u < num_patches_u; patch_u++) {
-		for (int patch_v = 0; patch_v < num_patches_v; patch_v++) {
-			BezierPatch& patch = patches[patch_u + patch_v * num_patches_u];
-			for (int point = 0; point < 16; ++point) {
-				int idx = (patch_u * 3 + point % 4) + (patch_v * 3 + point / 4) * count_u;
-				if (indices)
-					patch.points[point] = simplified_control_points + (indices_16bit ? indices16[idx] : indices8[idx]);
-				else
-					patch.points[point] = simplified_control_points + idx;
+	const int tessParams[] = { 1, tess_u, tess_v, count_u, count_v, 0, 0, prim_type, computeNormals, patchFacing, (int)origVertType, g_Config.iSplineBezierQuality };
+	u64 tessKey = ComputeTessCacheKey(simplified_control_points, index_lower_bound, index_upper_bound, indices, count_u * count_v, origVertType, tessParams, ARRAY_SIZE(tessParams));
+
+	int count = 0;
+	if (!LookupTessCache(tessKey, count)) {
+		double st = real_time_now();
+
+		// Bezier patches share less control points than spline patches. Otherwise they are pretty much the same (except bezier don't support the open/close thing)
+		int num_patches_u = (count_u - 1) / 3;
+		int num_patches_v = (count_v - 1) / 3;
+		BezierPatch* patches = new BezierPatch[num_patches_u * num_patches_v];
+		for (int patch_u = 0; patch_u < num_patches_u; patch_u++) {
+			for (int patch_v = 0; patch_v < num_patches_v; patch_v++) {
+				BezierPatch& patch = patches[patch_u + patch_v * num_patches_u];
+				for (int point = 0; point < 16; ++point) {
+					int idx = (patch_u * 3 + point % 4) + (patch_v * 3 + point / 4) * count_u;
+					if (indices)
+						patch.points[point] = simplified_control_points + (indices_16bit ? indices16[idx] : indices8[idx]);
+					else
+						patch.points[point] = simplified_control_points + idx;
+				}
+				patch.u_index = patch_u * 3;
+				patch.v_index = patch_v * 3;
+				patch.index = patch_v * num_patches_u + patch_u;
+				patch.primType = prim_type;
+				patch.computeNormals = computeNormals;
+				patch.patchFacing = patchFacing;
 			}
-			patch.u_index = patch_u * 3;
-			patch.v_index = patch_v * 3;
-			patch.index = patch_v * num_patches_u + patch_u;
-			patch.primType = prim_type;
-			patch.computeNormals = computeNormals;
-			patch.patchFacing = patchFacing;
 		}
-	}
 
-	int count = 0;
-	u8 *dest = splineBuffer;
-
-	// Simple approximation of the real tesselation factor.
-	// We shouldn't really split up into separate 4x4 patches, instead we should do something that works
-	// like the splines, so we subdivide across the whole "mega-patch".
-	if (num_patches_u == 0) num_patches_u = 1;
-	if (num_patches_v == 0) num_patches_v = 1;
-	if (tess_u < 4) tess_u = 4;
-	if (tess_v < 4) tess_v = 4;
-
-	u16 *inds = quadIndices_;
-	int maxVertices = SPLINE_BUFFER_SIZE / vertexSize;
-	for (int patch_idx = 0; patch_idx < num_patches_u*num_patches_v; ++patch_idx) {
-		BezierPatch& patch = patches[patch_idx];
-		TesselateBezierPatch(dest, inds, count, tess_u, tess_v, patch, origVertType, maxVertices);
+		u8 *dest = splineBuffer;
+
+		// Simple approximation of the real tesselation factor.
+		// We shouldn't really split up into separate 4x4 patches, instead we should do something that works
+		// like the splines, so we subdivide across the whole "mega-patch".
+		if (num_patches_u == 0) num_patches_u = 1;
+		if (num_patches_v == 0) num_patches_v = 1;
+		if (tess_u < 4) tess_u = 4;
+		if (tess_v < 4) tess_v = 4;
+
+		u16 *inds = quadIndices_;
+		int maxVertices = SPLINE_BUFFER_SIZE / vertexSize;
+		for (int patch_idx = 0; patch_idx < num_patches_u*num_patches_v; ++patch_idx) {
+			BezierPatch& patch = patches[patch_idx];
+			TesselateBezierPatch(dest, inds, count, tess_u, tess_v, patch, origVertType, maxVertices);
+		}
+		delete[] patches;
+
+		AddToTessCache(tessKey, vertexSize, count);
+		gpuStats.msTessellating += real_time_now() - st;
 	}
-	delete[] patches;
 
 	u32 vertTypeWithIndex16 = (vertType & ~GE_VTYPE_IDX_MASK) | GE_VTYPE_IDX_16BIT;
 
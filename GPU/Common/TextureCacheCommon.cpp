@@ -87,3 +87,57 @@ void TextureCacheCommon::GetSamplingParams(int &minFilt, int &magFilt, bool &sCl
 		minFilt &= 1;
 	}
 }
+
+const SharedTextureIndex::SharedTexture *SharedTextureIndex::Acquire(const ContentKey &key) {
+	auto indexed = contentIndex_.find(key);
+	if (indexed == contentIndex_.end()) {
+		return nullptr;
+	}
+
+	SharedTexture &shared = textures_[indexed->second];
+	shared.refs++;
+	bytesSaved_ += shared.bytes;
+	return &shared;
+}
+
+bool SharedTextureIndex::Register(TexCacheEntry &entry, const ContentKey &key, u32 bytes) {
+	// The key has the scale factor in it, and others would never get the scaled version.
+	if (entry.status & TexCacheEntry::STATUS_TO_SCALE) {
+		return false;
+	}
+	// Two entries with the same contents may have been decoding at once, the first one wins.
+	if (contentIndex_.find(key) != contentIndex_.end()) {
+		return false;
+	}
+
+	contentIndex_[key] = entry.textureName;
+	SharedTexture &shared = textures_[entry.textureName];
+	shared.key = key;
+	shared.name = entry.textureName;
+	shared.refs = 1;
+	shared.bytes = bytes;
+	shared.alphaStatus = entry.GetAlphaStatus();
+	return true;
+}
+
+bool SharedTextureIndex::Release(u32 name) {
+	auto iter = textures_.find(name);
+	if (iter == textures_.end()) {
+		return true;
+	}
+
+	SharedTexture &shared = iter->second;
+	if (--shared.refs > 0) {
+		bytesSaved_ -= shared.bytes;
+		return false;
+	}
+	contentIndex_.erase(shared.key);
+	textures_.erase(iter);
+	return true;
+}
+
+void SharedTextureIndex::Clear() {
+	contentIndex_.clear();
+	textures_.clear();
+	bytesSaved_ = 0;
+}
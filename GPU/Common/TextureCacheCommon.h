@@ -17,6 +17,9 @@
 
 #pragma once
 
+#include <map>
+#include <utility>
+
 #include "Common/CommonTypes.h"
 
 enum TextureFiltering {
@@ -57,6 +60,7 @@ class TextureCacheCommon {
 			STATUS_CLUT_RECHECK = 0x20,    // Another texture with same addr had a hashfail.
 			STATUS_DEPALETTIZE = 0x40,     // Needs to go through a depalettize pass.
 			STATUS_TO_SCALE = 0x80,        // Pending texture scaling in a later frame.
+			STATUS_SHARED = 0x100,         // Texture is also used by other entries, which may change its params.
 		};
 
 		// Status, but int so we can zero initialize.
@@ -122,3 +126,42 @@ class TextureCacheCommon {
 inline bool TextureCacheCommon::TexCacheEntry::Matches(u16 dim2, u8 format2, u8 maxLevel2) {
 	return dim == dim2 && format == format2 && maxLevel == maxLevel2;
 }
+
+// Texture names used by every entry with the same contents, wherever they are in RAM.
+// Only counts references, the backend still creates and deletes the textures.
+class SharedTextureIndex {
+public:
+	typedef TextureCacheCommon::TexCacheEntry TexCacheEntry;
+	// Hashes, then dimensions and everything else that changes the decoded result.
+	typedef std::pair<u64, u64> ContentKey;
+
+	struct SharedTexture {
+		ContentKey key;
+		u32 name;
+		int refs;
+		u32 bytes;
+		TexCacheEntry::Status alphaStatus;
+	};
+
+	SharedTextureIndex() : bytesSaved_(0) {}
+
+	// Takes another reference to the texture with these contents, or returns null if there is none.
+	const SharedTexture *Acquire(const ContentKey &key);
+	// Indexes the entry's texture under key, unless another has these contents or it's not final yet.
+	bool Register(TexCacheEntry &entry, const ContentKey &key, u32 bytes);
+	// Drops a reference.  Returns true if nothing uses the texture anymore, so it can be deleted.
+	bool Release(u32 name);
+	bool Contains(u32 name) const {
+		return textures_.find(name) != textures_.end();
+	}
+	void Clear();
+
+	u32 BytesSaved() const {
+		return bytesSaved_;
+	}
+
+private:
+	std::map<ContentKey, u32> contentIndex_;
+	std::map<u32, SharedTexture> textures_;
+	u32 bytesSaved_;
+};
@@ -24,6 +24,7 @@
 #include "GPU/Common/TextureDecoder.h"
 // NEON is in a separate file so that it can be compiled with a runtime check.
 #include "GPU/Common/TextureDecoderNEON.h"
+#include "GPU/Common/TextureDecoderAVX2.h"
 
 // TODO: Move some common things into here.
 
@@ -87,12 +88,12 @@ static const u32 textureAlignMask16[16] = {
 	0,   // INVALID,
 };
 
-u32 GetTextureBufw(int level, u32 texaddr, GETextureFormat format) {
+u32 GetTextureBufw(int level, u32 texaddr, GETextureFormat format, const GPUgstate &state) {
 	// This is a hack to allow for us to draw the huge PPGe texture, which is always in kernel ram.
 	if (texaddr < PSP_GetKernelMemoryEnd())
-		return gstate.texbufwidth[level] & 0x1FFF;
+		return state.texbufwidth[level] & 0x1FFF;
 
-	u32 bufw = gstate.texbufwidth[level] & textureAlignMask16[format];
+	u32 bufw = state.texbufwidth[level] & textureAlignMask16[format];
 	if (bufw == 0) {
 		// If it's less than 16 bytes, use 16 bytes.
 		bufw = (8 * 16) / textureBitsPerPixel[format];
@@ -297,6 +298,11 @@ ReliableHash64Func DoReliableHash64 = &XXH64;
 #endif
 #endif
 
+DeIndexTexture4To16Func DoDeIndexTexture4To16 = &DeIndexTexture4To16Basic;
+DeIndexTexture4To32Func DoDeIndexTexture4To32 = &DeIndexTexture4To32Basic;
+DeIndexTexture8To16Func DoDeIndexTexture8To16 = &DeIndexTexture8To16Basic;
+DeIndexTexture8To32Func DoDeIndexTexture8To32 = &DeIndexTexture8To32Basic;
+
 // This has to be done after CPUDetect has done its magic.
 void SetupTextureDecoder() {
 #ifdef HAVE_ARMV7
@@ -309,6 +315,43 @@ void SetupTextureDecoder() {
 #endif
 	}
 #endif
+#ifdef _M_SSE
+	// The hashes stay SSE2, they're one long dependency chain that wider vectors don't help.
+	if (cpu_info.bAVX2) {
+		DoDeIndexTexture4To16 = &DeIndexTexture4To16AVX2;
+		DoDeIndexTexture4To32 = &DeIndexTexture4To32AVX2;
+		DoDeIndexTexture8To16 = &DeIndexTexture8To16AVX2;
+		DoDeIndexTexture8To32 = &DeIndexTexture8To32AVX2;
+	}
+#endif
+}
+
+void DeIndexTexture4To16Basic(u16 *dest, const u8 *indexed, int length, const u16 *clut) {
+	for (int i = 0; i < length; i += 2) {
+		u8 index = *indexed++;
+		dest[i + 0] = clut[(index >> 0) & 0xf];
+		dest[i + 1] = clut[(index >> 4) & 0xf];
+	}
+}
+
+void DeIndexTexture4To32Basic(u32 *dest, const u8 *indexed, int length, const u32 *clut) {
+	for (int i = 0; i < length; i += 2) {
+		u8 index = *indexed++;
+		dest[i + 0] = clut[(index >> 0) & 0xf];
+		dest[i + 1] = clut[(index >> 4) & 0xf];
+	}
+}
+
+void DeIndexTexture8To16Basic(u16 *dest, const u8 *indexed, int length, const u16 *clut) {
+	for (int i = 0; i < length; ++i) {
+		*dest++ = clut[*indexed++];
+	}
+}
+
+void DeIndexTexture8To32Basic(u32 *dest, const u8 *indexed, int length, const u32 *clut) {
+	for (int i = 0; i < length; ++i) {
+		*dest++ = clut[*indexed++];
+	}
 }
 
 static inline u32 makecol(int r, int g, int b, int a) {
@@ -27,6 +27,7 @@ enum CheckAlphaResult {
 #include "Common/Common.h"
 #include "Core/MemMap.h"
 #include "GPU/ge_constants.h"
+#include "GPU/GPUState.h"
 #include "GPU/Common/TextureDecoderNEON.h"
 
 void SetupTextureDecoder();
@@ -132,18 +133,48 @@ static const u8 textureBitsPerPixel[16] = {
 	0,   // INVALID,
 };
 
-u32 GetTextureBufw(int level, u32 texaddr, GETextureFormat format);
+u32 GetTextureBufw(int level, u32 texaddr, GETextureFormat format, const GPUgstate &state = gstate);
+
+// Clut lookups for the usual case, where indices are used as is.  Picked by SetupTextureDecoder().
+// The clut may be read a little past the last entry, the clut buffers have plenty of room.
+typedef void (*DeIndexTexture4To16Func)(u16 *dest, const u8 *indexed, int length, const u16 *clut);
+typedef void (*DeIndexTexture4To32Func)(u32 *dest, const u8 *indexed, int length, const u32 *clut);
+typedef void (*DeIndexTexture8To16Func)(u16 *dest, const u8 *indexed, int length, const u16 *clut);
+typedef void (*DeIndexTexture8To32Func)(u32 *dest, const u8 *indexed, int length, const u32 *clut);
+extern DeIndexTexture4To16Func DoDeIndexTexture4To16;
+extern DeIndexTexture4To32Func DoDeIndexTexture4To32;
+extern DeIndexTexture8To16Func DoDeIndexTexture8To16;
+extern DeIndexTexture8To32Func DoDeIndexTexture8To32;
+
+void DeIndexTexture4To16Basic(u16 *dest, const u8 *indexed, int length, const u16 *clut);
+void DeIndexTexture4To32Basic(u32 *dest, const u8 *indexed, int length, const u32 *clut);
+void DeIndexTexture8To16Basic(u16 *dest, const u8 *indexed, int length, const u16 *clut);
+void DeIndexTexture8To32Basic(u32 *dest, const u8 *indexed, int length, const u32 *clut);
+
+inline void DeIndexTexture4Simple(u16 *dest, const u8 *indexed, int length, const u16 *clut) {
+	DoDeIndexTexture4To16(dest, indexed, length, clut);
+}
+
+inline void DeIndexTexture4Simple(u32 *dest, const u8 *indexed, int length, const u32 *clut) {
+	DoDeIndexTexture4To32(dest, indexed, length, clut);
+}
+
+inline void DeIndexTexture8Simple(u16 *dest, const u8 *indexed, int length, const u16 *clut) {
+	DoDeIndexTexture8To16(dest, indexed, length, clut);
+}
+
+inline void DeIndexTexture8Simple(u32 *dest, const u8 *indexed, int length, const u32 *clut) {
+	DoDeIndexTexture8To32(dest, indexed, length, clut);
+}
 
 template <typename IndexT, typename ClutT>
-inline void DeIndexTexture(ClutT *dest, const IndexT *indexed, int length, const ClutT *clut) {
+inline void DeIndexTexture(ClutT *dest, const IndexT *indexed, int length, const ClutT *clut, const GPUgstate &state = gstate) {
 	// Usually, there is no special offset, mask, or shift.
-	const bool nakedIndex = gstate.isClutIndexSimple();
+	const bool nakedIndex = state.isClutIndexSimple();
 
 	if (nakedIndex) {
 		if (sizeof(IndexT) == 1) {
-			for (int i = 0; i < length; ++i) {
-				*dest++ = clut[*indexed++];
-			}
+			DeIndexTexture8Simple(dest, (const u8 *)indexed, length, clut);
 		} else {
 			for (int i = 0; i < length; ++i) {
 				*dest++ = clut[(*indexed++) & 0xFF];
@@ -151,7 +182,7 @@ inline void DeIndexTexture(ClutT *dest, const IndexT *indexed, int length, const
 		}
 	} else {
 		for (int i = 0; i < length; ++i) {
-			*dest++ = clut[gstate.transformClutIndex(*indexed++)];
+			*dest++ = clut[state.transformClutIndex(*indexed++)];
 		}
 	}
 }
@@ -163,21 +194,17 @@ inline void DeIndexTexture(ClutT *dest, const u32 texaddr, int length, const Clu
 }
 
 template <typename ClutT>
-inline void DeIndexTexture4(ClutT *dest, const u8 *indexed, int length, const ClutT *clut) {
+inline void DeIndexTexture4(ClutT *dest, const u8 *indexed, int length, const ClutT *clut, const GPUgstate &state = gstate) {
 	// Usually, there is no special offset, mask, or shift.
-	const bool nakedIndex = gstate.isClutIndexSimple();
+	const bool nakedIndex = state.isClutIndexSimple();
 
 	if (nakedIndex) {
-		for (int i = 0; i < length; i += 2) {
-			u8 index = *indexed++;
-			dest[i + 0] = clut[(index >> 0) & 0xf];
-			dest[i + 1] = clut[(index >> 4) & 0xf];
-		}
+		DeIndexTexture4Simple(dest, indexed, length, clut);
 	} else {
 		for (int i = 0; i < length; i += 2) {
 			u8 index = *indexed++;
-			dest[i + 0] = clut[gstate.transformClutIndex((index >> 0) & 0xf)];
-			dest[i + 1] = clut[gstate.transformClutIndex((index >> 4) & 0xf)];
+			dest[i + 0] = clut[state.transformClutIndex((index >> 0) & 0xf)];
+			dest[i + 1] = clut[state.transformClutIndex((index >> 4) & 0xf)];
 		}
 	}
 }
@@ -0,0 +1,133 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include "GPU/Common/TextureDecoderAVX2.h"
+
+#ifdef _M_SSE
+#include <immintrin.h>
+
+// Built with the same flags as everything else, so each function asks for AVX2 itself.
+#if defined(__GNUC__) || defined(__clang__)
+#define AVX2_FUNC __attribute__((target("avx2")))
+#else
+#define AVX2_FUNC
+#endif
+
+// Widens 16 bytes of packed nibbles into 32 indices, one per byte, in order.
+AVX2_FUNC static inline __m256i ExpandNibbles(const u8 *indexed) {
+	const __m256i maskLow = _mm256_set1_epi16(0x000f);
+	const __m256i maskHigh = _mm256_set1_epi16(0x0f00);
+	const __m256i bytes = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)indexed));
+	return _mm256_or_si256(_mm256_and_si256(bytes, maskLow), _mm256_and_si256(_mm256_slli_epi16(bytes, 4), maskHigh));
+}
+
+AVX2_FUNC void DeIndexTexture4To16AVX2(u16 *dest, const u8 *indexed, int length, const u16 *clut) {
+	// With only 16 entries, the low and high bytes of the clut each fit in a byte shuffle.
+	const __m128i split = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+	const __m128i clut0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)clut), split);
+	const __m128i clut1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(clut + 8)), split);
+	const __m256i clutLow = _mm256_broadcastsi128_si256(_mm_unpacklo_epi64(clut0, clut1));
+	const __m256i clutHigh = _mm256_broadcastsi128_si256(_mm_unpackhi_epi64(clut0, clut1));
+
+	int i = 0;
+	for (; i + 32 <= length; i += 32) {
+		const __m256i index = ExpandNibbles(indexed + i / 2);
+		const __m256i low = _mm256_shuffle_epi8(clutLow, index);
+		const __m256i high = _mm256_shuffle_epi8(clutHigh, index);
+		// The unpacks stay within 128-bit lanes, so we get pixels 0-7/16-23 and 8-15/24-31.
+		const __m256i pixels0 = _mm256_unpacklo_epi8(low, high);
+		const __m256i pixels1 = _mm256_unpackhi_epi8(low, high);
+		_mm256_storeu_si256((__m256i *)(dest + i), _mm256_permute2x128_si256(pixels0, pixels1, 0x20));
+		_mm256_storeu_si256((__m256i *)(dest + i + 16), _mm256_permute2x128_si256(pixels0, pixels1, 0x31));
+	}
+
+	if (i < length) {
+		DeIndexTexture4To16Basic(dest + i, indexed + i / 2, length - i, clut);
+	}
+}
+
+// Looks up 8 indices in a 16 entry clut, held in two registers of 8.
+AVX2_FUNC static inline __m256i Lookup16Entries(__m256i clutLow, __m256i clutHigh, __m128i index8) {
+	const __m256i index = _mm256_cvtepu8_epi32(index8);
+	const __m256 low = _mm256_castsi256_ps(_mm256_permutevar8x32_epi32(clutLow, index));
+	const __m256 high = _mm256_castsi256_ps(_mm256_permutevar8x32_epi32(clutHigh, index));
+	// The permutes only look at the low 3 bits, the 4th picks the register.
+	const __m256 useHigh = _mm256_castsi256_ps(_mm256_slli_epi32(index, 28));
+	return _mm256_castps_si256(_mm256_blendv_ps(low, high, useHigh));
+}
+
+AVX2_FUNC void DeIndexTexture4To32AVX2(u32 *dest, const u8 *indexed, int length, const u32 *clut) {
+	const __m256i clutLow = _mm256_loadu_si256((const __m256i *)clut);
+	const __m256i clutHigh = _mm256_loadu_si256((const __m256i *)(clut + 8));
+
+	int i = 0;
+	for (; i + 32 <= length; i += 32) {
+		const __m256i index = ExpandNibbles(indexed + i / 2);
+		const __m128i index0 = _mm256_castsi256_si128(index);
+		const __m128i index1 = _mm256_extracti128_si256(index, 1);
+		_mm256_storeu_si256((__m256i *)(dest + i), Lookup16Entries(clutLow, clutHigh, index0));
+		_mm256_storeu_si256((__m256i *)(dest + i + 8), Lookup16Entries(clutLow, clutHigh, _mm_srli_si128(index0, 8)));
+		_mm256_storeu_si256((__m256i *)(dest + i + 16), Lookup16Entries(clutLow, clutHigh, index1));
+		_mm256_storeu_si256((__m256i *)(dest + i + 24), Lookup16Entries(clutLow, clutHigh, _mm_srli_si128(index1, 8)));
+	}
+
+	if (i < length) {
+		DeIndexTexture4To32Basic(dest + i, indexed + i / 2, length - i, clut);
+	}
+}
+
+AVX2_FUNC void DeIndexTexture8To16AVX2(u16 *dest, const u8 *indexed, int length, const u16 *clut) {
+	// There's no 16-bit gather, so this grabs 32 bits at each entry and drops the top half.
+	// That reads 2 bytes past entry 255, which is still inside the clut buffer.
+	const int *clut32 = (const int *)clut;
+	const __m256i mask = _mm256_set1_epi32(0x0000FFFF);
+
+	int i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i index = _mm_loadu_si128((const __m128i *)(indexed + i));
+		__m256i pixels0 = _mm256_i32gather_epi32(clut32, _mm256_cvtepu8_epi32(index), 2);
+		__m256i pixels1 = _mm256_i32gather_epi32(clut32, _mm256_cvtepu8_epi32(_mm_srli_si128(index, 8)), 2);
+		pixels0 = _mm256_and_si256(pixels0, mask);
+		pixels1 = _mm256_and_si256(pixels1, mask);
+		// Packing works per 128-bit lane too, so put the quarters back in order.
+		const __m256i packed = _mm256_packus_epi32(pixels0, pixels1);
+		_mm256_storeu_si256((__m256i *)(dest + i), _mm256_permute4x64_epi64(packed, 0xD8));
+	}
+
+	if (i < length) {
+		DeIndexTexture8To16Basic(dest + i, indexed + i, length - i, clut);
+	}
+}
+
+AVX2_FUNC void DeIndexTexture8To32AVX2(u32 *dest, const u8 *indexed, int length, const u32 *clut) {
+	const int *clut32 = (const int *)clut;
+
+	int i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i index = _mm_loadu_si128((const __m128i *)(indexed + i));
+		const __m256i pixels0 = _mm256_i32gather_epi32(clut32, _mm256_cvtepu8_epi32(index), 4);
+		const __m256i pixels1 = _mm256_i32gather_epi32(clut32, _mm256_cvtepu8_epi32(_mm_srli_si128(index, 8)), 4);
+		_mm256_storeu_si256((__m256i *)(dest + i), pixels0);
+		_mm256_storeu_si256((__m256i *)(dest + i + 8), pixels1);
+	}
+
+	if (i < length) {
+		DeIndexTexture8To32Basic(dest + i, indexed + i, length - i, clut);
+	}
+}
+
+#endif
@@ -23,16 +23,25 @@
 #include <algorithm>
 #include <cstdlib>
 #include <cmath>
+#include <cstring>
+#include <set>
 
 #include "GPU/Common/TextureScalerCommon.h"
 
+#include "base/timeutil.h"
+#include "file/file_util.h"
+#include "thread/threadutil.h"
 #include "Core/Config.h"
+#include "Core/System.h"
+#include "Core/ELF/ParamSFO.h"
 #include "Common/Common.h"
+#include "Common/FileUtil.h"
 #include "Common/Log.h"
 #include "Common/MsgHandler.h"
 #include "Common/CommonFuncs.h"
 #include "Common/ThreadPools.h"
 #include "Common/CPUDetect.h"
+#include "ext/snappy/snappy-c.h"
 #include "ext/xbrz/xbrz.h"
 
 #if _M_SSE >= 0x401
@@ -42,10 +51,6 @@
 // Report the time and throughput for each larger scaling operation in the log
 //#define SCALING_MEASURE_TIME
 
-#ifdef SCALING_MEASURE_TIME
-#include "base/timeutil.h"
-#endif
-
 /////////////////////////////////////// Helper Functions (mostly math for parallelization)
 
 namespace {
@@ -485,11 +490,50 @@ void dbgPGM(int w, int h, u32* pixels, const char* prefix = "dbg") { // 1 compon
 
 /////////////////////////////////////// Texture Scaler
 
-TextureScaler::TextureScaler() {
+namespace {
+
+// Finished scales nobody has asked for yet are dropped beyond this many (oldest first.)
+const size_t MAX_UNCLAIMED_SCALES = 32;
+
+const char SCALED_CACHE_MAGIC[4] = { 'P', 'S', 'C', 'T' };
+const u32 SCALED_CACHE_VERSION = 1;
+
+struct ScaledCacheHeader {
+	char magic[4];
+	u32 version;
+	u32 fullhash;
+	u32 cluthash;
+	u32 format;
+	u16 width;
+	u16 height;
+	u8 factor;
+	u8 type;
+	u8 deposterize;
+	u8 pad;
+	u32 compressedSize;
+};
+
+inline u64 ScaleJobId(u32 fullhash, u32 cluthash) {
+	return (u64)fullhash | ((u64)cluthash << 32);
+}
+
+}
+
+TextureScaler::TextureScaler() : worker_(nullptr), workerActive_(false), running_(nullptr), nextSeq_(0), scalingTime_(0.0), diskCacheSize_(0) {
 	initBicubicWeights();
 }
 
 TextureScaler::~TextureScaler() {
+	if (worker_) {
+		queueLock_.lock();
+		workerActive_ = false;
+		queueCond_.notify_one();
+		queueLock_.unlock();
+		worker_->join();
+		delete worker_;
+		worker_ = nullptr;
+	}
+	ClearPending();
 	xbrz::shutdown();
 }
 
@@ -510,10 +554,9 @@ void TextureScaler::Scale(u32* &data, u32 &dstFmt, int &width, int &height, int
 		return;
 	}
 
-#ifdef SCALING_MEASURE_TIME
 	double t_start = real_time_now();
-#endif
 
+	lock_guard guard(scaleLock_);
 	bufInput.resize(width*height); // used to store the input image image if it needs to be reformatted
 	bufOutput.resize(width*height*factor*factor); // used to store the upscaled image
 	u32 *inputBuf = bufInput.data();
@@ -522,44 +565,429 @@ void TextureScaler::Scale(u32* &data, u32 &dstFmt, int &width, int &height, int
 	// convert texture to correct format for scaling
 	ConvertTo8888(dstFmt, data, inputBuf, width, height);
 
+	ScaleInto(inputBuf, outputBuf, width, height, factor, g_Config.iTexScalingType, g_Config.bTexDeposterize);
+
+	// update values accordingly
+	dstFmt = Get8888Format();
+	data = outputBuf;
+	width *= factor;
+	height *= factor;
+
+	double t = real_time_now() - t_start;
+	{
+		lock_guard queueGuard(queueLock_);
+		scalingTime_ += t;
+	}
+
+#ifdef SCALING_MEASURE_TIME
+	if (width*height > 64 * 64 * factor*factor) {
+		NOTICE_LOG(MASTER_LOG, "TextureScaler: processed %9d pixels in %6.5lf seconds. (%9.2lf Mpixels/second)",
+			width*height, t, (width*height) / (t * 1000 * 1000));
+	}
+#endif
+}
+
+void TextureScaler::ScaleInto(u32 *input, u32 *output, int width, int height, int factor, int type, bool deposterize) {
 	// deposterize
-	if (g_Config.bTexDeposterize) {
+	if (deposterize) {
 		bufDeposter.resize(width*height);
-		DePosterize(inputBuf, bufDeposter.data(), width, height);
-		inputBuf = bufDeposter.data();
+		DePosterize(input, bufDeposter.data(), width, height);
+		input = bufDeposter.data();
 	}
 
 	// scale 
-	switch (g_Config.iTexScalingType) {
+	switch (type) {
 	case XBRZ:
-		ScaleXBRZ(factor, inputBuf, outputBuf, width, height);
+		ScaleXBRZ(factor, input, output, width, height);
 		break;
 	case HYBRID:
-		ScaleHybrid(factor, inputBuf, outputBuf, width, height);
+		ScaleHybrid(factor, input, output, width, height);
 		break;
 	case BICUBIC:
-		ScaleBicubicMitchell(factor, inputBuf, outputBuf, width, height);
+		ScaleBicubicMitchell(factor, input, output, width, height);
 		break;
 	case HYBRID_BICUBIC:
-		ScaleHybrid(factor, inputBuf, outputBuf, width, height, true);
+		ScaleHybrid(factor, input, output, width, height, true);
 		break;
 	default:
-		ERROR_LOG(G3D, "Unknown scaling type: %d", g_Config.iTexScalingType);
+		ERROR_LOG(G3D, "Unknown scaling type: %d", type);
 	}
+}
 
-	// update values accordingly
-	dstFmt = Get8888Format();
-	data = outputBuf;
-	width *= factor;
-	height *= factor;
+bool TextureScaler::ScaleCached(u32* &data, u32 &dstFmt, int &width, int &height, int factor, u32 fullhash, u32 cluthash) {
+	if (IsEmptyOrFlat(data, width*height, dstFmt)) {
+		INFO_LOG(G3D, "TextureScaler: early exit -- empty/flat texture");
+		return true;
+	}
 
-#ifdef SCALING_MEASURE_TIME
-	if (width*height > 64 * 64 * factor*factor) {
-		double t = real_time_now() - t_start;
-		NOTICE_LOG(MASTER_LOG, "TextureScaler: processed %9d pixels in %6.5lf seconds. (%9.2lf Mpixels/second)",
-			width*height, t, (width*height) / (t * 1000 * 1000));
+	ScaleKey key;
+	key.fullhash = fullhash;
+	key.cluthash = cluthash;
+	key.format = dstFmt;
+	key.width = (u16)width;
+	key.height = (u16)height;
+	key.factor = (u8)factor;
+	key.type = (u8)g_Config.iTexScalingType;
+	key.deposterize = g_Config.bTexDeposterize ? 1 : 0;
+	const std::string diskPath = g_Config.bTexScalingDiskCache ? DiskCachePath(key) : "";
+
+	if (!g_Config.bTexScalingAsync) {
+		if (!diskPath.empty() && LoadFromDisk(diskPath, key, bufCached_)) {
+			dstFmt = Get8888Format();
+			data = &bufCached_[0];
+			width *= factor;
+			height *= factor;
+			return true;
+		}
+
+		Scale(data, dstFmt, width, height, factor);
+		if (!diskPath.empty() && dstFmt == Get8888Format() && width == key.width * factor) {
+			AddToDiskCache(diskPath, SaveToDisk(diskPath, key, data, width * height));
+		}
+		return true;
+	}
+
+	lock_guard guard(queueLock_);
+	const u64 id = ScaleJobId(fullhash, cluthash);
+	auto iter = jobs_.find(id);
+	if (iter != jobs_.end()) {
+		ScaleJob *job = iter->second;
+		if (!(job->key == key)) {
+			// Same texture, but the size or scaling settings changed.  Start over.
+			RemoveJob(iter);
+		} else if (!job->done) {
+			return false;
+		} else {
+			bufCached_.swap(job->output);
+			RemoveJob(iter);
+
+			dstFmt = Get8888Format();
+			data = &bufCached_[0];
+			width *= factor;
+			height *= factor;
+			return true;
+		}
+	}
+
+	// The worker can't use data, it belongs to the texture cache.  Convert it now, while we have it.
+	ScaleJob *job = new ScaleJob();
+	job->key = key;
+	job->seq = nextSeq_++;
+	job->done = false;
+	job->cancelled = false;
+	job->diskPath = diskPath;
+	job->input.resize(width * height);
+	u32 *inputBuf = &job->input[0];
+	ConvertTo8888(dstFmt, data, inputBuf, width, height);
+	if (inputBuf != &job->input[0]) {
+		memcpy(&job->input[0], inputBuf, width * height * sizeof(u32));
+	}
+
+	jobs_[id] = job;
+	queue_.push_back(job);
+	StartWorker();
+	queueCond_.notify_one();
+	return false;
+}
+
+bool TextureScaler::IsScaleReady(u32 fullhash, u32 cluthash) {
+	lock_guard guard(queueLock_);
+	auto iter = jobs_.find(ScaleJobId(fullhash, cluthash));
+	return iter == jobs_.end() || iter->second->done;
+}
+
+void TextureScaler::CancelScale(u32 fullhash, u32 cluthash) {
+	lock_guard guard(queueLock_);
+	auto iter = jobs_.find(ScaleJobId(fullhash, cluthash));
+	if (iter != jobs_.end()) {
+		RemoveJob(iter);
+	}
+}
+
+void TextureScaler::ClearPending() {
+	lock_guard guard(queueLock_);
+	while (!jobs_.empty()) {
+		RemoveJob(jobs_.begin());
+	}
+	finished_.clear();
+}
+
+int TextureScaler::NumScalesPending() {
+	lock_guard guard(queueLock_);
+	return (int)queue_.size() + (running_ != nullptr ? 1 : 0);
+}
+
+double TextureScaler::TakeScalingTime() {
+	lock_guard guard(queueLock_);
+	double t = scalingTime_;
+	scalingTime_ = 0.0;
+	return t;
+}
+
+void TextureScaler::RemoveJob(std::map<u64, ScaleJob *>::iterator iter) {
+	ScaleJob *job = iter->second;
+	jobs_.erase(iter);
+	if (job == running_) {
+		// The worker deletes it when it's done.
+		job->cancelled = true;
+		return;
+	}
+	if (!job->done) {
+		queue_.erase(std::find(queue_.begin(), queue_.end(), job));
+	}
+	delete job;
+}
+
+void TextureScaler::StartWorker() {
+	if (!worker_) {
+		workerActive_ = true;
+		worker_ = new std::thread(std::bind(&TextureScaler::WorkerFunc, this));
+	}
+}
+
+void TextureScaler::WorkerFunc() {
+	setCurrentThreadName("TextureScaler");
+
+	lock_guard guard(queueLock_);
+	while (workerActive_) {
+		if (!scanDir_.empty()) {
+			const std::string dir = scanDir_;
+			scanDir_.clear();
+			queueLock_.unlock();
+			ScanDiskCache(dir);
+			queueLock_.lock();
+			continue;
+		}
+		if (queue_.empty()) {
+			queueCond_.wait(queueLock_);
+			continue;
+		}
+
+		ScaleJob *job = queue_.front();
+		queue_.pop_front();
+		running_ = job;
+
+		queueLock_.unlock();
+		ProcessJob(job);
+		queueLock_.lock();
+
+		running_ = nullptr;
+		if (job->cancelled) {
+			delete job;
+			continue;
+		}
+
+		job->done = true;
+		std::vector<u32>().swap(job->input);
+		finished_.push_back(std::make_pair(ScaleJobId(job->key.fullhash, job->key.cluthash), job->seq));
+
+		while (finished_.size() > MAX_UNCLAIMED_SCALES) {
+			auto oldest = jobs_.find(finished_.front().first);
+			if (oldest != jobs_.end() && oldest->second->seq == finished_.front().second) {
+				RemoveJob(oldest);
+			}
+			finished_.pop_front();
+		}
+	}
+}
+
+void TextureScaler::ProcessJob(ScaleJob *job) {
+	const ScaleKey &key = job->key;
+	if (!job->diskPath.empty() && LoadFromDisk(job->diskPath, key, job->output)) {
+		return;
+	}
+
+	double t_start = real_time_now();
+	job->output.resize(key.width * key.height * key.factor * key.factor);
+	{
+		lock_guard guard(scaleLock_);
+		ScaleInto(&job->input[0], &job->output[0], key.width, key.height, key.factor, key.type, key.deposterize != 0);
+	}
+	double t = real_time_now() - t_start;
+
+	queueLock_.lock();
+	scalingTime_ += t;
+	bool cancelled = job->cancelled;
+	queueLock_.unlock();
+
+	if (!job->diskPath.empty() && !cancelled) {
+		AddToDiskCache(job->diskPath, SaveToDisk(job->diskPath, key, &job->output[0], job->output.size()));
+	}
+}
+
+std::string TextureScaler::DiskCachePath(const ScaleKey &key) {
+	if (diskCacheDir_.empty()) {
+		// Homebrew usually lacks a disc ID, so there's nothing to keep its textures apart.
+		const std::string discID = g_paramSFO.GetValueString("DISC_ID");
+		if (discID.empty()) {
+			return "";
+		}
+		diskCacheDir_ = GetSysDirectory(DIRECTORY_CACHE) + "scaled/" + discID + "/";
+		if (!File::Exists(diskCacheDir_)) {
+			File::CreateFullPath(diskCacheDir_);
+		}
+
+		// Listing every cached file can take a while, so the worker does it.
+		lock_guard guard(queueLock_);
+		scanDir_ = GetSysDirectory(DIRECTORY_CACHE) + "scaled/";
+		StartWorker();
+		queueCond_.notify_one();
+	}
+
+	char filename[64];
+	snprintf(filename, sizeof(filename), "%08x%08x_%04x_%dx%d_%d_%dx%s.bin", key.fullhash, key.cluthash, key.format, key.width, key.height, key.type, key.factor, key.deposterize ? "_d" : "");
+	return diskCacheDir_ + filename;
+}
+
+bool TextureScaler::LoadFromDisk(const std::string &path, const ScaleKey &key, std::vector<u32> &output) {
+	FILE *f = File::OpenCFile(path, "rb");
+	if (!f) {
+		return false;
+	}
+
+	const size_t expectedSize = key.width * key.height * key.factor * key.factor * sizeof(u32);
+	ScaledCacheHeader header;
+	bool valid = fread(&header, sizeof(header), 1, f) == 1;
+	valid = valid && memcmp(header.magic, SCALED_CACHE_MAGIC, sizeof(header.magic)) == 0 && header.version == SCALED_CACHE_VERSION;
+	valid = valid && header.fullhash == key.fullhash && header.cluthash == key.cluthash && header.format == key.format;
+	valid = valid && header.width == key.width && header.height == key.height && header.factor == key.factor;
+	valid = valid && header.type == key.type && header.deposterize == key.deposterize;
+	valid = valid && header.compressedSize <= snappy_max_compressed_length(expectedSize);
+
+	if (valid) {
+		std::vector<char> compressed(header.compressedSize);
+		valid = header.compressedSize != 0 && fread(&compressed[0], 1, header.compressedSize, f) == header.compressedSize;
+		if (valid) {
+			output.resize(expectedSize / sizeof(u32));
+			size_t size = expectedSize;
+			valid = snappy_uncompress(&compressed[0], compressed.size(), (char *)&output[0], &size) == SNAPPY_OK && size == expectedSize;
+		}
+	}
+	fclose(f);
+
+	if (!valid) {
+		WARN_LOG(G3D, "TextureScaler: ignoring bad scaled texture cache file %s", path.c_str());
+		File::Delete(path);
+	}
+	return valid;
+}
+
+size_t TextureScaler::SaveToDisk(const std::string &path, const ScaleKey &key, const u32 *data, size_t count) {
+	size_t compressedSize = snappy_max_compressed_length(count * sizeof(u32));
+	std::vector<char> compressed(compressedSize);
+	if (snappy_compress((const char *)data, count * sizeof(u32), &compressed[0], &compressedSize) != SNAPPY_OK) {
+		return 0;
+	}
+
+	ScaledCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SCALED_CACHE_MAGIC, sizeof(header.magic));
+	header.version = SCALED_CACHE_VERSION;
+	header.fullhash = key.fullhash;
+	header.cluthash = key.cluthash;
+	header.format = key.format;
+	header.width = key.width;
+	header.height = key.height;
+	header.factor = key.factor;
+	header.type = key.type;
+	header.deposterize = key.deposterize;
+	header.compressedSize = (u32)compressedSize;
+
+	FILE *f = File::OpenCFile(path, "wb");
+	if (!f) {
+		ERROR_LOG(G3D, "TextureScaler: unable to write %s", path.c_str());
+		return 0;
+	}
+	bool success = fwrite(&header, sizeof(header), 1, f) == 1;
+	success = success && fwrite(&compressed[0], 1, compressedSize, f) == compressedSize;
+	fclose(f);
+
+	if (!success) {
+		ERROR_LOG(G3D, "TextureScaler: unable to write %s", path.c_str());
+		File::Delete(path);
+		return 0;
+	}
+	return sizeof(header) + compressedSize;
+}
+
+void TextureScaler::ScanDiskCache(const std::string &dir) {
+	// Oldest first, so they're evicted first.  Covers all games, the budget is shared.
+	std::vector<std::pair<u64, DiskCacheFile> > found;
+	std::vector<FileInfo> games;
+	getFilesInDir(dir.c_str(), &games);
+	for (const FileInfo &game : games) {
+		if (!game.isDirectory) {
+			continue;
+		}
+		std::vector<FileInfo> files;
+		getFilesInDir(game.fullName.c_str(), &files, "bin");
+		for (const FileInfo &file : files) {
+			File::FileDetails details;
+			if (!File::GetFileDetails(file.fullName, &details)) {
+				continue;
+			}
+			DiskCacheFile entry;
+			entry.path = file.fullName;
+			entry.size = details.size;
+			found.push_back(std::make_pair(details.mtime, entry));
+		}
+	}
+	std::stable_sort(found.begin(), found.end(), [](const std::pair<u64, DiskCacheFile> &a, const std::pair<u64, DiskCacheFile> &b) {
+		return a.first < b.first;
+	});
+
+	std::vector<std::string> evicted;
+	{
+		lock_guard guard(queueLock_);
+		// Files saved while we were scanning are already listed, and are newer than the rest.
+		std::set<std::string> listed;
+		for (const DiskCacheFile &file : diskCacheFiles_) {
+			listed.insert(file.path);
+		}
+		auto pos = diskCacheFiles_.begin();
+		for (const auto &entry : found) {
+			if (listed.find(entry.second.path) != listed.end()) {
+				continue;
+			}
+			pos = diskCacheFiles_.insert(pos, entry.second) + 1;
+			diskCacheSize_ += entry.second.size;
+		}
+		EvictFromDiskCache(evicted);
+	}
+	for (const std::string &path : evicted) {
+		File::Delete(path);
+	}
+}
+
+void TextureScaler::AddToDiskCache(const std::string &path, size_t bytes) {
+	if (bytes == 0) {
+		return;
+	}
+
+	std::vector<std::string> evicted;
+	{
+		lock_guard guard(queueLock_);
+		DiskCacheFile entry;
+		entry.path = path;
+		entry.size = bytes;
+		diskCacheFiles_.push_back(entry);
+		diskCacheSize_ += bytes;
+		EvictFromDiskCache(evicted);
+	}
+	// Outside the lock, the GPU thread may be waiting on it.
+	for (const std::string &evictedPath : evicted) {
+		File::Delete(evictedPath);
+	}
+}
+
+void TextureScaler::EvictFromDiskCache(std::vector<std::string> &evicted) {
+	const u64 maxSize = (u64)std::max(1, g_Config.iTexScalingDiskCacheSizeMB) * 1024 * 1024;
+	while (diskCacheSize_ > maxSize && !diskCacheFiles_.empty()) {
+		const DiskCacheFile &oldest = diskCacheFiles_.front();
+		evicted.push_back(oldest.path);
+		diskCacheSize_ -= std::min(diskCacheSize_, oldest.size);
+		diskCacheFiles_.pop_front();
 	}
-#endif
 }
 
 void TextureScaler::ScaleXBRZ(int factor, u32* source, u32* dest, int width, int height) {
@@ -17,11 +17,17 @@
 
 #pragma once
 
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/mutex.h"
+#include "base/functional.h"
+#include "thread/thread.h"
 #include "Common/CommonTypes.h"
 #include "Common/MemoryUtil.h"
 
-#include <vector>
-
 class TextureScaler {
 public:
 	TextureScaler();
@@ -29,13 +35,67 @@ class TextureScaler {
 
 	void Scale(u32* &data, u32 &dstfmt, int &width, int &height, int factor);
 
+	// Like Scale, but looks in the scaled texture disk cache first and, with TexScalingAsync,
+	// hands the work to a background thread.  Returns false if the scaled texture isn't ready
+	// yet, leaving data untouched - the caller should use it as is and come back later.
+	bool ScaleCached(u32* &data, u32 &dstfmt, int &width, int &height, int factor, u32 fullhash, u32 cluthash);
+	// False while a queued scale of this texture is still being worked on.
+	bool IsScaleReady(u32 fullhash, u32 cluthash);
+	// Drops a queued scale or unclaimed result of this texture, e.g. when it's deleted.
+	void CancelScale(u32 fullhash, u32 cluthash);
+	// Drops queued scales and results nobody picked up.
+	void ClearPending();
+
+	int NumScalesPending();
+	// Seconds spent scaling (on any thread) since the last call.
+	double TakeScalingTime();
+
 	enum { XBRZ = 0, HYBRID = 1, BICUBIC = 2, HYBRID_BICUBIC = 3 };
 
 private:
+	struct ScaleKey {
+		u32 fullhash;
+		u32 cluthash;
+		u32 format;
+		u16 width;
+		u16 height;
+		u8 factor;
+		u8 type;
+		u8 deposterize;
+
+		bool operator ==(const ScaleKey &other) const {
+			return fullhash == other.fullhash && cluthash == other.cluthash && format == other.format && width == other.width && height == other.height && factor == other.factor && type == other.type && deposterize == other.deposterize;
+		}
+	};
+
+	struct ScaleJob {
+		ScaleKey key;
+		u32 seq;
+		bool done;
+		bool cancelled;
+		std::string diskPath;
+		std::vector<u32> input;
+		std::vector<u32> output;
+	};
+
 	virtual void ConvertTo8888(u32 format, u32* source, u32* &dest, int width, int height) = 0;
 	virtual int BytesPerPixel(u32 format) = 0;
 	virtual u32 Get8888Format() = 0;
 
+	void ScaleInto(u32 *input, u32 *output, int width, int height, int factor, int type, bool deposterize);
+	void ProcessJob(ScaleJob *job);
+	void StartWorker();
+	void WorkerFunc();
+	void RemoveJob(std::map<u64, ScaleJob *>::iterator iter);
+	std::string DiskCachePath(const ScaleKey &key);
+	static bool LoadFromDisk(const std::string &path, const ScaleKey &key, std::vector<u32> &output);
+	// Returns the bytes written, 0 on failure.
+	static size_t SaveToDisk(const std::string &path, const ScaleKey &key, const u32 *data, size_t count);
+	void ScanDiskCache(const std::string &dir);
+	void AddToDiskCache(const std::string &path, size_t bytes);
+	// Called with queueLock_ held.  The caller deletes the evicted files after releasing it.
+	void EvictFromDiskCache(std::vector<std::string> &evicted);
+
 	void ScaleXBRZ(int factor, u32* source, u32* dest, int width, int height);
 	void ScaleBilinear(int factor, u32* source, u32* dest, int width, int height);
 	void ScaleBicubicBSpline(int factor, u32* source, u32* dest, int width, int height);
@@ -50,4 +110,34 @@ class TextureScaler {
 	// maximum is (100 MB total for a 512 by 512 texture with scaling factor 5 and hybrid scaling)
 	// of course, scaling factor 5 is totally silly anyway
 	SimpleBuf<u32> bufInput, bufDeposter, bufOutput, bufTmp1, bufTmp2, bufTmp3;
+	// Held while using the buffers above, since the worker thread shares them.
+	recursive_mutex scaleLock_;
+
+	// Scaled textures handed out by ScaleCached.
+	std::vector<u32> bufCached_;
+	std::string diskCacheDir_;
+
+	// Everything below is protected by queueLock_.
+	recursive_mutex queueLock_;
+	condition_variable queueCond_;
+	std::thread *worker_;
+	bool workerActive_;
+	// Pending and finished jobs, by fullhash | cluthash << 32.
+	std::map<u64, ScaleJob *> jobs_;
+	std::deque<ScaleJob *> queue_;
+	// Finished jobs in completion order, so that unclaimed results can be dropped.
+	std::deque<std::pair<u64, u32> > finished_;
+	ScaleJob *running_;
+	// The disk cache directory the worker should list, empty if there's nothing to do.
+	std::string scanDir_;
+	u32 nextSeq_;
+	double scalingTime_;
+
+	struct DiskCacheFile {
+		std::string path;
+		u64 size;
+	};
+	// Files in the scaled texture disk cache, oldest first.
+	std::deque<DiskCacheFile> diskCacheFiles_;
+	u64 diskCacheSize_;
 };
@@ -180,3 +180,139 @@ void Lighter::Light(float colorOut0[4], float colorOut1[4], const float colorIn[
 		colorOut1[i] = lightSum1[i];
 	}
 }
+
+#if defined(_M_SSE)
+
+// These follow the order of operations of Vec3f (with _M_SSE) and clamp() exactly, so that
+// Light4() matches Light() bit for bit.
+static inline __m128 Length4(const __m128 v[3]) {
+	return _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(v[0], v[0]), _mm_add_ps(_mm_mul_ps(v[1], v[1]), _mm_mul_ps(v[2], v[2]))));
+}
+
+static inline __m128 Dot4(const __m128 a[3], const __m128 b[3]) {
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+}
+
+// Like clamp(in, 0.0f, 1.0f), NaNs pass through.
+static inline __m128 Clamp01(__m128 in) {
+	return _mm_max_ps(_mm_setzero_ps(), _mm_min_ps(_mm_set1_ps(1.0f), in));
+}
+
+static inline __m128 Select(__m128 mask, __m128 a, __m128 b) {
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// There's no vector powf, and it has to match the scalar one anyway.
+static inline __m128 Pow4(__m128 in, float e) {
+	float f[4];
+	_mm_storeu_ps(f, in);
+	for (int i = 0; i < 4; i++)
+		f[i] = powf(f[i], e);
+	return _mm_loadu_ps(f);
+}
+
+void Lighter::Light4(__m128 colorOut0[4], __m128 colorOut1[4], const __m128 colorIn[4], const __m128 pos[3], const __m128 norm[3]) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	__m128 ambient[4];
+	__m128 diffuse[4];
+	__m128 specular[4];
+	__m128 lightSum0[4];
+	__m128 lightSum1[4];
+	for (int i = 0; i < 4; i++) {
+		ambient[i] = (materialUpdate_ & 1) ? colorIn[i] : _mm_set1_ps(materialAmbient[i]);
+		diffuse[i] = (materialUpdate_ & 2) ? colorIn[i] : _mm_set1_ps(materialDiffuse[i]);
+		specular[i] = (materialUpdate_ & 4) ? colorIn[i] : _mm_set1_ps(materialSpecular[i]);
+		lightSum0[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(globalAmbient[i]), ambient[i]), _mm_set1_ps(materialEmissive[i]));
+		lightSum1[i] = zero;
+	}
+
+	for (int l = 0; l < 4; l++) {
+		if (!gstate.isLightChanEnabled(l))
+			continue;
+
+		GELightType type = gstate.getLightType(l);
+
+		__m128 toLight[3];
+		for (int i = 0; i < 3; i++) {
+			toLight[i] = _mm_set1_ps(lpos[l * 3 + i]);
+			if (type != GE_LIGHTTYPE_DIRECTIONAL)
+				toLight[i] = _mm_sub_ps(toLight[i], pos[i]);
+		}
+
+		__m128 distanceToLight = Length4(toLight);
+		__m128 hasDistance = _mm_cmpgt_ps(distanceToLight, zero);
+		for (int i = 0; i < 3; i++)
+			toLight[i] = Select(hasDistance, _mm_div_ps(toLight[i], distanceToLight), toLight[i]);
+		// Clamp dot to zero (order matters for NaNs.)
+		__m128 dot = _mm_max_ps(zero, _mm_and_ps(hasDistance, Dot4(toLight, norm)));
+
+		if (gstate.isUsingPoweredDiffuseLight(l))
+			dot = Pow4(dot, specCoef_);
+
+		// Attenuation
+		__m128 lightScale = zero;
+		__m128 d = distanceToLight;
+		const float *att = &latt[l * 3];
+		switch (type) {
+		case GE_LIGHTTYPE_DIRECTIONAL:
+			lightScale = one;
+			break;
+		case GE_LIGHTTYPE_POINT:
+			lightScale = Clamp01(_mm_div_ps(one, _mm_add_ps(_mm_add_ps(_mm_set1_ps(att[0]), _mm_mul_ps(_mm_set1_ps(att[1]), d)), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(att[2]), d), d))));
+			break;
+		case GE_LIGHTTYPE_SPOT:
+		case GE_LIGHTTYPE_UNKNOWN:
+			{
+				Vec3f lightDir = Vec3f(&ldir[l * 3]).Normalized();
+				const __m128 dir[3] = { _mm_set1_ps(lightDir.x), _mm_set1_ps(lightDir.y), _mm_set1_ps(lightDir.z) };
+				__m128 len = Length4(toLight);
+				const __m128 toLightN[3] = { _mm_div_ps(toLight[0], len), _mm_div_ps(toLight[1], len), _mm_div_ps(toLight[2], len) };
+				__m128 angle = Dot4(toLightN, dir);
+				__m128 inCone = _mm_cmpge_ps(angle, _mm_set1_ps(lcutoff[l]));
+				if (_mm_movemask_ps(inCone) != 0) {
+					__m128 att4 = Clamp01(_mm_div_ps(one, _mm_add_ps(_mm_add_ps(_mm_set1_ps(att[0]), _mm_mul_ps(_mm_set1_ps(att[1]), d)), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(att[2]), d), d))));
+					lightScale = _mm_and_ps(inCone, _mm_mul_ps(att4, Pow4(angle, lconv[l])));
+				}
+			}
+			break;
+		default:
+			// ILLEGAL
+			break;
+		}
+
+		if (gstate.isUsingSpecularLight(l)) {
+			// Real PSP specular: the viewer is at (0, 0, 1).
+			__m128 halfVec[3] = { _mm_add_ps(toLight[0], zero), _mm_add_ps(toLight[1], zero), _mm_add_ps(toLight[2], one) };
+			__m128 len = Length4(halfVec);
+			for (int i = 0; i < 3; i++)
+				halfVec[i] = _mm_div_ps(halfVec[i], len);
+
+			__m128 specDot = Dot4(halfVec, norm);
+			__m128 lit = _mm_cmpgt_ps(specDot, zero);
+			if (_mm_movemask_ps(lit) != 0) {
+				__m128 scale = _mm_mul_ps(Pow4(specDot, specCoef_), lightScale);
+				for (int i = 0; i < 4; i++) {
+					__m128 lightSpec = _mm_set1_ps(i < 3 ? lcolor[2][l][i] : 0.0f);
+					lightSum1[i] = _mm_add_ps(lightSum1[i], _mm_and_ps(lit, _mm_mul_ps(_mm_mul_ps(lightSpec, specular[i]), scale)));
+				}
+			}
+		}
+
+		for (int i = 0; i < 4; i++) {
+			__m128 lightAmbient = _mm_set1_ps(i < 3 ? lcolor[0][l][i] : 0.0f);
+			__m128 lightDiff = _mm_set1_ps(i < 3 ? lcolor[1][l][i] : 0.0f);
+			__m128 diff = _mm_mul_ps(_mm_mul_ps(lightDiff, diffuse[i]), dot);
+			lightSum0[i] = _mm_add_ps(lightSum0[i], _mm_mul_ps(_mm_add_ps(_mm_mul_ps(lightAmbient, ambient[i]), diff), lightScale));
+		}
+	}
+
+	// The colors must eventually be clamped, but we expect the caller to do that.
+	for (int i = 0; i < 4; i++) {
+		colorOut0[i] = lightSum0[i];
+		colorOut1[i] = lightSum1[i];
+	}
+}
+
+#endif
@@ -157,9 +157,13 @@ void TextureCacheDX9::Clear(bool delete_them) {
 		secondCacheSizeEstimate_ = 0;
 	}
 	fbTexInfo_.clear();
+	scaler.ClearPending();
 }
 
 void TextureCacheDX9::DeleteTexture(TexCache::iterator it) {
+	if (it->second.status & TexCacheEntry::STATUS_TO_SCALE) {
+		scaler.CancelScale(it->second.fullhash, it->second.cluthash);
+	}
 	ReleaseTexture(&it->second);
 	auto fbInfo = fbTexInfo_.find(it->second.addr);
 	if (fbInfo != fbTexInfo_.end()) {
@@ -750,6 +754,8 @@ void TextureCacheDX9::StartFrame() {
 		// INFO_LOG(G3D, "Scaled %i texels", texelsScaledThisFrame_);
 	}
 	texelsScaledThisFrame_ = 0;
+	gpuStats.msTextureScaling += scaler.TakeScalingTime();
+	gpuStats.numTexturesScalePending = scaler.NumScalesPending();
 	if (clearCacheNextFrame_) {
 		Clear(true);
 		clearCacheNextFrame_ = false;
@@ -1283,7 +1289,8 @@ void TextureCacheDX9::SetTexture(bool force) {
 		}
 
 		if (match && (entry->status & TexCacheEntry::STATUS_TO_SCALE) && g_Config.iTexScalingLevel != 1 && texelsScaledThisFrame_ < TEXCACHE_MAX_TEXELS_SCALED) {
-			if ((entry->status & TexCacheEntry::STATUS_CHANGE_FREQUENT) == 0) {
+			// Keep using the unscaled texture until the scaler thread is done with it.
+			if ((entry->status & TexCacheEntry::STATUS_CHANGE_FREQUENT) == 0 && scaler.IsScaleReady(entry->fullhash, entry->cluthash)) {
 				// INFO_LOG(G3D, "Reloading texture to do the scaling we skipped..");
 				match = false;
 				reason = "scaling";
@@ -1803,8 +1810,12 @@ void TextureCacheDX9::LoadTextureLevel(TexCacheEntry &entry, int level, int maxL
 	gpuStats.numTexturesDecoded++;
 
 	u32 *pixelData = (u32 *)finalBuf;
-	if (scaleFactor > 1 && (entry.status & TexCacheEntry::STATUS_CHANGE_FREQUENT) == 0)
-		scaler.Scale(pixelData, dstFmt, w, h, scaleFactor);
+	if (scaleFactor > 1 && (entry.status & TexCacheEntry::STATUS_CHANGE_FREQUENT) == 0) {
+		if (!scaler.ScaleCached(pixelData, dstFmt, w, h, scaleFactor, entry.fullhash, entry.cluthash)) {
+			// Not scaled yet, we'll reload it once it is.
+			entry.status |= TexCacheEntry::STATUS_TO_SCALE;
+		}
+	}
 
 	if ((entry.status & TexCacheEntry::STATUS_CHANGE_FREQUENT) == 0) {
 		TexCacheEntry::Status alphaStatus = CheckAlpha(pixelData, dstFmt, w, w, h);
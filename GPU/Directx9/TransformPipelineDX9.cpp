@@ -369,7 +369,7 @@ void TransformDrawEngineDX9::DecodeVertsStep() {
 	void *inds = dc.inds;
 	if (indexType == GE_VTYPE_IDX_NONE >> GE_VTYPE_IDX_SHIFT) {
 		// Decode the verts and apply morphing. Simple.
-		dec_->DecodeVerts(decoded + decodedVerts_ * (int)dec_->GetDecVtxFmt().stride,
+		DecodeVertsRange(dec_, decoded + decodedVerts_ * (int)dec_->GetDecVtxFmt().stride,
 			dc.verts, indexLowerBound, indexUpperBound);
 		decodedVerts_ += indexUpperBound - indexLowerBound + 1;
 		indexGen.AddPrim(dc.prim, dc.vertexCount);
@@ -427,7 +427,7 @@ void TransformDrawEngineDX9::DecodeVertsStep() {
 		}
 
 		// 3. Decode that range of vertex data.
-		dec_->DecodeVerts(decoded + decodedVerts_ * (int)dec_->GetDecVtxFmt().stride,
+		DecodeVertsRange(dec_, decoded + decodedVerts_ * (int)dec_->GetDecVtxFmt().stride,
 			dc.verts, indexLowerBound, indexUpperBound);
 		decodedVerts_ += vertexCount;
 
@@ -18,11 +18,13 @@
 #include <algorithm>
 #include <cstring>
 
+#include "base/timeutil.h"
 #include "ext/xxhash.h"
 #include "math/math_util.h"
 #include "profiler/profiler.h"
 
 #include "Common/ColorConv.h"
+#include "Common/ThreadPools.h"
 #include "Core/Host.h"
 #include "Core/MemMap.h"
 #include "Core/Reporting.h"
@@ -131,16 +133,17 @@ static u32 EstimateTexMemoryUsage(const TextureCache::TexCacheEntry *entry) {
 }
 
 void TextureCache::Clear(bool delete_them) {
+	CancelAllDecodeJobs();
 	glBindTexture(GL_TEXTURE_2D, 0);
 	lastBoundTexture = -1;
 	if (delete_them) {
 		for (TexCache::iterator iter = cache.begin(); iter != cache.end(); ++iter) {
 			DEBUG_LOG(G3D, "Deleting texture %i", iter->second.textureName);
-			glDeleteTextures(1, &iter->second.textureName);
+			ReleaseTexture(iter->second);
 		}
 		for (TexCache::iterator iter = secondCache.begin(); iter != secondCache.end(); ++iter) {
 			DEBUG_LOG(G3D, "Deleting texture %i", iter->second.textureName);
-			glDeleteTextures(1, &iter->second.textureName);
+			ReleaseTexture(iter->second);
 		}
 		if (!nameCache_.empty()) {
 			glDeleteTextures((GLsizei)nameCache_.size(), &nameCache_[0]);
@@ -154,11 +157,17 @@ void TextureCache::Clear(bool delete_them) {
 		cacheSizeEstimate_ = 0;
 		secondCacheSizeEstimate_ = 0;
 	}
+	sharedTextures_.Clear();
 	fbTexInfo_.clear();
+	scaler.ClearPending();
 }
 
 void TextureCache::DeleteTexture(TexCache::iterator it) {
-	glDeleteTextures(1, &it->second.textureName);
+	CancelDecodeJob(&it->second);
+	if (it->second.status & TexCacheEntry::STATUS_TO_SCALE) {
+		scaler.CancelScale(it->second.fullhash, it->second.cluthash);
+	}
+	ReleaseTexture(it->second);
 	auto fbInfo = fbTexInfo_.find(it->second.addr);
 	if (fbInfo != fbTexInfo_.end()) {
 		fbTexInfo_.erase(fbInfo);
@@ -199,7 +208,8 @@ void TextureCache::Decimate() {
 		for (TexCache::iterator iter = secondCache.begin(); iter != secondCache.end(); ) {
 			// In low memory mode, we kill them all.
 			if (lowMemoryMode_ || iter->second.lastFrame + TEXTURE_SECOND_KILL_AGE < gpuStats.numFlips) {
-				glDeleteTextures(1, &iter->second.textureName);
+				CancelDecodeJob(&iter->second);
+				ReleaseTexture(iter->second);
 				secondCacheSizeEstimate_ -= EstimateTexMemoryUsage(&iter->second);
 				secondCache.erase(iter++);
 			} else {
@@ -472,7 +482,8 @@ void TextureCache::NotifyFramebuffer(u32 address, VirtualFramebuffer *framebuffe
 	}
 }
 
-void *TextureCache::UnswizzleFromMem(const u8 *texptr, u32 bufw, u32 height, u32 bytesPerPixel) {
+void *TextureCache::UnswizzleFromMem(DecodeContext &ctx, const u8 *texptr, u32 bufw, u32 height, u32 bytesPerPixel) {
+	SimpleBuf<u32> &tmpTexBuf32 = *ctx.tmpTexBuf32;
 	const u32 rowWidth = (bytesPerPixel > 0) ? (bufw * bytesPerPixel) : (bufw / 2);
 	const u32 pitch = rowWidth / 4;
 	const int bxc = rowWidth / 16;
@@ -528,47 +539,51 @@ void *TextureCache::UnswizzleFromMem(const u8 *texptr, u32 bufw, u32 height, u32
 	return tmpTexBuf32.data();
 }
 
-void *TextureCache::ReadIndexedTex(int level, const u8 *texptr, int bytesPerIndex, GLuint dstFmt, int bufw) {
-	int w = gstate.getTextureWidth(level);
-	int h = gstate.getTextureHeight(level);
+void *TextureCache::ReadIndexedTex(DecodeContext &ctx, int level, const u8 *texptr, int bytesPerIndex, GLuint dstFmt, int bufw) {
+	const GPUgstate &state = *ctx.state;
+	SimpleBuf<u32> &tmpTexBuf32 = *ctx.tmpTexBuf32;
+	SimpleBuf<u16> &tmpTexBuf16 = *ctx.tmpTexBuf16;
+	SimpleBuf<u32> &tmpTexBufRearrange = *ctx.tmpTexBufRearrange;
+	int w = state.getTextureWidth(level);
+	int h = state.getTextureHeight(level);
 	int length = bufw * h;
 	void *buf = NULL;
-	switch (gstate.getClutPaletteFormat()) {
+	switch (state.getClutPaletteFormat()) {
 	case GE_CMODE_16BIT_BGR5650:
 	case GE_CMODE_16BIT_ABGR5551:
 	case GE_CMODE_16BIT_ABGR4444:
 		{
 		tmpTexBuf16.resize(std::max(bufw, w) * h);
 		tmpTexBufRearrange.resize(std::max(bufw, w) * h);
-		const u16 *clut = GetCurrentClut<u16>();
-		if (!gstate.isTextureSwizzled()) {
+		const u16 *clut = (const u16 *)ctx.clut;
+		if (!state.isTextureSwizzled()) {
 			switch (bytesPerIndex) {
 			case 1:
-				DeIndexTexture(tmpTexBuf16.data(), (const u8 *)texptr, length, clut);
+				DeIndexTexture(tmpTexBuf16.data(), (const u8 *)texptr, length, clut, state);
 				break;
 
 			case 2:
-				DeIndexTexture(tmpTexBuf16.data(), (const u16_le *)texptr, length, clut);
+				DeIndexTexture(tmpTexBuf16.data(), (const u16_le *)texptr, length, clut, state);
 				break;
 
 			case 4:
-				DeIndexTexture(tmpTexBuf16.data(), (const u32_le *)texptr, length, clut);
+				DeIndexTexture(tmpTexBuf16.data(), (const u32_le *)texptr, length, clut, state);
 				break;
 			}
 		} else {
 			tmpTexBuf32.resize(std::max(bufw, w) * h);
-			UnswizzleFromMem(texptr, bufw, h, bytesPerIndex);
+			UnswizzleFromMem(ctx, texptr, bufw, h, bytesPerIndex);
 			switch (bytesPerIndex) {
 			case 1:
-				DeIndexTexture(tmpTexBuf16.data(), (u8 *) tmpTexBuf32.data(), length, clut);
+				DeIndexTexture(tmpTexBuf16.data(), (u8 *) tmpTexBuf32.data(), length, clut, state);
 				break;
 
 			case 2:
-				DeIndexTexture(tmpTexBuf16.data(), (u16 *) tmpTexBuf32.data(), length, clut);
+				DeIndexTexture(tmpTexBuf16.data(), (u16 *) tmpTexBuf32.data(), length, clut, state);
 				break;
 
 			case 4:
-				DeIndexTexture(tmpTexBuf16.data(), (u32 *) tmpTexBuf32.data(), length, clut);
+				DeIndexTexture(tmpTexBuf16.data(), (u32 *) tmpTexBuf32.data(), length, clut, state);
 				break;
 			}
 		}
@@ -580,41 +595,41 @@ void *TextureCache::ReadIndexedTex(int level, const u8 *texptr, int bytesPerInde
 		{
 		tmpTexBuf32.resize(std::max(bufw, w) * h);
 		tmpTexBufRearrange.resize(std::max(bufw, w) * h);
-		const u32 *clut = GetCurrentClut<u32>();
-		if (!gstate.isTextureSwizzled()) {
+		const u32 *clut = (const u32 *)ctx.clut;
+		if (!state.isTextureSwizzled()) {
 			switch (bytesPerIndex) {
 			case 1:
-				DeIndexTexture(tmpTexBuf32.data(), (const u8 *)texptr, length, clut);
+				DeIndexTexture(tmpTexBuf32.data(), (const u8 *)texptr, length, clut, state);
 				break;
 
 			case 2:
-				DeIndexTexture(tmpTexBuf32.data(), (const u16_le *)texptr, length, clut);
+				DeIndexTexture(tmpTexBuf32.data(), (const u16_le *)texptr, length, clut, state);
 				break;
 
 			case 4:
-				DeIndexTexture(tmpTexBuf32.data(), (const u32_le *)texptr, length, clut);
+				DeIndexTexture(tmpTexBuf32.data(), (const u32_le *)texptr, length, clut, state);
 				break;
 			}
 			buf = tmpTexBuf32.data();
 		} else {
-			UnswizzleFromMem(texptr, bufw, h, bytesPerIndex);
+			UnswizzleFromMem(ctx, texptr, bufw, h, bytesPerIndex);
 			// Since we had to unswizzle to tmpTexBuf32, let's output to tmpTexBuf16.
 			tmpTexBuf16.resize(std::max(bufw, w) * h * 2);
 			u32 *dest32 = (u32 *) tmpTexBuf16.data();
 			switch (bytesPerIndex) {
 			case 1:
-				DeIndexTexture(dest32, (u8 *) tmpTexBuf32.data(), length, clut);
+				DeIndexTexture(dest32, (u8 *) tmpTexBuf32.data(), length, clut, state);
 				buf = dest32;
 				break;
 
 			case 2:
-				DeIndexTexture(dest32, (u16 *) tmpTexBuf32.data(), length, clut);
+				DeIndexTexture(dest32, (u16 *) tmpTexBuf32.data(), length, clut, state);
 				buf = dest32;
 				break;
 
 			case 4:
 				// TODO: If a game actually uses this mode, check if using dest32 or tmpTexBuf32 is faster.
-				DeIndexTexture(tmpTexBuf32.data(), tmpTexBuf32.data(), length, clut);
+				DeIndexTexture(tmpTexBuf32.data(), tmpTexBuf32.data(), length, clut, state);
 				buf = tmpTexBuf32.data();
 				break;
 			}
@@ -623,7 +638,7 @@ void *TextureCache::ReadIndexedTex(int level, const u8 *texptr, int bytesPerInde
 		break;
 
 	default:
-		ERROR_LOG_REPORT(G3D, "Unhandled clut texture mode %d!!!", (gstate.clutformat & 3));
+		ERROR_LOG_REPORT(G3D, "Unhandled clut texture mode %d!!!", (state.clutformat & 3));
 		break;
 	}
 
@@ -776,6 +791,24 @@ void TextureCache::StartFrame() {
 		// INFO_LOG(G3D, "Scaled %i texels", texelsScaledThisFrame_);
 	}
 	texelsScaledThisFrame_ = 0;
+	gpuStats.msTextureScaling += scaler.TakeScalingTime();
+	gpuStats.numTexturesScalePending = scaler.NumScalesPending();
+
+	// Upload whatever finished decoding, so the jobs don't pile up for textures not drawn lately.
+	if (!decodeJobs_.empty()) {
+		std::vector<TexCacheEntry *> done;
+		for (auto iter = decodeJobs_.begin(); iter != decodeJobs_.end(); ++iter) {
+			if (iter->second->task->IsDone()) {
+				done.push_back(iter->second->entry);
+			}
+		}
+		for (size_t i = 0; i < done.size(); i++) {
+			FinishDecodeJob(done[i], false);
+		}
+	}
+	gpuStats.numTexturesDecodePending = (int)decodeJobs_.size();
+	gpuStats.numTextureDedupeBytesSaved = sharedTextures_.BytesSaved();
+
 	if (clearCacheNextFrame_) {
 		Clear(true);
 		clearCacheNextFrame_ = false;
@@ -1005,11 +1038,20 @@ void TextureCache::ApplyTexture() {
 			}
 		}
 
+		// In placeholder mode, we keep drawing with whatever's there until the decode is done.
+		if (!decodeJobs_.empty() && decodeJobs_.count(nextTexture_) != 0) {
+			if (FinishDecodeJob(nextTexture_, g_Config.iTexDecodeMode != 2)) {
+				gstate_c.textureFullAlpha = nextTexture_->GetAlphaStatus() == TexCacheEntry::STATUS_ALPHA_FULL;
+				gstate_c.textureSimpleAlpha = nextTexture_->GetAlphaStatus() != TexCacheEntry::STATUS_ALPHA_UNKNOWN;
+			}
+		}
+
 		if (nextTexture_->textureName != lastBoundTexture) {
 			glBindTexture(GL_TEXTURE_2D, nextTexture_->textureName);
 			lastBoundTexture = nextTexture_->textureName;
 		}
-		UpdateSamplingParams(*nextTexture_, false);
+		// Other entries drawing the same texture may have changed its params since.
+		UpdateSamplingParams(*nextTexture_, (nextTexture_->status & TexCacheEntry::STATUS_SHARED) != 0);
 	}
 
 	nextTexture_ = nullptr;
@@ -1345,7 +1387,8 @@ void TextureCache::SetTexture(bool force) {
 		}
 
 		if (match && (entry->status & TexCacheEntry::STATUS_TO_SCALE) && g_Config.iTexScalingLevel != 1 && texelsScaledThisFrame_ < TEXCACHE_MAX_TEXELS_SCALED) {
-			if ((entry->status & TexCacheEntry::STATUS_CHANGE_FREQUENT) == 0) {
+			// Keep using the unscaled texture until the scaler thread is done with it.
+			if ((entry->status & TexCacheEntry::STATUS_CHANGE_FREQUENT) == 0 && scaler.IsScaleReady(entry->fullhash, entry->cluthash)) {
 				// INFO_LOG(G3D, "Reloading texture to do the scaling we skipped..");
 				match = false;
 				reason = "scaling";
@@ -1364,12 +1407,20 @@ void TextureCache::SetTexture(bool force) {
 			VERBOSE_LOG(G3D, "Texture at %08x Found in Cache, applying", texaddr);
 			return; //Done!
 		} else {
+			// If the texture name lives on in the second cache, it needs the pending contents.
+			if (doDelete) {
+				CancelDecodeJob(entry);
+			} else {
+				FinishDecodeJob(entry, true);
+			}
 			cacheSizeEstimate_ -= EstimateTexMemoryUsage(entry);
 			entry->numInvalidated++;
 			gpuStats.numTextureInvalidations++;
 			DEBUG_LOG(G3D, "Texture different or overwritten, reloading at %08x: %s", texaddr, reason);
 			if (doDelete) {
-				if (entry->maxLevel == maxLevel && entry->dim == gstate.getTextureDimension(0) && entry->format == format && g_Config.iTexScalingLevel == 1) {
+				// Indexed textures must keep their contents, others may be using them or find them later.
+				bool indexed = sharedTextures_.Contains(entry->textureName);
+				if (entry->maxLevel == maxLevel && entry->dim == gstate.getTextureDimension(0) && entry->format == format && g_Config.iTexScalingLevel == 1 && !indexed) {
 					// Actually, if size and number of levels match, let's try to avoid deleting and recreating.
 					// Instead, let's use glTexSubImage to replace the images.
 					replaceImages = true;
@@ -1377,7 +1428,7 @@ void TextureCache::SetTexture(bool force) {
 					if (entry->textureName == lastBoundTexture) {
 						lastBoundTexture = -1;
 					}
-					glDeleteTextures(1, &entry->textureName);
+					ReleaseTexture(*entry);
 				}
 			}
 			// Clear the reliable bit if set.
@@ -1434,7 +1485,7 @@ void TextureCache::SetTexture(bool force) {
 	entry->fullhash = fullhash == 0 ? QuickTexHash(texaddr, bufw, w, h, format, entry) : fullhash;
 	entry->cluthash = cluthash;
 
-	entry->status &= ~TexCacheEntry::STATUS_ALPHA_MASK;
+	entry->status &= ~(TexCacheEntry::STATUS_ALPHA_MASK | TexCacheEntry::STATUS_SHARED);
 
 	gstate_c.curTextureWidth = w;
 	gstate_c.curTextureHeight = h;
@@ -1552,33 +1603,44 @@ void TextureCache::SetTexture(bool force) {
 	// the bottom few levels or rely on OpenGL's autogen mipmaps instead, which might not
 	// be as good quality as the game's own (might even be better in some cases though).
 
-	// Always load base level texture here 
-	LoadTextureLevel(*entry, 0, replaceImages, scaleFactor, dstFmt);
-	
+	int lastLevel = 0;
+	bool genMipmap = false;
 	// Mipmapping only enable when texture scaling disable
 	if (maxLevel > 0 && g_Config.iTexScalingLevel == 1) {
 		if (gstate_c.Supports(GPU_SUPPORTS_TEXTURE_LOD_CONTROL)) {
 			if (badMipSizes) {
 				// WARN_LOG(G3D, "Bad mipmap for texture sized %dx%dx%d - autogenerating", w, h, (int)format);
-				glGenerateMipmap(GL_TEXTURE_2D);
+				genMipmap = true;
 			} else {
-				for (int i = 1; i <= maxLevel; i++) {
-					LoadTextureLevel(*entry, i, replaceImages, scaleFactor, dstFmt);
-				}
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxLevel);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_LOD, (float)maxLevel);
+				lastLevel = maxLevel;
 			}
 		} else {
 			// Avoid PowerVR driver bug
 			if (w > 1 && h > 1 && !(h > w && (gl_extensions.bugs & BUG_PVR_GENMIPMAP_HEIGHT_GREATER))) {  // Really! only seems to fail if height > width
 				// NOTICE_LOG(G3D, "Generating mipmap for texture sized %dx%d%d", w, h, (int)format);
-				glGenerateMipmap(GL_TEXTURE_2D);
+				genMipmap = true;
 			} else {
 				entry->maxLevel = 0;
 			}
 		}
-	} else if (gstate_c.Supports(GPU_SUPPORTS_TEXTURE_LOD_CONTROL)) {
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	}
+
+	ContentKey contentKey;
+	const bool shareable = GetContentKey(*entry, scaleFactor, lastLevel, genMipmap, contentKey);
+
+	if (shareable && AcquireSharedTexture(entry, contentKey, replaceImages)) {
+		// Same contents as a texture we already have (say, at another address), nothing to decode.
+	} else if (g_Config.iTexDecodeMode != 0 && scaleFactor == 1 && (entry->status & TexCacheEntry::STATUS_CHANGE_FREQUENT) == 0) {
+		// Textures that change every few frames aren't worth the copies, and scaling wants the result right away.
+		StartDecodeJob(entry, dstFmt, lastLevel, genMipmap, replaceImages, shareable ? &contentKey : nullptr);
+	} else {
+		for (int i = 0; i <= lastLevel; i++) {
+			LoadTextureLevel(*entry, i, replaceImages, scaleFactor, dstFmt);
+		}
+		SetMipmapParams(lastLevel, genMipmap);
+		if (shareable) {
+			RegisterSharedTexture(*entry, contentKey);
+		}
 	}
 
 	int aniso = 1 << g_Config.iAnisotropyLevel;
@@ -1630,11 +1692,15 @@ GLenum TextureCache::GetDestFormat(GETextureFormat format, GEPaletteFormat clutF
 	}
 }
 
-void *TextureCache::DecodeTextureLevel(GETextureFormat format, GEPaletteFormat clutformat, int level, u32 &texByteAlign, GLenum dstFmt, int *bufwout) {
+void *TextureCache::DecodeTextureLevel(DecodeContext &ctx, GETextureFormat format, GEPaletteFormat clutformat, int level, u32 &texByteAlign, GLenum dstFmt, int *bufwout) {
+	const GPUgstate &state = *ctx.state;
+	SimpleBuf<u32> &tmpTexBuf32 = *ctx.tmpTexBuf32;
+	SimpleBuf<u16> &tmpTexBuf16 = *ctx.tmpTexBuf16;
+	SimpleBuf<u32> &tmpTexBufRearrange = *ctx.tmpTexBufRearrange;
 	void *finalBuf = NULL;
 
-	u32 texaddr = gstate.getTextureAddress(level);
-	bool swizzled = gstate.isTextureSwizzled();
+	u32 texaddr = state.getTextureAddress(level);
+	bool swizzled = state.isTextureSwizzled();
 	if ((texaddr & 0x00600000) != 0 && Memory::IsVRAMAddress(texaddr)) {
 		// This means it's in a mirror, possibly a swizzled mirror.  Let's report.
 		WARN_LOG_REPORT_ONCE(texmirror, G3D, "Decoding texture from VRAM mirror at %08x swizzle=%d", texaddr, swizzled ? 1 : 0);
@@ -1645,17 +1711,17 @@ void *TextureCache::DecodeTextureLevel(GETextureFormat format, GEPaletteFormat c
 		// Note that (texaddr & 0x00600000) == 0x00600000 is very likely to be depth texturing.
 	}
 
-	int bufw = GetTextureBufw(level, texaddr, format);
+	int bufw = GetTextureBufw(level, texaddr, format, state);
 	if (bufwout)
 		*bufwout = bufw;
-	int w = gstate.getTextureWidth(level);
-	int h = gstate.getTextureHeight(level);
-	const u8 *texptr = Memory::GetPointer(texaddr);
+	int w = state.getTextureWidth(level);
+	int h = state.getTextureHeight(level);
+	const u8 *texptr = ctx.levelData[level] ? ctx.levelData[level] : Memory::GetPointer(texaddr);
 
 	switch (format) {
 	case GE_TFMT_CLUT4:
 		{
-		const bool mipmapShareClut = gstate.isClutSharedForMipmaps();
+		const bool mipmapShareClut = state.isClutSharedForMipmaps();
 		const int clutSharingOffset = mipmapShareClut ? 0 : level * 16;
 
 		switch (clutformat) {
@@ -1665,21 +1731,21 @@ void *TextureCache::DecodeTextureLevel(GETextureFormat format, GEPaletteFormat c
 			{
 			tmpTexBuf16.resize(std::max(bufw, w) * h);
 			tmpTexBufRearrange.resize(std::max(bufw, w) * h);
-			const u16 *clut = GetCurrentClut<u16>() + clutSharingOffset;
+			const u16 *clut = (const u16 *)ctx.clut + clutSharingOffset;
 			texByteAlign = 2;
 			if (!swizzled) {
-				if (clutAlphaLinear_ && mipmapShareClut) {
-					DeIndexTexture4Optimal(tmpTexBuf16.data(), texptr, bufw * h, clutAlphaLinearColor_);
+				if (ctx.clutAlphaLinear && mipmapShareClut) {
+					DeIndexTexture4Optimal(tmpTexBuf16.data(), texptr, bufw * h, ctx.clutAlphaLinearColor);
 				} else {
-					DeIndexTexture4(tmpTexBuf16.data(), texptr, bufw * h, clut);
+					DeIndexTexture4(tmpTexBuf16.data(), texptr, bufw * h, clut, state);
 				}
 			} else {
 				tmpTexBuf32.resize(std::max(bufw, w) * h);
-				UnswizzleFromMem(texptr, bufw, h, 0);
-				if (clutAlphaLinear_ && mipmapShareClut) {
-					DeIndexTexture4Optimal(tmpTexBuf16.data(), (const u8 *)tmpTexBuf32.data(), bufw * h, clutAlphaLinearColor_);
+				UnswizzleFromMem(ctx, texptr, bufw, h, 0);
+				if (ctx.clutAlphaLinear && mipmapShareClut) {
+					DeIndexTexture4Optimal(tmpTexBuf16.data(), (const u8 *)tmpTexBuf32.data(), bufw * h, ctx.clutAlphaLinearColor);
 				} else {
-					DeIndexTexture4(tmpTexBuf16.data(), (const u8 *)tmpTexBuf32.data(), bufw * h, clut);
+					DeIndexTexture4(tmpTexBuf16.data(), (const u8 *)tmpTexBuf32.data(), bufw * h, clut, state);
 				}
 			}
 			finalBuf = tmpTexBuf16.data();
@@ -1690,40 +1756,40 @@ void *TextureCache::DecodeTextureLevel(GETextureFormat format, GEPaletteFormat c
 			{
 			tmpTexBuf32.resize(std::max(bufw, w) * h);
 			tmpTexBufRearrange.resize(std::max(bufw, w) * h);
-			const u32 *clut = GetCurrentClut<u32>() + clutSharingOffset;
+			const u32 *clut = (const u32 *)ctx.clut + clutSharingOffset;
 			if (!swizzled) {
-				DeIndexTexture4(tmpTexBuf32.data(), texptr, bufw * h, clut);
+				DeIndexTexture4(tmpTexBuf32.data(), texptr, bufw * h, clut, state);
 				finalBuf = tmpTexBuf32.data();
 			} else {
-				UnswizzleFromMem(texptr, bufw, h, 0);
+				UnswizzleFromMem(ctx, texptr, bufw, h, 0);
 				// Let's reuse tmpTexBuf16, just need double the space.
 				tmpTexBuf16.resize(std::max(bufw, w) * h * 2);
-				DeIndexTexture4((u32 *)tmpTexBuf16.data(), (u8 *)tmpTexBuf32.data(), bufw * h, clut);
+				DeIndexTexture4((u32 *)tmpTexBuf16.data(), (u8 *)tmpTexBuf32.data(), bufw * h, clut, state);
 				finalBuf = tmpTexBuf16.data();
 			}
 			}
 			break;
 
 		default:
-			ERROR_LOG_REPORT(G3D, "Unknown CLUT4 texture mode %d", gstate.getClutPaletteFormat());
+			ERROR_LOG_REPORT(G3D, "Unknown CLUT4 texture mode %d", state.getClutPaletteFormat());
 			return NULL;
 		}
 		}
 		break;
 
 	case GE_TFMT_CLUT8:
-		texByteAlign = texByteAlignMap[gstate.getClutPaletteFormat()];
-		finalBuf = ReadIndexedTex(level, texptr, 1, dstFmt, bufw);
+		texByteAlign = texByteAlignMap[state.getClutPaletteFormat()];
+		finalBuf = ReadIndexedTex(ctx, level, texptr, 1, dstFmt, bufw);
 		break;
 
 	case GE_TFMT_CLUT16:
-		texByteAlign = texByteAlignMap[gstate.getClutPaletteFormat()];
-		finalBuf = ReadIndexedTex(level, texptr, 2, dstFmt, bufw);
+		texByteAlign = texByteAlignMap[state.getClutPaletteFormat()];
+		finalBuf = ReadIndexedTex(ctx, level, texptr, 2, dstFmt, bufw);
 		break;
 
 	case GE_TFMT_CLUT32:
-		texByteAlign = texByteAlignMap[gstate.getClutPaletteFormat()];
-		finalBuf = ReadIndexedTex(level, texptr, 4, dstFmt, bufw);
+		texByteAlign = texByteAlignMap[state.getClutPaletteFormat()];
+		finalBuf = ReadIndexedTex(ctx, level, texptr, 4, dstFmt, bufw);
 		break;
 
 	case GE_TFMT_4444:
@@ -1739,7 +1805,7 @@ void *TextureCache::DecodeTextureLevel(GETextureFormat format, GEPaletteFormat c
 			ConvertColors(finalBuf, texptr, dstFmt, bufw * h);
 		} else {
 			tmpTexBuf32.resize(std::max(bufw, w) * h);
-			finalBuf = UnswizzleFromMem(texptr, bufw, h, 2);
+			finalBuf = UnswizzleFromMem(ctx, texptr, bufw, h, 2);
 			ConvertColors(finalBuf, finalBuf, dstFmt, bufw * h);
 		}
 		break;
@@ -1747,7 +1813,7 @@ void *TextureCache::DecodeTextureLevel(GETextureFormat format, GEPaletteFormat c
 	case GE_TFMT_8888:
 		if (!swizzled) {
 			// Special case: if we don't need to deal with packing, we don't need to copy.
-			if ((g_Config.iTexScalingLevel == 1 && gstate_c.Supports(GPU_SUPPORTS_UNPACK_SUBIMAGE)) || w == bufw) {
+			if (ctx.unpackRowLength || w == bufw) {
 				if (UseBGRA8888()) {
 					tmpTexBuf32.resize(std::max(bufw, w) * h);
 					finalBuf = tmpTexBuf32.data();
@@ -1763,7 +1829,7 @@ void *TextureCache::DecodeTextureLevel(GETextureFormat format, GEPaletteFormat c
 			}
 		} else {
 			tmpTexBuf32.resize(std::max(bufw, w) * h);
-			finalBuf = UnswizzleFromMem(texptr, bufw, h, 4);
+			finalBuf = UnswizzleFromMem(ctx, texptr, bufw, h, 4);
 			ConvertColors(finalBuf, finalBuf, dstFmt, bufw * h);
 		}
 		break;
@@ -1840,7 +1906,7 @@ void *TextureCache::DecodeTextureLevel(GETextureFormat format, GEPaletteFormat c
 		ERROR_LOG_REPORT(G3D, "NO finalbuf! Will crash!");
 	}
 
-	if (!(g_Config.iTexScalingLevel == 1 && gstate_c.Supports(GPU_SUPPORTS_UNPACK_SUBIMAGE)) && w != bufw) {
+	if (!ctx.unpackRowLength && w != bufw) {
 		int pixelSize;
 		switch (dstFmt) {
 		case GL_UNSIGNED_SHORT_4_4_4_4:
@@ -1899,18 +1965,19 @@ void TextureCache::LoadTextureLevel(TexCacheEntry &entry, int level, bool replac
 	int w = gstate.getTextureWidth(level);
 	int h = gstate.getTextureHeight(level);
 	bool useUnpack = false;
-	bool useBGRA;
 	u32 *pixelData;
+	// TODO: only do this once
+	u32 texByteAlign = 1;
+	int bufw;
 	{
 
 	PROFILE_THIS_SCOPE("decodetex");
 
-	// TODO: only do this once
-	u32 texByteAlign = 1;
-
 	GEPaletteFormat clutformat = gstate.getClutPaletteFormat();
-	int bufw;
-	void *finalBuf = DecodeTextureLevel(GETextureFormat(entry.format), clutformat, level, texByteAlign, dstFmt, &bufw);
+	DecodeContext ctx = GetDecodeContext();
+	double st = real_time_now();
+	void *finalBuf = DecodeTextureLevel(ctx, GETextureFormat(entry.format), clutformat, level, texByteAlign, dstFmt, &bufw);
+	gpuStats.msTextureDecoding += real_time_now() - st;
 	if (finalBuf == NULL) {
 		return;
 	}
@@ -1918,18 +1985,17 @@ void TextureCache::LoadTextureLevel(TexCacheEntry &entry, int level, bool replac
 	gpuStats.numTexturesDecoded++;
 
 	// Can restore these and remove the fixup at the end of DecodeTextureLevel on desktop GL and GLES 3.
-	if ((g_Config.iTexScalingLevel == 1 && gstate_c.Supports(GPU_SUPPORTS_UNPACK_SUBIMAGE)) && w != bufw) {
-		glPixelStorei(GL_UNPACK_ROW_LENGTH, bufw);
+	if (ctx.unpackRowLength && w != bufw) {
 		useUnpack = true;
 	}
 
-	glPixelStorei(GL_UNPACK_ALIGNMENT, texByteAlign);
-
-	useBGRA = UseBGRA8888() && dstFmt == GL_UNSIGNED_BYTE;
-
 	pixelData = (u32 *)finalBuf;
-	if (scaleFactor > 1 && (entry.status & TexCacheEntry::STATUS_CHANGE_FREQUENT) == 0)
-		scaler.Scale(pixelData, dstFmt, w, h, scaleFactor);
+	if (scaleFactor > 1 && (entry.status & TexCacheEntry::STATUS_CHANGE_FREQUENT) == 0) {
+		if (!scaler.ScaleCached(pixelData, dstFmt, w, h, scaleFactor, entry.fullhash, entry.cluthash)) {
+			// Not scaled yet, we'll reload it once it is.
+			entry.status |= TexCacheEntry::STATUS_TO_SCALE;
+		}
+	}
 
 	if ((entry.status & TexCacheEntry::STATUS_CHANGE_FREQUENT) == 0) {
 		TexCacheEntry::Status alphaStatus = CheckAlpha(pixelData, dstFmt, useUnpack ? bufw : w, w, h);
@@ -1939,19 +2005,28 @@ void TextureCache::LoadTextureLevel(TexCacheEntry &entry, int level, bool replac
 	}
 	}
 
+	UploadTextureLevel(level, replaceImages, w, h, dstFmt, pixelData, useUnpack ? bufw : w, texByteAlign);
+}
+
+void TextureCache::UploadTextureLevel(int level, bool replaceImages, int w, int h, GLenum dstFmt, const void *pixels, int rowLength, u32 texByteAlign) {
+	if (rowLength != w) {
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, texByteAlign);
+
 	GLuint components = dstFmt == GL_UNSIGNED_SHORT_5_6_5 ? GL_RGB : GL_RGBA;
 
 	GLuint components2 = components;
-	if (useBGRA) {
+	if (UseBGRA8888() && dstFmt == GL_UNSIGNED_BYTE) {
 		components2 = GL_BGRA_EXT;
 	}
 
 	if (replaceImages) {
 		PROFILE_THIS_SCOPE("repltex");
-		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, components2, dstFmt, pixelData);
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, components2, dstFmt, pixels);
 	} else {
 		PROFILE_THIS_SCOPE("loadtex");
-		glTexImage2D(GL_TEXTURE_2D, level, components, w, h, 0, components2, dstFmt, pixelData);
+		glTexImage2D(GL_TEXTURE_2D, level, components, w, h, 0, components2, dstFmt, pixels);
 		if (!lowMemoryMode_) {
 			GLenum err = glGetError();
 			if (err == GL_OUT_OF_MEMORY) {
@@ -1960,16 +2035,261 @@ void TextureCache::LoadTextureLevel(TexCacheEntry &entry, int level, bool replac
 				decimationCounter_ = 0;
 				Decimate();
 				// Try again, now that we've cleared out textures in lowMemoryMode_.
-				glTexImage2D(GL_TEXTURE_2D, level, components, w, h, 0, components2, dstFmt, pixelData);
+				glTexImage2D(GL_TEXTURE_2D, level, components, w, h, 0, components2, dstFmt, pixels);
 			}
 		}
 	}
 
-	if (useUnpack) {
+	if (rowLength != w) {
 		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 	}
 }
 
+void TextureCache::SetMipmapParams(int lastLevel, bool genMipmap) {
+	if (genMipmap) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+	} else if (lastLevel > 0) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, lastLevel);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_LOD, (float)lastLevel);
+	} else if (gstate_c.Supports(GPU_SUPPORTS_TEXTURE_LOD_CONTROL)) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	}
+}
+
+TextureCache::DecodeContext TextureCache::GetDecodeContext() {
+	DecodeContext ctx;
+	ctx.state = &gstate;
+	memset(ctx.levelData, 0, sizeof(ctx.levelData));
+	ctx.clut = clutBuf_;
+	ctx.clutAlphaLinear = clutAlphaLinear_;
+	ctx.clutAlphaLinearColor = clutAlphaLinearColor_;
+	ctx.unpackRowLength = g_Config.iTexScalingLevel == 1 && gstate_c.Supports(GPU_SUPPORTS_UNPACK_SUBIMAGE);
+	ctx.tmpTexBuf32 = &tmpTexBuf32;
+	ctx.tmpTexBuf16 = &tmpTexBuf16;
+	ctx.tmpTexBufRearrange = &tmpTexBufRearrange;
+	return ctx;
+}
+
+void TextureCache::StartDecodeJob(TexCacheEntry *entry, GLenum dstFmt, int lastLevel, bool genMipmap, bool replaceImages, const ContentKey *contentKey) {
+	DecodeJob *job = new DecodeJob();
+	job->entry = entry;
+	job->state = gstate;
+	job->format = GETextureFormat(entry->format);
+	job->clutFormat = gstate.getClutPaletteFormat();
+	job->dstFmt = dstFmt;
+	job->lastLevel = lastLevel;
+	job->genMipmap = genMipmap;
+	job->replaceImages = replaceImages;
+	// Only indexed once uploaded, until then there's nothing to share.
+	job->shareable = contentKey != nullptr;
+	if (contentKey) {
+		job->contentKey = *contentKey;
+	}
+	job->decodeTime = 0.0;
+
+	// The game is free to overwrite all of this once we return, so the job gets its own copies.
+	job->ctx = GetDecodeContext();
+	job->ctx.state = &job->state;
+	if (clutBuf_) {
+		memcpy(job->clut, clutBuf_, sizeof(job->clut));
+	} else {
+		memset(job->clut, 0, sizeof(job->clut));
+	}
+	job->ctx.clut = job->clut;
+	job->ctx.tmpTexBuf32 = &job->tmpTexBuf32;
+	job->ctx.tmpTexBuf16 = &job->tmpTexBuf16;
+	job->ctx.tmpTexBufRearrange = &job->tmpTexBufRearrange;
+
+	size_t tmpPixels = 0;
+	for (int level = 0; level <= lastLevel; level++) {
+		u32 texaddr = gstate.getTextureAddress(level);
+		int bufw = GetTextureBufw(level, texaddr, job->format);
+		// Swizzled textures are stored in whole blocks of 8 rows.
+		int h = (gstate.getTextureHeight(level) + 7) & ~7;
+		tmpPixels = std::max(tmpPixels, (size_t)std::max(bufw, gstate.getTextureWidth(level)) * h);
+		u32 size = std::max(textureBitsPerPixel[job->format] * bufw * h / 8, 16);
+		u32 validSize = Memory::ValidSize(texaddr, size);
+
+		std::vector<u8> &data = job->levelData[level];
+		data.resize(size, 0);
+		if (validSize > 0) {
+			memcpy(&data[0], Memory::GetPointer(texaddr), validSize);
+		}
+		job->ctx.levelData[level] = &data[0];
+	}
+	// Resizing doesn't keep the contents, so these can't be left to grow while decoding.
+	job->tmpTexBuf32.resize(tmpPixels);
+	job->tmpTexBuf16.resize(tmpPixels * 2);
+	job->tmpTexBufRearrange.resize(tmpPixels);
+
+	entry->SetAlphaStatus(TexCacheEntry::STATUS_ALPHA_UNKNOWN);
+	if (g_Config.iTexDecodeMode == 2 && !replaceImages) {
+		// Something to sample until the real thing is uploaded.
+		static const u32 placeholder = 0;
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &placeholder);
+		if (gstate_c.Supports(GPU_SUPPORTS_TEXTURE_LOD_CONTROL)) {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		}
+	}
+
+	gpuStats.numTexturesDecoded += lastLevel + 1;
+	decodeJobs_[entry] = job;
+	job->task = GlobalThreadPool::Submit(std::bind(&TextureCache::RunDecodeJob, job));
+}
+
+// Runs on a pool thread, and only touches the job.
+void TextureCache::RunDecodeJob(DecodeJob *job) {
+	double st = real_time_now();
+	const GLenum dstFmt = job->dstFmt;
+	const int pixelSize = dstFmt == GL_UNSIGNED_BYTE ? 4 : 2;
+
+	for (int level = 0; level <= job->lastLevel; level++) {
+		DecodedLevel &out = job->levels[level];
+		out.w = job->state.getTextureWidth(level);
+		out.h = job->state.getTextureHeight(level);
+		out.texByteAlign = 1;
+
+		int bufw;
+		void *finalBuf = DecodeTextureLevel(job->ctx, job->format, job->clutFormat, level, out.texByteAlign, dstFmt, &bufw);
+		if (finalBuf == NULL) {
+			continue;
+		}
+
+		out.rowLength = job->ctx.unpackRowLength && out.w != bufw ? bufw : out.w;
+		const u8 *pixels = (const u8 *)finalBuf;
+		out.pixels.assign(pixels, pixels + out.rowLength * out.h * pixelSize);
+		out.alphaStatus = CheckAlpha((const u32 *)finalBuf, dstFmt, out.rowLength, out.w, out.h);
+	}
+
+	job->decodeTime = real_time_now() - st;
+}
+
+bool TextureCache::FinishDecodeJob(TexCacheEntry *entry, bool wait) {
+	auto iter = decodeJobs_.find(entry);
+	if (iter == decodeJobs_.end()) {
+		return true;
+	}
+
+	DecodeJob *job = iter->second;
+	if (!job->task->IsDone()) {
+		if (!wait) {
+			return false;
+		}
+		gpuStats.numTextureDecodeStalls++;
+		job->task->Wait();
+	}
+	// Uploading may decimate, which cancels jobs, so it must not find this one anymore.
+	decodeJobs_.erase(iter);
+	gpuStats.msTextureDecoding += job->decodeTime;
+
+	// Levels that failed to decode were never uploaded when decoding inline either.
+	for (int level = 0; level <= job->lastLevel; level++) {
+		if (!job->levels[level].pixels.empty()) {
+			entry->SetAlphaStatus(job->levels[level].alphaStatus, level);
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, entry->textureName);
+	lastBoundTexture = entry->textureName;
+	for (int level = 0; level <= job->lastLevel; level++) {
+		const DecodedLevel &decoded = job->levels[level];
+		if (!decoded.pixels.empty()) {
+			UploadTextureLevel(level, job->replaceImages, decoded.w, decoded.h, job->dstFmt, &decoded.pixels[0], decoded.rowLength, decoded.texByteAlign);
+		}
+	}
+	SetMipmapParams(job->lastLevel, job->genMipmap);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (job->shareable) {
+		RegisterSharedTexture(*entry, job->contentKey);
+	}
+
+	delete job;
+	return true;
+}
+
+void TextureCache::CancelDecodeJob(const TexCacheEntry *entry) {
+	if (decodeJobs_.empty()) {
+		return;
+	}
+	auto iter = decodeJobs_.find(entry);
+	if (iter != decodeJobs_.end()) {
+		iter->second->task->Wait();
+		delete iter->second;
+		decodeJobs_.erase(iter);
+	}
+}
+
+void TextureCache::CancelAllDecodeJobs() {
+	for (auto iter = decodeJobs_.begin(); iter != decodeJobs_.end(); ++iter) {
+		iter->second->task->Wait();
+		delete iter->second;
+	}
+	decodeJobs_.clear();
+}
+
+bool TextureCache::GetContentKey(const TexCacheEntry &entry, int scaleFactor, int lastLevel, bool genMipmap, ContentKey &key) {
+	// Only level 0 is hashed, and when 512 tall, maybe not all of it (see QuickTexHash.)
+	if (lastLevel != 0 || (((entry.dim >> 8) & 0xf) == 9 && entry.maxSeenV != 0 && entry.maxSeenV < 512)) {
+		return false;
+	}
+
+	// The clut format, shift, and mask are already part of the cluthash.
+	key.first = entry.fullhash | ((u64)entry.cluthash << 32);
+	key.second = entry.dim | ((u64)entry.bufw << 16) | ((u64)entry.format << 32) | ((u64)entry.maxLevel << 40);
+	key.second |= ((u64)scaleFactor << 48) | ((u64)genMipmap << 56) | ((u64)gstate.isTextureSwizzled() << 57);
+	return true;
+}
+
+bool TextureCache::AcquireSharedTexture(TexCacheEntry *entry, const ContentKey &key, bool replaceImages) {
+	const SharedTextureIndex::SharedTexture *shared = sharedTextures_.Acquire(key);
+	if (!shared) {
+		return false;
+	}
+
+	const u32 name = shared->name;
+	entry->SetAlphaStatus(shared->alphaStatus);
+	if (shared->refs == 2) {
+		// The entry that uploaded it has to stop trusting its sampling params, too.
+		for (TexCache::iterator iter = cache.begin(); iter != cache.end(); ++iter) {
+			if (iter->second.textureName == name) {
+				iter->second.status |= TexCacheEntry::STATUS_SHARED;
+			}
+		}
+		for (TexCache::iterator iter = secondCache.begin(); iter != secondCache.end(); ++iter) {
+			if (iter->second.textureName == name) {
+				iter->second.status |= TexCacheEntry::STATUS_SHARED;
+			}
+		}
+	}
+
+	// We won't be uploading to the entry's own texture after all.
+	if (replaceImages) {
+		ReleaseTexture(*entry);
+	} else {
+		nameCache_.push_back(entry->textureName);
+	}
+
+	entry->textureName = name;
+	entry->status |= TexCacheEntry::STATUS_SHARED;
+	gpuStats.numTextureDedupeHits++;
+
+	glBindTexture(GL_TEXTURE_2D, name);
+	lastBoundTexture = name;
+	return true;
+}
+
+void TextureCache::RegisterSharedTexture(TexCacheEntry &entry, const ContentKey &key) {
+	sharedTextures_.Register(entry, key, EstimateTexMemoryUsage(&entry));
+}
+
+void TextureCache::ReleaseTexture(const TexCacheEntry &entry) {
+	u32 name = entry.textureName;
+	if (sharedTextures_.Release(name)) {
+		glDeleteTextures(1, &name);
+	}
+}
+
 // Only used by Qt UI?
 bool TextureCache::DecodeTexture(u8* output, const GPUgstate &state) {
 	GPUgstate oldState = gstate;
@@ -1992,7 +2312,8 @@ bool TextureCache::DecodeTexture(u8* output, const GPUgstate &state) {
 	int w = gstate.getTextureWidth(level);
 	int h = gstate.getTextureHeight(level);
 
-	void *finalBuf = DecodeTextureLevel(format, clutformat, level, texByteAlign, dstFmt);
+	DecodeContext ctx = GetDecodeContext();
+	void *finalBuf = DecodeTextureLevel(ctx, format, clutformat, level, texByteAlign, dstFmt);
 	if (finalBuf == NULL) {
 		return false;
 	}
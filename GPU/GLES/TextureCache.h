@@ -18,8 +18,11 @@
 #pragma once
 
 #include <map>
+#include <memory>
+#include <vector>
 
 #include "gfx_es2/gpu_features.h"
+#include "thread/threadpool.h"
 
 #include "Globals.h"
 #include "GPU/GPUInterface.h"
@@ -97,16 +100,85 @@ class TextureCache : public TextureCacheCommon {
 private:
 	// Can't be unordered_map, we use lower_bound ... although for some reason that compiles on MSVC.
 	typedef std::map<u64, TexCacheEntry> TexCache;
+	typedef SharedTextureIndex::ContentKey ContentKey;
+
+	// Everything decoding reads, so that it can run on a worker thread just as well.
+	struct DecodeContext {
+		const GPUgstate *state;
+		// Copies of each level's data, or null to read it straight from PSP memory.
+		const u8 *levelData[8];
+		const void *clut;
+		bool clutAlphaLinear;
+		u16 clutAlphaLinearColor;
+		// If set, rows are uploaded with GL_UNPACK_ROW_LENGTH rather than rearranged.
+		bool unpackRowLength;
+		SimpleBuf<u32> *tmpTexBuf32;
+		SimpleBuf<u16> *tmpTexBuf16;
+		SimpleBuf<u32> *tmpTexBufRearrange;
+	};
+
+	struct DecodedLevel {
+		std::vector<u8> pixels;
+		int w;
+		int h;
+		// Only differs from w when using GL_UNPACK_ROW_LENGTH.
+		int rowLength;
+		u32 texByteAlign;
+		TexCacheEntry::Status alphaStatus;
+	};
+
+	// A texture being decoded on the thread pool, see iTexDecodeMode.
+	struct DecodeJob {
+		TexCacheEntry *entry;
+		GPUgstate state;
+		DecodeContext ctx;
+		std::vector<u8> levelData[8];
+		u32 clut[1024];
+		SimpleBuf<u32> tmpTexBuf32;
+		SimpleBuf<u16> tmpTexBuf16;
+		SimpleBuf<u32> tmpTexBufRearrange;
+
+		GETextureFormat format;
+		GEPaletteFormat clutFormat;
+		GLenum dstFmt;
+		int lastLevel;
+		bool genMipmap;
+		bool replaceImages;
+		bool shareable;
+		ContentKey contentKey;
+
+		// Filled in by the worker.
+		DecodedLevel levels[8];
+		double decodeTime;
+		std::shared_ptr<ThreadPoolTask> task;
+	};
 
 	void Decimate();  // Run this once per frame to get rid of old textures.
 	void DeleteTexture(TexCache::iterator it);
-	void *UnswizzleFromMem(const u8 *texptr, u32 bufw, u32 height, u32 bytesPerPixel);
-	void *ReadIndexedTex(int level, const u8 *texptr, int bytesPerIndex, GLuint dstFmt, int bufw);
+	static void *UnswizzleFromMem(DecodeContext &ctx, const u8 *texptr, u32 bufw, u32 height, u32 bytesPerPixel);
+	static void *ReadIndexedTex(DecodeContext &ctx, int level, const u8 *texptr, int bytesPerIndex, GLuint dstFmt, int bufw);
 	void UpdateSamplingParams(TexCacheEntry &entry, bool force);
 	void LoadTextureLevel(TexCacheEntry &entry, int level, bool replaceImages, int scaleFactor, GLenum dstFmt);
+	void UploadTextureLevel(int level, bool replaceImages, int w, int h, GLenum dstFmt, const void *pixels, int rowLength, u32 texByteAlign);
+	void SetMipmapParams(int lastLevel, bool genMipmap);
 	GLenum GetDestFormat(GETextureFormat format, GEPaletteFormat clutFormat) const;
-	void *DecodeTextureLevel(GETextureFormat format, GEPaletteFormat clutformat, int level, u32 &texByteAlign, GLenum dstFmt, int *bufw = 0);
-	TexCacheEntry::Status CheckAlpha(const u32 *pixelData, GLenum dstFmt, int stride, int w, int h);
+	DecodeContext GetDecodeContext();
+	static void *DecodeTextureLevel(DecodeContext &ctx, GETextureFormat format, GEPaletteFormat clutformat, int level, u32 &texByteAlign, GLenum dstFmt, int *bufw = 0);
+	static TexCacheEntry::Status CheckAlpha(const u32 *pixelData, GLenum dstFmt, int stride, int w, int h);
+	void StartDecodeJob(TexCacheEntry *entry, GLenum dstFmt, int lastLevel, bool genMipmap, bool replaceImages, const ContentKey *contentKey);
+	static void RunDecodeJob(DecodeJob *job);
+	// Uploads the result of a finished job, waiting for it first if "wait".  Returns false if still pending.
+	bool FinishDecodeJob(TexCacheEntry *entry, bool wait);
+	// Waits for and drops any job decoding this entry.
+	void CancelDecodeJob(const TexCacheEntry *entry);
+	void CancelAllDecodeJobs();
+	// Returns false if the decoded texture would depend on more than the hashed data.
+	static bool GetContentKey(const TexCacheEntry &entry, int scaleFactor, int lastLevel, bool genMipmap, ContentKey &key);
+	// Points the entry at an already uploaded texture with the same contents, if there is one.
+	bool AcquireSharedTexture(TexCacheEntry *entry, const ContentKey &key, bool replaceImages);
+	void RegisterSharedTexture(TexCacheEntry &entry, const ContentKey &key);
+	// Deletes the entry's texture, unless other entries still use it.
+	void ReleaseTexture(const TexCacheEntry &entry);
 	template <typename T>
 	const T *GetCurrentClut();
 	u32 GetCurrentClutHash();
@@ -142,6 +214,10 @@ class TextureCache : public TextureCacheCommon {
 
 	SimpleBuf<u32> tmpTexBufRearrange;
 
+	std::map<const TexCacheEntry *, DecodeJob *> decodeJobs_;
+
+	SharedTextureIndex sharedTextures_;
+
 	u32 clutLastFormat_;
 	u32 *clutBufRaw_;
 	u32 *clutBufConverted_;
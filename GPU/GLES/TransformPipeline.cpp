@@ -348,7 +348,7 @@ void TransformDrawEngine::DecodeVertsStep() {
 	u32 indexType = dc.indexType;
 	if (indexType == (GE_VTYPE_IDX_NONE >> GE_VTYPE_IDX_SHIFT)) {
 		// Decode the verts and apply morphing. Simple.
-		dec_->DecodeVerts(decoded + decodedVerts_ * (int)dec_->GetDecVtxFmt().stride,
+		DecodeVertsRange(dec_, decoded + decodedVerts_ * (int)dec_->GetDecVtxFmt().stride,
 			dc.verts, indexLowerBound, indexUpperBound);
 		decodedVerts_ += indexUpperBound - indexLowerBound + 1;
 		indexGen.AddPrim(dc.prim, dc.vertexCount);
@@ -407,7 +407,7 @@ void TransformDrawEngine::DecodeVertsStep() {
 
 		// 3. Decode that range of vertex data.
 		int stride = (int)dec_->GetDecVtxFmt().stride;
-		dec_->DecodeVerts(decoded + decodedVerts_ * stride, dc.verts, indexLowerBound, indexUpperBound);
+		DecodeVertsRange(dec_, decoded + decodedVerts_ * stride, dc.verts, indexLowerBound, indexUpperBound);
 		decodedVerts_ += vertexCount;
 
 		// 4. Advance indexgen vertex counter.
@@ -69,6 +69,13 @@ struct GPUStatistics {
 		numAlphaTestedDraws = 0;
 		numNonAlphaTestedDraws = 0;
 		msProcessingDisplayLists = 0;
+		msTextureScaling = 0;
+		msTextureDecoding = 0;
+		numTextureDecodeStalls = 0;
+		numTextureDedupeHits = 0;
+		numTessCacheHits = 0;
+		numTessCacheMisses = 0;
+		msTessellating = 0;
 		vertexGPUCycles = 0;
 		otherGPUCycles = 0;
 		memset(gpuCommandsAtCallLevel, 0, sizeof(gpuCommandsAtCallLevel));
@@ -87,6 +94,13 @@ struct GPUStatistics {
 	int numShaderSwitches;
 	int numTexturesDecoded;
 	double msProcessingDisplayLists;
+	double msTextureScaling;
+	double msTextureDecoding;
+	int numTextureDecodeStalls;
+	int numTextureDedupeHits;
+	int numTessCacheHits;
+	int numTessCacheMisses;
+	double msTessellating;
 	int vertexGPUCycles;
 	int otherGPUCycles;
 	int gpuCommandsAtCallLevel[4];
@@ -98,6 +112,9 @@ struct GPUStatistics {
 	int numVBlanks;
 	int numFlips;
 	int numTextures;
+	int numTexturesScalePending;
+	int numTexturesDecodePending;
+	int numTextureDedupeBytesSaved;
 	int numVertexShaders;
 	int numFragmentShaders;
 	int numShaders;
@@ -0,0 +1,91 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include "Core/Config.h"
+#include "GPU/GPUState.h"
+#include "GPU/Software/PixelJit.h"
+
+namespace Rasterizer {
+
+PixelFuncID ComputePixelFuncID(bool clearMode) {
+	PixelFuncID id;
+
+	id.fbFormat = gstate.FrameBufFormat();
+	if (gstate.isModeThrough())
+		id.flags |= PIXEL_FLAG_THROUGH;
+
+	if (clearMode) {
+		id.clearMode = 1;
+		id.clearModeMask = (gstate.clearmode >> 8) & 7;
+		return id;
+	}
+
+	const bool fogApplied = gstate.isFogEnabled() && !gstate.isModeThrough();
+	if (gstate.isColorTestEnabled() || gstate.isAlphaTestEnabled() || gstate.isStencilTestEnabled() || gstate.isLogicOpEnabled() || fogApplied)
+		id.unsupported = 1;
+
+	if (gstate.isDepthTestEnabled()) {
+		id.flags |= PIXEL_FLAG_DEPTH_TEST;
+		id.depthFunc = gstate.getDepthTestFunction();
+		if (gstate.isDepthWriteEnabled())
+			id.flags |= PIXEL_FLAG_DEPTH_WRITE;
+	}
+	if (gstate.isTextureMapEnabled() && gstate.isColorDoublingEnabled())
+		id.flags |= PIXEL_FLAG_COLOR_DOUBLING;
+	if (gstate.isAlphaBlendEnabled()) {
+		id.flags |= PIXEL_FLAG_ALPHA_BLEND;
+		id.blendEq = gstate.getBlendEq();
+		id.blendFactors = gstate.getBlendFuncA() | (gstate.getBlendFuncB() << 4);
+	}
+
+	return id;
+}
+
+PixelJitCache::PixelJitCache() {
+	// Each function is small, this is plenty for every state a game will use.
+	AllocCodeSpace(1024 * 64);
+}
+
+void PixelJitCache::Clear() {
+	ClearCodeSpace();
+	cache_.clear();
+}
+
+SingleFunc PixelJitCache::GetSingle(const PixelFuncID &id) {
+	if (!g_Config.bSoftwareRenderingJit)
+		return nullptr;
+
+	auto it = cache_.find(id);
+	if (it != cache_.end())
+		return it->second;
+
+	// Functions are at most a few hundred bytes, start over if we run low.
+	if (GetSpaceLeft() < 4096)
+		Clear();
+
+	SingleFunc func = id.unsupported ? nullptr : CompileSingle(id);
+	cache_[id] = func;
+	return func;
+}
+
+#if !defined(_M_X64)
+SingleFunc PixelJitCache::CompileSingle(const PixelFuncID &id) {
+	return nullptr;
+}
+#endif
+
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <unordered_map>
+
+#include "Common/CommonTypes.h"
+#include "GPU/Math3D.h"
+
+#if defined(_M_X64)
+#include "Common/x64Emitter.h"
+#else
+#include "Common/FakeEmitter.h"
+#endif
+
+namespace Rasterizer {
+
+// Everything in DrawSinglePixel that depends on GE state, so equal ids can share code.
+struct PixelFuncID {
+	PixelFuncID() : fullKey(0) {
+	}
+
+	union {
+		u64 fullKey;
+		struct {
+			u8 clearMode;
+			// Clear mode color/alpha/depth write flags (clearmode >> 8.)
+			u8 clearModeMask;
+			u8 fbFormat;
+			u8 flags;
+			u8 depthFunc;
+			u8 blendEq;
+			// Source factor in the low nibble, dest factor in the high.
+			u8 blendFactors;
+			// Nonzero if state the jit doesn't handle is used (stencil, alpha/color test, logic ops, fog.)
+			u8 unsupported;
+		};
+	};
+
+	bool operator == (const PixelFuncID &other) const {
+		return fullKey == other.fullKey;
+	}
+};
+
+enum {
+	PIXEL_FLAG_THROUGH = 0x01,
+	PIXEL_FLAG_DEPTH_TEST = 0x02,
+	PIXEL_FLAG_DEPTH_WRITE = 0x04,
+	PIXEL_FLAG_COLOR_DOUBLING = 0x08,
+	PIXEL_FLAG_ALPHA_BLEND = 0x10,
+};
+
+PixelFuncID ComputePixelFuncID(bool clearMode);
+
+// Same as DrawSinglePixel, except that fog is never applied.  z must be zero extended.
+typedef void (*SingleFunc)(int x, int y, int z, const Math3D::Vec4<int> &color);
+
+#if defined(_M_X64)
+class PixelJitCache : public Gen::XCodeBlock {
+#else
+class PixelJitCache : public FakeGen::FakeXCodeBlock {
+#endif
+public:
+	PixelJitCache();
+
+	// Returns nullptr if the state isn't supported, in which case DrawSinglePixel must be used.
+	// Not thread safe, resolve the function before splitting work over threads.
+	SingleFunc GetSingle(const PixelFuncID &id);
+	void Clear();
+
+private:
+	SingleFunc CompileSingle(const PixelFuncID &id);
+
+	struct PixelFuncIDHash {
+		size_t operator()(const PixelFuncID &id) const {
+			return std::hash<u64>()(id.fullKey);
+		}
+	};
+
+	std::unordered_map<PixelFuncID, SingleFunc, PixelFuncIDHash> cache_;
+};
+
+}
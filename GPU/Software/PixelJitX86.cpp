@@ -0,0 +1,280 @@
+// Copyright (c) 2013- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#if defined(_M_X64)
+
+#include <vector>
+
+#include "GPU/GPUState.h"
+#include "GPU/Software/PixelJit.h"
+#include "GPU/Software/SoftGpu.h"
+
+extern FormatBuffer fb;
+extern FormatBuffer depthbuf;
+
+using namespace Gen;
+
+namespace Rasterizer {
+
+static const u32 MEMORY_ALIGNED16(rgbMask[4]) = {0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0};
+static const u32 MEMORY_ALIGNED16(alphaMask[4]) = {0, 0, 0, 0xFFFFFFFF};
+static const s32 MEMORY_ALIGNED16(all255[4]) = {255, 255, 255, 255};
+static const float MEMORY_ALIGNED16(by255[4]) = {
+	1.0f / 255.0f, 1.0f / 255.0f, 1.0f / 255.0f, 1.0f / 255.0f,
+};
+
+#ifdef _WIN32
+static const X64Reg argXReg = RCX;
+static const X64Reg argYReg = RDX;
+static const X64Reg argZReg = R8;
+static const X64Reg argColorReg = R9;
+#else
+static const X64Reg argXReg = RDI;
+static const X64Reg argYReg = RSI;
+static const X64Reg argZReg = RDX;
+static const X64Reg argColorReg = RCX;
+#endif
+static const X64Reg tempReg1 = RAX;
+static const X64Reg addrReg = R10;
+static const X64Reg oldColorReg = R11;
+
+// Only XMM0-XMM5 are volatile on Windows, so we stick to those.
+static const X64Reg primColorReg = XMM0;
+static const X64Reg dstColorReg = XMM1;
+static const X64Reg srcFactorReg = XMM2;
+static const X64Reg dstFactorReg = XMM3;
+static const X64Reg fpScratchReg = XMM4;
+static const X64Reg zeroReg = XMM5;
+
+// The GE_SRCBLEND_* and GE_DSTBLEND_* values mirror each other, "other color" is the dst color
+// for the source factor and the source color for the dest factor.
+static void JitBlendFactor(XEmitter *emit, X64Reg dest, int factor, X64Reg otherColor, const u32 *fix) {
+	switch (factor) {
+	case GE_SRCBLEND_DSTCOLOR:
+		emit->MOVDQA(dest, R(otherColor));
+		break;
+
+	case GE_SRCBLEND_INVDSTCOLOR:
+		emit->MOVDQA(dest, M(all255));
+		emit->PSUBD(dest, R(otherColor));
+		break;
+
+	case GE_SRCBLEND_SRCALPHA:
+	case GE_SRCBLEND_DSTALPHA:
+	case GE_SRCBLEND_DOUBLESRCALPHA:
+	case GE_SRCBLEND_DOUBLEDSTALPHA:
+	{
+		bool fromSrc = factor == GE_SRCBLEND_SRCALPHA || factor == GE_SRCBLEND_DOUBLESRCALPHA;
+		emit->PSHUFD(dest, R(fromSrc ? primColorReg : dstColorReg), _MM_SHUFFLE(3, 3, 3, 3));
+		if (factor >= GE_SRCBLEND_DOUBLESRCALPHA)
+			emit->PADDD(dest, R(dest));
+		break;
+	}
+
+	case GE_SRCBLEND_INVSRCALPHA:
+	case GE_SRCBLEND_INVDSTALPHA:
+	case GE_SRCBLEND_DOUBLEINVSRCALPHA:
+	case GE_SRCBLEND_DOUBLEINVDSTALPHA:
+	{
+		bool fromSrc = factor == GE_SRCBLEND_INVSRCALPHA || factor == GE_SRCBLEND_DOUBLEINVSRCALPHA;
+		emit->PSHUFD(fpScratchReg, R(fromSrc ? primColorReg : dstColorReg), _MM_SHUFFLE(3, 3, 3, 3));
+		if (factor >= GE_SRCBLEND_DOUBLESRCALPHA)
+			emit->PADDD(fpScratchReg, R(fpScratchReg));
+		emit->MOVDQA(dest, M(all255));
+		emit->PSUBD(dest, R(fpScratchReg));
+		break;
+	}
+
+	case GE_SRCBLEND_FIXA:
+		// The command byte ends up in the unused fourth lane.
+		emit->MOVD_xmm(dest, M(fix));
+		emit->PUNPCKLBW(dest, R(zeroReg));
+		emit->PUNPCKLWD(dest, R(zeroReg));
+		break;
+	}
+}
+
+SingleFunc PixelJitCache::CompileSingle(const PixelFuncID &id) {
+	// TODO: 16-bit framebuffers.
+	if (id.fbFormat != GE_FORMAT_8888)
+		return nullptr;
+
+	const bool blend = (id.flags & PIXEL_FLAG_ALPHA_BLEND) != 0;
+	const int srcFactor = id.blendFactors & 0xF;
+	const int dstFactor = id.blendFactors >> 4;
+	if (blend) {
+		if (id.blendEq > GE_BLENDMODE_MUL_AND_SUBTRACT_REVERSE)
+			return nullptr;
+		if (srcFactor > GE_SRCBLEND_FIXA || dstFactor > GE_DSTBLEND_FIXB)
+			return nullptr;
+	}
+
+	const u8 *start = AlignCode16();
+
+	const bool depthTest = !id.clearMode && (id.flags & PIXEL_FLAG_DEPTH_TEST) != 0;
+	bool depthWrite;
+	if (id.clearMode)
+		depthWrite = (id.clearModeMask & 4) != 0;
+	else
+		depthWrite = (id.flags & PIXEL_FLAG_DEPTH_WRITE) != 0;
+
+	if (depthTest && id.depthFunc == GE_COMP_NEVER) {
+		RET();
+		return (SingleFunc)start;
+	}
+
+	std::vector<FixupBranch> discards;
+
+	// Depth range test, this applies in clear mode too.
+	if ((id.flags & PIXEL_FLAG_THROUGH) == 0) {
+		MOVZX(32, 16, tempReg1, M(&gstate.minz));
+		CMP(32, R(argZReg), R(tempReg1));
+		discards.push_back(J_CC(CC_B, true));
+		MOVZX(32, 16, tempReg1, M(&gstate.maxz));
+		CMP(32, R(argZReg), R(tempReg1));
+		discards.push_back(J_CC(CC_A, true));
+	}
+
+	if (depthTest || depthWrite) {
+		MOV(32, R(tempReg1), M(&gstate.zbwidth));
+		AND(32, R(tempReg1), Imm32(0x7FC));
+		IMUL(32, tempReg1, R(argYReg));
+		ADD(32, R(tempReg1), R(argXReg));
+		MOV(PTRBITS, R(addrReg), M(&depthbuf.data));
+		LEA(PTRBITS, addrReg, MComplex(addrReg, tempReg1, SCALE_2, 0));
+
+		if (depthTest && id.depthFunc != GE_COMP_ALWAYS) {
+			MOVZX(32, 16, oldColorReg, MatR(addrReg));
+			CMP(32, R(argZReg), R(oldColorReg));
+			// Jump if the test fails.
+			CCFlags cc = CC_NE;
+			switch (id.depthFunc) {
+			case GE_COMP_EQUAL: cc = CC_NE; break;
+			case GE_COMP_NOTEQUAL: cc = CC_E; break;
+			case GE_COMP_LESS: cc = CC_AE; break;
+			case GE_COMP_LEQUAL: cc = CC_A; break;
+			case GE_COMP_GREATER: cc = CC_BE; break;
+			case GE_COMP_GEQUAL: cc = CC_B; break;
+			}
+			discards.push_back(J_CC(cc, true));
+		}
+		if (depthWrite)
+			MOV(16, MatR(addrReg), R(argZReg));
+	}
+
+	MOV(32, R(tempReg1), M(&gstate.fbwidth));
+	AND(32, R(tempReg1), Imm32(0x7FC));
+	IMUL(32, tempReg1, R(argYReg));
+	ADD(32, R(tempReg1), R(argXReg));
+	MOV(PTRBITS, R(addrReg), M(&fb.data));
+	LEA(PTRBITS, addrReg, MComplex(addrReg, tempReg1, SCALE_4, 0));
+	MOV(32, R(oldColorReg), MatR(addrReg));
+
+	MOVDQU(primColorReg, MatR(argColorReg));
+
+	if (id.flags & PIXEL_FLAG_COLOR_DOUBLING) {
+		MOVDQA(dstColorReg, R(primColorReg));
+		PADDD(dstColorReg, R(primColorReg));
+		PAND(dstColorReg, M(rgbMask));
+		PAND(primColorReg, M(alphaMask));
+		POR(primColorReg, R(dstColorReg));
+	}
+
+	if (blend) {
+		PXOR(zeroReg, R(zeroReg));
+		MOVD_xmm(dstColorReg, R(oldColorReg));
+		PUNPCKLBW(dstColorReg, R(zeroReg));
+		PUNPCKLWD(dstColorReg, R(zeroReg));
+
+		JitBlendFactor(this, srcFactorReg, srcFactor, dstColorReg, &gstate.blendfixa);
+		JitBlendFactor(this, dstFactorReg, dstFactor, primColorReg, &gstate.blendfixb);
+
+		// Same operations in the same order as AlphaBlendingResult(), so results match.
+		CVTDQ2PS(fpScratchReg, R(primColorReg));
+		CVTDQ2PS(srcFactorReg, R(srcFactorReg));
+		MULPS(fpScratchReg, R(srcFactorReg));
+		CVTDQ2PS(zeroReg, R(dstColorReg));
+		CVTDQ2PS(dstFactorReg, R(dstFactorReg));
+		MULPS(zeroReg, R(dstFactorReg));
+		switch (id.blendEq) {
+		case GE_BLENDMODE_MUL_AND_ADD:
+			ADDPS(fpScratchReg, R(zeroReg));
+			break;
+		case GE_BLENDMODE_MUL_AND_SUBTRACT:
+			SUBPS(fpScratchReg, R(zeroReg));
+			break;
+		case GE_BLENDMODE_MUL_AND_SUBTRACT_REVERSE:
+			SUBPS(zeroReg, R(fpScratchReg));
+			MOVAPS(fpScratchReg, R(zeroReg));
+			break;
+		}
+		MULPS(fpScratchReg, M(by255));
+		CVTPS2DQ(srcFactorReg, R(fpScratchReg));
+	} else {
+		MOVDQA(srcFactorReg, R(primColorReg));
+	}
+
+	// Clamp and pack the rgb.
+	PACKSSDW(srcFactorReg, R(srcFactorReg));
+	PACKUSWB(srcFactorReg, R(srcFactorReg));
+	MOVD_xmm(R(tempReg1), srcFactorReg);
+	AND(32, R(tempReg1), Imm32(0x00FFFFFF));
+
+	// Now the stencil.  We're done with the coordinates and z, so we can use those regs.
+	if (id.clearMode) {
+		// In clear mode, it uses the alpha color as stencil.
+		PSHUFD(fpScratchReg, R(primColorReg), _MM_SHUFFLE(3, 3, 3, 3));
+		MOVD_xmm(R(argZReg), fpScratchReg);
+		SHL(32, R(argZReg), Imm8(24));
+	} else {
+		MOV(32, R(argZReg), R(oldColorReg));
+		AND(32, R(argZReg), Imm32(0xFF000000));
+	}
+	OR(32, R(tempReg1), R(argZReg));
+
+	if (id.clearMode) {
+		u32 mask = ((id.clearModeMask & 1) ? 0 : 0x00FFFFFF) | ((id.clearModeMask & 2) ? 0 : 0xFF000000);
+		if (mask != 0) {
+			AND(32, R(oldColorReg), Imm32(mask));
+			AND(32, R(tempReg1), Imm32(~mask));
+			OR(32, R(tempReg1), R(oldColorReg));
+		}
+	} else {
+		MOV(32, R(argZReg), M(&gstate.pmskc));
+		AND(32, R(argZReg), Imm32(0x00FFFFFF));
+		MOV(32, R(argXReg), M(&gstate.pmska));
+		SHL(32, R(argXReg), Imm8(24));
+		OR(32, R(argZReg), R(argXReg));
+
+		AND(32, R(oldColorReg), R(argZReg));
+		NOT(32, R(argZReg));
+		AND(32, R(tempReg1), R(argZReg));
+		OR(32, R(tempReg1), R(oldColorReg));
+	}
+
+	MOV(32, MatR(addrReg), R(tempReg1));
+
+	for (const FixupBranch &discard : discards)
+		SetJumpTarget(discard);
+	RET();
+
+	return (SingleFunc)start;
+}
+
+}
+
+#endif
@@ -27,9 +27,11 @@
 
 #include "GPU/Common/TextureDecoder.h"
 #include "GPU/Software/SoftGpu.h"
+#include "GPU/Software/PixelJit.h"
 #include "GPU/Software/Rasterizer.h"
 
 #include <algorithm>
+#include <vector>
 
 #if defined(_M_SSE)
 #include <emmintrin.h>
@@ -1176,11 +1178,414 @@ static inline Vec2<float> Interpolate(const Vec2<float> &c0, const Vec2<float> &
 #endif
 }
 
+#if defined(_M_SSE) && !defined(_M_IX86)
+// The quad path shades the covered pixels of a 4 pixel span together, one pixel per lane.
+// Each lane does the same float operations in the same order as the per pixel code above,
+// so the output is identical.
+
+struct QuadColor {
+	__m128i r, g, b, a;
+};
+
+// The GE state the quad path depends on, read once per slice.
+struct QuadState {
+	// Nearest filtering at level 0 is done for the whole quad, otherwise each lane uses ApplyTexturing().
+	bool nearest;
+	bool texAlpha;
+	GETexFunc texFunc;
+	bool texClampS;
+	bool texClampT;
+	int texWidth;
+	int texHeight;
+
+	// If false, each lane goes through the pixel function or DrawSinglePixel().
+	bool output;
+	bool depthRange;
+	__m128i depthMin;
+	__m128i depthMax;
+	bool depthTest;
+	GEComparison depthFunc;
+	bool depthWrite;
+	bool doubling;
+	bool fog;
+	QuadColor fogColor;
+	bool blend;
+	GEBlendMode blendEq;
+	int srcFactor;
+	int dstFactor;
+	QuadColor fixA;
+	QuadColor fixB;
+	__m128i colorMask;
+	int fbStride;
+	int depthStride;
+};
+
+static inline __m128i SelectQuad(const __m128i &mask, const __m128i &a, const __m128i &b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline QuadColor QuadFromRGBA(const __m128i &c) {
+	const __m128i byteMask = _mm_set1_epi32(0xFF);
+	QuadColor q;
+	q.r = _mm_and_si128(c, byteMask);
+	q.g = _mm_and_si128(_mm_srli_epi32(c, 8), byteMask);
+	q.b = _mm_and_si128(_mm_srli_epi32(c, 16), byteMask);
+	q.a = _mm_srli_epi32(c, 24);
+	return q;
+}
+
+// Clamps each channel to 0-255 like ToRGBA(), and returns the four pixels as RGBA8888.
+static inline __m128i QuadToRGBA(const QuadColor &q) {
+	// Gives r0-r3, b0-b3, g0-g3, a0-a3 as bytes, then interleaves them.
+	__m128i c = _mm_packus_epi16(_mm_packs_epi32(q.r, q.b), _mm_packs_epi32(q.g, q.a));
+	c = _mm_unpacklo_epi8(c, _mm_srli_si128(c, 8));
+	return _mm_unpacklo_epi16(c, _mm_srli_si128(c, 8));
+}
+
+static inline void QuadToPixels(const QuadColor &q, Vec4<int> pixels[4]) {
+	__m128 c0 = _mm_castsi128_ps(q.r);
+	__m128 c1 = _mm_castsi128_ps(q.g);
+	__m128 c2 = _mm_castsi128_ps(q.b);
+	__m128 c3 = _mm_castsi128_ps(q.a);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	pixels[0] = Vec4<int>(_mm_castps_si128(c0));
+	pixels[1] = Vec4<int>(_mm_castps_si128(c1));
+	pixels[2] = Vec4<int>(_mm_castps_si128(c2));
+	pixels[3] = Vec4<int>(_mm_castps_si128(c3));
+}
+
+static inline QuadColor QuadFromPixels(const Vec4<int> pixels[4]) {
+	__m128 c0 = _mm_castsi128_ps(pixels[0].ivec);
+	__m128 c1 = _mm_castsi128_ps(pixels[1].ivec);
+	__m128 c2 = _mm_castsi128_ps(pixels[2].ivec);
+	__m128 c3 = _mm_castsi128_ps(pixels[3].ivec);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	QuadColor q;
+	q.r = _mm_castps_si128(c0);
+	q.g = _mm_castps_si128(c1);
+	q.b = _mm_castps_si128(c2);
+	q.a = _mm_castps_si128(c3);
+	return q;
+}
+
+static inline __m128 InterpolateQuad(float c0, float c1, float c2, const __m128 &w0, const __m128 &w1, const __m128 &w2, const __m128 &wsum_recip) {
+	__m128 v = _mm_mul_ps(_mm_set_ps1(c0), w0);
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_set_ps1(c1), w1));
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_set_ps1(c2), w2));
+	return _mm_mul_ps(v, wsum_recip);
+}
+
+static inline __m128i InterpolateQuad(int c0, int c1, int c2, const __m128 &w0, const __m128 &w1, const __m128 &w2, const __m128 &wsum_recip) {
+	return _mm_cvtps_epi32(InterpolateQuad((float)c0, (float)c1, (float)c2, w0, w1, w2, wsum_recip));
+}
+
+static inline QuadColor InterpolateQuad(const Vec4<int> &c0, const Vec4<int> &c1, const Vec4<int> &c2, const __m128 &w0, const __m128 &w1, const __m128 &w2, const __m128 &wsum_recip) {
+	QuadColor q;
+	q.r = InterpolateQuad(c0.r(), c1.r(), c2.r(), w0, w1, w2, wsum_recip);
+	q.g = InterpolateQuad(c0.g(), c1.g(), c2.g(), w0, w1, w2, wsum_recip);
+	q.b = InterpolateQuad(c0.b(), c1.b(), c2.b(), w0, w1, w2, wsum_recip);
+	q.a = InterpolateQuad(c0.a(), c1.a(), c2.a(), w0, w1, w2, wsum_recip);
+	return q;
+}
+
+static inline QuadColor InterpolateQuad(const Vec3<int> &c0, const Vec3<int> &c1, const Vec3<int> &c2, const __m128 &w0, const __m128 &w1, const __m128 &w2, const __m128 &wsum_recip) {
+	QuadColor q;
+	q.r = InterpolateQuad(c0.r(), c1.r(), c2.r(), w0, w1, w2, wsum_recip);
+	q.g = InterpolateQuad(c0.g(), c1.g(), c2.g(), w0, w1, w2, wsum_recip);
+	q.b = InterpolateQuad(c0.b(), c1.b(), c2.b(), w0, w1, w2, wsum_recip);
+	q.a = _mm_setzero_si128();
+	return q;
+}
+
+static inline QuadColor QuadFromColor(const Vec4<int> &c) {
+	QuadColor q;
+	q.r = _mm_set1_epi32(c.r());
+	q.g = _mm_set1_epi32(c.g());
+	q.b = _mm_set1_epi32(c.b());
+	q.a = _mm_set1_epi32(c.a());
+	return q;
+}
+
+static inline QuadColor QuadFromColor(const Vec3<int> &c) {
+	return QuadFromColor(Vec4<int>(c, 0));
+}
+
+static void ComputeQuadState(QuadState &state, bool clearMode, int magFilt) {
+	state.nearest = magFilt == 0;
+	state.texAlpha = gstate.isTextureAlphaUsed();
+	state.texFunc = gstate.getTextureFunction();
+	state.texClampS = gstate.isTexCoordClampedS();
+	state.texClampT = gstate.isTexCoordClampedT();
+	state.texWidth = 1 << (gstate.texsize[0] & 0xf);
+	state.texHeight = 1 << ((gstate.texsize[0] >> 8) & 0xf);
+
+	// Stencil, the color and alpha tests and logic ops stay per pixel, and so do 16-bit framebuffers.
+	state.output = !clearMode && gstate.FrameBufFormat() == GE_FORMAT_8888;
+	if (gstate.isStencilTestEnabled() || gstate.isColorTestEnabled() || gstate.isAlphaTestEnabled() || gstate.isLogicOpEnabled())
+		state.output = false;
+
+	state.depthRange = !gstate.isModeThrough();
+	state.depthMin = _mm_set1_epi32(gstate.getDepthRangeMin());
+	state.depthMax = _mm_set1_epi32(gstate.getDepthRangeMax());
+	state.depthTest = gstate.isDepthTestEnabled();
+	state.depthFunc = gstate.getDepthTestFunction();
+	state.depthWrite = gstate.isDepthWriteEnabled();
+	state.doubling = gstate.isTextureMapEnabled() && gstate.isColorDoublingEnabled();
+	state.fog = gstate.isFogEnabled() && !gstate.isModeThrough();
+	state.fogColor = QuadFromColor(Vec3<int>::FromRGB(gstate.fogcolor));
+
+	state.blend = gstate.isAlphaBlendEnabled();
+	state.blendEq = gstate.getBlendEq();
+	state.srcFactor = gstate.getBlendFuncA();
+	state.dstFactor = gstate.getBlendFuncB();
+	state.fixA = QuadFromColor(Vec3<int>::FromRGB(gstate.getFixA()));
+	state.fixB = QuadFromColor(Vec3<int>::FromRGB(gstate.getFixB()));
+	// Leave the invalid modes to the per pixel path, which reports them.
+	if (state.blend && (state.blendEq > GE_BLENDMODE_ABSDIFF || state.srcFactor > GE_SRCBLEND_FIXA || state.dstFactor > GE_DSTBLEND_FIXB))
+		state.output = false;
+
+	state.colorMask = _mm_set1_epi32(gstate.getColorMask());
+	state.fbStride = gstate.FrameBufStride();
+	state.depthStride = gstate.DepthBufStride();
+}
+
+static inline __m128i ClampFogDepthQuad(const __m128 &fogdepth) {
+	const __m128 clamped = _mm_min_ps(_mm_max_ps(fogdepth, _mm_setzero_ps()), _mm_set_ps1(1.0f));
+	return _mm_cvttps_epi32(_mm_mul_ps(clamped, _mm_set_ps1(255.0f)));
+}
+
+static inline __m128i WrapOrClampQuad(__m128i c, int size, bool clamp) {
+	const __m128i maxc = _mm_set1_epi32(size - 1);
+	if (!clamp)
+		return _mm_and_si128(c, maxc);
+	c = SelectQuad(_mm_cmpgt_epi32(c, maxc), maxc, c);
+	return _mm_andnot_si128(_mm_cmplt_epi32(c, _mm_setzero_si128()), c);
+}
+
+// Nearest filtered texels at level 0, like ApplyTexturing().
+static inline __m128i SampleNearestQuad(const QuadState &state, bool through, const __m128 &s, const __m128 &t, const u8 *texptr, int texbufwidthbits) {
+	MEMORY_ALIGNED16(int u[4]);
+	MEMORY_ALIGNED16(int v[4]);
+	if (through) {
+		// Through mode always wraps.
+		const __m128i u_texel = _mm_srai_epi32(_mm_cvttps_epi32(_mm_mul_ps(s, _mm_set_ps1(256.0f))), 8);
+		const __m128i v_texel = _mm_srai_epi32(_mm_cvttps_epi32(_mm_mul_ps(t, _mm_set_ps1(256.0f))), 8);
+		_mm_store_si128((__m128i *)u, WrapOrClampQuad(u_texel, state.texWidth, false));
+		_mm_store_si128((__m128i *)v, WrapOrClampQuad(v_texel, state.texHeight, false));
+	} else {
+		const __m128i u_texel = _mm_cvttps_epi32(_mm_mul_ps(s, _mm_set_ps1((float)state.texWidth)));
+		const __m128i v_texel = _mm_cvttps_epi32(_mm_mul_ps(t, _mm_set_ps1((float)state.texHeight)));
+		_mm_store_si128((__m128i *)u, WrapOrClampQuad(u_texel, state.texWidth, state.texClampS));
+		_mm_store_si128((__m128i *)v, WrapOrClampQuad(v_texel, state.texHeight, state.texClampT));
+	}
+
+	Nearest4 texels = SampleNearest<4>(0, u, v, texptr, texbufwidthbits);
+	return _mm_load_si128((const __m128i *)texels.v);
+}
+
+// Same rounding as the SSE path of GetTextureFunctionOutput().
+static inline __m128i ModulateQuad(const __m128i &p, const __m128i &t) {
+	return _mm_cvtps_epi32(_mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(p), _mm_cvtepi32_ps(t)), _mm_set_ps1(255.0f)));
+}
+
+// Returns false if the texture function is left to GetTextureFunctionOutput().
+static inline bool TextureFunctionQuad(const QuadState &state, QuadColor &prim, const QuadColor &tex) {
+	switch (state.texFunc) {
+	case GE_TEXFUNC_MODULATE:
+		prim.r = ModulateQuad(prim.r, tex.r);
+		prim.g = ModulateQuad(prim.g, tex.g);
+		prim.b = ModulateQuad(prim.b, tex.b);
+		if (state.texAlpha)
+			prim.a = ModulateQuad(prim.a, tex.a);
+		return true;
+
+	case GE_TEXFUNC_REPLACE:
+		prim.r = tex.r;
+		prim.g = tex.g;
+		prim.b = tex.b;
+		if (state.texAlpha)
+			prim.a = tex.a;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// The factors of GetSourceFactor() and GetDestFactor(), which share numbering except for
+// the color factors: those use the other side's color.
+static inline void BlendFactorQuad(int factor, const QuadColor &other, const QuadColor &source, const QuadColor &dst, const QuadColor &fix, QuadColor &out) {
+	const __m128i const255 = _mm_set1_epi32(255);
+	__m128i alpha;
+	switch (factor) {
+	case GE_SRCBLEND_DSTCOLOR:
+		out = other;
+		return;
+	case GE_SRCBLEND_INVDSTCOLOR:
+		out.r = _mm_sub_epi32(const255, other.r);
+		out.g = _mm_sub_epi32(const255, other.g);
+		out.b = _mm_sub_epi32(const255, other.b);
+		return;
+	case GE_SRCBLEND_FIXA:
+		out = fix;
+		return;
+
+	case GE_SRCBLEND_SRCALPHA: alpha = source.a; break;
+	case GE_SRCBLEND_INVSRCALPHA: alpha = _mm_sub_epi32(const255, source.a); break;
+	case GE_SRCBLEND_DSTALPHA: alpha = dst.a; break;
+	case GE_SRCBLEND_INVDSTALPHA: alpha = _mm_sub_epi32(const255, dst.a); break;
+	case GE_SRCBLEND_DOUBLESRCALPHA: alpha = _mm_add_epi32(source.a, source.a); break;
+	case GE_SRCBLEND_DOUBLEINVSRCALPHA: alpha = _mm_sub_epi32(const255, _mm_add_epi32(source.a, source.a)); break;
+	case GE_SRCBLEND_DOUBLEDSTALPHA: alpha = _mm_add_epi32(dst.a, dst.a); break;
+	case GE_SRCBLEND_DOUBLEINVDSTALPHA: alpha = _mm_sub_epi32(const255, _mm_add_epi32(dst.a, dst.a)); break;
+	default: alpha = _mm_setzero_si128(); break;
+	}
+	out.r = alpha;
+	out.g = alpha;
+	out.b = alpha;
+}
+
+static inline __m128i BlendChannelQuad(GEBlendMode eq, const __m128i &src, const __m128i &dst, const __m128i &srcfactor, const __m128i &dstfactor) {
+	switch (eq) {
+	case GE_BLENDMODE_MUL_AND_ADD:
+	case GE_BLENDMODE_MUL_AND_SUBTRACT:
+	case GE_BLENDMODE_MUL_AND_SUBTRACT_REVERSE:
+	{
+		// Same as the SSE path of AlphaBlendingResult().
+		const __m128 s = _mm_mul_ps(_mm_cvtepi32_ps(src), _mm_cvtepi32_ps(srcfactor));
+		const __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(dst), _mm_cvtepi32_ps(dstfactor));
+		__m128 v;
+		if (eq == GE_BLENDMODE_MUL_AND_ADD)
+			v = _mm_add_ps(s, d);
+		else if (eq == GE_BLENDMODE_MUL_AND_SUBTRACT)
+			v = _mm_sub_ps(s, d);
+		else
+			v = _mm_sub_ps(d, s);
+		return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set_ps1(1.0f / 255.0f)));
+	}
+
+	case GE_BLENDMODE_MIN:
+		return SelectQuad(_mm_cmplt_epi32(src, dst), src, dst);
+
+	case GE_BLENDMODE_MAX:
+		return SelectQuad(_mm_cmpgt_epi32(src, dst), src, dst);
+
+	case GE_BLENDMODE_ABSDIFF:
+	default:
+	{
+		const __m128i diff = _mm_sub_epi32(src, dst);
+		const __m128i sign = _mm_srai_epi32(diff, 31);
+		return _mm_sub_epi32(_mm_xor_si128(diff, sign), sign);
+	}
+	}
+}
+
+// (c * fog + fogColor * (255 - fog)) / 255 in integers.  The products and the sum are well
+// below 2^24, so they're exact as floats, and truncating the division gives the same result.
+static inline __m128i FogChannelQuad(const __m128i &c, const __m128i &fogColor, const __m128 &fog, const __m128 &invFog) {
+	const __m128 sum = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(c), fog), _mm_mul_ps(_mm_cvtepi32_ps(fogColor), invFog));
+	return _mm_cvttps_epi32(_mm_div_ps(sum, _mm_set_ps1(255.0f)));
+}
+
+// DrawSinglePixel() for the lanes set in mask, for the state QuadState::output allows.
+// x must not wrap within the quad.
+static inline void DrawPixelQuad(const QuadState &state, int x, int y, int mask, const __m128i &z, const __m128i &fog, QuadColor prim) {
+	const __m128i laneBits = _mm_set_epi32(8, 4, 2, 1);
+	const __m128i allOnes = _mm_set1_epi32(-1);
+	__m128i pass = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(mask), laneBits), laneBits);
+
+	if (state.depthRange)
+		pass = _mm_andnot_si128(_mm_or_si128(_mm_cmplt_epi32(z, state.depthMin), _mm_cmpgt_epi32(z, state.depthMax)), pass);
+
+	if (state.depthTest) {
+		u16 *depthptr = (u16 *)depthbuf.data + x + y * state.depthStride;
+		const __m128i ref = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)depthptr), _mm_setzero_si128());
+		__m128i passed;
+		switch (state.depthFunc) {
+		case GE_COMP_NEVER: passed = _mm_setzero_si128(); break;
+		case GE_COMP_ALWAYS: passed = allOnes; break;
+		case GE_COMP_EQUAL: passed = _mm_cmpeq_epi32(z, ref); break;
+		case GE_COMP_NOTEQUAL: passed = _mm_xor_si128(_mm_cmpeq_epi32(z, ref), allOnes); break;
+		case GE_COMP_LESS: passed = _mm_cmplt_epi32(z, ref); break;
+		case GE_COMP_LEQUAL: passed = _mm_xor_si128(_mm_cmpgt_epi32(z, ref), allOnes); break;
+		case GE_COMP_GREATER: passed = _mm_cmpgt_epi32(z, ref); break;
+		case GE_COMP_GEQUAL: passed = _mm_xor_si128(_mm_cmplt_epi32(z, ref), allOnes); break;
+		default: passed = _mm_setzero_si128(); break;
+		}
+		pass = _mm_and_si128(pass, passed);
+
+		if (state.depthWrite) {
+			// Sign extend first, so the pack doesn't saturate depths over 0x7FFF.
+			__m128i depth = SelectQuad(pass, z, ref);
+			depth = _mm_srai_epi32(_mm_slli_epi32(depth, 16), 16);
+			_mm_storel_epi64((__m128i *)depthptr, _mm_packs_epi32(depth, depth));
+		}
+	}
+
+	if (_mm_movemask_ps(_mm_castsi128_ps(pass)) == 0)
+		return;
+
+	if (state.doubling) {
+		prim.r = _mm_slli_epi32(prim.r, 1);
+		prim.g = _mm_slli_epi32(prim.g, 1);
+		prim.b = _mm_slli_epi32(prim.b, 1);
+	}
+
+	if (state.fog) {
+		const __m128 fogf = _mm_cvtepi32_ps(fog);
+		const __m128 invFog = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_set1_epi32(255), fog));
+		prim.r = FogChannelQuad(prim.r, state.fogColor.r, fogf, invFog);
+		prim.g = FogChannelQuad(prim.g, state.fogColor.g, fogf, invFog);
+		prim.b = FogChannelQuad(prim.b, state.fogColor.b, fogf, invFog);
+	}
+
+	u32 *fbptr = (u32 *)fb.data + x + y * state.fbStride;
+	const __m128i old_color = _mm_loadu_si128((const __m128i *)fbptr);
+	const QuadColor dst = QuadFromRGBA(old_color);
+
+	QuadColor result;
+	if (state.blend) {
+		QuadColor srcfactor, dstfactor;
+		BlendFactorQuad(state.srcFactor, dst, prim, dst, state.fixA, srcfactor);
+		BlendFactorQuad(state.dstFactor, prim, prim, dst, state.fixB, dstfactor);
+		result.r = BlendChannelQuad(state.blendEq, prim.r, dst.r, srcfactor.r, dstfactor.r);
+		result.g = BlendChannelQuad(state.blendEq, prim.g, dst.g, srcfactor.g, dstfactor.g);
+		result.b = BlendChannelQuad(state.blendEq, prim.b, dst.b, srcfactor.b, dstfactor.b);
+	} else {
+		result.r = prim.r;
+		result.g = prim.g;
+		result.b = prim.b;
+	}
+	// No stencil test, so the stencil is kept.
+	result.a = dst.a;
+
+	__m128i new_color = QuadToRGBA(result);
+	new_color = SelectQuad(state.colorMask, old_color, new_color);
+	_mm_storeu_si128((__m128i *)fbptr, SelectQuad(pass, new_color, old_color));
+}
+#endif
+
+static PixelJitCache *pixelJitCache = nullptr;
+
+// Must be called on the GPU thread, the result can then be used from any thread.
+static SingleFunc GetPixelFunc(bool clearMode)
+{
+	if (!pixelJitCache)
+		pixelJitCache = new PixelJitCache();
+	return pixelJitCache->GetSingle(ComputePixelFuncID(clearMode));
+}
+
+void Shutdown()
+{
+	delete pixelJitCache;
+	pixelJitCache = nullptr;
+}
+
 template <bool clearMode>
 void DrawTriangleSlice(
 	const VertexData& v0, const VertexData& v1, const VertexData& v2,
 	int minX, int minY, int maxX, int maxY,
-	int y1, int y2)
+	int y1, int y2, SingleFunc pixelFunc)
 {
 	Vec2<int> d01((int)v0.screenpos.x - (int)v1.screenpos.x, (int)v0.screenpos.y - (int)v1.screenpos.y);
 	Vec2<int> d02((int)v0.screenpos.x - (int)v2.screenpos.x, (int)v0.screenpos.y - (int)v2.screenpos.y);
@@ -1225,6 +1630,13 @@ void DrawTriangleSlice(
 		}
 	}
 
+	// The framebuffer writes may alias gstate as far as the compiler knows, so read the
+	// state the per pixel path depends on up front instead of on every pixel.
+	const bool gouraud = gstate.getShadeMode() == GE_SHADE_GOURAUD && !clearMode;
+	const bool textured = gstate.isTextureMapEnabled() && !clearMode;
+	const bool through = gstate.isModeThrough();
+	const bool fogEnabled = gstate.isFogEnabled() && !clearMode;
+
 	ScreenCoords pprime(minX, minY, 0);
 	int w0_base = orient2d(v1.screenpos, v2.screenpos, pprime);
 	int w1_base = orient2d(v2.screenpos, v0.screenpos, pprime);
@@ -1239,6 +1651,209 @@ void DrawTriangleSlice(
 	// This is common, and when we interpolate, we lose accuracy.
 	const bool flatZ = v0.screenpos.z == v1.screenpos.z && v0.screenpos.z == v2.screenpos.z;
 
+	const int w0IncX = orient2dIncX(d12.y) * 16;
+	const int w1IncX = orient2dIncX(-d02.y) * 16;
+	const int w2IncX = orient2dIncX(d01.y) * 16;
+
+	auto shadePixel = [&](const DrawingCoords &p, int w0, int w1, int w2) {
+		int wsum = w0 + w1 + w2;
+		if (wsum == 0.0f)
+			return;
+		float wsum_recip = 1.0f / (float)wsum;
+
+		Vec4<int> prim_color;
+		Vec3<int> sec_color;
+		if (gouraud) {
+			// Does the PSP do perspective-correct color interpolation? The GC doesn't.
+			prim_color = Interpolate(v0.color0, v1.color0, v2.color0, w0, w1, w2, wsum_recip);
+			sec_color = Interpolate(v0.color1, v1.color1, v2.color1, w0, w1, w2, wsum_recip);
+		} else {
+			prim_color = v2.color0;
+			sec_color = v2.color1;
+		}
+
+		if (textured) {
+			if (through) {
+				Vec2<float> texcoords = Interpolate(v0.texturecoords, v1.texturecoords, v2.texturecoords, w0, w1, w2, wsum_recip);
+				ApplyTexturing(prim_color, texcoords.s(), texcoords.t(), maxTexLevel, magFilt, texptr, texbufwidthbits);
+			} else {
+				// Texture coordinate interpolation must definitely be perspective-correct.
+				float s = 0, t = 0;
+				GetTextureCoordinates(v0, v1, v2, w0, w1, w2, s, t);
+				s = s * texScaleU + texOffsetU;
+				t = t * texScaleV + texOffsetV;
+				ApplyTexturing(prim_color, s, t, maxTexLevel, magFilt, texptr, texbufwidthbits);
+			}
+		}
+
+		if (!clearMode) {
+			// TODO: Tried making Vec4 do this, but things got slower.
+#if defined(_M_SSE)
+			const __m128i sec = _mm_and_si128(sec_color.ivec, _mm_set_epi32(0, -1, -1, -1));
+			prim_color.ivec = _mm_add_epi32(prim_color.ivec, sec);
+#else
+			prim_color += Vec4<int>(sec_color, 0);
+#endif
+		}
+
+		int fog = 255;
+		if (fogEnabled) {
+			fog = ClampFogDepth(((float)v0.fogdepth * w0 + (float)v1.fogdepth * w1 + (float)v2.fogdepth * w2) * wsum_recip);
+		}
+
+		u16 z = v2.screenpos.z;
+		// TODO: Is that the correct way to interpolate?
+		// Without the (u32), this causes an ICE in some versions of gcc.
+		if (!flatZ)
+			z = (u16)(u32)(((float)v0.screenpos.z * w0 + (float)v1.screenpos.z * w1 + (float)v2.screenpos.z * w2) * wsum_recip);
+
+		if (pixelFunc)
+			pixelFunc(p.x, p.y, z, prim_color);
+		else
+			DrawSinglePixel<clearMode>(p, z, fog, prim_color);
+	};
+
+#if defined(_M_SSE)
+	// Edge functions are evaluated for spans of 4 pixels at a time.
+	const __m128i w0Steps = _mm_set_epi32(w0IncX * 3, w0IncX * 2, w0IncX, 0);
+	const __m128i w1Steps = _mm_set_epi32(w1IncX * 3, w1IncX * 2, w1IncX, 0);
+	const __m128i w2Steps = _mm_set_epi32(w2IncX * 3, w2IncX * 2, w2IncX, 0);
+	const __m128i biasVec0 = _mm_set1_epi32(bias0);
+	const __m128i biasVec1 = _mm_set1_epi32(bias1);
+	const __m128i biasVec2 = _mm_set1_epi32(bias2);
+#endif
+
+#if defined(_M_SSE) && !defined(_M_IX86)
+	// Same as shadePixel, for the pixels of a span set in mask.
+	const bool quads = g_Config.bSoftwareRenderingSIMD;
+	QuadState quadState;
+	if (quads)
+		ComputeQuadState(quadState, clearMode, magFilt);
+	const bool perspectiveUV = gstate.getUVGenMode() != GE_TEXMAP_TEXTURE_MATRIX;
+	const float q0 = 1.f / v0.clippos.w;
+	const float q1 = 1.f / v1.clippos.w;
+	const float q2 = 1.f / v2.clippos.w;
+
+	auto shadeQuad = [&](const DrawingCoords &p, int w0, int w1, int w2, int mask) {
+		const __m128i w0vec = _mm_add_epi32(_mm_set1_epi32(w0), w0Steps);
+		const __m128i w1vec = _mm_add_epi32(_mm_set1_epi32(w1), w1Steps);
+		const __m128i w2vec = _mm_add_epi32(_mm_set1_epi32(w2), w2Steps);
+		const __m128i wsum = _mm_add_epi32(_mm_add_epi32(w0vec, w1vec), w2vec);
+		mask &= ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(wsum, _mm_setzero_si128())));
+		if (mask == 0)
+			return;
+
+		const __m128 fw0 = _mm_cvtepi32_ps(w0vec);
+		const __m128 fw1 = _mm_cvtepi32_ps(w1vec);
+		const __m128 fw2 = _mm_cvtepi32_ps(w2vec);
+		const __m128 wsum_recip = _mm_div_ps(_mm_set_ps1(1.0f), _mm_cvtepi32_ps(wsum));
+
+		QuadColor prim_color;
+		QuadColor sec_color;
+		if (gouraud) {
+			prim_color = InterpolateQuad(v0.color0, v1.color0, v2.color0, fw0, fw1, fw2, wsum_recip);
+			sec_color = InterpolateQuad(v0.color1, v1.color1, v2.color1, fw0, fw1, fw2, wsum_recip);
+		} else {
+			prim_color = QuadFromColor(v2.color0);
+			sec_color = QuadFromColor(v2.color1);
+		}
+
+		if (textured) {
+			MEMORY_ALIGNED16(float ls[4]);
+			MEMORY_ALIGNED16(float lt[4]);
+			__m128 s, t;
+			if (through) {
+				s = InterpolateQuad(v0.texturecoords.s(), v1.texturecoords.s(), v2.texturecoords.s(), fw0, fw1, fw2, wsum_recip);
+				t = InterpolateQuad(v0.texturecoords.t(), v1.texturecoords.t(), v2.texturecoords.t(), fw0, fw1, fw2, wsum_recip);
+			} else {
+				if (perspectiveUV) {
+					// Same as GetTextureCoordinates().
+					const __m128 q_recip = _mm_div_ps(_mm_set_ps1(1.0f), InterpolateQuad(q0, q1, q2, fw0, fw1, fw2, _mm_set_ps1(1.0f)));
+					s = InterpolateQuad(v0.texturecoords.s() * q0, v1.texturecoords.s() * q1, v2.texturecoords.s() * q2, fw0, fw1, fw2, q_recip);
+					t = InterpolateQuad(v0.texturecoords.t() * q0, v1.texturecoords.t() * q1, v2.texturecoords.t() * q2, fw0, fw1, fw2, q_recip);
+				} else {
+					MEMORY_ALIGNED16(int lw0[4]);
+					MEMORY_ALIGNED16(int lw1[4]);
+					MEMORY_ALIGNED16(int lw2[4]);
+					_mm_store_si128((__m128i *)lw0, w0vec);
+					_mm_store_si128((__m128i *)lw1, w1vec);
+					_mm_store_si128((__m128i *)lw2, w2vec);
+					for (int i = 0; i < 4; ++i) {
+						ls[i] = 0.0f;
+						lt[i] = 0.0f;
+						if (mask & (1 << i))
+							GetTextureCoordinates(v0, v1, v2, lw0[i], lw1[i], lw2[i], ls[i], lt[i]);
+					}
+					s = _mm_load_ps(ls);
+					t = _mm_load_ps(lt);
+				}
+				s = _mm_add_ps(_mm_mul_ps(s, _mm_set_ps1(texScaleU)), _mm_set_ps1(texOffsetU));
+				t = _mm_add_ps(_mm_mul_ps(t, _mm_set_ps1(texScaleV)), _mm_set_ps1(texOffsetV));
+			}
+
+			Vec4<int> pixels[4];
+			if (quadState.nearest) {
+				const QuadColor texcolor = QuadFromRGBA(SampleNearestQuad(quadState, through, s, t, texptr[0], texbufwidthbits[0]));
+				if (!TextureFunctionQuad(quadState, prim_color, texcolor)) {
+					Vec4<int> texels[4];
+					QuadToPixels(prim_color, pixels);
+					QuadToPixels(texcolor, texels);
+					for (int i = 0; i < 4; ++i) {
+						if (mask & (1 << i))
+							pixels[i] = GetTextureFunctionOutput(pixels[i], texels[i]);
+					}
+					prim_color = QuadFromPixels(pixels);
+				}
+			} else {
+				_mm_store_ps(ls, s);
+				_mm_store_ps(lt, t);
+				QuadToPixels(prim_color, pixels);
+				for (int i = 0; i < 4; ++i) {
+					if (mask & (1 << i))
+						ApplyTexturing(pixels[i], ls[i], lt[i], maxTexLevel, magFilt, texptr, texbufwidthbits);
+				}
+				prim_color = QuadFromPixels(pixels);
+			}
+		}
+
+		if (!clearMode) {
+			prim_color.r = _mm_add_epi32(prim_color.r, sec_color.r);
+			prim_color.g = _mm_add_epi32(prim_color.g, sec_color.g);
+			prim_color.b = _mm_add_epi32(prim_color.b, sec_color.b);
+		}
+
+		__m128i fog = _mm_set1_epi32(255);
+		if (fogEnabled)
+			fog = ClampFogDepthQuad(InterpolateQuad(v0.fogdepth, v1.fogdepth, v2.fogdepth, fw0, fw1, fw2, wsum_recip));
+
+		__m128i z = _mm_set1_epi32(v2.screenpos.z);
+		if (!flatZ)
+			z = _mm_and_si128(_mm_cvttps_epi32(InterpolateQuad((float)v0.screenpos.z, (float)v1.screenpos.z, (float)v2.screenpos.z, fw0, fw1, fw2, wsum_recip)), _mm_set1_epi32(0xFFFF));
+
+		// The quad can wrap around to x = 0, in which case it's not contiguous.
+		if (!pixelFunc && quadState.output && p.x + 3 <= 0x3FF) {
+			DrawPixelQuad(quadState, p.x, p.y, mask, z, fog, prim_color);
+			return;
+		}
+
+		MEMORY_ALIGNED16(int lz[4]);
+		MEMORY_ALIGNED16(int lfog[4]);
+		Vec4<int> pixels[4];
+		_mm_store_si128((__m128i *)lz, z);
+		_mm_store_si128((__m128i *)lfog, fog);
+		QuadToPixels(prim_color, pixels);
+		DrawingCoords pi = p;
+		for (int i = 0; i < 4; ++i, pi.x = (pi.x + 1) & 0x3FF) {
+			if (!(mask & (1 << i)))
+				continue;
+			if (pixelFunc)
+				pixelFunc(pi.x, pi.y, lz[i], pixels[i]);
+			else
+				DrawSinglePixel<clearMode>(pi, (u16)lz[i], (u8)lfog[i], pixels[i]);
+		}
+	};
+#endif
+
 	for (pprime.y = minY + y1 * 16; pprime.y < minY + y2 * 16; pprime.y += 16,
 										w0_base += orient2dIncY(d12.x)*16,
 										w1_base += orient2dIncY(-d02.x)*16,
@@ -1250,88 +1865,72 @@ void DrawTriangleSlice(
 		pprime.x = minX;
 		DrawingCoords p = TransformUnit::ScreenToDrawing(pprime);
 
-		for (; pprime.x <= maxX; pprime.x +=16,
-			w0 += orient2dIncX(d12.y)*16,
-			w1 += orient2dIncX(-d02.y)*16,
-			w2 += orient2dIncX(d01.y)*16,
-			p.x = (p.x + 1) & 0x3FF) {
-
-			// If p is on or inside all edges, render pixel
-			if (w0 + bias0 >= 0 && w1 + bias1 >= 0 && w2 + bias2 >= 0) {
-				int wsum = w0 + w1 + w2;
-				if (wsum == 0.0f)
-					continue;
-				float wsum_recip = 1.0f / (float)wsum;
-
-				Vec4<int> prim_color;
-				Vec3<int> sec_color;
-				if (gstate.getShadeMode() == GE_SHADE_GOURAUD && !clearMode) {
-					// Does the PSP do perspective-correct color interpolation? The GC doesn't.
-					prim_color = Interpolate(v0.color0, v1.color0, v2.color0, w0, w1, w2, wsum_recip);
-					sec_color = Interpolate(v0.color1, v1.color1, v2.color1, w0, w1, w2, wsum_recip);
-				} else {
-					prim_color = v2.color0;
-					sec_color = v2.color1;
-				}
-
-				if (gstate.isTextureMapEnabled() && !clearMode) {
-					if (gstate.isModeThrough()) {
-						Vec2<float> texcoords = Interpolate(v0.texturecoords, v1.texturecoords, v2.texturecoords, w0, w1, w2, wsum_recip);
-						ApplyTexturing(prim_color, texcoords.s(), texcoords.t(), maxTexLevel, magFilt, texptr, texbufwidthbits);
-					} else {
-						// Texture coordinate interpolation must definitely be perspective-correct.
-						float s = 0, t = 0;
-						GetTextureCoordinates(v0, v1, v2, w0, w1, w2, s, t);
-						s = s * texScaleU + texOffsetU;
-						t = t * texScaleV + texOffsetV;
-						ApplyTexturing(prim_color, s, t, maxTexLevel, magFilt, texptr, texbufwidthbits);
-					}
-				}
+		// The covered part of a row is a single span, so once we leave the triangle we're done.
+		bool seenInside = false;
+		for (int x = minX; x <= maxX; x += 16 * 4,
+			w0 += w0IncX * 4,
+			w1 += w1IncX * 4,
+			w2 += w2IncX * 4,
+			p.x = (p.x + 4) & 0x3FF) {
 
-				if (!clearMode) {
-					// TODO: Tried making Vec4 do this, but things got slower.
+			// Bit i is set if pixel i of the span is on or inside all edges.
 #if defined(_M_SSE)
-					const __m128i sec = _mm_and_si128(sec_color.ivec, _mm_set_epi32(0, -1, -1, -1));
-					prim_color.ivec = _mm_add_epi32(prim_color.ivec, sec);
+			__m128i e0 = _mm_add_epi32(_mm_add_epi32(_mm_set1_epi32(w0), w0Steps), biasVec0);
+			__m128i e1 = _mm_add_epi32(_mm_add_epi32(_mm_set1_epi32(w1), w1Steps), biasVec1);
+			__m128i e2 = _mm_add_epi32(_mm_add_epi32(_mm_set1_epi32(w2), w2Steps), biasVec2);
+			__m128i outside = _mm_or_si128(_mm_or_si128(e0, e1), e2);
+			int inside = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF;
 #else
-					prim_color += Vec4<int>(sec_color, 0);
+			int inside = 0;
+			for (int i = 0; i < 4; ++i) {
+				if (w0 + w0IncX * i + bias0 >= 0 && w1 + w1IncX * i + bias1 >= 0 && w2 + w2IncX * i + bias2 >= 0)
+					inside |= 1 << i;
+			}
 #endif
-				}
-
-				int fog = 255;
-				if (gstate.isFogEnabled() && !clearMode) {
-					fog = ClampFogDepth(((float)v0.fogdepth * w0 + (float)v1.fogdepth * w1 + (float)v2.fogdepth * w2) * wsum_recip);
-				}
+			// Drop pixels past the end of the row.
+			int remaining = (maxX - x) / 16 + 1;
+			if (remaining < 4)
+				inside &= (1 << remaining) - 1;
+
+			if (inside == 0) {
+				if (seenInside)
+					break;
+				continue;
+			}
+			seenInside = true;
 
-				u16 z = v2.screenpos.z;
-				// TODO: Is that the correct way to interpolate?
-				// Without the (u32), this causes an ICE in some versions of gcc.
-				if (!flatZ)
-					z = (u16)(u32)(((float)v0.screenpos.z * w0 + (float)v1.screenpos.z * w1 + (float)v2.screenpos.z * w2) * wsum_recip);
+#if defined(_M_SSE) && !defined(_M_IX86)
+			if (quads) {
+				shadeQuad(p, w0, w1, w2, inside);
+				continue;
+			}
+#endif
 
-				DrawSinglePixel<clearMode>(p, z, fog, prim_color);
+			DrawingCoords pi = p;
+			int lw0 = w0, lw1 = w1, lw2 = w2;
+			for (; inside != 0; inside >>= 1, lw0 += w0IncX, lw1 += w1IncX, lw2 += w2IncX, pi.x = (pi.x + 1) & 0x3FF) {
+				if (inside & 1)
+					shadePixel(pi, lw0, lw1, lw2);
 			}
 		}
 	}
 }
 
-// Draws triangle, vertices specified in counter-clockwise direction
-void DrawTriangle(const VertexData& v0, const VertexData& v1, const VertexData& v2)
+// Computes the screen space bounding box of a triangle, clamped to the scissor.
+// Returns false if the triangle is backfacing and should be dropped.
+static bool GetTriangleBounds(const VertexData& v0, const VertexData& v1, const VertexData& v2, int &minX, int &minY, int &maxX, int &maxY)
 {
-	PROFILE_THIS_SCOPE("draw_tri");
-
 	Vec2<int> d01((int)v0.screenpos.x - (int)v1.screenpos.x, (int)v0.screenpos.y - (int)v1.screenpos.y);
 	Vec2<int> d02((int)v0.screenpos.x - (int)v2.screenpos.x, (int)v0.screenpos.y - (int)v2.screenpos.y);
-	Vec2<int> d12((int)v1.screenpos.x - (int)v2.screenpos.x, (int)v1.screenpos.y - (int)v2.screenpos.y);
 
 	// Drop primitives which are not in CCW order by checking the cross product
 	if (d01.x * d02.y - d01.y * d02.x < 0)
-		return;
+		return false;
 
-	int minX = std::min(std::min(v0.screenpos.x, v1.screenpos.x), v2.screenpos.x) & ~0xF;
-	int minY = std::min(std::min(v0.screenpos.y, v1.screenpos.y), v2.screenpos.y) & ~0xF;
-	int maxX = std::max(std::max(v0.screenpos.x, v1.screenpos.x), v2.screenpos.x) & ~0xF;
-	int maxY = std::max(std::max(v0.screenpos.y, v1.screenpos.y), v2.screenpos.y) & ~0xF;
+	minX = std::min(std::min(v0.screenpos.x, v1.screenpos.x), v2.screenpos.x) & ~0xF;
+	minY = std::min(std::min(v0.screenpos.y, v1.screenpos.y), v2.screenpos.y) & ~0xF;
+	maxX = std::max(std::max(v0.screenpos.x, v1.screenpos.x), v2.screenpos.x) & ~0xF;
+	maxY = std::max(std::max(v0.screenpos.y, v1.screenpos.y), v2.screenpos.y) & ~0xF;
 
 	DrawingCoords scissorTL(gstate.getScissorX1(), gstate.getScissorY1(), 0);
 	DrawingCoords scissorBR(gstate.getScissorX2(), gstate.getScissorY2(), 0);
@@ -1339,34 +1938,169 @@ void DrawTriangle(const VertexData& v0, const VertexData& v1, const VertexData&
 	maxX = std::min(maxX, (int)TransformUnit::DrawingToScreen(scissorBR).x);
 	minY = std::max(minY, (int)TransformUnit::DrawingToScreen(scissorTL).y);
 	maxY = std::min(maxY, (int)TransformUnit::DrawingToScreen(scissorBR).y);
+	return true;
+}
+
+// While binning, triangles are queued up and sorted into screen tiles instead of being drawn.
+// Tiles never share pixels and each one draws its triangles in submission order, so rasterizing
+// the tiles in parallel produces exactly the same output as drawing the triangles one by one.
+// gstate must not change between BeginBinning() and EndBinning().
+enum {
+	BIN_TILE_SIZE = 32,
+	BIN_TILE_SCREEN_SIZE = BIN_TILE_SIZE * 16,
+	// Drawing coordinates wrap at 1024.
+	BIN_GRID_SIZE = 1024 / BIN_TILE_SIZE,
+	// Bounds memory use for huge draws, we just flush early.
+	BIN_MAX_TRIANGLES = 4096,
+};
+
+struct BinnedTriangle {
+	VertexData v[3];
+	int minX, minY, maxX, maxY;
+};
+
+static bool binning = false;
+static std::vector<BinnedTriangle> binnedTriangles;
+static std::vector<int> bins[BIN_GRID_SIZE * BIN_GRID_SIZE];
+static std::vector<int> usedBins;
+
+template <bool clearMode>
+static void DrawBinnedTile(int tile, SingleFunc pixelFunc)
+{
+	DrawingCoords tileDrawing((tile % BIN_GRID_SIZE) * BIN_TILE_SIZE, (tile / BIN_GRID_SIZE) * BIN_TILE_SIZE, 0);
+	ScreenCoords tileTL = TransformUnit::DrawingToScreen(tileDrawing);
+	int tileX2 = tileTL.x + BIN_TILE_SCREEN_SIZE;
+	int tileY2 = tileTL.y + BIN_TILE_SCREEN_SIZE;
+
+	for (int index : bins[tile]) {
+		const BinnedTriangle &tri = binnedTriangles[index];
+
+		// Sample positions must stay on the triangle's own 16-unit grid for identical results.
+		int startX = tri.minX;
+		if (startX < tileTL.x)
+			startX += (tileTL.x - tri.minX + 15) & ~0xF;
+		int endX = std::min(tri.maxX, tileX2 - 1);
+		int y1 = tileTL.y > tri.minY ? (tileTL.y - tri.minY + 15) / 16 : 0;
+		int y2 = std::min((tri.maxY - tri.minY) / 16 + 1, (tileY2 - tri.minY + 15) / 16);
+		if (startX > endX || y1 >= y2)
+			continue;
+
+		DrawTriangleSlice<clearMode>(tri.v[0], tri.v[1], tri.v[2], startX, tri.minY, endX, tri.maxY, y1, y2, pixelFunc);
+	}
+}
+
+static void FlushBins()
+{
+	if (binnedTriangles.empty())
+		return;
+
+	PROFILE_THIS_SCOPE("draw_bins");
+
+	SingleFunc pixelFunc = GetPixelFunc(gstate.isModeClear());
+	if (gstate.isModeClear()) {
+		GlobalThreadPool::Loop([&](int a, int b) {
+			for (int i = a; i < b; ++i)
+				DrawBinnedTile<true>(usedBins[i], pixelFunc);
+		}, 0, (int)usedBins.size());
+	} else {
+		GlobalThreadPool::Loop([&](int a, int b) {
+			for (int i = a; i < b; ++i)
+				DrawBinnedTile<false>(usedBins[i], pixelFunc);
+		}, 0, (int)usedBins.size());
+	}
+
+	for (int tile : usedBins)
+		bins[tile].clear();
+	usedBins.clear();
+	binnedTriangles.clear();
+}
+
+static void BinTriangle(const VertexData& v0, const VertexData& v1, const VertexData& v2, int minX, int minY, int maxX, int maxY)
+{
+	if (binnedTriangles.size() >= BIN_MAX_TRIANGLES)
+		FlushBins();
+
+	int index = (int)binnedTriangles.size();
+	binnedTriangles.push_back(BinnedTriangle());
+	BinnedTriangle &tri = binnedTriangles.back();
+	tri.v[0] = v0;
+	tri.v[1] = v1;
+	tri.v[2] = v2;
+	tri.minX = minX;
+	tri.minY = minY;
+	tri.maxX = maxX;
+	tri.maxY = maxY;
+
+	// The bounds were clamped to the scissor, so they're never left of / above the offset.
+	DrawingCoords tl = TransformUnit::ScreenToDrawing(ScreenCoords(minX, minY, 0));
+	DrawingCoords br = TransformUnit::ScreenToDrawing(ScreenCoords(maxX, maxY, 0));
+	for (int ty = tl.y / BIN_TILE_SIZE; ty <= br.y / BIN_TILE_SIZE; ++ty) {
+		for (int tx = tl.x / BIN_TILE_SIZE; tx <= br.x / BIN_TILE_SIZE; ++tx) {
+			int tile = ty * BIN_GRID_SIZE + tx;
+			if (bins[tile].empty())
+				usedBins.push_back(tile);
+			bins[tile].push_back(index);
+		}
+	}
+}
+
+void BeginBinning()
+{
+	binning = true;
+}
+
+void EndBinning()
+{
+	FlushBins();
+	binning = false;
+}
+
+// Draws triangle, vertices specified in counter-clockwise direction
+void DrawTriangle(const VertexData& v0, const VertexData& v1, const VertexData& v2)
+{
+	PROFILE_THIS_SCOPE("draw_tri");
+
+	int minX, minY, maxX, maxY;
+	if (!GetTriangleBounds(v0, v1, v2, minX, minY, maxX, maxY))
+		return;
+
+	if (binning) {
+		// Like the row count below, a maxY that rounded down to just above minY still draws the row at minY.
+		if (minX <= maxX && maxY - minY > -16)
+			BinTriangle(v0, v1, v2, minX, minY, maxX, std::max(minY, maxY));
+		return;
+	}
 
 	int range = (maxY - minY) / 16 + 1;
+	SingleFunc pixelFunc = GetPixelFunc(gstate.isModeClear());
 	if (gstate.isModeClear()) {
 		if (range >= 24 && (maxX - minX) >= 24 * 16)
 		{
-      VertexData v[3] = { v0, v1, v2 };
-			auto bound = [&](int a, int b) -> void {DrawTriangleSlice<true>(v0, v1, v2, minX, minY, maxX, maxY, a, b); };
+			auto bound = [&](int a, int b) -> void {DrawTriangleSlice<true>(v0, v1, v2, minX, minY, maxX, maxY, a, b, pixelFunc); };
 			GlobalThreadPool::Loop(bound, 0, range);
 		}
 		else
 		{
-			DrawTriangleSlice<true>(v0, v1, v2, minX, minY, maxX, maxY, 0, range);
+			DrawTriangleSlice<true>(v0, v1, v2, minX, minY, maxX, maxY, 0, range, pixelFunc);
 		}
 	} else {
 		if (range >= 24 && (maxX - minX) >= 24 * 16)
 		{
-			auto bound = [&](int a, int b) -> void {DrawTriangleSlice<false>(v0, v1, v2, minX, minY, maxX, maxY, a, b); };
+			auto bound = [&](int a, int b) -> void {DrawTriangleSlice<false>(v0, v1, v2, minX, minY, maxX, maxY, a, b, pixelFunc); };
 			GlobalThreadPool::Loop(bound, 0, range);
 		}
 		else
 		{
-			DrawTriangleSlice<false>(v0, v1, v2, minX, minY, maxX, maxY, 0, range);
+			DrawTriangleSlice<false>(v0, v1, v2, minX, minY, maxX, maxY, 0, range, pixelFunc);
 		}
 	}
 }
 
 void DrawPoint(const VertexData &v0)
 {
+	// Keep draw order intact.
+	FlushBins();
+
 	ScreenCoords pos = v0.screenpos;
 	Vec4<int> prim_color = v0.color0;
 	Vec3<int> sec_color = v0.color1;
@@ -1446,6 +2180,8 @@ void DrawPoint(const VertexData &v0)
 
 void DrawLine(const VertexData &v0, const VertexData &v1)
 {
+	FlushBins();
+
 	// TODO: Use a proper line drawing algorithm that handles fractional endpoints correctly.
 	Vec3<int> a(v0.screenpos.x, v0.screenpos.y, v0.screenpos.z);
 	Vec3<int> b(v1.screenpos.x, v1.screenpos.y, v0.screenpos.z);
@@ -28,6 +28,14 @@ void DrawTriangle(const VertexData& v0, const VertexData& v1, const VertexData&
 void DrawPoint(const VertexData &v0);
 void DrawLine(const VertexData &v0, const VertexData &v1);
 
+// Between these, triangles are sorted into screen tiles and drawn in parallel at the end.
+// Output is identical to drawing them immediately.  gstate must not change in between.
+void BeginBinning();
+void EndBinning();
+
+// Frees the pixel function cache.
+void Shutdown();
+
 bool GetCurrentStencilbuffer(GPUDebugBuffer &buffer);
 bool GetCurrentTexture(GPUDebugBuffer &buffer, int level);
 
@@ -168,6 +168,7 @@ SoftGPU::SoftGPU()
 
 SoftGPU::~SoftGPU()
 {
+	Rasterizer::Shutdown();
 	glDeleteProgram(program);
 	glDeleteTextures(1, &temp_texture);
 }
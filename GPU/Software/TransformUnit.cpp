@@ -26,6 +26,7 @@
 #include "GPU/Software/TransformUnit.h"
 #include "GPU/Software/Clipper.h"
 #include "GPU/Software/Lighting.h"
+#include "GPU/Software/Rasterizer.h"
 
 static u8 buf[65536 * 48];  // yolo
 bool TransformUnit::outside_range_flag = false;
@@ -338,6 +339,11 @@ void TransformUnit::SubmitPrimitive(void* vertices, void* indices, u32 prim_type
 
 	VertexData data[max_vtcs_per_prim];
 
+	// gstate can't change during a draw, so the triangles can be binned and rasterized in parallel.
+	const bool binTriangles = prim_type != GE_PRIM_POINTS && prim_type != GE_PRIM_LINES && prim_type != GE_PRIM_LINE_STRIP && g_Config.iNumWorkerThreads > 1;
+	if (binTriangles)
+		Rasterizer::BeginBinning();
+
 	// TODO: Do this in two passes - first process the vertices (before indexing/stripping),
 	// then resolve the indices. This lets us avoid transforming shared vertices twice.
 
@@ -499,6 +505,9 @@ void TransformUnit::SubmitPrimitive(void* vertices, void* indices, u32 prim_type
 		}
 	}
 
+	if (binTriangles)
+		Rasterizer::EndBinning();
+
 	host->GPUNotifyDraw();
 }
 
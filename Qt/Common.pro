@@ -44,6 +44,7 @@ win32 {
 }
 
 armv7: SOURCES += $$P/Common/ColorConvNEON.cpp
+i86: SOURCES += $$P/Common/ColorConvAVX2.cpp
 
 SOURCES += $$P/Common/ChunkFile.cpp \
 	$$P/Common/ColorConv.cpp \
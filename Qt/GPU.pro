@@ -62,6 +62,7 @@ SOURCES += $$P/GPU/GeDisasm.cpp \ # GPU
 	$$P/ext/xbrz/*.cpp # XBRZ
 
 armv7: SOURCES += $$P/GPU/Common/TextureDecoderNEON.cpp
+i86: SOURCES += $$P/GPU/Common/TextureDecoderAVX2.cpp
 
 arm: SOURCES += $$P/GPU/Common/VertexDecoderArm.cpp
 else:i86: SOURCES += $$P/GPU/Common/VertexDecoderX86.cpp
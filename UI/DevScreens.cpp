@@ -667,6 +667,8 @@ UI::EventReturn JitCompareScreen::OnShowStats(UI::EventParams &e) {
 	NOTICE_LOG(JIT, "Average Bloat: %0.2f%%", 100 * bcStats.avgBloat);
 	NOTICE_LOG(JIT, "Min Bloat: %0.2f%%  (%08x)", 100 * bcStats.minBloat, bcStats.minBloatBlock);
 	NOTICE_LOG(JIT, "Max Bloat: %0.2f%%  (%08x)", 100 * bcStats.maxBloat, bcStats.maxBloatBlock);
+	NOTICE_LOG(JIT, "Tier 1 blocks: %d, tier 2 blocks: %d, tier ups: %d", bcStats.numTier1Blocks, bcStats.numTier2Blocks, bcStats.numTierUps);
+	NOTICE_LOG(JIT, "Persistent cache: %d hits, %d misses, %d invalidated", bcStats.persistentHits, bcStats.persistentMisses, bcStats.persistentInvalidated);
 
 	int ctr = 0, sz = (int)bcStats.bloatMap.size();
 	for (auto iter : bcStats.bloatMap) {
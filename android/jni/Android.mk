@@ -28,6 +28,8 @@ ARCH_FILES := \
   $(SRC)/Core/MIPS/x86/JitSafeMem.cpp \
   $(SRC)/Core/MIPS/x86/RegCache.cpp \
   $(SRC)/Core/MIPS/x86/RegCacheFPU.cpp \
+  $(SRC)/Common/ColorConvAVX2.cpp \
+  $(SRC)/GPU/Common/TextureDecoderAVX2.cpp \
   $(SRC)/GPU/Common/VertexDecoderX86.cpp
 endif
 
@@ -184,6 +186,8 @@ EXEC_AND_LIB_FILES := \
   $(SRC)/GPU/Null/NullGpu.cpp \
   $(SRC)/GPU/Software/Clipper.cpp \
   $(SRC)/GPU/Software/Lighting.cpp \
+  $(SRC)/GPU/Software/PixelJit.cpp \
+  $(SRC)/GPU/Software/PixelJitX86.cpp \
   $(SRC)/GPU/Software/Rasterizer.cpp.arm \
   $(SRC)/GPU/Software/SoftGpu.cpp \
   $(SRC)/GPU/Software/TransformUnit.cpp \
@@ -216,6 +220,7 @@ EXEC_AND_LIB_FILES := \
   $(SRC)/Core/MemMapFunctions.cpp \
   $(SRC)/Core/Reporting.cpp \
   $(SRC)/Core/SaveState.cpp \
+  $(SRC)/Core/StateRingbuffer.cpp \
   $(SRC)/Core/Screenshot.cpp \
   $(SRC)/Core/System.cpp \
   $(SRC)/Core/Debugger/Breakpoints.cpp \
@@ -444,6 +449,18 @@ ifeq ($(UNITTEST),1)
     $(SRC)/Core/MIPS/MIPSAsm.cpp \
     $(SRC)/unittest/JitHarness.cpp \
     $(SRC)/unittest/TestVertexJit.cpp \
+    $(SRC)/unittest/TestSoftRasterizer.cpp \
+    $(SRC)/unittest/TestThreadPool.cpp \
+    $(SRC)/unittest/TestCoreTiming.cpp \
+    $(SRC)/unittest/TestThreadQueueList.cpp \
+    $(SRC)/unittest/TestHLE.cpp \
+    $(SRC)/unittest/TestTextureDecoder.cpp \
+    $(SRC)/unittest/TestTextureCache.cpp \
+    $(SRC)/unittest/TestSoftwareTransform.cpp \
+    $(SRC)/unittest/TestFileLoader.cpp \
+    $(SRC)/unittest/TestISOFileSystem.cpp \
+    $(SRC)/unittest/TestDirectoryFileSystem.cpp \
+    $(SRC)/unittest/TestStateRingbuffer.cpp \
     $(TESTARMEMITTER_FILE) \
     $(SRC)/unittest/UnitTest.cpp
 
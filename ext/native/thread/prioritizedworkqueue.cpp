@@ -2,6 +2,7 @@
 #include "base/logging.h"
 #include "base/timeutil.h"
 #include "thread/thread.h"
+#include "thread/threadpool.h"
 #include "thread/prioritizedworkqueue.h"
 
 PrioritizedWorkQueue::~PrioritizedWorkQueue() {
@@ -14,6 +15,35 @@ void PrioritizedWorkQueue::Add(PrioritizedWorkQueueItem *item) {
 	lock_guard guard(mutex_);
 	queue_.push_back(item);
 	notEmpty_.notify_one();
+	// Which item the task runs is decided when it starts, so priorities can still change.
+	if (pool_) {
+		pool_->Submit(std::bind(&PrioritizedWorkQueue::RunOne, this));
+	}
+}
+
+void PrioritizedWorkQueue::ProcessOn(ThreadPool *pool) {
+	lock_guard guard(mutex_);
+	pool_ = pool;
+	if (pool_) {
+		for (size_t i = 0; i < queue_.size(); ++i) {
+			pool_->Submit(std::bind(&PrioritizedWorkQueue::RunOne, this));
+		}
+	}
+}
+
+void PrioritizedWorkQueue::RunOne() {
+	PrioritizedWorkQueueItem *item;
+	{
+		lock_guard guard(mutex_);
+		if (done_ || queue_.empty()) {
+			return;
+		}
+		item = PopBest();
+	}
+	if (item) {
+		item->run();
+		delete item;
+	}
 }
 
 void PrioritizedWorkQueue::Stop() {
@@ -64,6 +94,10 @@ PrioritizedWorkQueueItem *PrioritizedWorkQueue::Pop() {
 		}
 	}
 
+	return PopBest();
+}
+
+PrioritizedWorkQueueItem *PrioritizedWorkQueue::PopBest() {
 	// Find the top priority item (lowest value).
 	float best_prio = std::numeric_limits<float>::infinity();
 	std::vector<PrioritizedWorkQueueItem *>::iterator best = queue_.end();
@@ -86,30 +120,18 @@ PrioritizedWorkQueueItem *PrioritizedWorkQueue::Pop() {
 
 // TODO: This feels ugly. Revisit later.
 
-static std::thread *workThread;
-
-static void threadfunc(PrioritizedWorkQueue *wq) {
-	while (true) {
-		PrioritizedWorkQueueItem *item = wq->Pop();
-		if (!item) {
-			if (wq->Done())
-				break;
-		} else {
-			item->run();
-			delete item;
-		}
-	}
-}
+// A single worker, so items still run one at a time, like they always have.
+static ThreadPool *workPool;
 
 void ProcessWorkQueueOnThreadWhile(PrioritizedWorkQueue *wq) {
-	workThread = new std::thread(std::bind(&threadfunc, wq));
+	workPool = new ThreadPool(1);
+	wq->ProcessOn(workPool);
 }
 
 void StopProcessingWorkQueue(PrioritizedWorkQueue *wq) {
 	wq->Stop();
-	if (workThread) {
-		workThread->join();
-		delete workThread;
-	}
-	workThread = 0;
+	wq->ProcessOn(nullptr);
+	// Tasks still queued see that we're done and return right away.
+	delete workPool;
+	workPool = 0;
 }
@@ -7,6 +7,8 @@
 #include "base/mutex.h"
 #include "thread/threadutil.h"
 
+class ThreadPool;
+
 // Priorities can change dynamically.
 // Try to make priority() fast, it will be called a lot.
 
@@ -23,7 +25,7 @@ class PrioritizedWorkQueueItem {
 
 class PrioritizedWorkQueue {
 public:
-	PrioritizedWorkQueue() : done_(false) {}
+	PrioritizedWorkQueue() : done_(false), pool_(nullptr) {}
 	~PrioritizedWorkQueue();
 	// Takes ownership.
 	void Add(PrioritizedWorkQueueItem *item);
@@ -31,13 +33,20 @@ class PrioritizedWorkQueue {
 	// The worker should simply call this in a loop. Will block when appropriate.
 	PrioritizedWorkQueueItem *Pop();
 
+	// Runs items as tasks on the pool, highest priority first, from now on.  Pass nullptr to stop.
+	void ProcessOn(ThreadPool *pool);
+
 	void Flush();
 	bool Done() { return done_; }
 	void Stop();
 	void WaitUntilDone();
 
 private:
+	PrioritizedWorkQueueItem *PopBest();
+	void RunOne();
+
 	bool done_;
+	ThreadPool *pool_;
 	recursive_mutex mutex_;
 	condition_variable notEmpty_;
 
@@ -47,7 +56,7 @@ class PrioritizedWorkQueue {
 };
 
 
-// Starts up a thread that keeps trying to run this workqueue.
+// Starts up a single thread pool worker that keeps running this workqueue.
 // TODO: This feels ugly. Revisit later.
 void ProcessWorkQueueOnThreadWhile(PrioritizedWorkQueue *wq);
 void StopProcessingWorkQueue(PrioritizedWorkQueue *wq);
@@ -1,80 +1,45 @@
+#include <algorithm>
+
 #include "base/logging.h"
 #include "threadpool.h"
+#include "threadutil.h"
 
-///////////////////////////// WorkerThread
-
-WorkerThread::WorkerThread() : active(true), started(false) {
-	thread = new std::thread(std::bind(&WorkerThread::WorkFunc, this));
-	doneMutex.lock();
-	while(!started) { };
-}
+// Loops are cut into this many slices per thread, so that when some slices take longer
+// than others, the threads that finish early can steal the rest.
+static const int SLICES_PER_THREAD = 4;
 
-WorkerThread::~WorkerThread() {
-	mutex.lock();
-	active = false;
-	signal.notify_one();
-	mutex.unlock();
-	thread->join();
-	delete thread;
-}
-
-void WorkerThread::Process(const std::function<void()>& work) {
-	mutex.lock();
-	work_ = work;
-	signal.notify_one();
-	mutex.unlock();
-}
+///////////////////////////// ThreadPoolTask
 
-void WorkerThread::WaitForCompletion() {
-	done.wait(doneMutex);
+bool ThreadPoolTask::IsDone() {
+	lock_guard guard(mutex_);
+	return finished_;
 }
 
-void WorkerThread::WorkFunc() {
-	mutex.lock();
-	started = true;
-	while (active) {
-		signal.wait(mutex);
-		if (active) {
-			work_();
-			doneMutex.lock();
-			done.notify_one();
-			doneMutex.unlock();
+void ThreadPoolTask::Wait() {
+	int worker = pool_->CurrentWorker();
+	while (!IsDone()) {
+		if (!pool_->RunOneTask(worker)) {
+			// Nothing left to help with, someone else is running it.
+			lock_guard guard(mutex_);
+			if (!finished_) {
+				done_.wait(mutex_);
+			}
 		}
 	}
 }
 
-LoopWorkerThread::LoopWorkerThread() : WorkerThread(true) {
-	thread = new std::thread(std::bind(&LoopWorkerThread::WorkFunc, this));
-	doneMutex.lock();
-	while(!started) { };
-}
+void ThreadPoolTask::Run() {
+	work_();
+	work_ = nullptr;
 
-void LoopWorkerThread::Process(const std::function<void(int, int)> &work, int start, int end) {
-	mutex.lock();
-	work_ = work;
-	start_ = start;
-	end_ = end;
-	signal.notify_one();
-	mutex.unlock();
-}
-
-void LoopWorkerThread::WorkFunc() {
-	mutex.lock();
-	started = true;
-	while (active) {
-		signal.wait(mutex);
-		if (active) {
-			work_(start_, end_);
-			doneMutex.lock();
-			done.notify_one();
-			doneMutex.unlock();
-		}
-	}
+	lock_guard guard(mutex_);
+	finished_ = true;
+	done_.notify_all();
 }
 
 ///////////////////////////// ThreadPool
 
-ThreadPool::ThreadPool(int numThreads) : workersStarted(false) {
+ThreadPool::ThreadPool(int numThreads) : workersStarted(false), active(true), queuedTasks(0), nextDeque(0) {
 	if (numThreads <= 0) {
 		numThreads_ = 1;
 		ILOG("ThreadPool: Bad number of threads %i", numThreads);
@@ -86,36 +51,165 @@ ThreadPool::ThreadPool(int numThreads) : workersStarted(false) {
 	}
 }
 
+ThreadPool::~ThreadPool() {
+	sleepMutex.lock();
+	active = false;
+	for (size_t i = 0; i < workers.size(); ++i) {
+		workAvailable.notify_one();
+	}
+	sleepMutex.unlock();
+
+	for (size_t i = 0; i < workers.size(); ++i) {
+		workers[i]->join();
+		delete workers[i];
+	}
+	for (size_t i = 0; i < deques.size(); ++i) {
+		delete deques[i];
+	}
+}
+
 void ThreadPool::StartWorkers() {
+	lock_guard guard(sleepMutex);
 	if (!workersStarted) {
-		for(int i = 0; i < numThreads_; ++i) {
-			workers.push_back(std::make_shared<LoopWorkerThread>());
+		// Threads waiting on tasks do their share of the work, so one less is enough.
+		// Still need one for Submit though, if there's nobody waiting.
+		int numWorkers = std::max(1, numThreads_ - 1);
+		for (int i = 0; i < numWorkers; ++i) {
+			deques.push_back(new TaskDeque());
+		}
+		// Workers look up their deques, so they all have to exist first.
+		for (int i = 0; i < numWorkers; ++i) {
+			workers.push_back(new std::thread(std::bind(&ThreadPool::WorkFunc, this, i)));
+			workerIds.push_back(workers.back()->get_id());
 		}
 		workersStarted = true;
 	}
 }
 
+void ThreadPool::WorkFunc(int index) {
+	setCurrentThreadName("PoolWorker");
+
+	while (true) {
+		if (RunOneTask(index)) {
+			continue;
+		}
+
+		lock_guard guard(sleepMutex);
+		if (!active) {
+			break;
+		}
+		// Anything queued since we looked counts in queuedTasks, so we can't miss it.
+		if (queuedTasks == 0) {
+			workAvailable.wait(sleepMutex);
+		}
+	}
+}
+
+int ThreadPool::CurrentWorker() {
+	// No lock needed, workerIds doesn't change once StartWorkers has run, which it has
+	// by the time anyone has a task to wait on.
+	std::thread::id self = std::this_thread::get_id();
+	for (size_t i = 0; i < workerIds.size(); ++i) {
+		if (workerIds[i] == self) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+std::shared_ptr<ThreadPoolTask> ThreadPool::Submit(const std::function<void()> &work) {
+	StartWorkers();
+
+	std::shared_ptr<ThreadPoolTask> task(new ThreadPoolTask(this, work));
+	int worker = CurrentWorker();
+
+	lock_guard guard(sleepMutex);
+	int target = worker;
+	if (target < 0) {
+		target = nextDeque;
+		nextDeque = (nextDeque + 1) % (int)deques.size();
+	}
+	{
+		lock_guard dequeGuard(deques[target]->mutex);
+		deques[target]->tasks.push_back(task);
+	}
+	queuedTasks++;
+	workAvailable.notify_one();
+	return task;
+}
+
+std::shared_ptr<ThreadPoolTask> ThreadPool::TakeTask(int worker) {
+	std::shared_ptr<ThreadPoolTask> task;
+	if (worker >= 0) {
+		// Our own newest task first, its data is most likely still in cache.
+		TaskDeque *own = deques[worker];
+		lock_guard guard(own->mutex);
+		if (!own->tasks.empty()) {
+			task = own->tasks.back();
+			own->tasks.pop_back();
+			return task;
+		}
+	}
+
+	// Steal the oldest task from someone else.
+	const int start = worker >= 0 ? worker + 1 : 0;
+	for (int i = 0; i < (int)deques.size(); ++i) {
+		TaskDeque *victim = deques[(start + i) % deques.size()];
+		lock_guard guard(victim->mutex);
+		if (!victim->tasks.empty()) {
+			task = victim->tasks.front();
+			victim->tasks.pop_front();
+			return task;
+		}
+	}
+	return task;
+}
+
+bool ThreadPool::RunOneTask(int worker) {
+	{
+		lock_guard guard(sleepMutex);
+		if (queuedTasks == 0) {
+			return false;
+		}
+		// Claim a task before looking for it.  If the count only went down once a task was taken,
+		// everyone else would keep finding empty deques and trying again until it did, instead
+		// of sleeping.
+		queuedTasks--;
+	}
+
+	// Every claim has a task waiting in some deque.  We can still miss it, if the one we were
+	// headed for gets taken by a later claimer while a new one lands in a deque we already
+	// looked at, so look again.  That only happens while others are making progress.
+	std::shared_ptr<ThreadPoolTask> task = TakeTask(worker);
+	while (!task) {
+		task = TakeTask(worker);
+	}
+
+	task->Run();
+	return true;
+}
+
 void ThreadPool::ParallelLoop(const std::function<void(int,int)> &loop, int lower, int upper) {
 	int range = upper - lower;
-	if (range >= numThreads_ * 2) { // don't parallelize tiny loops (this could be better, maybe add optional parameter that estimates work per iteration)
-		lock_guard guard(mutex);
-		StartWorkers();
+	if (numThreads_ > 1 && range >= numThreads_ * 2) { // don't parallelize tiny loops (this could be better, maybe add optional parameter that estimates work per iteration)
+		int slices = std::min(range, numThreads_ * SLICES_PER_THREAD);
+		int chunk = range / slices;
+		int extra = range % slices;
 
-		// could do slightly better load balancing for the generic case, 
-		// but doesn't matter since all our loops are power of 2
-		int chunk = range / numThreads_;
+		std::vector<std::shared_ptr<ThreadPoolTask>> tasks;
+		tasks.reserve(slices - 1);
 		int s = lower;
-		for (int i = 0; i < numThreads_ - 1; ++i) {
-			workers[i]->Process(loop, s, s+chunk);
-			s+=chunk;
+		for (int i = 0; i < slices - 1; ++i) {
+			int e = s + chunk + (i < extra ? 1 : 0);
+			tasks.push_back(Submit(std::bind(loop, s, e)));
+			s = e;
 		}
-		// This is the final chunk.
+		// This is the final chunk, we run it ourselves before helping with the rest.
 		loop(s, upper);
-		for (int i = 0; i < numThreads_ - 1; ++i) {
-			workers[i]->WaitForCompletion();
+		for (size_t i = 0; i < tasks.size(); ++i) {
+			tasks[i]->Wait();
 		}
 	} else {
 		loop(lower, upper);
 	}
 }
-
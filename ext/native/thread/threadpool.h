@@ -1,73 +1,86 @@
 #pragma once
 
+#include <deque>
+#include <vector>
+
 #include "thread.h"
 #include "base/mutex.h"
 #include "base/functional.h"
 
-// This is the simplest possible worker implementation I can think of
-// but entirely sufficient for the given purpose.
-// Only handles a single item of work at a time.
-class WorkerThread {
-public:
-	WorkerThread();
-	virtual ~WorkerThread();
-
-	// submit a new work item
-	void Process(const std::function<void()>& work);
-	// wait for a submitted work item to be completed
-	void WaitForCompletion();
+class ThreadPool;
 
-protected:
-	WorkerThread(bool ignored) : active(true), started(false) {}
-	virtual void WorkFunc();
-
-	std::thread *thread; // the worker thread
-	::condition_variable signal; // used to signal new work
-	::condition_variable done; // used to signal work completion
-	::recursive_mutex mutex, doneMutex; // associated with each respective condition variable
-	volatile bool active, started;
+// A unit of work submitted to a ThreadPool, doubling as its future.
+class ThreadPoolTask {
+public:
+	// True once the work has run.
+	bool IsDone();
+	// Blocks until the work has run.  Runs other queued work meanwhile, so it's fine
+	// to wait from inside a task (nested parallelism.)
+	void Wait();
 
 private:
-	std::function<void()> work_; // the work to be done by this thread
+	friend class ThreadPool;
+	ThreadPoolTask(ThreadPool *pool, const std::function<void()> &work) : pool_(pool), work_(work), finished_(false) {}
+	void Run();
 
-	WorkerThread(const WorkerThread& other); // prevent copies
-	void operator =(const WorkerThread &other);
-};
-
-class LoopWorkerThread : public WorkerThread {
-public:
-	LoopWorkerThread();
-	void Process(const std::function<void(int, int)> &work, int start, int end);
+	ThreadPool *pool_;
+	std::function<void()> work_;
+	::recursive_mutex mutex_;
+	::condition_variable done_;
+	bool finished_;
 
-protected:
-	virtual void WorkFunc();
-
-private:
-	int start_;
-	int end_;
-	std::function<void(int, int)> work_; // the work to be done by this thread
+	ThreadPoolTask(const ThreadPoolTask& other); // prevent copies
+	void operator =(const ThreadPoolTask &other);
 };
 
-// A thread pool manages a set of worker threads, and allows the execution of parallel loops on them
-// individual parallel loops are fully sequentialized to simplify synchronization, which should not 
-// be a problem as they should each use the entire system
+// A work stealing thread pool.  Each worker thread has its own deque of tasks: it takes
+// its newest task first, and when it runs out, steals the oldest tasks of the others.
+// Any thread waiting on a task helps out the same way, so loops can be nested, and
+// several threads can run parallel loops at the same time.
 class ThreadPool {
 public:
 	ThreadPool(int numThreads);
-	// don't need a destructor, "workers" is cleared on delete, 
-	// leading to the stopping and joining of all worker threads (RAII and all that)
+	// Stops and joins all workers, once they've run out of queued tasks.
+	~ThreadPool();
 
+	// Queues work to be run on any of the threads.
+	std::shared_ptr<ThreadPoolTask> Submit(const std::function<void()> &work);
+
+	// Executes slices of "loop" from "lower" to "upper" in parallel, and returns when all are done.
 	void ParallelLoop(const std::function<void(int,int)> &loop, int lower, int upper);
 
+	int NumThreads() const { return numThreads_; }
+
 private:
+	friend class ThreadPoolTask;
+
+	struct TaskDeque {
+		::recursive_mutex mutex;
+		std::deque<std::shared_ptr<ThreadPoolTask>> tasks;
+	};
+
+	void StartWorkers();
+	void WorkFunc(int index);
+	int CurrentWorker();
+	// Runs a single queued task, if there are any.  Returns false if there were none.
+	bool RunOneTask(int worker);
+	std::shared_ptr<ThreadPoolTask> TakeTask(int worker);
+
 	int numThreads_;
-	std::vector<std::shared_ptr<LoopWorkerThread>> workers;
-	::recursive_mutex mutex; // used to sequentialize loop execution
+	std::vector<std::thread *> workers;
+	std::vector<std::thread::id> workerIds;
+	std::vector<TaskDeque *> deques;
 
+	// Protects everything below, and is what idle workers sleep on.
+	::recursive_mutex sleepMutex;
+	::condition_variable workAvailable;
 	bool workersStarted;
-	void StartWorkers();
-	
+	bool active;
+	// Tasks sitting in deques that nobody has claimed yet.
+	int queuedTasks;
+	// Where tasks from threads outside the pool go next (round robin.)
+	int nextDeque;
+
 	ThreadPool(const ThreadPool& other); // prevent copies
 	void operator =(const ThreadPool &other);
 };
-
@@ -26,6 +26,7 @@
 #include "Core/MIPS/MIPSAsm.h"
 #include "Core/MIPS/MIPSTables.h"
 #include "Core/MemMap.h"
+#include "Core/Config.h"
 #include "Core/Core.h"
 #include "Core/CoreTiming.h"
 #include "Core/HLE/HLE.h"
@@ -198,4 +199,260 @@ bool TestJit() {
 	DestroyJitHarness();
 
 	return jit_speed >= interp_speed;
-}
\ No newline at end of file
+}
+
+bool TestJitBlockInvalidation() {
+	SetupJitHarness();
+
+	// Keeps the generated code small enough that all the blocks fit.
+	const bool oldFastMemory = g_Config.bFastMemory;
+	g_Config.bFastMemory = true;
+	mipsr4k.UpdateCore(CPU_JIT);
+	JitBlockCache *cache = MIPSComp::jit->GetBlockCache();
+
+	// Each block is just "jr ra; nop", so they're 8 bytes apart.
+	const int numBlocks = 100000;
+	const u32 base = PSP_GetUserMemoryBase();
+	const u32 end = base + numBlocks * 8;
+	u32 *p = (u32 *)Memory::GetPointer(base);
+	for (int i = 0; i < numBlocks; ++i) {
+		*p++ = MIPS_MAKE_JR_RA();
+		*p++ = MIPS_MAKE_NOP();
+	}
+
+	auto compileAll = [&]() {
+		MIPSComp::jit->ClearCache();
+		double st = real_time_now();
+		for (u32 addr = base; addr < end; addr += 8) {
+			currentMIPS->pc = addr;
+			MIPSComp::jit->Compile(addr);
+		}
+		return real_time_now() - st;
+	};
+	auto countValid = [&]() {
+		int valid = 0;
+		for (u32 addr = base; addr < end; addr += 8) {
+			if (cache->GetBlockNumberFromStartAddress(addr) != -1) {
+				++valid;
+			}
+		}
+		return valid;
+	};
+
+	bool success = true;
+	double compileTime = compileAll();
+	if (countValid() != numBlocks) {
+		printf("Expected %d blocks after compile, jit cache may have filled up.\n", numBlocks);
+		success = false;
+	}
+
+	// Lots of small writes near, but not touching, code (like games writing data between overlays.)
+	u32 seed = 0x1337;
+	double st = real_time_now();
+	for (int i = 0; i < numBlocks; ++i) {
+		seed = seed * 1103515245 + 12345;
+		const u32 addr = end + ((seed >> 8) & 0xFFFFC);
+		cache->InvalidateICache(addr, 64);
+	}
+	double missTime = real_time_now() - st;
+	if (countValid() != numBlocks) {
+		printf("Invalidation outside the code destroyed blocks.\n");
+		success = false;
+	}
+
+	// Now small writes over the code, 32 blocks at a time.
+	st = real_time_now();
+	for (u32 addr = base; addr < end; addr += 256) {
+		cache->InvalidateICache(addr, 256);
+	}
+	double hitTime = real_time_now() - st;
+	if (countValid() != 0) {
+		printf("Blocks survived invalidation.\n");
+		success = false;
+	}
+
+	// And finally one big write over everything, like a module reload.
+	compileAll();
+	st = real_time_now();
+	cache->InvalidateICache(base, end - base);
+	double rangeTime = real_time_now() - st;
+	if (countValid() != 0) {
+		printf("Blocks survived range invalidation.\n");
+		success = false;
+	}
+
+	printf("Compiled %d blocks in %f ms\n", numBlocks, compileTime * 1000.0);
+	printf("%d missed invalidations: %f ms\n", numBlocks, missTime * 1000.0);
+	printf("%d small invalidations: %f ms\n", (end - base) / 256, hitTime * 1000.0);
+	printf("Single range invalidation: %f ms\n", rangeTime * 1000.0);
+
+	g_Config.bFastMemory = oldFastMemory;
+	DestroyJitHarness();
+
+	return success;
+}
+
+// Runs a two block loop to completion, returns the seconds taken and the loop's sum in v0.
+static double RunTierUpLoop(int hotBlockThreshold, u32 iterations, u32 *sum, int *tierUps) {
+	SetupJitHarness();
+
+	const int oldThreshold = g_Config.iJitHotBlockThreshold;
+	g_Config.iJitHotBlockThreshold = hotBlockThreshold;
+	mipsr4k.UpdateCore(CPU_JIT);
+
+	// Special ops, rd = rs op rt.
+	auto makeSpecial = [](int funct, int rd, int rs, int rt) -> u32 {
+		return (rs << 21) | (rt << 16) | (rd << 11) | funct;
+	};
+	auto makeORI = [](int rt, int rs, u32 imm) -> u32 {
+		return (13 << 26) | (rs << 21) | (rt << 16) | (imm & 0xFFFF);
+	};
+	auto makeBEQ = [](int rs, int rt, int offs) -> u32 {
+		return (4 << 26) | (rs << 21) | (rt << 16) | (offs & 0xFFFF);
+	};
+
+	// v0 = sum, v1 = i, a0 = iterations.
+	u32 *p = (u32 *)Memory::GetPointer(PSP_GetUserMemoryBase());
+	*p++ = MIPS_MAKE_ADDIU(MIPS_REG_V0, MIPS_REG_ZERO, 0);
+	*p++ = MIPS_MAKE_ADDIU(MIPS_REG_V1, MIPS_REG_ZERO, 0);
+	*p++ = MIPS_MAKE_LUI(MIPS_REG_A0, iterations >> 16);
+	*p++ = makeORI(MIPS_REG_A0, MIPS_REG_A0, iterations);
+	// loop: (a separate block, and another one after the beq.)
+	*p++ = MIPS_MAKE_ADDIU(MIPS_REG_V1, MIPS_REG_V1, 1);
+	*p++ = makeSpecial(0x21, MIPS_REG_V0, MIPS_REG_V0, MIPS_REG_V1);  // addu
+	*p++ = makeBEQ(MIPS_REG_V1, MIPS_REG_A0, 3);
+	*p++ = MIPS_MAKE_NOP();
+	*p++ = MIPS_MAKE_B(-5);
+	*p++ = MIPS_MAKE_NOP();
+	// done:
+	*p++ = MIPS_MAKE_SYSCALL("UnitTestFakeSyscalls", "UnitTestTerminator");
+	*p++ = MIPS_MAKE_BREAK(1);
+
+	currentMIPS->pc = PSP_GetUserMemoryBase();
+	coreState = CORE_RUNNING;
+	double st = real_time_now();
+	while (coreState == CORE_RUNNING) {
+		mipsr4k.RunLoopUntil(1000000);
+	}
+	double elapsed = real_time_now() - st;
+
+	BlockCacheStats stats;
+	MIPSComp::jit->GetBlockCache()->ComputeStats(stats);
+	*tierUps = stats.numTierUps;
+	*sum = currentMIPS->r[MIPS_REG_V0];
+
+	g_Config.iJitHotBlockThreshold = oldThreshold;
+	DestroyJitHarness();
+
+	return elapsed;
+}
+
+bool TestJitTierUp() {
+	const u32 iterations = 20000000;
+	u32 expected = 0;
+	for (u32 i = 1; i <= iterations; ++i) {
+		expected += i;
+	}
+
+	u32 sum;
+	int tierUps;
+	bool success = true;
+
+	double offTime = RunTierUpLoop(0, iterations, &sum, &tierUps);
+	if (sum != expected || tierUps != 0) {
+		printf("Without tier up: sum %08x (expected %08x), %d tier ups\n", sum, expected, tierUps);
+		success = false;
+	}
+
+	double onTime = RunTierUpLoop(100, iterations, &sum, &tierUps);
+	if (sum != expected || tierUps == 0) {
+		printf("With tier up: sum %08x (expected %08x), %d tier ups\n", sum, expected, tierUps);
+		success = false;
+	}
+
+	printf("Loop of %u iterations: %f ms without tier up, %f ms with (%d tier ups)\n", iterations, offTime * 1000.0, onTime * 1000.0, tierUps);
+	return success;
+}
+
+bool TestInterpreter() {
+	SetupJitHarness();
+
+	// Special ops, rd = rs op rt.
+	auto makeSpecial = [](int funct, int rd, int rs, int rt) -> u32 {
+		return (rs << 21) | (rt << 16) | (rd << 11) | funct;
+	};
+	const int FUNCT_ADDU = 0x21;
+	const int FUNCT_OR = 0x25;
+	const int FUNCT_XOR = 0x26;
+	const u32 limit = 0x10000;
+
+	// r1 counts up to limit, r3 and r4 accumulate something that depends on every iteration.
+	const u32 base = PSP_GetUserMemoryBase();
+	u32 *p = (u32 *)Memory::GetPointer(base);
+	*p++ = MIPS_MAKE_ADDIU(1, 0, 0);
+	*p++ = MIPS_MAKE_ADDIU(3, 0, 0);
+	*p++ = MIPS_MAKE_ADDIU(4, 0, 0);
+	*p++ = MIPS_MAKE_LUI(2, limit >> 16);
+	const u32 loop = base + 4 * 4;
+	*p++ = MIPS_MAKE_ADDIU(1, 1, 1);
+	u32 *combine = p;
+	*p++ = makeSpecial(FUNCT_XOR, 3, 3, 1);
+	*p++ = makeSpecial(FUNCT_ADDU, 4, 4, 3);
+	// bne r1, r2, loop
+	*p++ = (5 << 26) | (1 << 21) | (2 << 16) | (((loop - (base + 8 * 4)) >> 2) & 0xFFFF);
+	*p++ = MIPS_MAKE_NOP();
+	*p++ = MIPS_MAKE_SYSCALL("UnitTestFakeSyscalls", "UnitTestTerminator");
+	*p++ = MIPS_MAKE_BREAK(1);
+	const int instructionsPerRun = 4 + 5 * limit + 1;
+
+	auto expected = [&](bool useOr) {
+		u32 r3 = 0, r4 = 0;
+		for (u32 r1 = 1; r1 <= limit; ++r1) {
+			r3 = useOr ? (r3 | r1) : (r3 ^ r1);
+			r4 += r3;
+		}
+		return r4;
+	};
+	auto run = [&]() {
+		currentMIPS->pc = base;
+		coreState = CORE_RUNNING;
+		while (coreState == CORE_RUNNING) {
+			mipsr4k.RunLoopUntil(CoreTiming::GetTicks() + 1000000000ULL);
+		}
+		return currentMIPS->r[4];
+	};
+
+	bool success = true;
+	if (run() != expected(false)) {
+		printf("Interpreter got the wrong result: %08x, expected %08x\n", currentMIPS->r[4], expected(false));
+		success = false;
+	}
+
+	int runs = 0;
+	double st = real_time_now();
+	do {
+		run();
+		++runs;
+	} while (real_time_now() - st < 0.5);
+	double elapsed = real_time_now() - st;
+
+	// Rewrite code that's already been decoded, as a game would before invalidating.
+	*combine = makeSpecial(FUNCT_OR, 3, 3, 1);
+	currentMIPS->InvalidateICache(base + 5 * 4, 4);
+	if (run() != expected(true)) {
+		printf("Interpreter ran stale code after invalidation.\n");
+		success = false;
+	}
+	// And without invalidating, which some games get away with.
+	*combine = makeSpecial(FUNCT_XOR, 3, 3, 1);
+	if (run() != expected(false)) {
+		printf("Interpreter ran stale code after a write.\n");
+		success = false;
+	}
+
+	printf("Interpreter: %0.2f million MIPS instructions/sec\n", (double)runs * instructionsPerRun / elapsed / 1000000.0);
+
+	DestroyJitHarness();
+
+	return success;
+}
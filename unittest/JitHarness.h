@@ -18,3 +18,6 @@
 #pragma once
 
 bool TestJit();
+bool TestJitBlockInvalidation();
+bool TestJitTierUp();
+bool TestInterpreter();
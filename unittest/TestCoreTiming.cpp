@@ -0,0 +1,290 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <list>
+#include <vector>
+
+#include "base/functional.h"
+#include "base/timeutil.h"
+#include "thread/thread.h"
+#include "Common/ChunkFile.h"
+#include "Core/CoreTiming.h"
+#include "Core/MIPS/MIPS.h"
+#include "unittest/TestCoreTiming.h"
+#include "unittest/UnitTest.h"
+
+static const int NUM_EVENTS = 5000;
+static const int NUM_TS_THREADS = 4;
+static const int NUM_TS_EVENTS = 250;
+static const int BENCH_PENDING = 10000;
+static const int BENCH_OPS = 100000;
+
+struct FiredEvent {
+	int type;
+	u64 userdata;
+	bool operator ==(const FiredEvent &other) const {
+		return type == other.type && userdata == other.userdata;
+	}
+};
+
+static std::vector<FiredEvent> fired;
+static int testEvent;
+static int otherEvent;
+static int tsEvent;
+
+static void RecordEvent(int type, u64 userdata) {
+	FiredEvent ev = { type, userdata };
+	fired.push_back(ev);
+}
+
+static void TestEventCallback(u64 userdata, int cyclesLate) {
+	RecordEvent(testEvent, userdata);
+}
+
+static void OtherEventCallback(u64 userdata, int cyclesLate) {
+	RecordEvent(otherEvent, userdata);
+}
+
+static void TsEventCallback(u64 userdata, int cyclesLate) {
+	RecordEvent(tsEvent, userdata);
+}
+
+// How CoreTiming used to keep events: a sorted list, new events go after others with the same time.
+struct ListEvent {
+	s64 time;
+	int type;
+	u64 userdata;
+};
+
+class EventList {
+public:
+	void Schedule(s64 time, int type, u64 userdata) {
+		ListEvent ev = { time, type, userdata };
+		auto it = events_.begin();
+		while (it != events_.end() && it->time <= time)
+			++it;
+		events_.insert(it, ev);
+	}
+
+	s64 Unschedule(int type, u64 userdata) {
+		s64 result = 0;
+		for (auto it = events_.begin(); it != events_.end(); ) {
+			if (it->type == type && it->userdata == userdata) {
+				result = it->time;
+				it = events_.erase(it);
+			} else {
+				++it;
+			}
+		}
+		return result;
+	}
+
+	void Remove(int type) {
+		for (auto it = events_.begin(); it != events_.end(); ) {
+			if (it->type == type)
+				it = events_.erase(it);
+			else
+				++it;
+		}
+	}
+
+	void FireAll() {
+		for (auto it = events_.begin(); it != events_.end(); ++it)
+			RecordEvent(it->type, it->userdata);
+		events_.clear();
+	}
+
+private:
+	std::list<ListEvent> events_;
+};
+
+// Keeps jumping ahead to the next event until we've seen count of them.
+static void RunEvents(size_t count) {
+	for (int i = 0; i < 100000 && fired.size() < count; ++i) {
+		currentMIPS->downcount = 0;
+		CoreTiming::Advance();
+	}
+}
+
+static void ScheduleTsEvents(int thread) {
+	for (int i = 0; i < NUM_TS_EVENTS; ++i) {
+		CoreTiming::ScheduleEvent_Threadsafe(500 + (i & 7), tsEvent, thread * NUM_TS_EVENTS + i);
+	}
+}
+
+static bool TestOrdering() {
+	EventList reference;
+	u32 seed = 0x1337;
+	auto rand = [&]() {
+		seed = seed * 1103515245 + 12345;
+		return seed >> 8;
+	};
+
+	// Plenty of events with the same time and the same userdata.
+	for (int i = 0; i < NUM_EVENTS; ++i) {
+		int type = (rand() & 3) == 0 ? otherEvent : testEvent;
+		s64 cycles = rand() % 1000;
+		u64 userdata = rand() % 2000;
+		CoreTiming::ScheduleEvent(cycles, type, userdata);
+		reference.Schedule(CoreTiming::GetTicks() + cycles, type, userdata);
+	}
+	for (int i = 0; i < NUM_EVENTS / 10; ++i) {
+		u64 userdata = rand() % 2000;
+		s64 left = CoreTiming::UnscheduleEvent(testEvent, userdata);
+		s64 expected = reference.Unschedule(testEvent, userdata);
+		if (expected != 0)
+			expected -= CoreTiming::GetTicks();
+		EXPECT_TRUE(left == expected);
+	}
+	EXPECT_TRUE(CoreTiming::IsScheduled(otherEvent));
+	CoreTiming::RemoveEvent(otherEvent);
+	reference.Remove(otherEvent);
+	EXPECT_FALSE(CoreTiming::IsScheduled(otherEvent));
+
+	std::vector<std::thread *> threads;
+	for (int i = 0; i < NUM_TS_THREADS; ++i) {
+		threads.push_back(new std::thread(std::bind(&ScheduleTsEvents, i)));
+	}
+	for (size_t i = 0; i < threads.size(); ++i) {
+		threads[i]->join();
+		delete threads[i];
+	}
+
+	fired.clear();
+	reference.FireAll();
+	std::vector<FiredEvent> expected = fired;
+
+	fired.clear();
+	RunEvents(expected.size() + NUM_TS_THREADS * NUM_TS_EVENTS);
+
+	// Each thread's events should come in the order it scheduled them, after any with the same time.
+	std::vector<FiredEvent> regular;
+	std::vector<int> lastTsKey(NUM_TS_THREADS, -1);
+	int tsCount = 0;
+	for (size_t i = 0; i < fired.size(); ++i) {
+		if (fired[i].type == tsEvent) {
+			int thread = (int)(fired[i].userdata / NUM_TS_EVENTS);
+			int index = (int)(fired[i].userdata % NUM_TS_EVENTS);
+			// Sorted by time first (from index & 7), then by order of scheduling.
+			int key = (index & 7) * NUM_TS_EVENTS + index;
+			EXPECT_TRUE(key > lastTsKey[thread]);
+			lastTsKey[thread] = key;
+			tsCount++;
+		} else {
+			regular.push_back(fired[i]);
+		}
+	}
+	EXPECT_EQ_INT(tsCount, NUM_TS_THREADS * NUM_TS_EVENTS);
+	EXPECT_EQ_INT((int)regular.size(), (int)expected.size());
+	EXPECT_TRUE(regular == expected);
+	return true;
+}
+
+struct TimingState {
+	void DoState(PointerWrap &p) {
+		CoreTiming::DoState(p);
+	}
+};
+
+static bool TestSaveState() {
+	u32 seed = 0x5678;
+	auto rand = [&]() {
+		seed = seed * 1103515245 + 12345;
+		return seed >> 8;
+	};
+	for (int i = 0; i < 100; ++i) {
+		CoreTiming::ScheduleEvent(rand() % 100, (rand() & 1) ? testEvent : otherEvent, i);
+	}
+	for (int i = 0; i < 10; ++i) {
+		CoreTiming::ScheduleEvent_Threadsafe(rand() % 100, tsEvent, i);
+	}
+
+	TimingState state;
+	const int downcount = currentMIPS->downcount;
+	std::vector<u8> buffer(CChunkFileReader::MeasurePtr(state));
+	EXPECT_TRUE(CChunkFileReader::SavePtr(&buffer[0], state) == CChunkFileReader::ERROR_NONE);
+
+	fired.clear();
+	RunEvents(110);
+	std::vector<FiredEvent> expected = fired;
+	EXPECT_EQ_INT((int)expected.size(), 110);
+
+	// Loading should bring back all the same events, threadsafe ones included, in the same order.
+	CoreTiming::ScheduleEvent(50, testEvent, 1000);
+	currentMIPS->downcount = downcount;
+	EXPECT_TRUE(CChunkFileReader::LoadPtr(&buffer[0], state) == CChunkFileReader::ERROR_NONE);
+	fired.clear();
+	RunEvents(110);
+	EXPECT_TRUE(fired == expected);
+	EXPECT_FALSE(CoreTiming::IsScheduled(testEvent));
+	return true;
+}
+
+static void Benchmark() {
+	EventList reference;
+	u32 seed = 0x4321;
+	auto rand = [&]() {
+		seed = seed * 1103515245 + 12345;
+		return seed >> 8;
+	};
+
+	for (int i = 0; i < BENCH_PENDING; ++i) {
+		s64 cycles = rand() % 1000000;
+		CoreTiming::ScheduleEvent(cycles, testEvent, i);
+		reference.Schedule(cycles, testEvent, i);
+	}
+
+	// Like games rearming their alarms and vtimers.
+	const u32 startSeed = seed;
+	double st = real_time_now();
+	for (int i = 0; i < BENCH_OPS; ++i) {
+		u64 userdata = rand() % BENCH_PENDING;
+		CoreTiming::UnscheduleEvent(testEvent, userdata);
+		CoreTiming::ScheduleEvent(rand() % 1000000, testEvent, userdata);
+	}
+	double heapTime = real_time_now() - st;
+
+	seed = startSeed;
+	st = real_time_now();
+	for (int i = 0; i < BENCH_OPS; ++i) {
+		u64 userdata = rand() % BENCH_PENDING;
+		reference.Unschedule(testEvent, userdata);
+		reference.Schedule(rand() % 1000000, testEvent, userdata);
+	}
+	double listTime = real_time_now() - st;
+
+	printf("Rescheduling with %d pending events: %0.1f ns (sorted list: %0.1f ns)\n", BENCH_PENDING, heapTime * 1e9 / BENCH_OPS, listTime * 1e9 / BENCH_OPS);
+	CoreTiming::ClearPendingEvents();
+}
+
+bool TestCoreTiming() {
+	CoreTiming::Init();
+	testEvent = CoreTiming::RegisterEvent("TestEvent", &TestEventCallback);
+	otherEvent = CoreTiming::RegisterEvent("OtherEvent", &OtherEventCallback);
+	tsEvent = CoreTiming::RegisterEvent("TsEvent", &TsEventCallback);
+
+	bool success = TestOrdering();
+	CoreTiming::ClearPendingEvents();
+	success = success && TestSaveState();
+	CoreTiming::ClearPendingEvents();
+	if (success)
+		Benchmark();
+
+	CoreTiming::Shutdown();
+	return success;
+}
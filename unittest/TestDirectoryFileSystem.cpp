@@ -0,0 +1,211 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "base/timeutil.h"
+#include "util/text/utf8.h"
+#include "Common/CommonWindows.h"
+#include "Common/FileUtil.h"
+#include "Core/FileSystems/DirectoryFileSystem.h"
+#include "unittest/TestDirectoryFileSystem.h"
+#include "unittest/UnitTest.h"
+
+// 100 saves of 100 files each, so a 10k file memstick.
+static const int NUM_SAVES = 100;
+static const int FILES_PER_SAVE = 100;
+
+static std::string TempPath(const char *name) {
+#ifdef _WIN32
+	wchar_t path[MAX_PATH];
+	GetTempPath(MAX_PATH, path);
+	return ConvertWStringToUTF8(path) + name;
+#else
+	const char *dir = getenv("TMPDIR");
+	return std::string(dir ? dir : "/tmp") + "/" + name;
+#endif
+}
+
+static std::string SaveDir(int s) {
+	char name[32];
+	snprintf(name, sizeof(name), "PSP/SAVEDATA/ULUS%05d", s);
+	return name;
+}
+
+static std::string FileName(int f) {
+	char name[16];
+	snprintf(name, sizeof(name), "DATA%02d.BIN", f);
+	return name;
+}
+
+static std::string LowerCase(std::string str) {
+	for (size_t i = 0; i < str.size(); ++i)
+		str[i] = tolower(str[i]);
+	return str;
+}
+
+// Games often don't match the case of what's on the memstick.
+static std::string GuestPath(int s, int f) {
+	return "/" + LowerCase(SaveDir(s) + "/" + FileName(f));
+}
+
+static bool WriteFile(const std::string &filename, size_t size) {
+	FILE *f = File::OpenCFile(filename, "wb");
+	if (!f)
+		return false;
+	std::vector<u8> data(size, 'x');
+	bool written = size == 0 || fwrite(&data[0], 1, size, f) == size;
+	fclose(f);
+	return written;
+}
+
+static bool BuildTree(const std::string &base) {
+	for (int s = 0; s < NUM_SAVES; ++s) {
+		EXPECT_TRUE(File::CreateFullPath(base + SaveDir(s)));
+		for (int f = 0; f < FILES_PER_SAVE; ++f)
+			EXPECT_TRUE(WriteFile(base + SaveDir(s) + "/" + FileName(f), f));
+	}
+	return true;
+}
+
+static bool ExpectSize(DirectoryFileSystem &fs, const std::string &path, int size) {
+	PSPFileInfo info = fs.GetFileInfo(path);
+	if (!info.exists || info.size != size) {
+		printf("%s: exists %d, size %d, expected %d\n", path.c_str(), info.exists ? 1 : 0, (int)info.size, size);
+		return false;
+	}
+	return true;
+}
+
+static bool TestChanges(const std::string &base) {
+	SequentialHandleAllocator handles;
+	DirectoryFileSystem fs(&handles, base);
+
+	EXPECT_TRUE(ExpectSize(fs, GuestPath(5, 7), 7));
+	u32 handle = fs.OpenFile(GuestPath(5, 9), FILEACCESS_READ);
+	EXPECT_TRUE(handle != 0);
+	u8 data[16];
+	EXPECT_EQ_INT((int)fs.ReadFile(handle, data, sizeof(data)), 9);
+	fs.CloseFile(handle);
+	EXPECT_FALSE(fs.GetFileInfo("/psp/savedata/ulus00005/nope.bin").exists);
+
+	// Changes made through the file system.
+	handle = fs.OpenFile("/PSP/SAVEDATA/ULUS00005/NEW.BIN", (FileAccess)(FILEACCESS_WRITE | FILEACCESS_CREATE));
+	EXPECT_TRUE(handle != 0);
+	EXPECT_EQ_INT((int)fs.WriteFile(handle, data, 3), 3);
+	fs.CloseFile(handle);
+	EXPECT_TRUE(ExpectSize(fs, "/psp/savedata/ulus00005/new.bin", 3));
+
+	EXPECT_EQ_INT(fs.RenameFile("/psp/savedata/ulus00005/new.bin", "RENAMED.BIN"), 0);
+	EXPECT_FALSE(fs.GetFileInfo("/psp/savedata/ulus00005/new.bin").exists);
+	EXPECT_TRUE(ExpectSize(fs, "/psp/savedata/ulus00005/renamed.bin", 3));
+	EXPECT_TRUE(fs.RemoveFile("/psp/savedata/ulus00005/renamed.bin"));
+	EXPECT_FALSE(fs.GetFileInfo("/psp/savedata/ulus00005/renamed.bin").exists);
+
+	EXPECT_TRUE(fs.RmDir("/psp/savedata/ulus00008"));
+	EXPECT_FALSE(fs.GetFileInfo(GuestPath(8, 0)).exists);
+	EXPECT_TRUE(fs.MkDir("/psp/savedata/ulus00008/sub"));
+	EXPECT_TRUE(fs.GetFileInfo("/PSP/SAVEDATA/ULUS00008/SUB").type == FILETYPE_DIRECTORY);
+
+	// And behind its back, like the user copying saves in.
+	EXPECT_TRUE(ExpectSize(fs, GuestPath(6, 1), 1));
+	EXPECT_TRUE(WriteFile(base + SaveDir(6) + "/EXTERNAL.BIN", 5));
+	EXPECT_TRUE(ExpectSize(fs, "/psp/savedata/ulus00006/external.bin", 5));
+	EXPECT_TRUE(File::Delete(base + SaveDir(6) + "/EXTERNAL.BIN"));
+	EXPECT_FALSE(fs.GetFileInfo("/psp/savedata/ulus00006/external.bin").exists);
+
+	// Something else takes the place of a directory we've looked in.
+	EXPECT_TRUE(ExpectSize(fs, GuestPath(7, 1), 1));
+	EXPECT_TRUE(File::Rename(base + SaveDir(7), base + SaveDir(7) + "_OLD"));
+	EXPECT_TRUE(File::CreateFullPath(base + SaveDir(7)));
+	EXPECT_TRUE(WriteFile(base + SaveDir(7) + "/OTHER.BIN", 2));
+	EXPECT_TRUE(ExpectSize(fs, "/psp/savedata/ulus00007/other.bin", 2));
+	EXPECT_FALSE(fs.GetFileInfo(GuestPath(7, 1)).exists);
+	EXPECT_TRUE(ExpectSize(fs, "/psp/savedata/ulus00007_old/data01.bin", 1));
+	return true;
+}
+
+#if HOST_IS_CASE_SENSITIVE
+// What GetFileInfo() does with the path, minus building the PSPFileInfo.
+static double StatAll(std::string &base, PathCaseCache *cache, s64 *sizes) {
+	double st = real_time_now();
+	for (int s = 0; s < NUM_SAVES; ++s) {
+		for (int f = 0; f < FILES_PER_SAVE; ++f) {
+			std::string path = GuestPath(s, f);
+			File::FileDetails details;
+			if (!File::Exists(base + path.substr(1)) && FixPathCase(base, path, FPC_FILE_MUST_EXIST, cache) && File::GetFileDetails(base + path.substr(1), &details))
+				*sizes += details.size;
+		}
+	}
+	return real_time_now() - st;
+}
+
+static double OpenAll(std::string &base, PathCaseCache *cache, int *opened) {
+	double st = real_time_now();
+	for (int s = 0; s < NUM_SAVES; ++s) {
+		for (int f = 0; f < FILES_PER_SAVE; ++f) {
+			std::string path = GuestPath(s, f);
+			DirectoryFileHandle handle;
+			u32 err;
+			if (handle.Open(base, path, FILEACCESS_READ, err, cache)) {
+				(*opened)++;
+				handle.Close();
+			}
+		}
+	}
+	return real_time_now() - st;
+}
+
+static void Benchmark(std::string &base) {
+	PathCaseCache cache;
+	s64 cachedSizes = 0, scannedSizes = 0;
+	int cachedOpens = 0, scannedOpens = 0;
+
+	double scannedStat = StatAll(base, nullptr, &scannedSizes);
+	double scannedOpen = OpenAll(base, nullptr, &scannedOpens);
+	// Once to fill the cache, then time it.
+	StatAll(base, &cache, &cachedSizes);
+	cachedSizes = 0;
+	double cachedStat = StatAll(base, &cache, &cachedSizes);
+	double cachedOpen = OpenAll(base, &cache, &cachedOpens);
+
+	const int count = NUM_SAVES * FILES_PER_SAVE;
+	const char *mismatch = cachedSizes == scannedSizes && cachedOpens == scannedOpens && cachedOpens == count ? "" : " MISMATCH";
+	printf("Memstick with %d files, wrong case: %0.0f stats/s (scanning: %0.0f stats/s)%s\n", count, count / cachedStat, count / scannedStat, mismatch);
+	printf("Memstick with %d files, wrong case: %0.0f opens/s (scanning: %0.0f opens/s)%s\n", count, count / cachedOpen, count / scannedOpen, mismatch);
+}
+#endif
+
+bool TestDirectoryFileSystem() {
+	std::string base = TempPath("ppsspp_dirfs_test/");
+	File::DeleteDirRecursively(base);
+
+	bool success = BuildTree(base);
+#if HOST_IS_CASE_SENSITIVE
+	// Before the changes below, so that every file is still there.
+	if (success)
+		Benchmark(base);
+#endif
+	success = success && TestChanges(base);
+
+	File::DeleteDirRecursively(base);
+	return success;
+}
@@ -0,0 +1,323 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/timeutil.h"
+#include "util/text/utf8.h"
+#include "Common/CommonWindows.h"
+#include "Common/FileUtil.h"
+#include "Core/Config.h"
+#include "Core/FileLoaders/CachingFileLoader.h"
+#include "Core/FileLoaders/DiskCachingFileLoader.h"
+#include "Core/FileLoaders/LocalFileLoader.h"
+#include "Core/FileSystems/BlockDevices.h"
+#include "unittest/TestFileLoader.h"
+#include "unittest/UnitTest.h"
+
+// Not a whole number of sectors, so reads can run off the end.
+static const u32 FILE_SIZE = 32 * 1024 * 1024 + 1000;
+static const int NUM_RANDOM_READS = 2000;
+static const int BENCH_RANDOM_READS = 100000;
+static const size_t RANDOM_READ_SIZE = 2048;
+static const size_t SEQUENTIAL_READ_SIZE = 65536;
+// Small enough that the threads keep evicting each other's blocks.
+static const int DISK_CACHE_SIZE_MB = 2;
+static const int DISK_CACHE_THREADS = 4;
+static const int DISK_CACHE_READS_PER_THREAD = 500;
+// Like a movie and its audio, read from somewhere slow.
+static const u32 STREAM_READ_SIZE = 16 * 1024;
+static const u32 STREAM_SIZE = 8 * 1024 * 1024;
+static const int SLOW_BACKEND_MS = 2;
+
+static std::string TempPath(const char *name) {
+#ifdef _WIN32
+	wchar_t path[MAX_PATH];
+	GetTempPath(MAX_PATH, path);
+	return ConvertWStringToUTF8(path) + name;
+#else
+	const char *dir = getenv("TMPDIR");
+	return std::string(dir ? dir : "/tmp") + "/" + name;
+#endif
+}
+
+struct Rng {
+	u32 seed;
+	u32 operator ()() {
+		seed = seed * 1103515245 + 12345;
+		return seed >> 8;
+	}
+};
+
+static bool WriteTestFile(const std::string &filename, std::vector<u8> &contents) {
+	Rng rand = { 0x1234 };
+	contents.resize(FILE_SIZE);
+	for (u32 i = 0; i < FILE_SIZE; ++i)
+		contents[i] = (u8)rand();
+
+	FILE *f = File::OpenCFile(filename, "wb");
+	EXPECT_TRUE(f != nullptr);
+	bool written = fwrite(&contents[0], 1, FILE_SIZE, f) == FILE_SIZE;
+	fclose(f);
+	EXPECT_TRUE(written);
+	return true;
+}
+
+static bool TestReads(FileLoader &loader, bool mapped, const std::vector<u8> &contents) {
+	EXPECT_EQ_INT((int)loader.FileSize(), (int)FILE_SIZE);
+
+	Rng rand = { 0x5678 };
+	std::vector<u8> buf(SEQUENTIAL_READ_SIZE);
+	for (int i = 0; i < NUM_RANDOM_READS; ++i) {
+		u32 pos = rand() % FILE_SIZE;
+		size_t bytes = 1 + rand() % SEQUENTIAL_READ_SIZE;
+		size_t expected = std::min(bytes, (size_t)(FILE_SIZE - pos));
+		EXPECT_EQ_INT((int)loader.ReadAt(pos, bytes, &buf[0]), (int)expected);
+		EXPECT_TRUE(memcmp(&buf[0], &contents[pos], expected) == 0);
+	}
+
+	// Whole items only, like fread.
+	EXPECT_EQ_INT((int)loader.ReadAt(FILE_SIZE - 3000, 2048, 4, &buf[0]), 1);
+	EXPECT_TRUE(memcmp(&buf[0], &contents[FILE_SIZE - 3000], 2048) == 0);
+	EXPECT_EQ_INT((int)loader.ReadAt(FILE_SIZE, 1, 16, &buf[0]), 0);
+
+	// Read continues where the last read stopped.
+	loader.Seek(4096);
+	EXPECT_EQ_INT((int)loader.Read(1000, &buf[0]), 1000);
+	EXPECT_EQ_INT((int)loader.Read(1000, &buf[1000]), 1000);
+	EXPECT_TRUE(memcmp(&buf[0], &contents[4096], 2000) == 0);
+
+	const u8 *ptr = loader.GetPointer(12345, 100);
+	if (mapped) {
+		EXPECT_TRUE(ptr != nullptr && memcmp(ptr, &contents[12345], 100) == 0);
+		EXPECT_TRUE(loader.GetPointer(FILE_SIZE - 10, 11) == nullptr);
+	} else {
+		EXPECT_TRUE(ptr == nullptr);
+	}
+	return true;
+}
+
+static bool TestBlockDevice(FileLoader &loader, bool mapped, const std::vector<u8> &contents) {
+	FileBlockDevice device(&loader);
+	EXPECT_EQ_INT(device.GetNumBlocks(), FILE_SIZE / 2048);
+
+	std::vector<u8> buf(2048 * 8);
+	EXPECT_TRUE(device.ReadBlocks(100, 8, &buf[0]));
+	EXPECT_TRUE(memcmp(&buf[0], &contents[100 * 2048], 2048 * 8) == 0);
+
+	const u8 *ptr = device.GetBlocksPointer(100, 8);
+	EXPECT_EQ_INT(ptr != nullptr, mapped);
+	if (ptr) {
+		EXPECT_TRUE(memcmp(ptr, &contents[100 * 2048], 2048 * 8) == 0);
+	}
+	return true;
+}
+
+// Keeps track of what actually reaches the file, and can pretend to be slow.
+class CountingFileLoader : public LocalFileLoader {
+public:
+	CountingFileLoader(const std::string &filename, int delayMs = 0) : LocalFileLoader(filename, true), bytesRead_(0), delayMs_(delayMs) {
+	}
+
+	size_t ReadAt(s64 absolutePos, size_t bytes, size_t count, void *data) override {
+		bytesRead_ += bytes * count;
+		if (delayMs_ > 0)
+			sleep_ms(delayMs_);
+		return LocalFileLoader::ReadAt(absolutePos, bytes, count, data);
+	}
+
+	size_t BytesRead() const {
+		return bytesRead_;
+	}
+
+private:
+	size_t bytesRead_;
+	int delayMs_;
+};
+
+static bool TestDiskCacheReuse(const std::string &filename, const std::vector<u8> &contents) {
+	std::vector<u8> buf(1024 * 1024);
+	for (int pass = 0; pass < 2; ++pass) {
+		CountingFileLoader *backend = new CountingFileLoader(filename);
+		DiskCachingFileLoader loader(backend);
+		EXPECT_EQ_INT((int)loader.ReadAt(1000, buf.size(), &buf[0]), (int)buf.size());
+		EXPECT_TRUE(memcmp(&buf[0], &contents[1000], buf.size()) == 0);
+		EXPECT_EQ_INT((int)loader.ReadAt(1000, buf.size(), &buf[0]), (int)buf.size());
+		EXPECT_TRUE(memcmp(&buf[0], &contents[1000], buf.size()) == 0);
+
+		// Once while filling the cache, then never again, not even after reopening it.
+		const size_t expected = pass == 0 ? 17 * SEQUENTIAL_READ_SIZE : 0;
+		EXPECT_EQ_INT((int)backend->BytesRead(), (int)expected);
+	}
+	return true;
+}
+
+static bool TestDiskCacheThreads(const std::string &filename, const std::vector<u8> &contents) {
+	int mismatches[DISK_CACHE_THREADS] = {};
+	auto readFunc = [&](int thread) {
+		// Each with its own loader, all sharing one cache.
+		DiskCachingFileLoader loader(new LocalFileLoader(filename, true));
+		Rng rand = { 0x1000u + thread };
+		std::vector<u8> buf(SEQUENTIAL_READ_SIZE * 2);
+		for (int i = 0; i < DISK_CACHE_READS_PER_THREAD; ++i) {
+			// Bunch the reads up a bit, so blocks are shared between threads.
+			u32 pos = (rand() % (FILE_SIZE / 4)) + (thread & 1) * (FILE_SIZE / 2);
+			size_t bytes = 1 + rand() % buf.size();
+			size_t expected = std::min(bytes, (size_t)(FILE_SIZE - pos));
+			if (loader.ReadAt(pos, bytes, &buf[0]) != expected || memcmp(&buf[0], &contents[pos], expected) != 0)
+				mismatches[thread]++;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < DISK_CACHE_THREADS; ++i)
+		threads.push_back(std::thread(readFunc, i));
+	for (auto &t : threads)
+		t.join();
+
+	for (int i = 0; i < DISK_CACHE_THREADS; ++i)
+		EXPECT_EQ_INT(mismatches[i], 0);
+	return true;
+}
+
+static bool TestDiskCache(const std::string &filename, const std::vector<u8> &contents) {
+	const std::string cacheDir = TempPath("ppsspp_diskcache_test");
+	File::CreateFullPath(cacheDir);
+	DiskCachingFileLoaderCache::SetCacheDir(cacheDir);
+	int savedSize = g_Config.iDiskCacheSizeMB;
+	int savedEviction = g_Config.iDiskCacheEviction;
+	g_Config.iDiskCacheSizeMB = DISK_CACHE_SIZE_MB;
+
+	bool success = true;
+	for (int eviction = 0; eviction < 2 && success; ++eviction) {
+		g_Config.iDiskCacheEviction = eviction;
+		success = TestDiskCacheReuse(filename, contents);
+		success = success && TestDiskCacheThreads(filename, contents);
+		// The same cache file again, after all that eviction.
+		success = success && TestDiskCacheThreads(filename, contents);
+		File::DeleteDirRecursively(cacheDir);
+		File::CreateFullPath(cacheDir);
+	}
+
+	g_Config.iDiskCacheEviction = savedEviction;
+	g_Config.iDiskCacheSizeMB = savedSize;
+	DiskCachingFileLoaderCache::SetCacheDir("");
+	File::DeleteDirRecursively(cacheDir);
+	return success;
+}
+
+static bool TestCachingStreams(const std::string &filename, const std::vector<u8> &contents) {
+	u32 startReads, startMisses, startReadAhead, startReadAheadUsed;
+	double startStall;
+	CachingFileLoader::GetStats(startReads, startMisses, startReadAhead, startReadAheadUsed, startStall);
+
+	{
+		CachingFileLoader caching(new CountingFileLoader(filename, SLOW_BACKEND_MS));
+		FileLoader &loader = caching;
+		std::vector<u8> buf(STREAM_READ_SIZE);
+		const u32 starts[2] = { 1000, FILE_SIZE / 2 + 12345 };
+		for (u32 offset = 0; offset < STREAM_SIZE; offset += STREAM_READ_SIZE) {
+			for (int i = 0; i < 2; ++i) {
+				const u32 pos = starts[i] + offset;
+				EXPECT_EQ_INT((int)loader.ReadAt(pos, STREAM_READ_SIZE, &buf[0]), (int)STREAM_READ_SIZE);
+				EXPECT_TRUE(memcmp(&buf[0], &contents[pos], STREAM_READ_SIZE) == 0);
+			}
+			// Decoding takes a while, which is when read-ahead gets to run.
+			sleep_ms(1);
+		}
+
+		// And the odd random read in between doesn't break anything.
+		EXPECT_EQ_INT((int)loader.ReadAt(FILE_SIZE - 100, 100, &buf[0]), 100);
+		EXPECT_TRUE(memcmp(&buf[0], &contents[FILE_SIZE - 100], 100) == 0);
+	}
+
+	u32 reads, misses, readAhead, readAheadUsed;
+	double stall;
+	CachingFileLoader::GetStats(reads, misses, readAhead, readAheadUsed, stall);
+	reads -= startReads;
+	misses -= startMisses;
+	readAhead -= startReadAhead;
+	readAheadUsed -= startReadAheadUsed;
+	stall -= startStall;
+
+	printf("Streaming from a slow file: %d%% of blocks read ahead, %d%% of read-ahead used, %0.1f ms stalled\n", (int)(100 * (u64)readAhead / (readAhead + misses)), readAhead ? (int)(100 * (u64)readAheadUsed / readAhead) : 0, stall * 1000.0);
+	EXPECT_TRUE(readAheadUsed > 0);
+	return true;
+}
+
+static void Benchmark(const std::string &filename) {
+	std::vector<u8> buf(SEQUENTIAL_READ_SIZE);
+	double rates[2][2];
+	for (int map = 0; map < 2; ++map) {
+		LocalFileLoader local(filename, map != 0);
+		if (map && !local.IsMapped()) {
+			printf("Memory mapping not available, skipping file loader benchmark\n");
+			return;
+		}
+		FileLoader &loader = local;
+
+		Rng rand = { 0x9ABC };
+		double st = real_time_now();
+		for (int i = 0; i < BENCH_RANDOM_READS; ++i) {
+			u32 block = rand() % (FILE_SIZE / RANDOM_READ_SIZE);
+			loader.ReadAt(block * RANDOM_READ_SIZE, RANDOM_READ_SIZE, &buf[0]);
+		}
+		rates[map][0] = BENCH_RANDOM_READS * RANDOM_READ_SIZE / (real_time_now() - st);
+
+		size_t total = 0;
+		st = real_time_now();
+		for (int pass = 0; pass < 4; ++pass) {
+			for (u32 pos = 0; pos + SEQUENTIAL_READ_SIZE <= FILE_SIZE; pos += SEQUENTIAL_READ_SIZE) {
+				total += loader.ReadAt(pos, SEQUENTIAL_READ_SIZE, &buf[0]);
+			}
+		}
+		rates[map][1] = total / (real_time_now() - st);
+	}
+
+	const double MB = 1024.0 * 1024.0;
+	printf("File loader, 2 KB random reads: %0.1f MB/s (stdio: %0.1f MB/s)\n", rates[1][0] / MB, rates[0][0] / MB);
+	printf("File loader, 64 KB sequential reads: %0.1f MB/s (stdio: %0.1f MB/s)\n", rates[1][1] / MB, rates[0][1] / MB);
+}
+
+bool TestFileLoader() {
+	const std::string filename = TempPath("ppsspp_fileloader_test.bin");
+	std::vector<u8> contents;
+	if (!WriteTestFile(filename, contents))
+		return false;
+
+	bool success = true;
+	for (int map = 0; map < 2 && success; ++map) {
+		LocalFileLoader loader(filename, map != 0);
+		EXPECT_TRUE(loader.Exists());
+		// Only 64-bit builds map files.
+		success = TestReads(loader, loader.IsMapped(), contents);
+		success = success && TestBlockDevice(loader, loader.IsMapped(), contents);
+	}
+	success = success && TestDiskCache(filename, contents);
+	success = success && TestCachingStreams(filename, contents);
+	if (success)
+		Benchmark(filename);
+
+	File::Delete(filename);
+	return success;
+}
@@ -0,0 +1,130 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "base/timeutil.h"
+#include "Core/HLE/HLE.h"
+#include "Core/HLE/HLETables.h"
+#include "unittest/TestHLE.h"
+#include "unittest/UnitTest.h"
+
+static const int BENCH_PASSES = 20;
+
+struct Import {
+	const char *moduleName;
+	u32 nid;
+};
+
+// What resolution used to do: strcmp each module, then scan its table.
+static u32 ReferenceSyscallOp(const std::vector<HLEModule> &modules, const char *moduleName, u32 nid) {
+	for (size_t i = 0; i < modules.size(); ++i) {
+		if (strcmp(moduleName, modules[i].name) != 0)
+			continue;
+		for (int j = 0; j < modules[i].numFunctions; ++j) {
+			if (modules[i].funcTable[j].ID == nid)
+				return 0x0000000c | ((u32)i << 18) | (j << 6);
+		}
+		return 0x0003FFCC | ((u32)i << 18);
+	}
+	return 0x03FFFFCC;
+}
+
+static bool TestLookups(const std::vector<HLEModule> &modules, const std::vector<Import> &imports) {
+	for (size_t i = 0; i < imports.size(); ++i) {
+		const Import &imp = imports[i];
+		u32 expected = ReferenceSyscallOp(modules, imp.moduleName, imp.nid);
+		EXPECT_EQ_INT(GetSyscallOp(imp.moduleName, imp.nid), expected);
+
+		// The first of any duplicate modules or nids wins, as before.
+		const HLEFunction *func = GetFunc(imp.moduleName, imp.nid);
+		if ((expected & 0x3FFFF) == 0x3FFCC) {
+			EXPECT_TRUE(func == nullptr);
+		} else {
+			int moduleIndex = expected >> 18;
+			int funcIndex = (expected >> 6) & 0xFFF;
+			EXPECT_TRUE(func == &modules[moduleIndex].funcTable[funcIndex]);
+		}
+	}
+
+	// Names are compared by contents, not by pointer.
+	char copy[64];
+	strcpy(copy, modules[0].name);
+	EXPECT_EQ_INT(GetModuleIndex(copy), 0);
+	EXPECT_EQ_INT(GetModuleIndex("NotARealModule"), -1);
+	EXPECT_EQ_INT(GetFuncIndex(0, 0xDEADBEEF), -1);
+	EXPECT_FALSE(FuncImportIsSyscall(modules[0].name, 0xDEADBEEF));
+	EXPECT_FALSE(FuncImportIsSyscall("NotARealModule", modules[0].funcTable[0].ID));
+	return true;
+}
+
+static void Benchmark(const std::vector<HLEModule> &modules, const std::vector<Import> &imports) {
+	// Like ImportFuncSymbol(): check for HLE, then write the syscall.
+	u32 indexedSum = 0;
+	double st = real_time_now();
+	for (int pass = 0; pass < BENCH_PASSES; ++pass) {
+		for (size_t i = 0; i < imports.size(); ++i) {
+			if (FuncImportIsSyscall(imports[i].moduleName, imports[i].nid))
+				indexedSum += GetSyscallOp(imports[i].moduleName, imports[i].nid);
+		}
+	}
+	double indexedTime = real_time_now() - st;
+
+	u32 scanSum = 0;
+	st = real_time_now();
+	for (int pass = 0; pass < BENCH_PASSES; ++pass) {
+		for (size_t i = 0; i < imports.size(); ++i) {
+			u32 op = ReferenceSyscallOp(modules, imports[i].moduleName, imports[i].nid);
+			if ((op & 0x3FFFF) != 0x3FFCC)
+				scanSum += op;
+		}
+	}
+	double scanTime = real_time_now() - st;
+
+	const double count = (double)imports.size() * BENCH_PASSES;
+	printf("Importing %d nids from %d modules: %0.1f ns each (scanning: %0.1f ns)%s\n", (int)imports.size(), (int)modules.size(), indexedTime * 1e9 / count, scanTime * 1e9 / count, indexedSum == scanSum ? "" : " MISMATCH");
+}
+
+bool TestHLE() {
+	HLEShutdown();
+	RegisterAllModules();
+
+	std::vector<HLEModule> modules;
+	for (int i = 0; GetModuleByIndex(i) != nullptr; ++i)
+		modules.push_back(*GetModuleByIndex(i));
+
+	// Imports name their module using the PRX's own strings, not our pointers.
+	std::vector<std::string> names(modules.size());
+	std::vector<Import> imports;
+	for (size_t i = 0; i < modules.size(); ++i) {
+		names[i] = modules[i].name;
+		for (int j = 0; j < modules[i].numFunctions; ++j) {
+			Import imp = { names[i].c_str(), modules[i].funcTable[j].ID };
+			imports.push_back(imp);
+		}
+	}
+
+	bool success = TestLookups(modules, imports);
+	if (success)
+		Benchmark(modules, imports);
+
+	HLEShutdown();
+	return success;
+}
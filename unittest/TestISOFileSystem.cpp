@@ -0,0 +1,412 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "base/timeutil.h"
+#include "Core/FileSystems/BlockDevices.h"
+#include "Core/FileSystems/FileSystem.h"
+#include "Core/FileSystems/ISOFileSystem.h"
+#include "unittest/TestISOFileSystem.h"
+#include "unittest/UnitTest.h"
+
+// 100 directories of 1000 files each, so 100k entries.
+static const int NUM_DIRS = 100;
+static const int FILES_PER_DIR = 1000;
+static const u32 ROOT_SECTOR = 18;
+static const int BENCH_MOUNTS = 20;
+static const int BENCH_PASSES = 5;
+
+struct SynthEntry {
+	std::string name;
+	u32 sector;
+	u32 size;
+	bool isDirectory;
+};
+
+// Keeps the whole image in memory, and counts reads so we can see when directories get read.
+class MemoryBlockDevice : public BlockDevice {
+public:
+	MemoryBlockDevice(const std::vector<u8> &data, int *reads) : data_(data), reads_(reads) {
+	}
+
+	bool ReadBlock(int blockNumber, u8 *outPtr) override {
+		return ReadBlocks(blockNumber, 1, outPtr);
+	}
+	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr) override {
+		(*reads_)++;
+		if (minBlock + count > GetNumBlocks())
+			return false;
+		memcpy(outPtr, &data_[minBlock * 2048], count * 2048);
+		return true;
+	}
+	u32 GetNumBlocks() override {
+		return (u32)(data_.size() / 2048);
+	}
+
+private:
+	const std::vector<u8> &data_;
+	int *reads_;
+};
+
+static std::string DirName(int d) {
+	char name[16];
+	snprintf(name, sizeof(name), "DIR%03d", d);
+	return name;
+}
+
+static std::string FileName(int f) {
+	char name[16];
+	snprintf(name, sizeof(name), "FILE%04d.BIN", f);
+	return name;
+}
+
+static u32 FileSize(int d, int f) {
+	return d * FILES_PER_DIR + f + 1;
+}
+
+static int RecordSize(const SynthEntry &e) {
+	int size = 33 + (int)e.name.size();
+	return size + (size & 1);
+}
+
+// Records can't cross sectors, so a record that doesn't fit starts the next one.
+static u32 DirectorySectors(const std::vector<SynthEntry> &entries) {
+	u32 sectors = 1;
+	int offset = 0;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		if (offset + RecordSize(entries[i]) > 2048) {
+			sectors++;
+			offset = 0;
+		}
+		offset += RecordSize(entries[i]);
+	}
+	return sectors;
+}
+
+static void PutBoth32(u8 *p, u32 v) {
+	for (int i = 0; i < 4; ++i) {
+		p[i] = (u8)(v >> (i * 8));
+		p[7 - i] = (u8)(v >> (i * 8));
+	}
+}
+
+static void WriteDirectory(std::vector<u8> &iso, u32 sector, const std::vector<SynthEntry> &entries) {
+	int offset = 0;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const SynthEntry &e = entries[i];
+		int size = RecordSize(e);
+		if (offset + size > 2048) {
+			sector++;
+			offset = 0;
+		}
+		u8 *p = &iso[sector * 2048 + offset];
+		p[0] = (u8)size;
+		PutBoth32(p + 2, e.sector);
+		PutBoth32(p + 10, e.size);
+		p[25] = e.isDirectory ? 2 : 0;
+		p[28] = 1;
+		p[31] = 1;
+		p[32] = (u8)e.name.size();
+		memcpy(p + 33, e.name.data(), e.name.size());
+		offset += size;
+	}
+}
+
+static std::vector<SynthEntry> DirectoryWithRelatives(u32 self, u32 parent) {
+	std::vector<SynthEntry> entries(2);
+	entries[0].name = std::string(1, '\x00');
+	entries[1].name = std::string(1, '\x01');
+	entries[0].sector = self;
+	entries[1].sector = parent;
+	for (int i = 0; i < 2; ++i) {
+		entries[i].size = 2048;
+		entries[i].isDirectory = true;
+	}
+	return entries;
+}
+
+static void SetDirectory(SynthEntry &e, u32 sector, u32 sectors) {
+	e.sector = sector;
+	e.size = sectors * 2048;
+}
+
+// Root has DIR000-DIR099, each with FILE0000.BIN and on, and DIR000 also has NESTED/DEEP.BIN.
+// DIR001 also has names that only differ by case: CASE.BIN and case.bin, and SUB and sub (both NESTED.)
+static void BuildISO(std::vector<u8> &iso) {
+	std::vector<std::vector<SynthEntry>> dirs(NUM_DIRS);
+	std::vector<SynthEntry> nested = DirectoryWithRelatives(0, 0);
+	SynthEntry deep = { "DEEP.BIN", 0, 1234, false };
+	nested.push_back(deep);
+
+	for (int d = 0; d < NUM_DIRS; ++d) {
+		dirs[d] = DirectoryWithRelatives(0, ROOT_SECTOR);
+		if (d == 0) {
+			SynthEntry e = { "NESTED", 0, 0, true };
+			dirs[d].push_back(e);
+		}
+		for (int f = 0; f < FILES_PER_DIR; ++f) {
+			SynthEntry e = { FileName(f), 0, FileSize(d, f), false };
+			dirs[d].push_back(e);
+		}
+	}
+	const SynthEntry caseEntries[4] = {
+		{ "CASE.BIN", 0, 111, false },
+		{ "case.bin", 0, 222, false },
+		{ "SUB", 0, 0, true },
+		{ "sub", 0, 0, true },
+	};
+	dirs[1].insert(dirs[1].end(), caseEntries, caseEntries + 4);
+
+	std::vector<SynthEntry> root = DirectoryWithRelatives(ROOT_SECTOR, ROOT_SECTOR);
+	for (int d = 0; d < NUM_DIRS; ++d) {
+		SynthEntry e = { DirName(d), 0, 0, true };
+		root.push_back(e);
+	}
+
+	// Names decide the sizes, so now everything can be placed.
+	const u32 rootSectors = DirectorySectors(root);
+	SetDirectory(root[0], ROOT_SECTOR, rootSectors);
+	SetDirectory(root[1], ROOT_SECTOR, rootSectors);
+	u32 next = ROOT_SECTOR + rootSectors;
+	std::vector<u32> dirSectors(NUM_DIRS);
+	for (int d = 0; d < NUM_DIRS; ++d) {
+		dirSectors[d] = next;
+		next += DirectorySectors(dirs[d]);
+		SetDirectory(root[2 + d], dirSectors[d], DirectorySectors(dirs[d]));
+		SetDirectory(dirs[d][0], dirSectors[d], DirectorySectors(dirs[d]));
+		SetDirectory(dirs[d][1], ROOT_SECTOR, rootSectors);
+	}
+	const u32 nestedSector = next++;
+	SetDirectory(dirs[0][2], nestedSector, 1);
+	SetDirectory(dirs[1][dirs[1].size() - 2], nestedSector, 1);
+	SetDirectory(dirs[1][dirs[1].size() - 1], nestedSector, 1);
+	SetDirectory(nested[0], nestedSector, 1);
+	SetDirectory(nested[1], dirSectors[0], DirectorySectors(dirs[0]));
+
+	iso.assign(next * 2048, 0);
+	u8 *desc = &iso[16 * 2048];
+	// The root's record in the volume descriptor is the same as its "." record.
+	std::vector<SynthEntry> rootSelf(1, root[0]);
+	WriteDirectory(iso, 16, rootSelf);
+	memmove(desc + 156, desc, RecordSize(root[0]));
+	memset(desc, 0, 156);
+	desc[0] = 1;
+	memcpy(desc + 1, "CD001", 5);
+	desc[6] = 1;
+
+	WriteDirectory(iso, ROOT_SECTOR, root);
+	for (int d = 0; d < NUM_DIRS; ++d)
+		WriteDirectory(iso, dirSectors[d], dirs[d]);
+	WriteDirectory(iso, nestedSector, nested);
+}
+
+static bool ExpectFile(ISOFileSystem &fs, const std::string &path, u32 size) {
+	PSPFileInfo info = fs.GetFileInfo(path);
+	if (!info.exists || info.size != size) {
+		printf("%s: exists %d, size %d, expected %d\n", path.c_str(), info.exists ? 1 : 0, (int)info.size, size);
+		return false;
+	}
+	return true;
+}
+
+static bool TestLookups(const std::vector<u8> &iso) {
+	SequentialHandleAllocator handles;
+	int reads = 0;
+	ISOFileSystem fs(&handles, new MemoryBlockDevice(iso, &reads), "");
+	// Just the volume descriptor and the root directory, which is read all at once.
+	EXPECT_EQ_INT(reads, 2);
+
+	std::vector<PSPFileInfo> listing = fs.GetDirListing("/");
+	EXPECT_EQ_INT((int)listing.size(), NUM_DIRS);
+	EXPECT_TRUE(listing[7].name == DirName(7) && listing[7].type == FILETYPE_DIRECTORY);
+	EXPECT_EQ_INT(reads, 2);
+
+	EXPECT_TRUE(ExpectFile(fs, "/DIR005/FILE0123.BIN", FileSize(5, 123)));
+	EXPECT_EQ_INT(reads, 3);
+	// Any spelling finds the same file without reading anything again.
+	EXPECT_TRUE(ExpectFile(fs, "dir005/file0123.bin", FileSize(5, 123)));
+	EXPECT_TRUE(ExpectFile(fs, "./DIR005//File0123.bin", FileSize(5, 123)));
+	EXPECT_TRUE(ExpectFile(fs, "/DIR004/../DIR005/./FILE0123.BIN", FileSize(5, 123)));
+	EXPECT_EQ_INT(reads, 3);
+
+	EXPECT_TRUE(ExpectFile(fs, "/DIR000/NESTED/DEEP.BIN", 1234));
+	EXPECT_TRUE(ExpectFile(fs, "/DIR000/NESTED/../FILE0001.BIN", FileSize(0, 1)));
+	EXPECT_EQ_INT(reads, 5);
+
+	EXPECT_FALSE(fs.GetFileInfo("/DIR005/NOPE.BIN").exists);
+	EXPECT_FALSE(fs.GetFileInfo("/DIR005/FILE0123.BIN/NOPE").exists);
+	EXPECT_FALSE(fs.GetFileInfo("/NODIR/FILE0123.BIN").exists);
+	EXPECT_TRUE(fs.GetFileInfo("/DIR006").type == FILETYPE_DIRECTORY);
+	EXPECT_TRUE(fs.GetFileInfo("/").type == FILETYPE_DIRECTORY);
+
+	listing = fs.GetDirListing("/DIR007");
+	EXPECT_EQ_INT((int)listing.size(), FILES_PER_DIR);
+	for (int f = 0; f < FILES_PER_DIR; ++f) {
+		EXPECT_TRUE(listing[f].name == FileName(f));
+		EXPECT_EQ_INT((int)listing[f].size, (int)FileSize(7, f));
+	}
+
+	// Every file, each from a directory read the first time it was needed.
+	for (int d = 0; d < NUM_DIRS; ++d) {
+		for (int f = 0; f < FILES_PER_DIR; f += 97)
+			EXPECT_TRUE(ExpectFile(fs, "/" + DirName(d) + "/" + FileName(f), FileSize(d, f)));
+	}
+	EXPECT_EQ_INT(reads, 2 + NUM_DIRS + 1);
+	return true;
+}
+
+static bool TestAmbiguousCase(const std::vector<u8> &iso) {
+	SequentialHandleAllocator handles;
+	int reads = 0;
+	ISOFileSystem fs(&handles, new MemoryBlockDevice(iso, &reads), "");
+
+	// Exact names still find the right one, other spellings can't pick.
+	EXPECT_TRUE(ExpectFile(fs, "/DIR001/CASE.BIN", 111));
+	EXPECT_TRUE(ExpectFile(fs, "/DIR001/case.bin", 222));
+	EXPECT_TRUE(ExpectFile(fs, "/dir001/./case.bin", 222));
+	EXPECT_FALSE(fs.GetFileInfo("/DIR001/Case.bin").exists);
+
+	// Below an ambiguous directory, only exact names work.
+	EXPECT_TRUE(ExpectFile(fs, "/DIR001/SUB/DEEP.BIN", 1234));
+	EXPECT_TRUE(ExpectFile(fs, "/dir001/sub/DEEP.BIN", 1234));
+	EXPECT_FALSE(fs.GetFileInfo("/DIR001/Sub/DEEP.BIN").exists);
+	EXPECT_FALSE(fs.GetFileInfo("/DIR001/SUB/deep.bin").exists);
+	EXPECT_TRUE(fs.GetFileInfo("/DIR001/sub").type == FILETYPE_DIRECTORY);
+
+	// Everything else in the directory is still found in any case.
+	EXPECT_TRUE(ExpectFile(fs, "/dir001/file0005.bin", FileSize(1, 5)));
+	return true;
+}
+
+// Resolving a wrong-case path first mustn't change what exact names find later.
+static bool TestWrongCaseFirst(const std::vector<u8> &iso) {
+	SequentialHandleAllocator handles;
+	int reads = 0;
+	ISOFileSystem fs(&handles, new MemoryBlockDevice(iso, &reads), "");
+
+	EXPECT_TRUE(ExpectFile(fs, "/Dir001/File0005.Bin", FileSize(1, 5)));
+	EXPECT_TRUE(ExpectFile(fs, "/dir001/sub/DEEP.BIN", 1234));
+	EXPECT_EQ_INT(reads, 4);
+
+	// Exact names win over their case-only siblings, in either order.
+	EXPECT_TRUE(ExpectFile(fs, "/DIR001/case.bin", 222));
+	EXPECT_TRUE(ExpectFile(fs, "/DIR001/CASE.BIN", 111));
+	EXPECT_TRUE(ExpectFile(fs, "/dir001/case.bin", 222));
+	EXPECT_FALSE(fs.GetFileInfo("/DIR001/cASE.BIN").exists);
+
+	// And wrong-case names still resolve next to them.
+	EXPECT_TRUE(ExpectFile(fs, "/DIR001/file0005.BIN", FileSize(1, 5)));
+	EXPECT_EQ_INT(reads, 4);
+	return true;
+}
+
+static bool TestRestrictedTree(const std::vector<u8> &iso) {
+	SequentialHandleAllocator handles;
+	int reads = 0;
+	ISOFileSystem fs(&handles, new MemoryBlockDevice(iso, &reads), "/DIR003");
+
+	EXPECT_EQ_INT((int)fs.GetDirListing("/").size(), 1);
+	EXPECT_TRUE(ExpectFile(fs, "/DIR003/FILE0042.BIN", FileSize(3, 42)));
+	EXPECT_FALSE(fs.GetFileInfo("/DIR004/FILE0042.BIN").exists);
+	return true;
+}
+
+// What lookups used to cost: compare names against each child, component by component.
+static const PSPFileInfo *ScanLookup(const std::vector<PSPFileInfo> &root, const std::vector<std::vector<PSPFileInfo>> &dirs, const std::string &dir, const std::string &file) {
+	for (size_t d = 0; d < root.size(); ++d) {
+		if (root[d].name != dir)
+			continue;
+		for (size_t f = 0; f < dirs[d].size(); ++f) {
+			if (dirs[d][f].name == file)
+				return &dirs[d][f];
+		}
+	}
+	return nullptr;
+}
+
+static void Benchmark(const std::vector<u8> &iso) {
+	SequentialHandleAllocator handles;
+	int reads = 0;
+
+	double st = real_time_now();
+	for (int i = 0; i < BENCH_MOUNTS; ++i) {
+		ISOFileSystem fs(&handles, new MemoryBlockDevice(iso, &reads), "");
+	}
+	double mountTime = (real_time_now() - st) / BENCH_MOUNTS;
+
+	std::vector<std::string> dirNames, fileNames, paths;
+	for (int d = 0; d < NUM_DIRS; ++d)
+		dirNames.push_back(DirName(d));
+	for (int f = 0; f < FILES_PER_DIR; ++f)
+		fileNames.push_back(FileName(f));
+	for (int d = 0; d < NUM_DIRS; ++d) {
+		for (int f = 0; f < FILES_PER_DIR; ++f)
+			paths.push_back("/" + dirNames[d] + "/" + fileNames[f]);
+	}
+
+	ISOFileSystem fs(&handles, new MemoryBlockDevice(iso, &reads), "");
+	s64 firstSum = 0;
+	st = real_time_now();
+	for (size_t i = 0; i < paths.size(); ++i)
+		firstSum += fs.GetFileInfo(paths[i]).size;
+	double firstTime = real_time_now() - st;
+
+	s64 indexedSum = 0;
+	st = real_time_now();
+	for (int pass = 0; pass < BENCH_PASSES; ++pass) {
+		for (size_t i = 0; i < paths.size(); ++i)
+			indexedSum += fs.GetFileInfo(paths[i]).size;
+	}
+	double indexedTime = real_time_now() - st;
+
+	std::vector<PSPFileInfo> root = fs.GetDirListing("/");
+	std::vector<std::vector<PSPFileInfo>> dirs;
+	for (int d = 0; d < NUM_DIRS; ++d)
+		dirs.push_back(fs.GetDirListing("/" + dirNames[d]));
+	s64 scanSum = 0;
+	st = real_time_now();
+	for (int pass = 0; pass < BENCH_PASSES; ++pass) {
+		for (int d = 0; d < NUM_DIRS; ++d) {
+			for (int f = 0; f < FILES_PER_DIR; ++f) {
+				PSPFileInfo info = *ScanLookup(root, dirs, dirNames[d], fileNames[f]);
+				scanSum += info.size;
+			}
+		}
+	}
+	double scanTime = real_time_now() - st;
+
+	const double count = (double)paths.size() * BENCH_PASSES;
+	printf("ISO with %d entries: mount %0.3f ms, first lookups %0.1f ms (reading directories)\n", (int)paths.size(), mountTime * 1000.0, firstTime * 1000.0);
+	printf("ISO path lookups: %0.1f ns each (scanning children: %0.1f ns)%s\n", indexedTime * 1e9 / count, scanTime * 1e9 / count, indexedSum == scanSum && indexedSum == firstSum * BENCH_PASSES ? "" : " MISMATCH");
+}
+
+bool TestISOFileSystem() {
+	std::vector<u8> iso;
+	BuildISO(iso);
+
+	bool success = TestLookups(iso);
+	success = success && TestAmbiguousCase(iso);
+	success = success && TestWrongCaseFirst(iso);
+	success = success && TestRestrictedTree(iso);
+	if (success)
+		Benchmark(iso);
+	return success;
+}
@@ -0,0 +1,344 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "Common/Common.h"
+#include "Core/Config.h"
+#include "Core/MemMap.h"
+#include "GPU/ge_constants.h"
+#include "GPU/GPU.h"
+#include "GPU/GPUState.h"
+#include "GPU/Software/SoftGpu.h"
+#include "GPU/Software/Rasterizer.h"
+#include "unittest/TestSoftRasterizer.h"
+#include "unittest/UnitTest.h"
+
+extern FormatBuffer fb;
+extern FormatBuffer depthbuf;
+
+static const int FB_STRIDE = 512;
+static const int FB_HEIGHT = 272;
+// Deliberately not a multiple of 16, so sample positions don't line up with pixels.
+static const int OFFSET_X16 = (2048 - 240) * 16 + 8;
+static const int OFFSET_Y16 = (2048 - 136) * 16 + 8;
+// The alpha is the stencil, which should be kept when not written.
+static const u32 INITIAL_COLOR = 0x40808080;
+static const u16 INITIAL_DEPTH = 0x4000;
+static const u32 TEXTURE_ADDR = 0x08900000;
+static const int TEXTURE_SIZE = 64;
+// Variants 5 and up are textured.
+static const int NUM_VARIANTS = 10;
+
+class SoftRasterizerTestHarness {
+public:
+	SoftRasterizerTestHarness() : seed_(0x12345678) {
+		color_.resize(FB_STRIDE * FB_HEIGHT);
+		depth_.resize(FB_STRIDE * FB_HEIGHT);
+	}
+
+	void SetupState(bool clearMode, int variant) {
+		memset(&gstate, 0, sizeof(gstate));
+		gstate.vertType = GE_VTYPE_THROUGH;
+		gstate.framebufpixformat = GE_FORMAT_8888;
+		gstate.fbwidth = FB_STRIDE;
+		gstate.zbwidth = FB_STRIDE;
+		gstate.scissor1 = 0;
+		gstate.scissor2 = 479 | (271 << 10);
+		gstate.offsetx = OFFSET_X16;
+		gstate.offsety = OFFSET_Y16;
+		gstate.shademodel = GE_SHADE_GOURAUD;
+		gstate.minz = 0x1000;
+		gstate.maxz = 0xF000;
+		gstate.blendfixa = 0x204080;
+		gstate.blendfixb = 0xC0A010;
+
+		if (clearMode) {
+			// Clear color, stencil, and depth, or a subset.
+			static const u32 clearModes[] = { 0x701, 0x101, 0x601 };
+			gstate.clearmode = clearModes[variant % ARRAY_SIZE(clearModes)];
+			return;
+		}
+
+		switch (variant) {
+		case 0:
+			gstate.alphaBlendEnable = 1;
+			gstate.blend = GE_SRCBLEND_SRCALPHA | (GE_DSTBLEND_INVSRCALPHA << 4) | (GE_BLENDMODE_MUL_AND_ADD << 8);
+			gstate.zTestEnable = 1;
+			gstate.ztestfunc = GE_COMP_GEQUAL;
+			break;
+		case 1:
+			// Also tests the depth range.
+			gstate.vertType = 0;
+			gstate.zTestEnable = 1;
+			gstate.ztestfunc = GE_COMP_LESS;
+			gstate.zmsk = 1;
+			break;
+		case 2:
+			gstate.alphaBlendEnable = 1;
+			gstate.blend = GE_SRCBLEND_FIXA | (GE_DSTBLEND_FIXB << 4) | (GE_BLENDMODE_MUL_AND_SUBTRACT << 8);
+			gstate.zTestEnable = 1;
+			gstate.ztestfunc = GE_COMP_NOTEQUAL;
+			break;
+		case 3:
+			gstate.alphaBlendEnable = 1;
+			gstate.blend = GE_SRCBLEND_DSTCOLOR | (GE_DSTBLEND_SRCCOLOR << 4) | (GE_BLENDMODE_MUL_AND_SUBTRACT_REVERSE << 8);
+			gstate.pmskc = 0x00FF00;
+			gstate.pmska = 0x0F;
+			break;
+		case 4:
+			gstate.alphaBlendEnable = 1;
+			gstate.blend = GE_SRCBLEND_DOUBLEINVSRCALPHA | (GE_DSTBLEND_DOUBLEDSTALPHA << 4) | (GE_BLENDMODE_MUL_AND_ADD << 8);
+			gstate.zTestEnable = 1;
+			gstate.ztestfunc = GE_COMP_GREATER;
+			break;
+		case 5:
+			gstate.texfunc = GE_TEXFUNC_MODULATE | 0x100 | 0x10000;
+			gstate.alphaBlendEnable = 1;
+			gstate.blend = GE_SRCBLEND_SRCALPHA | (GE_DSTBLEND_INVSRCALPHA << 4) | (GE_BLENDMODE_MUL_AND_ADD << 8);
+			gstate.zTestEnable = 1;
+			gstate.ztestfunc = GE_COMP_GEQUAL;
+			break;
+		case 6:
+			// Perspective correct texture coordinates and fog, clamped in one direction.
+			gstate.vertType = 0;
+			gstate.texfunc = GE_TEXFUNC_REPLACE;
+			gstate.texwrap = 1;
+			gstate.fogEnable = 1;
+			gstate.zTestEnable = 1;
+			gstate.ztestfunc = GE_COMP_LEQUAL;
+			gstate.zmsk = 0;
+			gstate.alphaBlendEnable = 1;
+			gstate.blend = GE_SRCBLEND_FIXA | (GE_DSTBLEND_FIXB << 4) | (GE_BLENDMODE_MIN << 8);
+			break;
+		case 7:
+			// Bilinear filtering and a texture function without a quad path.
+			gstate.vertType = 0;
+			gstate.texfilter = 0x100;
+			gstate.texfunc = GE_TEXFUNC_DECAL | 0x100;
+			gstate.texwrap = 0x100;
+			gstate.fogEnable = 1;
+			gstate.alphaBlendEnable = 1;
+			gstate.blend = GE_SRCBLEND_DSTALPHA | (GE_DSTBLEND_INVSRCCOLOR << 4) | (GE_BLENDMODE_ABSDIFF << 8);
+			gstate.pmskc = 0xF0F0F0;
+			break;
+		case 8:
+			gstate.shademodel = GE_SHADE_FLAT;
+			gstate.texformat = GE_TFMT_4444;
+			gstate.texfunc = GE_TEXFUNC_ADD | 0x100;
+			gstate.alphaBlendEnable = 1;
+			gstate.blend = GE_SRCBLEND_INVDSTCOLOR | (GE_DSTBLEND_DOUBLEINVSRCALPHA << 4) | (GE_BLENDMODE_MAX << 8);
+			break;
+		case 9:
+			// Texture coordinates from the texture matrix.
+			gstate.vertType = 0;
+			gstate.texmapmode = GE_TEXMAP_TEXTURE_MATRIX | (GE_PROJMAP_UV << 8);
+			gstate.tgenMatrix[0] = 1.0f;
+			gstate.tgenMatrix[4] = 1.0f;
+			gstate.tgenMatrix[11] = 1.0f;
+			gstate.texfunc = GE_TEXFUNC_MODULATE;
+			gstate.zTestEnable = 1;
+			gstate.ztestfunc = GE_COMP_ALWAYS;
+			gstate.alphaBlendEnable = 1;
+			gstate.blend = GE_SRCBLEND_DOUBLESRCALPHA | (GE_DSTBLEND_FIXB << 4) | (GE_BLENDMODE_MUL_AND_SUBTRACT << 8);
+			break;
+		}
+
+		if (variant >= 5) {
+			gstate.textureMapEnable = 1;
+			if (variant != 8)
+				gstate.texformat = GE_TFMT_8888;
+			gstate.texaddr[0] = TEXTURE_ADDR & 0xFFFFF0;
+			gstate.texbufwidth[0] = TEXTURE_SIZE | ((TEXTURE_ADDR & 0x0F000000) >> 8);
+			gstate.texsize[0] = 6 | (6 << 8);
+			// Through mode uses texel coordinates, so the others need scaling.
+			gstate.texscaleu = toFloat24(1.0f / TEXTURE_SIZE);
+			gstate.texscalev = toFloat24(1.0f / TEXTURE_SIZE);
+			gstate.texoffsetu = toFloat24(0.25f);
+			gstate.fogcolor = 0x3060C0;
+		}
+
+		fb.data = (u8 *)&color_[0];
+		depthbuf.data = (u8 *)&depth_[0];
+	}
+
+	void GenerateTriangles(int count) {
+		verts_.resize(count * 3);
+		for (int i = 0; i < count; ++i) {
+			// Mostly small ones, but some that cross many tiles.
+			int size = (i % 8) == 0 ? 480 * 16 : 48 * 16;
+			int baseX = Rand() % (480 * 16);
+			int baseY = Rand() % (272 * 16);
+			for (int j = 0; j < 3; ++j) {
+				VertexData &v = verts_[i * 3 + j];
+				v.modelpos.SetZero();
+				v.worldpos.SetZero();
+				v.clippos.SetZero();
+				v.clippos.w = 0.5f + RandFloat() * 4.0f;
+				v.texturecoords = Vec2<float>(RandFloat() * 128.0f - 32.0f, RandFloat() * 128.0f - 32.0f);
+				v.normal.SetZero();
+				v.worldnormal.SetZero();
+				v.fogdepth = RandFloat() * 1.5f - 0.25f;
+				int x = baseX + (int)(Rand() % (u32)size) - size / 2;
+				int y = baseY + (int)(Rand() % (u32)size) - size / 2;
+				v.screenpos.x = OFFSET_X16 + std::max(0, std::min(x, 479 * 16));
+				v.screenpos.y = OFFSET_Y16 + std::max(0, std::min(y, 271 * 16));
+				v.screenpos.z = Rand() & 0xFFFF;
+				v.color0 = Vec4<int>(Rand() & 0xFF, Rand() & 0xFF, Rand() & 0xFF, Rand() & 0xFF);
+				v.color1 = Vec3<int>(Rand() & 0x3F, Rand() & 0x3F, Rand() & 0x3F);
+			}
+		}
+	}
+
+	void Draw(bool clearMode, bool binned, int variant = 0) {
+		SetupState(clearMode, variant);
+		std::fill(color_.begin(), color_.end(), INITIAL_COLOR);
+		std::fill(depth_.begin(), depth_.end(), INITIAL_DEPTH);
+
+		if (binned)
+			Rasterizer::BeginBinning();
+		for (size_t i = 0; i < verts_.size(); i += 3) {
+			// Submit both windings, like the clipper does for rectangles.  One gets culled.
+			Rasterizer::DrawTriangle(verts_[i], verts_[i + 1], verts_[i + 2]);
+			Rasterizer::DrawTriangle(verts_[i + 2], verts_[i + 1], verts_[i]);
+		}
+		if (binned)
+			Rasterizer::EndBinning();
+	}
+
+	const std::vector<u32> &Color() const {
+		return color_;
+	}
+	const std::vector<u16> &Depth() const {
+		return depth_;
+	}
+
+	void FillTexture() {
+		u32 *texture = (u32 *)Memory::GetPointer(TEXTURE_ADDR);
+		for (int i = 0; i < TEXTURE_SIZE * TEXTURE_SIZE; ++i)
+			texture[i] = Rand() ^ (Rand() << 16);
+	}
+
+private:
+	u32 Rand() {
+		// Just needs to be deterministic.
+		seed_ = seed_ * 1103515245 + 12345;
+		return seed_ >> 8;
+	}
+
+	float RandFloat() {
+		return (Rand() & 0xFFFF) * (1.0f / 65536.0f);
+	}
+
+	u32 seed_;
+	std::vector<VertexData> verts_;
+	std::vector<u32> color_;
+	std::vector<u16> depth_;
+};
+
+static bool TestBinnedMatchesSerial(SoftRasterizerTestHarness &h, bool clearMode) {
+	h.Draw(clearMode, false);
+	std::vector<u32> serialColor = h.Color();
+	std::vector<u16> serialDepth = h.Depth();
+
+	h.Draw(clearMode, true);
+	EXPECT_TRUE(serialColor == h.Color());
+	EXPECT_TRUE(serialDepth == h.Depth());
+
+	// Make sure we actually drew something.
+	size_t drawn = 0;
+	for (u32 c : serialColor)
+		drawn += c != INITIAL_COLOR ? 1 : 0;
+	EXPECT_TRUE(drawn > serialColor.size() / 4);
+	return true;
+}
+
+static bool TestJitMatchesInterpreter(SoftRasterizerTestHarness &h, bool clearMode, int variant) {
+	g_Config.bSoftwareRenderingJit = false;
+	h.Draw(clearMode, false, variant);
+	std::vector<u32> interpColor = h.Color();
+	std::vector<u16> interpDepth = h.Depth();
+
+	g_Config.bSoftwareRenderingJit = true;
+	h.Draw(clearMode, false, variant);
+	g_Config.bSoftwareRenderingJit = false;
+
+	EXPECT_TRUE(interpColor == h.Color());
+	EXPECT_TRUE(interpDepth == h.Depth());
+	return true;
+}
+
+static bool TestSimdMatchesScalar(SoftRasterizerTestHarness &h, bool clearMode, int variant) {
+	g_Config.bSoftwareRenderingSIMD = false;
+	h.Draw(clearMode, false, variant);
+	std::vector<u32> scalarColor = h.Color();
+	std::vector<u16> scalarDepth = h.Depth();
+
+	g_Config.bSoftwareRenderingSIMD = true;
+	h.Draw(clearMode, false, variant);
+	g_Config.bSoftwareRenderingSIMD = false;
+
+	EXPECT_TRUE(scalarColor == h.Color());
+	EXPECT_TRUE(scalarDepth == h.Depth());
+	return true;
+}
+
+bool TestSoftRasterizer() {
+	GPUgstate savedState = gstate;
+	FormatBuffer savedFb = fb;
+	FormatBuffer savedDepth = depthbuf;
+	// The global pool is created on first use, so this only matters if nothing else used it yet.
+	int savedThreads = g_Config.iNumWorkerThreads;
+	if (g_Config.iNumWorkerThreads < 4)
+		g_Config.iNumWorkerThreads = 4;
+
+	// The textured variants read the texture from PSP memory.
+	Memory::g_MemorySize = Memory::RAM_NORMAL_SIZE;
+	Memory::Init();
+
+	SoftRasterizerTestHarness h;
+	// Enough triangles to force an early flush of the bins.
+	h.GenerateTriangles(6000);
+	h.FillTexture();
+
+	bool savedJit = g_Config.bSoftwareRenderingJit;
+	bool savedSimd = g_Config.bSoftwareRenderingSIMD;
+	g_Config.bSoftwareRenderingJit = false;
+	g_Config.bSoftwareRenderingSIMD = false;
+
+	bool result = TestBinnedMatchesSerial(h, false) && TestBinnedMatchesSerial(h, true);
+	for (int i = 0; i < 5 && result; ++i)
+		result = TestJitMatchesInterpreter(h, false, i);
+	for (int i = 0; i < 3 && result; ++i)
+		result = TestJitMatchesInterpreter(h, true, i);
+	for (int i = 0; i < NUM_VARIANTS && result; ++i)
+		result = TestSimdMatchesScalar(h, false, i);
+	for (int i = 0; i < 3 && result; ++i)
+		result = TestSimdMatchesScalar(h, true, i);
+
+	g_Config.bSoftwareRenderingJit = savedJit;
+	g_Config.bSoftwareRenderingSIMD = savedSimd;
+	Memory::Shutdown();
+
+	g_Config.iNumWorkerThreads = savedThreads;
+	gstate = savedState;
+	fb = savedFb;
+	depthbuf = savedDepth;
+	return result;
+}
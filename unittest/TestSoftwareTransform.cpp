@@ -0,0 +1,272 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "base/timeutil.h"
+#include "math/math_util.h"
+#include "Core/Config.h"
+#include "GPU/GPU.h"
+#include "GPU/GPUState.h"
+#include "GPU/ge_constants.h"
+#include "GPU/Common/SoftwareTransformCommon.h"
+#include "GPU/Common/VertexDecoderCommon.h"
+#include "unittest/TestSoftwareTransform.h"
+#include "unittest/UnitTest.h"
+
+// Not a multiple of four, so the one by one tail runs too.
+static const int NUM_VERTS = 1003;
+
+class SoftwareTransformTestHarness {
+public:
+	SoftwareTransformTestHarness() : seed_(0x1234) {
+	}
+
+	// Random floats for everything, and some zero weights to skip bones with.
+	void GenerateVerts(u32 vertType) {
+		vertType_ = vertType;
+
+		VertexDecoderOptions options;
+		memset(&options, 0, sizeof(options));
+		VertexDecoder dec;
+		dec.SetVertexType(vertType, options);
+
+		std::vector<u8> src(NUM_VERTS * dec.VertexSize());
+		u8 *p = &src[0];
+		const int numWeights = vertTypeGetNumBoneWeights(vertType);
+		for (int i = 0; i < NUM_VERTS; ++i) {
+			if (vertTypeIsSkinningEnabled(vertType)) {
+				for (int w = 0; w < numWeights; ++w)
+					p = Put(p, (Rand() & 3) == 0 ? 0.0f : RandFloat(0.0f, 1.0f));
+			}
+			p = Put(p, RandFloat(-2.0f, 2.0f));
+			p = Put(p, RandFloat(-2.0f, 2.0f));
+			u32 color = Rand() | (Rand() << 24);
+			memcpy(p, &color, sizeof(color));
+			p += sizeof(color);
+			for (int j = 0; j < 6; ++j)
+				p = Put(p, RandFloat(-10.0f, 10.0f));
+		}
+
+		decFmt_ = dec.GetDecVtxFmt();
+		decoded_.resize(NUM_VERTS * decFmt_.stride);
+		dec.DecodeVerts(&decoded_[0], &src[0], 0, NUM_VERTS - 1);
+	}
+
+	void RandomMatrix(float m[12], float scale) {
+		for (int i = 0; i < 9; ++i)
+			m[i] = RandFloat(-scale, scale);
+		for (int i = 9; i < 12; ++i)
+			m[i] = RandFloat(-20.0f, 20.0f);
+	}
+
+	void Transform(bool simd, std::vector<TransformedVertex> &out) {
+		g_Config.bSoftwareTransformSIMD = simd;
+
+		out.resize(NUM_VERTS);
+		u16 *inds = nullptr;
+		int maxIndex = NUM_VERTS;
+		TransformedVertex *drawBuffer = nullptr;
+		int numTrans = 0;
+		bool drawIndexed = false;
+		SoftwareTransformResult result;
+		memset(&result, 0, sizeof(result));
+		SoftwareTransform(GE_PRIM_TRIANGLES, &decoded_[0], NUM_VERTS, vertType_, inds, GE_VTYPE_IDX_NONE, decFmt_, maxIndex, nullptr, nullptr, &out[0], nullptr, drawBuffer, numTrans, drawIndexed, &result, 1.0f);
+	}
+
+	float RandFloat(float lo, float hi) {
+		return lo + (hi - lo) * (Rand() & 0xFFFF) * (1.0f / 65535.0f);
+	}
+
+private:
+	u32 Rand() {
+		// Just needs to be deterministic.
+		seed_ = seed_ * 1103515245 + 12345;
+		return seed_ >> 8;
+	}
+
+	static u8 *Put(u8 *p, float f) {
+		memcpy(p, &f, sizeof(f));
+		return p + sizeof(f);
+	}
+
+	u32 seed_;
+	u32 vertType_;
+	DecVtxFormat decFmt_;
+	std::vector<u8> decoded_;
+};
+
+static bool CloseEnough(float a, float b) {
+	if (a == b || (my_isnan(a) && my_isnan(b)))
+		return true;
+	return fabsf(a - b) <= 1e-5f * std::max(1.0f, fabsf(a));
+}
+
+static bool ColorsCloseEnough(u32 a, u32 b) {
+	for (int shift = 0; shift < 32; shift += 8) {
+		int diff = (int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF);
+		if (diff < -1 || diff > 1)
+			return false;
+	}
+	return true;
+}
+
+static void SetupLights(SoftwareTransformTestHarness &h, bool secondaryColor, int materialUpdate) {
+	static const GELightType types[4] = { GE_LIGHTTYPE_DIRECTIONAL, GE_LIGHTTYPE_POINT, GE_LIGHTTYPE_SPOT, GE_LIGHTTYPE_UNKNOWN };
+	static const GELightComputation comps[4] = { GE_LIGHTCOMP_BOTH, GE_LIGHTCOMP_BOTHWITHPOWDIFFUSE, GE_LIGHTCOMP_BOTH, GE_LIGHTCOMP_ONLYDIFFUSE };
+
+	gstate.lightingEnable = 1;
+	gstate.lmode = secondaryColor ? 1 : 0;
+	gstate.materialupdate = materialUpdate;
+	gstate.ambientcolor = 0x202020;
+	gstate.ambientalpha = 0xFF;
+	gstate.materialambient = 0x808080;
+	gstate.materialalpha = 0xC0;
+	gstate.materialdiffuse = 0xA0B0C0;
+	gstate.materialspecular = 0xFFFFFF;
+	gstate.materialemissive = 0x101010;
+	gstate.materialspecularcoef = toFloat24(8.0f);
+
+	for (int l = 0; l < 4; ++l) {
+		gstate.lightEnable[l] = 1;
+		gstate.ltype[l] = comps[l] | (types[l] << 8);
+		for (int i = 0; i < 3; ++i) {
+			gstate.lpos[l * 3 + i] = toFloat24(h.RandFloat(-30.0f, 30.0f));
+			gstate.ldir[l * 3 + i] = toFloat24(h.RandFloat(-1.0f, 1.0f));
+		}
+		gstate.latt[l * 3 + 0] = toFloat24(1.0f);
+		gstate.latt[l * 3 + 1] = toFloat24(0.05f);
+		gstate.latt[l * 3 + 2] = toFloat24(0.001f);
+		gstate.lconv[l] = toFloat24(2.0f);
+		gstate.lcutoff[l] = toFloat24(0.3f);
+		gstate.lcolor[l * 3 + 0] = 0x303030;
+		gstate.lcolor[l * 3 + 1] = 0x4080C0 + l;
+		gstate.lcolor[l * 3 + 2] = 0xFFFFFF;
+	}
+}
+
+static bool CompareTransforms(SoftwareTransformTestHarness &h, const char *name) {
+	std::vector<TransformedVertex> scalar;
+	std::vector<TransformedVertex> simd;
+	h.Transform(false, scalar);
+	h.Transform(true, simd);
+
+	int mismatches = 0;
+	int identical = 0;
+	for (int i = 0; i < NUM_VERTS; ++i) {
+		const TransformedVertex &a = scalar[i];
+		const TransformedVertex &b = simd[i];
+		bool close = ColorsCloseEnough(a.color0_32, b.color0_32) && ColorsCloseEnough(a.color1_32, b.color1_32);
+		for (int j = 0; j < 4; ++j)
+			close = close && CloseEnough(a.pos[j], b.pos[j]);
+		for (int j = 0; j < 3; ++j)
+			close = close && CloseEnough(a.uv[j], b.uv[j]);
+		if (!close) {
+			if (mismatches == 0) {
+				printf("%s: vertex %d differs: %f %f %f fog %f uv %f %f %f colors %08x %08x vs %f %f %f fog %f uv %f %f %f colors %08x %08x\n", name, i,
+					a.x, a.y, a.z, a.fog, a.u, a.v, a.w, a.color0_32, a.color1_32,
+					b.x, b.y, b.z, b.fog, b.u, b.v, b.w, b.color0_32, b.color1_32);
+			}
+			mismatches++;
+		}
+		if (memcmp(&a, &b, sizeof(a)) == 0)
+			identical++;
+	}
+
+	if (identical != NUM_VERTS)
+		printf("%s: %d of %d vertices not bit exact\n", name, NUM_VERTS - identical, NUM_VERTS);
+	EXPECT_EQ_INT(mismatches, 0);
+	return true;
+}
+
+static void Benchmark(SoftwareTransformTestHarness &h, const char *name) {
+	std::vector<TransformedVertex> out;
+	double rates[2];
+	for (int simd = 0; simd < 2; ++simd) {
+		int total = 0;
+		double st = real_time_now();
+		do {
+			for (int j = 0; j < 20; ++j) {
+				h.Transform(simd != 0, out);
+				total += NUM_VERTS;
+			}
+		} while (real_time_now() - st < 0.5);
+		rates[simd] = total / (real_time_now() - st);
+	}
+	printf("Software transform, %s: %0.2f Mverts/s (scalar: %0.2f Mverts/s)\n", name, rates[1] / 1000000.0, rates[0] / 1000000.0);
+}
+
+bool TestSoftwareTransform() {
+	GPUgstate savedState = gstate;
+	GPUStateCache savedStateCache = gstate_c;
+	bool savedSIMD = g_Config.bSoftwareTransformSIMD;
+	bool savedPrescaleUV = g_Config.bPrescaleUV;
+
+	memset(&gstate, 0, sizeof(gstate));
+	// 1x1 texture, so there's nothing to scale UVs by.
+	gstate_c.curTextureWidth = 1;
+	gstate_c.curTextureHeight = 1;
+	gstate_c.flipTexture = false;
+	gstate_c.uv.uScale = 2.0f;
+	gstate_c.uv.vScale = 0.5f;
+	gstate_c.uv.uOff = 0.25f;
+	gstate_c.uv.vOff = -0.25f;
+	g_Config.bPrescaleUV = false;
+	gstate.fog1 = toFloat24(100.0f);
+	gstate.fog2 = toFloat24(0.01f);
+
+	SoftwareTransformTestHarness h;
+	h.RandomMatrix(gstate.worldMatrix, 2.0f);
+	h.RandomMatrix(gstate.viewMatrix, 1.0f);
+	h.RandomMatrix(gstate.tgenMatrix, 1.0f);
+	for (int i = 0; i < 8; ++i)
+		h.RandomMatrix(gstate.boneMatrix + i * 12, 1.0f);
+
+	const u32 plainType = GE_VTYPE_POS_FLOAT | GE_VTYPE_NRM_FLOAT | GE_VTYPE_COL_8888 | GE_VTYPE_TC_FLOAT;
+	const u32 skinnedType = plainType | GE_VTYPE_WEIGHT_FLOAT | (3 << GE_VTYPE_WEIGHTCOUNT_SHIFT);
+
+	bool success = true;
+
+	h.GenerateVerts(plainType);
+	success = success && CompareTransforms(h, "unlit");
+
+	SetupLights(h, true, 7);
+	success = success && CompareTransforms(h, "lit");
+	if (success)
+		Benchmark(h, "four lights");
+
+	gstate.reversenormals = 1;
+	SetupLights(h, false, 0);
+	gstate.texmapmode = GE_TEXMAP_ENVIRONMENT_MAP;
+	gstate.texshade = 1 | (2 << 8);
+	success = success && CompareTransforms(h, "shade mapped");
+
+	h.GenerateVerts(skinnedType);
+	gstate.texmapmode = GE_TEXMAP_TEXTURE_MATRIX | (GE_PROJMAP_NORMALIZED_NORMAL << 8);
+	SetupLights(h, true, 2);
+	success = success && CompareTransforms(h, "skinned");
+
+	g_Config.bPrescaleUV = savedPrescaleUV;
+	g_Config.bSoftwareTransformSIMD = savedSIMD;
+	gstate_c = savedStateCache;
+	gstate = savedState;
+	return success;
+}
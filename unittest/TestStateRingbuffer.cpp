@@ -0,0 +1,107 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Common/Common.h"
+#include "Core/StateRingbuffer.h"
+#include "unittest/TestStateRingbuffer.h"
+#include "unittest/UnitTest.h"
+
+// About the size of a real state: 32MB of RAM plus the rest.
+static const size_t STATE_SIZE = 40 * 1024 * 1024;
+static const int NUM_STATES = 20;
+static const int BENCH_FRAMES = 60;
+// Scattered writes per frame, like a game touching its heap and a few buffers.
+static const int WRITES_PER_FRAME = 400;
+static const int WRITE_SIZE = 64;
+
+static std::vector<u8> liveState;
+static std::vector<u8> loadedState;
+
+static CChunkFileReader::Error CaptureLiveState(std::vector<u8> &data) {
+	if (data.size() < liveState.size())
+		data.resize(liveState.size());
+	memcpy(&data[0], &liveState[0], liveState.size());
+	return CChunkFileReader::ERROR_NONE;
+}
+
+static CChunkFileReader::Error LoadLiveState(std::vector<u8> &data) {
+	loadedState = data;
+	return CChunkFileReader::ERROR_NONE;
+}
+
+static void RunFrame(u32 &seed) {
+	for (int i = 0; i < WRITES_PER_FRAME; ++i) {
+		seed = seed * 1103515245 + 12345;
+		size_t pos = (seed >> 4) % (STATE_SIZE - WRITE_SIZE);
+		for (int j = 0; j < WRITE_SIZE; ++j) {
+			liveState[pos + j] = (u8)(seed >> (j & 7));
+		}
+	}
+}
+
+bool TestStateRingbuffer() {
+	liveState.resize(STATE_SIZE);
+	for (size_t i = 0; i < STATE_SIZE; i += 4) {
+		// Something that doesn't compress to nothing, like real RAM.
+		u32 v = (u32)(i * 2654435761U);
+		memcpy(&liveState[i], &v, 4);
+	}
+
+	SaveState::StateRingbuffer ring(NUM_STATES, &CaptureLiveState, &LoadLiveState);
+	EXPECT_TRUE(ring.Empty());
+
+	u32 seed = 0x1337;
+	std::vector<u8> previous, newest;
+	for (int frame = 0; frame < BENCH_FRAMES; ++frame) {
+		RunFrame(seed);
+		EXPECT_EQ_INT(ring.Save(), CChunkFileReader::ERROR_NONE);
+		// Let the worker catch up, otherwise it'd skip states depending on the machine.
+		ring.Flush();
+
+		if (frame == BENCH_FRAMES - 2)
+			previous = liveState;
+		else if (frame == BENCH_FRAMES - 1)
+			newest = liveState;
+	}
+
+	float captureMs;
+	int bytesPerState, numStates, totalBytes;
+	ring.GetStats(captureMs, bytesPerState, numStates, totalBytes);
+	printf("Rewind: %d MB state, %d writes/frame: capture %0.2f ms avg, %d bytes/snapshot avg, %d states in %d bytes\n",
+		(int)(STATE_SIZE / (1024 * 1024)), WRITES_PER_FRAME, captureMs, bytesPerState, numStates, totalBytes);
+	EXPECT_EQ_INT(numStates, NUM_STATES);
+	// Sparse writes should delta encode to a small fraction of the state.
+	EXPECT_TRUE(bytesPerState > 0 && (size_t)bytesPerState < STATE_SIZE / 16);
+
+	// Restores go newest first.
+	EXPECT_EQ_INT(ring.Restore(), CChunkFileReader::ERROR_NONE);
+	EXPECT_TRUE(loadedState == newest);
+	EXPECT_EQ_INT(ring.Restore(), CChunkFileReader::ERROR_NONE);
+	EXPECT_TRUE(loadedState == previous);
+
+	ring.Clear();
+	EXPECT_TRUE(ring.Empty());
+	EXPECT_FALSE(ring.Restore() == CChunkFileReader::ERROR_NONE);
+
+	std::vector<u8>().swap(liveState);
+	std::vector<u8>().swap(loadedState);
+	return true;
+}
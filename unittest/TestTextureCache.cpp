@@ -0,0 +1,112 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <cstring>
+
+#include "GPU/Common/TextureCacheCommon.h"
+#include "unittest/TestTextureCache.h"
+#include "unittest/UnitTest.h"
+
+typedef TextureCacheCommon::TexCacheEntry TexCacheEntry;
+
+static const u32 TEXTURE_BYTES = 256 * 256 * 4;
+
+static TexCacheEntry MakeEntry(u32 addr, u32 name) {
+	TexCacheEntry entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.addr = addr;
+	entry.textureName = name;
+	entry.fullhash = 0x12345678;
+	entry.dim = 0x0808;
+	entry.SetAlphaStatus(TexCacheEntry::STATUS_ALPHA_SIMPLE);
+	return entry;
+}
+
+static SharedTextureIndex::ContentKey MakeKey(const TexCacheEntry &entry, int scaleFactor) {
+	// Just needs to differ by scale factor, like the backend's keys.
+	return SharedTextureIndex::ContentKey(entry.fullhash, entry.dim | ((u64)scaleFactor << 48));
+}
+
+static bool TestSharing() {
+	SharedTextureIndex index;
+	TexCacheEntry first = MakeEntry(0x04100000, 1);
+	TexCacheEntry second = MakeEntry(0x04200000, 2);
+	const SharedTextureIndex::ContentKey key = MakeKey(first, 1);
+
+	EXPECT_TRUE(index.Acquire(key) == nullptr);
+	EXPECT_TRUE(index.Register(first, key, TEXTURE_BYTES));
+	// Uploaded at the same time, the first one stays.
+	EXPECT_FALSE(index.Register(second, key, TEXTURE_BYTES));
+	EXPECT_TRUE(index.Release(second.textureName));
+
+	const SharedTextureIndex::SharedTexture *shared = index.Acquire(key);
+	EXPECT_TRUE(shared != nullptr);
+	EXPECT_EQ_INT(shared->name, first.textureName);
+	EXPECT_EQ_INT(shared->refs, 2);
+	EXPECT_EQ_INT((int)shared->alphaStatus, (int)TexCacheEntry::STATUS_ALPHA_SIMPLE);
+	EXPECT_EQ_INT(index.BytesSaved(), TEXTURE_BYTES);
+
+	// Not deleted until both are done with it.
+	EXPECT_FALSE(index.Release(first.textureName));
+	EXPECT_EQ_INT(index.BytesSaved(), 0);
+	EXPECT_TRUE(index.Contains(first.textureName));
+	EXPECT_TRUE(index.Release(first.textureName));
+	EXPECT_FALSE(index.Contains(first.textureName));
+	EXPECT_TRUE(index.Acquire(key) == nullptr);
+	return true;
+}
+
+// With scaleFactor > 1 and the scaler running in the background, the first upload is unscaled.
+static bool TestSharingWhileScaling() {
+	SharedTextureIndex index;
+	TexCacheEntry first = MakeEntry(0x04100000, 1);
+	TexCacheEntry second = MakeEntry(0x04200000, 2);
+	const SharedTextureIndex::ContentKey key = MakeKey(first, 2);
+
+	// Nothing to share until the scaled version is uploaded.
+	first.status |= TexCacheEntry::STATUS_TO_SCALE;
+	EXPECT_FALSE(index.Register(first, key, TEXTURE_BYTES));
+	EXPECT_TRUE(index.Acquire(key) == nullptr);
+
+	// So the other entry uploads its own, and waits for the scaler too.
+	second.status |= TexCacheEntry::STATUS_TO_SCALE;
+	EXPECT_FALSE(index.Register(second, key, TEXTURE_BYTES));
+
+	// The first reloads once scaled, its unscaled texture just goes.
+	EXPECT_TRUE(index.Release(first.textureName));
+	first.textureName = 3;
+	first.status &= ~TexCacheEntry::STATUS_TO_SCALE;
+	EXPECT_TRUE(index.Register(first, key, TEXTURE_BYTES * 4));
+
+	// And the second can use it when it reloads.
+	EXPECT_TRUE(index.Release(second.textureName));
+	const SharedTextureIndex::SharedTexture *shared = index.Acquire(key);
+	EXPECT_TRUE(shared != nullptr);
+	EXPECT_EQ_INT(shared->name, first.textureName);
+	EXPECT_EQ_INT(shared->refs, 2);
+
+	// Unscaled uploads don't match the scaled key.
+	EXPECT_TRUE(index.Acquire(MakeKey(first, 1)) == nullptr);
+	return true;
+}
+
+bool TestTextureCache() {
+	RET(TestSharing());
+	RET(TestSharingWhileScaling());
+	return true;
+}
@@ -0,0 +1,136 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <vector>
+
+#include "base/timeutil.h"
+#include "Common/ColorConv.h"
+#include "Common/CPUDetect.h"
+#include "Common/MemoryUtil.h"
+#include "GPU/Common/TextureDecoder.h"
+#include "unittest/TestTextureDecoder.h"
+#include "unittest/UnitTest.h"
+
+// Odd sizes on purpose, so the vector loops leave tails of all sizes.
+static const int testLengths[] = { 2, 14, 16, 30, 32, 34, 48, 62, 64, 96, 1000, 4096 + 18 };
+static const int BENCH_PIXELS = 512 * 512;
+static const int BENCH_PASSES = 20;
+
+static u32 seed = 0x1234;
+static u32 Rand() {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+template <typename T>
+static void FillRandom(T *p, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		p[i] = (T)(Rand() ^ (Rand() << 16));
+	}
+}
+
+template <typename ClutT, typename Func>
+static bool TestDeIndex(const char *name, Func func, Func basic, const u8 *indexed, const ClutT *clut, int shift) {
+	for (size_t l = 0; l < ARRAYSIZE(testLengths); ++l) {
+		const int length = testLengths[l];
+		// Either one could write past the end, if it went wrong.
+		std::vector<ClutT> expected(length + 32, 0xCC), actual(length + 32, 0xCC);
+		basic(&expected[0], indexed + shift, length, clut);
+		func(&actual[0], indexed + shift, length, clut);
+		if (expected != actual) {
+			printf("%s: mismatch at length %d\n", name, length);
+			return false;
+		}
+	}
+	return true;
+}
+
+template <typename Func>
+static bool TestConvert(const char *name, Func func, u32 (*reference)(u16), const u16 *src) {
+	for (size_t l = 0; l < ARRAYSIZE(testLengths); ++l) {
+		const int length = testLengths[l];
+		// Aligned and not, since SSE2 only handles the former.
+		for (int offset = 0; offset < 2; ++offset) {
+			std::vector<u32> dst(length + offset + 8, 0xCCCCCCCC);
+			func(&dst[offset], src + offset, length);
+			for (int i = 0; i < length; ++i) {
+				if (dst[offset + i] != reference(src[offset + i])) {
+					printf("%s: mismatch at pixel %d of %d (offset %d): %08x, expected %08x\n", name, i, length, offset, dst[offset + i], reference(src[offset + i]));
+					return false;
+				}
+			}
+			EXPECT_EQ_INT(dst[offset + length], 0xCCCCCCCC);
+		}
+	}
+	return true;
+}
+
+template <typename ClutT, typename Func>
+static void BenchDeIndex(const char *name, Func func, Func basic, const u8 *indexed, const ClutT *clut) {
+	std::vector<ClutT> dest(BENCH_PIXELS);
+	double st = real_time_now();
+	for (int i = 0; i < BENCH_PASSES; ++i) {
+		func(&dest[0], indexed, BENCH_PIXELS, clut);
+	}
+	double funcTime = real_time_now() - st;
+
+	st = real_time_now();
+	for (int i = 0; i < BENCH_PASSES; ++i) {
+		basic(&dest[0], indexed, BENCH_PIXELS, clut);
+	}
+	double basicTime = real_time_now() - st;
+
+	const double scale = 1e9 / ((double)BENCH_PIXELS * BENCH_PASSES);
+	printf("%s: %0.2f ns per pixel (basic: %0.2f ns)\n", name, funcTime * scale, basicTime * scale);
+}
+
+bool TestTextureDecoder() {
+	SetupTextureDecoder();
+	printf("Using AVX2: %s\n", cpu_info.bAVX2 ? "yes" : "no");
+
+	// Like the clut buffers in the texture caches, there's plenty of room after the entries.
+	u32 *clut32 = (u32 *)AllocateAlignedMemory(1024 * sizeof(u32), 16);
+	u16 *clut16 = (u16 *)clut32;
+	FillRandom(clut32, 1024);
+
+	std::vector<u8> indexed(BENCH_PIXELS);
+	FillRandom(&indexed[0], indexed.size());
+	std::vector<u16> colors(BENCH_PIXELS);
+	FillRandom(&colors[0], colors.size());
+
+	bool success = true;
+	for (int shift = 0; shift < 2 && success; ++shift) {
+		success = success && TestDeIndex("CLUT4 to 16-bit", DoDeIndexTexture4To16, &DeIndexTexture4To16Basic, &indexed[0], clut16, shift);
+		success = success && TestDeIndex("CLUT4 to 32-bit", DoDeIndexTexture4To32, &DeIndexTexture4To32Basic, &indexed[0], clut32, shift);
+		success = success && TestDeIndex("CLUT8 to 16-bit", DoDeIndexTexture8To16, &DeIndexTexture8To16Basic, &indexed[0], clut16, shift);
+		success = success && TestDeIndex("CLUT8 to 32-bit", DoDeIndexTexture8To32, &DeIndexTexture8To32Basic, &indexed[0], clut32, shift);
+	}
+	success = success && TestConvert("565 to 8888", &ConvertRGBA565ToRGBA8888, &RGB565ToRGBA8888, &colors[0]);
+	success = success && TestConvert("5551 to 8888", &ConvertRGBA5551ToRGBA8888, &RGBA5551ToRGBA8888, &colors[0]);
+	success = success && TestConvert("4444 to 8888", &ConvertRGBA4444ToRGBA8888, &RGBA4444ToRGBA8888, &colors[0]);
+
+	if (success) {
+		BenchDeIndex("CLUT4 to 16-bit", DoDeIndexTexture4To16, &DeIndexTexture4To16Basic, &indexed[0], clut16);
+		BenchDeIndex("CLUT4 to 32-bit", DoDeIndexTexture4To32, &DeIndexTexture4To32Basic, &indexed[0], clut32);
+		BenchDeIndex("CLUT8 to 16-bit", DoDeIndexTexture8To16, &DeIndexTexture8To16Basic, &indexed[0], clut16);
+		BenchDeIndex("CLUT8 to 32-bit", DoDeIndexTexture8To32, &DeIndexTexture8To32Basic, &indexed[0], clut32);
+	}
+
+	FreeAlignedMemory(clut32);
+	return success;
+}
@@ -0,0 +1,158 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <vector>
+
+#include "base/mutex.h"
+#include "base/timeutil.h"
+#include "thread/threadpool.h"
+#include "Common/Common.h"
+#include "ext/xbrz/xbrz.h"
+#include "unittest/TestThreadPool.h"
+#include "unittest/UnitTest.h"
+
+static const int BENCH_SIZE = 256;
+static const int BENCH_FACTOR = 4;
+static const int BENCH_RUNS = 10;
+
+static void CountLoop(std::vector<int> *hits, int offset, int lower, int upper) {
+	for (int i = lower; i < upper; ++i) {
+		(*hits)[offset + i]++;
+	}
+}
+
+static void NestedLoop(ThreadPool *pool, std::vector<int> *hits, int inner, int lower, int upper) {
+	for (int i = lower; i < upper; ++i) {
+		pool->ParallelLoop(std::bind(&CountLoop, hits, i * inner, placeholder::_1, placeholder::_2), 0, inner);
+	}
+}
+
+static void CountTask(recursive_mutex *mutex, int *count) {
+	lock_guard guard(*mutex);
+	(*count)++;
+}
+
+static void SpawningTask(ThreadPool *pool, recursive_mutex *mutex, int *count) {
+	std::shared_ptr<ThreadPoolTask> child = pool->Submit(std::bind(&CountTask, mutex, count));
+	child->Wait();
+	CountTask(mutex, count);
+}
+
+static bool TestLoops(ThreadPool &pool) {
+	std::vector<int> hits(10000, 0);
+	for (int i = 0; i < 10; ++i) {
+		pool.ParallelLoop(std::bind(&CountLoop, &hits, 0, placeholder::_1, placeholder::_2), 0, (int)hits.size());
+	}
+	for (size_t i = 0; i < hits.size(); ++i) {
+		EXPECT_EQ_INT(hits[i], 10);
+	}
+
+	// Loops inside loops, each covering its own part of hits.
+	const int inner = 100;
+	std::vector<int> nested(100 * inner, 0);
+	pool.ParallelLoop(std::bind(&NestedLoop, &pool, &nested, inner, placeholder::_1, placeholder::_2), 0, 100);
+	for (size_t i = 0; i < nested.size(); ++i) {
+		EXPECT_EQ_INT(nested[i], 1);
+	}
+	return true;
+}
+
+static bool TestTasks(ThreadPool &pool) {
+	recursive_mutex mutex;
+	int count = 0;
+	std::vector<std::shared_ptr<ThreadPoolTask>> tasks;
+	for (int i = 0; i < 500; ++i) {
+		tasks.push_back(pool.Submit(std::bind(&SpawningTask, &pool, &mutex, &count)));
+	}
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		tasks[i]->Wait();
+		EXPECT_TRUE(tasks[i]->IsDone());
+	}
+	EXPECT_EQ_INT(count, 1000);
+	return true;
+}
+
+// How ThreadPool used to split loops: one equal slice per thread, the last one on the caller.
+static void FixedSliceLoop(ThreadPool &pool, const std::function<void(int, int)> &loop, int lower, int upper) {
+	int threads = pool.NumThreads();
+	int chunk = (upper - lower) / threads;
+	std::vector<std::shared_ptr<ThreadPoolTask>> tasks;
+	int s = lower;
+	for (int i = 0; i < threads - 1; ++i) {
+		tasks.push_back(pool.Submit(std::bind(loop, s, s + chunk)));
+		s += chunk;
+	}
+	loop(s, upper);
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		tasks[i]->Wait();
+	}
+}
+
+// Flat at the top, noisy at the bottom: xBRZ takes shortcuts on flat areas, so the rows differ a lot in cost.
+static void GenerateUnevenTexture(std::vector<u32> &tex) {
+	tex.resize(BENCH_SIZE * BENCH_SIZE);
+	u32 seed = 0x12345678;
+	for (int y = 0; y < BENCH_SIZE; ++y) {
+		for (int x = 0; x < BENCH_SIZE; ++x) {
+			seed = seed * 1103515245 + 12345;
+			u32 noise = (seed >> 8) & 0x00F0F0F0;
+			tex[y * BENCH_SIZE + x] = y < BENCH_SIZE * 3 / 4 ? 0xFF336699 : (0xFF000000 | noise);
+		}
+	}
+}
+
+static bool TestScalerBenchmark(ThreadPool &pool) {
+	std::vector<u32> tex;
+	GenerateUnevenTexture(tex);
+	std::vector<u32> fixedOut(tex.size() * BENCH_FACTOR * BENCH_FACTOR);
+	std::vector<u32> stealingOut(fixedOut.size());
+
+	xbrz::ScalerCfg cfg;
+	xbrz::init();
+	std::function<void(int, int)> fixedLoop = std::bind(&xbrz::scale, BENCH_FACTOR, &tex[0], &fixedOut[0], BENCH_SIZE, BENCH_SIZE, xbrz::ColorFormat::ARGB, cfg, placeholder::_1, placeholder::_2);
+	std::function<void(int, int)> stealingLoop = std::bind(&xbrz::scale, BENCH_FACTOR, &tex[0], &stealingOut[0], BENCH_SIZE, BENCH_SIZE, xbrz::ColorFormat::ARGB, cfg, placeholder::_1, placeholder::_2);
+
+	double fixedTime = 0.0;
+	double stealingTime = 0.0;
+	for (int i = 0; i < BENCH_RUNS; ++i) {
+		double start = real_time_now();
+		FixedSliceLoop(pool, fixedLoop, 0, BENCH_SIZE);
+		double middle = real_time_now();
+		pool.ParallelLoop(stealingLoop, 0, BENCH_SIZE);
+		double end = real_time_now();
+		fixedTime += middle - start;
+		stealingTime += end - middle;
+	}
+
+	printf("xBRZ %dx of %dx%d on %d threads: fixed slices %0.2f ms, work stealing %0.2f ms\n", BENCH_FACTOR, BENCH_SIZE, BENCH_SIZE, pool.NumThreads(), fixedTime * 1000.0 / BENCH_RUNS, stealingTime * 1000.0 / BENCH_RUNS);
+	EXPECT_TRUE(fixedOut == stealingOut);
+	return true;
+}
+
+bool TestThreadPool() {
+	ThreadPool pool(4);
+	RET(TestLoops(pool));
+	RET(TestTasks(pool));
+	RET(TestScalerBenchmark(pool));
+
+	// A single thread still has to run submitted tasks.
+	ThreadPool single(1);
+	RET(TestLoops(single));
+	RET(TestTasks(single));
+	return true;
+}
@@ -0,0 +1,226 @@
+// Copyright (c) 2015- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include "base/timeutil.h"
+#include "Common/ChunkFile.h"
+#include "Core/HLE/ThreadQueueList.h"
+#include "unittest/TestThreadQueueList.h"
+#include "unittest/UnitTest.h"
+
+static const int NUM_OPS = 20000;
+static const int NUM_THREADS = 200;
+static const int BENCH_BLOCKED = 64;
+static const u32 BENCH_BLOCKED_PRIO = 16;
+static const u32 BENCH_PAIR_PRIO = 100;
+static const int BENCH_SWITCHES = 1000000;
+
+// The obvious version: a deque per priority, scanned from the top.
+struct ReferenceQueue {
+	std::deque<SceUID> queues[ThreadQueueList::NUM_QUEUES];
+
+	SceUID pop_first_better(u32 priority) {
+		for (u32 i = 0; i < priority; ++i) {
+			if (!queues[i].empty()) {
+				SceUID id = queues[i].front();
+				queues[i].pop_front();
+				return id;
+			}
+		}
+		return 0;
+	}
+
+	SceUID pop_first() {
+		return pop_first_better(ThreadQueueList::NUM_QUEUES);
+	}
+
+	void remove(u32 priority, SceUID id) {
+		std::deque<SceUID> &q = queues[priority];
+		auto it = std::find(q.begin(), q.end(), id);
+		if (it != q.end())
+			q.erase(it);
+	}
+
+	void rotate(u32 priority) {
+		std::deque<SceUID> &q = queues[priority];
+		if (q.size() > 1) {
+			q.push_back(q.front());
+			q.pop_front();
+		}
+	}
+};
+
+static bool TestAgainstReference() {
+	ThreadQueueList list;
+	ReferenceQueue reference;
+	// Where each thread is queued, or -1.
+	std::vector<int> queuedAt(NUM_THREADS + 1, -1);
+
+	u32 seed = 0x1234;
+	auto rand = [&]() {
+		seed = seed * 1103515245 + 12345;
+		return seed >> 8;
+	};
+	auto dequeued = [&](SceUID id) {
+		if (id != 0)
+			queuedAt[id] = -1;
+	};
+
+	for (int i = 0; i < NUM_OPS; ++i) {
+		SceUID id = 1 + rand() % NUM_THREADS;
+		// Cluster priorities like games do, but cross the word boundaries of the bitmap.
+		u32 prio = (rand() & 1) ? 16 + rand() % 24 : rand() % ThreadQueueList::NUM_QUEUES;
+
+		switch (rand() % 6) {
+		case 0:
+		case 1:
+			if (queuedAt[id] == -1) {
+				list.prepare(prio);
+				list.push_back(prio, id);
+				reference.queues[prio].push_back(id);
+				queuedAt[id] = prio;
+			}
+			break;
+		case 2:
+			if (queuedAt[id] == -1) {
+				list.prepare(prio);
+				list.push_front(prio, id);
+				reference.queues[prio].push_front(id);
+				queuedAt[id] = prio;
+			}
+			break;
+		case 3:
+			if (queuedAt[id] != -1) {
+				list.remove(queuedAt[id], id);
+				reference.remove(queuedAt[id], id);
+				queuedAt[id] = -1;
+			}
+			break;
+		case 4:
+			if (queuedAt[id] != -1) {
+				list.rotate(queuedAt[id]);
+				reference.rotate(queuedAt[id]);
+			}
+			break;
+		case 5:
+			{
+				SceUID expected = reference.pop_first_better(prio);
+				SceUID actual = list.pop_first_better(prio);
+				EXPECT_EQ_INT(actual, expected);
+				dequeued(actual);
+			}
+			break;
+		}
+
+		if ((i % 1000) == 0) {
+			for (u32 p = 0; p < ThreadQueueList::NUM_QUEUES; ++p) {
+				EXPECT_EQ_INT(list.empty(p), reference.queues[p].empty());
+			}
+		}
+	}
+
+	// Drain in order.
+	SceUID expected;
+	while ((expected = reference.pop_first()) != 0) {
+		SceUID actual = list.pop_first();
+		EXPECT_EQ_INT(actual, expected);
+	}
+	EXPECT_EQ_INT(list.pop_first_better(ThreadQueueList::NUM_QUEUES), 0);
+	return true;
+}
+
+static bool TestSaveState() {
+	ThreadQueueList list;
+	for (int i = 0; i < 40; ++i) {
+		u32 prio = (i * 37) % ThreadQueueList::NUM_QUEUES;
+		list.prepare(prio);
+		list.push_back(prio, i + 1);
+	}
+
+	std::vector<u8> buffer(CChunkFileReader::MeasurePtr(list));
+	EXPECT_TRUE(CChunkFileReader::SavePtr(&buffer[0], list) == CChunkFileReader::ERROR_NONE);
+
+	std::vector<SceUID> expected;
+	SceUID id;
+	while ((id = list.pop_first_better(ThreadQueueList::NUM_QUEUES)) != 0)
+		expected.push_back(id);
+	EXPECT_EQ_INT((int)expected.size(), 40);
+
+	// Loading has to bring back which levels are ready, not just their contents.
+	ThreadQueueList loaded;
+	EXPECT_TRUE(CChunkFileReader::LoadPtr(&buffer[0], loaded) == CChunkFileReader::ERROR_NONE);
+	for (size_t i = 0; i < expected.size(); ++i) {
+		EXPECT_EQ_INT(loaded.pop_first_better(ThreadQueueList::NUM_QUEUES), expected[i]);
+	}
+	EXPECT_EQ_INT(loaded.pop_first_better(ThreadQueueList::NUM_QUEUES), 0);
+	return true;
+}
+
+// Two threads handing a semaphore back and forth: whoever runs signals the other (making
+// it ready), then waits on the semaphore itself, and the best ready thread runs next.
+template <typename Q>
+static double PingPong(Q &q, SceUID current) {
+	double st = real_time_now();
+	for (int i = 0; i < BENCH_SWITCHES; ++i) {
+		SceUID partner = current == 2 ? 3 : 2;
+		q.push_back(BENCH_PAIR_PRIO, partner);
+		current = q.pop_first();
+	}
+	return real_time_now() - st;
+}
+
+struct ReferenceAdapter {
+	ReferenceQueue &ref;
+	void push_back(u32 priority, SceUID id) {
+		ref.queues[priority].push_back(id);
+	}
+	SceUID pop_first() {
+		return ref.pop_first();
+	}
+};
+
+static void Benchmark() {
+	ThreadQueueList list;
+	ReferenceQueue reference;
+	// Lots of higher priority threads, all blocked on vblank, io, etc. at the moment.
+	for (int i = 0; i < BENCH_BLOCKED; ++i)
+		list.prepare(BENCH_BLOCKED_PRIO + i);
+	list.prepare(BENCH_PAIR_PRIO);
+	// Thread 1 idles at the lowest priority, thread 2 runs and thread 3 waits on it.
+	list.prepare(127);
+	list.push_back(127, 1);
+	reference.queues[127].push_back(1);
+
+	double bitmapTime = PingPong(list, 2);
+	ReferenceAdapter adapter = { reference };
+	double scanTime = PingPong(adapter, 2);
+
+	printf("Semaphore ping-pong under %d blocked threads: %0.1f ns per switch (scanning deques: %0.1f ns)\n", BENCH_BLOCKED, bitmapTime * 1e9 / BENCH_SWITCHES, scanTime * 1e9 / BENCH_SWITCHES);
+}
+
+bool TestThreadQueueList() {
+	bool success = TestAgainstReference();
+	success = success && TestSaveState();
+	if (success)
+		Benchmark();
+	return success;
+}
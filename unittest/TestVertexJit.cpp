@@ -15,9 +15,13 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <cstring>
+#include <vector>
+
 #include "base/timeutil.h"
 #include "Common/Common.h"
 #include "Core/Config.h"
+#include "GPU/Common/DrawEngineCommon.h"
 #include "GPU/Common/VertexDecoderCommon.h"
 #include "GPU/ge_constants.h"
 #include "GPU/GPUState.h"
@@ -77,14 +81,25 @@ class VertexDecoderTestHarness {
 		dec_->DecodeVerts(dst_, src_, indexLowerBound_, indexUpperBound);
 	}
 
-	double ExecuteTimed(int vtype, int indexUpperBound, bool useJit) {
+	// Decodes like the draw engines do, on several threads if it's big enough.
+	void ExecuteParallel(int vtype, int indexUpperBound) {
+		SetupExecute(vtype, true);
+
+		DrawEngineCommon::DecodeVertsRange(dec_, dst_, src_, indexLowerBound_, indexUpperBound);
+	}
+
+	double ExecuteTimed(int vtype, int indexUpperBound, bool useJit, bool parallel = false) {
 		SetupExecute(vtype, useJit);
 
 		int total = 0;
 		double st = real_time_now();
 		do {
 			for (int j = 0; j < ROUNDS; ++j) {
-				dec_->DecodeVerts(dst_, src_, indexLowerBound_, indexUpperBound);
+				if (parallel) {
+					DrawEngineCommon::DecodeVertsRange(dec_, dst_, src_, indexLowerBound_, indexUpperBound);
+				} else {
+					dec_->DecodeVerts(dst_, src_, indexLowerBound_, indexUpperBound);
+				}
 				++total;
 			}
 		} while (real_time_now() - st < 0.5);
@@ -93,6 +108,16 @@ class VertexDecoderTestHarness {
 		return total / elapsed;
 	}
 
+	void FillRandom(int bytes, u32 seed) {
+		if (needsReset_) {
+			Reset();
+		}
+		for (int i = 0; i < bytes; ++i) {
+			seed = seed * 1103515245 + 12345;
+			src_[srcPos_++] = (u8)(seed >> 16);
+		}
+	}
+
 	void Add8(u8 x) {
 		if (needsReset_) {
 			Reset();
@@ -629,6 +654,75 @@ static bool TestVertexFloatSkin() {
 
 // TODO: Morph (col, pos, nrm), weights (no skin), morph + weights?
 
+static const int BATCH_VERTS = 32768;
+
+struct BatchFormat {
+	const char *name;
+	int vtype;
+};
+
+static const BatchFormat batchFormats[] = {
+	{ "s8 pos/nrm/tc", GE_VTYPE_POS_8BIT | GE_VTYPE_NRM_8BIT | GE_VTYPE_TC_8BIT },
+	{ "s16 pos/nrm/tc, 565", GE_VTYPE_POS_16BIT | GE_VTYPE_NRM_16BIT | GE_VTYPE_TC_16BIT | GE_VTYPE_COL_565 },
+	{ "float pos/nrm/tc, 8888", GE_VTYPE_POS_FLOAT | GE_VTYPE_NRM_FLOAT | GE_VTYPE_TC_FLOAT | GE_VTYPE_COL_8888 },
+	{ "s16 skinned x4", GE_VTYPE_POS_16BIT | GE_VTYPE_NRM_16BIT | GE_VTYPE_WEIGHT_16BIT | (3 << GE_VTYPE_WEIGHTCOUNT_SHIFT) },
+	{ "float morphed x2", GE_VTYPE_POS_FLOAT | GE_VTYPE_NRM_FLOAT | (1 << GE_VTYPE_MORPHCOUNT_SHIFT) },
+};
+
+static void SetupBatchState() {
+	g_Config.bSoftwareSkinning = true;
+	for (int i = 0; i < 8 * 12; ++i) {
+		gstate.boneMatrix[i] = (float)(i % 5) * 0.25f;
+	}
+	gstate_c.morphWeights[0] = 0.25f;
+	gstate_c.morphWeights[1] = 0.75f;
+}
+
+// Large batches get split across threads, which has to give the exact same output.
+static bool TestVertexParallel() {
+	SetupBatchState();
+
+	bool failed = false;
+	for (size_t i = 0; i < ARRAY_SIZE(batchFormats); ++i) {
+		VertexDecoderTestHarness dec;
+		VertexDecoder sizer;
+		sizer.SetVertexType(batchFormats[i].vtype, VertexDecoderOptions());
+		// Offset the start, so slices don't line up with the buffer.
+		dec.FillRandom((BATCH_VERTS + 7) * sizer.VertexSize(), 0x1234 + (u32)i);
+		dec.SetIndexLowerBound(7);
+
+		dec.Execute(batchFormats[i].vtype, BATCH_VERTS + 6, true);
+		const size_t bytes = BATCH_VERTS * dec.GetDstStride();
+		std::vector<u8> serial((u8 *)dec.GetData(), (u8 *)dec.GetData() + bytes);
+		memset(dec.GetData(), 0xCC, bytes);
+
+		dec.ExecuteParallel(batchFormats[i].vtype, BATCH_VERTS + 6);
+		if (memcmp(&serial[0], dec.GetData(), bytes) != 0) {
+			printf("TestVertexParallel: %s differs from serial decoding\n", batchFormats[i].name);
+			failed = true;
+		}
+	}
+
+	return !failed;
+}
+
+static void BenchmarkBatches() {
+	SetupBatchState();
+
+	for (size_t i = 0; i < ARRAY_SIZE(batchFormats); ++i) {
+		VertexDecoderTestHarness dec;
+		VertexDecoder sizer;
+		sizer.SetVertexType(batchFormats[i].vtype, VertexDecoderOptions());
+		dec.FillRandom(BATCH_VERTS * sizer.VertexSize(), 0x5678);
+
+		const double perDecode = BATCH_VERTS / 1000000.0;
+		double jit = dec.ExecuteTimed(batchFormats[i].vtype, BATCH_VERTS - 1, true) * perDecode;
+		double parallel = dec.ExecuteTimed(batchFormats[i].vtype, BATCH_VERTS - 1, true, true) * perDecode;
+		printf("%s: %0.1f Mverts/s threaded, %0.1f Mverts/s jit\n", batchFormats[i].name, parallel, jit);
+	}
+	printf("\n");
+}
+
 typedef bool (*VertexTestFunc)();
 
 static VertexTestFunc vertdecTestFuncs[] = {
@@ -648,6 +742,8 @@ static VertexTestFunc vertdecTestFuncs[] = {
 	&TestVertex8Skin,
 	&TestVertex16Skin,
 	&TestVertexFloatSkin,
+
+	&TestVertexParallel,
 };
 
 bool TestVertexJit() {
@@ -673,6 +769,12 @@ bool TestVertexJit() {
 	printf("Result: %f, %f, %f\n", x, y, z);
 	printf("Jit was %fx faster than steps.\n\n", yesJit / noJit);
 
+	// The global pool is created on first use, so this only matters if nothing else used it yet.
+	int savedThreads = g_Config.iNumWorkerThreads;
+	if (g_Config.iNumWorkerThreads < 4)
+		g_Config.iNumWorkerThreads = 4;
+	BenchmarkBatches();
+
 	bool pass = true;
 	for (size_t i = 0; i < ARRAY_SIZE(vertdecTestFuncs); ++i) {
 		if (!vertdecTestFuncs[i]()) {
@@ -680,5 +782,6 @@ bool TestVertexJit() {
 		}
 	}
 
+	g_Config.iNumWorkerThreads = savedThreads;
 	return pass;
 }
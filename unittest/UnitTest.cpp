@@ -44,6 +44,18 @@
 
 #include "unittest/JitHarness.h"
 #include "unittest/TestVertexJit.h"
+#include "unittest/TestSoftRasterizer.h"
+#include "unittest/TestThreadPool.h"
+#include "unittest/TestCoreTiming.h"
+#include "unittest/TestThreadQueueList.h"
+#include "unittest/TestHLE.h"
+#include "unittest/TestTextureDecoder.h"
+#include "unittest/TestTextureCache.h"
+#include "unittest/TestSoftwareTransform.h"
+#include "unittest/TestFileLoader.h"
+#include "unittest/TestISOFileSystem.h"
+#include "unittest/TestDirectoryFileSystem.h"
+#include "unittest/TestStateRingbuffer.h"
 #include "unittest/UnitTest.h"
 
 std::string System_GetProperty(SystemProperty prop) { return ""; }
@@ -419,12 +431,27 @@ TestItem availableTests[] = {
 	TEST_ITEM(X64Emitter),
 #endif
 	TEST_ITEM(VertexJit),
+	TEST_ITEM(SoftRasterizer),
+	TEST_ITEM(ThreadPool),
+	TEST_ITEM(CoreTiming),
+	TEST_ITEM(ThreadQueueList),
+	TEST_ITEM(HLE),
+	TEST_ITEM(TextureDecoder),
+	TEST_ITEM(TextureCache),
+	TEST_ITEM(SoftwareTransform),
+	TEST_ITEM(FileLoader),
+	TEST_ITEM(ISOFileSystem),
+	TEST_ITEM(DirectoryFileSystem),
+	TEST_ITEM(StateRingbuffer),
 	TEST_ITEM(Asin),
 	TEST_ITEM(SinCos),
 	TEST_ITEM(VFPUSinCos),
 	TEST_ITEM(MathUtil),
 	TEST_ITEM(Parsers),
 	TEST_ITEM(Jit),
+	TEST_ITEM(JitBlockInvalidation),
+	TEST_ITEM(JitTierUp),
+	TEST_ITEM(Interpreter),
 	TEST_ITEM(MatrixTranspose),
 	TEST_ITEM(ParseLBN),
 };